@@ -0,0 +1,223 @@
+#include "bench.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#include <direct.h>
+#include <process.h>
+#define getcwd _getcwd
+#define chdir _chdir
+#define rmdir _rmdir
+#else
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+static const Bench benches[] = {
+    {"filetree", bench_filetree},
+    {"strarena", bench_strarena},
+    {"indexer", bench_indexer},
+    {"watch", bench_watch},
+    {"ignore", bench_ignore},
+    {"snapshot", bench_snapshot},
+    {"document", bench_document},
+    {"largefile", bench_largefile},
+    {"highlight", bench_highlight},
+    {"search", bench_search},
+    {"find", bench_find},
+    {"quickopen", bench_quickopen},
+    {"utf8", bench_utf8},
+    {"console", bench_console},
+    {"terminal", bench_terminal},
+    {"scrollback", bench_scrollback},
+    {"font", bench_font},
+    {"ui", bench_ui},
+    {"render", bench_render},
+    {"trace", bench_trace},
+    {"memory", bench_memory},
+    {"startup", bench_startup},
+};
+
+#define NUM_BENCHES (sizeof benches / sizeof benches[0])
+
+// Results go out as one JSON object a line rather than as text, for scripts comparing runs
+static bool json_output;
+
+char *bench_make_temp_dir(void)
+{
+    char *path = malloc(FILENAME_LEN);
+
+#ifdef _WIN32
+    const char *tmp = getenv("TEMP");
+    static int counter;
+
+    do
+        snprintf(path, FILENAME_LEN, "%s\\theeditor-bench-%d-%d", tmp ? tmp : ".", _getpid(), counter++);
+    while (!bench_make_dir(path));
+#else
+    snprintf(path, FILENAME_LEN, "/tmp/theeditor-bench-XXXXXX");
+    if (!mkdtemp(path))
+    {
+        free(path);
+        return NULL;
+    }
+#endif
+
+    return path;
+}
+
+typedef struct {
+    const char *parent;
+} RemoveState;
+
+static bool remove_entry(void *user, const char *name, size_t len_name, FileTreeItemFlags type)
+{
+    RemoveState *state = user;
+    char path[2 * FILENAME_LEN];
+
+    snprintf(path, sizeof path, "%s%c%.*s", state->parent, PATH_SEPARATOR, (int)len_name, name);
+
+    if (type & FTI_DIRECTORY)
+        bench_remove_tree(path);
+    else
+        remove(path);
+
+    return true;
+}
+
+void bench_remove_tree(const char *path)
+{
+    RemoveState state = {.parent = path};
+
+    platform_list_directory(path, remove_entry, &state);
+    rmdir(path);
+}
+
+bool bench_make_dir(const char *path)
+{
+#ifdef _WIN32
+    return _mkdir(path) == 0;
+#else
+    return mkdir(path, 0755) == 0;
+#endif
+}
+
+bool bench_make_file(const char *path, size_t size)
+{
+    FILE *f = fopen(path, "wb");
+    if (!f)
+        return false;
+
+    char block[4096];
+    memset(block, 'x', sizeof block);
+
+    while (size)
+    {
+        size_t n = size < sizeof block ? size : sizeof block;
+        fwrite(block, 1, n, f);
+        size -= n;
+    }
+
+    fclose(f);
+    return true;
+}
+
+void bench_sleep_ms(int ms)
+{
+#ifdef _WIN32
+    Sleep((DWORD)ms);
+#else
+    usleep((useconds_t)ms * 1000);
+#endif
+}
+
+bool bench_change_dir(const char *path)
+{
+    return chdir(path) == 0;
+}
+
+char *bench_current_dir(void)
+{
+    char *path = malloc(4096);
+    if (!getcwd(path, 4096))
+        path[0] = '\0';
+    return path;
+}
+
+void bench_report(const char *bench, const char *name, double value, const char *unit)
+{
+    if (json_output)
+        printf("{\"bench\": \"%s\", \"case\": \"%s\", \"value\": %.3f, \"unit\": \"%s\"}\n", bench, name, value, unit);
+    else
+        printf("%s.%s %.3f %s\n", bench, name, value, unit);
+    fflush(stdout);
+}
+
+void bench_sample(void (*run)(void *user), void *user, size_t nwarmup, uint64_t *samples, size_t nsamples)
+{
+    for (size_t i = 0; i < nwarmup; i++)
+        run(user);
+
+    for (size_t i = 0; i < nsamples; i++)
+    {
+        uint64_t start = platform_time_ns();
+        run(user);
+        samples[i] = platform_time_ns() - start;
+    }
+}
+
+static int compare_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+void bench_report_timings(const char *bench, const char *name, uint64_t *samples, size_t nsamples, double divisor,
+                          const char *unit)
+{
+    char full[128];
+
+    qsort(samples, nsamples, sizeof *samples, compare_u64);
+
+    snprintf(full, sizeof full, "%s_min", name);
+    bench_report(bench, full, (double)samples[0] / divisor, unit);
+    snprintf(full, sizeof full, "%s_median", name);
+    bench_report(bench, full, (double)samples[nsamples / 2] / divisor, unit);
+    snprintf(full, sizeof full, "%s_p99", name);
+    bench_report(bench, full, (double)samples[nsamples * 99 / 100] / divisor, unit);
+}
+
+int main(int nargs, const char *argv[])
+{
+    if (nargs > 1 && !strcmp(argv[1], "--json"))
+    {
+        json_output = true;
+        argv[1] = argv[0];
+        argv++;
+        nargs--;
+    }
+
+    if (nargs < 2)
+    {
+        for (size_t i = 0; i < NUM_BENCHES; i++)
+            benches[i].run(0, NULL);
+        return EXIT_SUCCESS;
+    }
+
+    for (size_t i = 0; i < NUM_BENCHES; i++)
+    {
+        if (!strcmp(benches[i].name, argv[1]))
+        {
+            benches[i].run(nargs - 2, argv + 2);
+            return EXIT_SUCCESS;
+        }
+    }
+
+    fprintf(stderr, "Unknown benchmark '%s', expected one of:\n", argv[1]);
+    for (size_t i = 0; i < NUM_BENCHES; i++)
+        fprintf(stderr, "    %s\n", benches[i].name);
+
+    return EXIT_FAILURE;
+}
@@ -0,0 +1,56 @@
+#ifndef THE_EDITOR_BENCH_H
+#define THE_EDITOR_BENCH_H
+
+#include "../src/theeditor.h"
+
+typedef struct {
+    const char *name;
+    void (*run)(int nargs, const char *argv[]);
+} Bench;
+
+/** Creates a fresh empty directory under the system temp directory, the result must be freed. */
+char *bench_make_temp_dir(void);
+/** Recursively deletes a directory made by the benchmarks. */
+void bench_remove_tree(const char *path);
+bool bench_make_dir(const char *path);
+bool bench_make_file(const char *path, size_t size);
+bool bench_change_dir(const char *path);
+/** Gives up the processor, for benchmarks that wait on a background thread the way a frame loop would. */
+void bench_sleep_ms(int ms);
+/** Returns the current working directory, the result must be freed. */
+char *bench_current_dir(void);
+/** Prints a single result line, in the form `bench.case value unit`, or as a JSON object when run with --json. */
+void bench_report(const char *bench, const char *name, double value, const char *unit);
+/** Runs `run` `nwarmup` times untimed so caches and allocations settle, then times each of `nsamples` more runs. */
+void bench_sample(void (*run)(void *user), void *user, size_t nwarmup, uint64_t *samples, size_t nsamples);
+/**
+ * Reports the fastest, median and 99th percentile of timings in nanoseconds as `name_min`, `name_median` and
+ * `name_p99`, each divided by `divisor`.  Sorts the samples.
+ */
+void bench_report_timings(const char *bench, const char *name, uint64_t *samples, size_t nsamples, double divisor,
+                          const char *unit);
+
+void bench_filetree(int nargs, const char *argv[]);
+void bench_strarena(int nargs, const char *argv[]);
+void bench_indexer(int nargs, const char *argv[]);
+void bench_watch(int nargs, const char *argv[]);
+void bench_ignore(int nargs, const char *argv[]);
+void bench_snapshot(int nargs, const char *argv[]);
+void bench_document(int nargs, const char *argv[]);
+void bench_largefile(int nargs, const char *argv[]);
+void bench_highlight(int nargs, const char *argv[]);
+void bench_search(int nargs, const char *argv[]);
+void bench_find(int nargs, const char *argv[]);
+void bench_quickopen(int nargs, const char *argv[]);
+void bench_utf8(int nargs, const char *argv[]);
+void bench_console(int nargs, const char *argv[]);
+void bench_terminal(int nargs, const char *argv[]);
+void bench_scrollback(int nargs, const char *argv[]);
+void bench_font(int nargs, const char *argv[]);
+void bench_ui(int nargs, const char *argv[]);
+void bench_render(int nargs, const char *argv[]);
+void bench_trace(int nargs, const char *argv[]);
+void bench_memory(int nargs, const char *argv[]);
+void bench_startup(int nargs, const char *argv[]);
+
+#endif // THE_EDITOR_BENCH_H
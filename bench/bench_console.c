@@ -0,0 +1,111 @@
+#include "bench.h"
+
+#include <stdio.h>
+#include <string.h>
+
+// About what a frame is at 60 Hz
+#define FRAME_MS 16
+
+typedef struct {
+    size_t bytes;
+} Received;
+
+static void count_output(void *user, const char *data, size_t len)
+{
+    Received *received = user;
+    received->bytes += len;
+}
+
+/* Writes lines the length of a build log's, returns whether the file could be written. */
+static bool write_log(const char *path, size_t size)
+{
+    static const char line[] = "cc -O2 -c src/some_module.c -o build/some_module.o   [ 42%] Building C object\n";
+    FILE *f = fopen(path, "wb");
+
+    if (!f)
+        return false;
+
+    for (size_t written = 0; written < size; written += sizeof line - 1)
+        fwrite(line, 1, sizeof line - 1, f);
+
+    fclose(f);
+    return true;
+}
+
+/*
+ * Has the shell print the file and exit, taking its output every `frame_ms` the way the UI would, or as fast as it
+ * comes with 0.  Reports the throughput and the longest a poll took.
+ */
+static void run_cat(const char *label, const char *path, int frame_ms)
+{
+    Console *console = console_create(NULL, 120, 40);
+    Received received = {0};
+    char command[2 * FILENAME_LEN];
+    char name[64];
+
+    if (!console)
+    {
+        fprintf(stderr, "Could not start a shell\n");
+        return;
+    }
+
+#ifdef _WIN32
+    snprintf(command, sizeof command, "type \"%s\" & exit\r", path);
+#else
+    snprintf(command, sizeof command, "cat '%s'; exit\r", path);
+#endif
+    console_write(console, command, strlen(command));
+
+    uint64_t longest = 0;
+    uint64_t start = platform_time_ns();
+
+    for (;;)
+    {
+        uint64_t poll_start = platform_time_ns();
+        bool running = console_poll(console, count_output, &received);
+        uint64_t poll_end = platform_time_ns();
+
+        if (poll_end - poll_start > longest)
+            longest = poll_end - poll_start;
+        if (!running)
+            break;
+
+        bench_sleep_ms(frame_ms ? frame_ms : 1);
+    }
+
+    double seconds = (double)(platform_time_ns() - start) / 1e9;
+
+    snprintf(name, sizeof name, "%s_throughput", label);
+    bench_report("console", name, (double)received.bytes / (1 << 20) / seconds, "MB/s");
+    snprintf(name, sizeof name, "%s_longest_poll", label);
+    bench_report("console", name, (double)longest / 1e6, "ms");
+
+    console_destroy(console);
+}
+
+/* Usage: console [megabytes], defaults to 256 printed by the shell, taken at 60 Hz and then as fast as it comes. */
+void bench_console(int nargs, const char *argv[])
+{
+    size_t megabytes = nargs > 0 ? (size_t)strtoull(argv[0], NULL, 10) : 256;
+    char *root = bench_make_temp_dir();
+    char path[2 * FILENAME_LEN];
+
+    if (!root)
+    {
+        fprintf(stderr, "Could not create a temporary directory\n");
+        return;
+    }
+
+    snprintf(path, sizeof path, "%s%clog.txt", root, PATH_SEPARATOR);
+
+    if (write_log(path, megabytes << 20))
+    {
+        // Once to bring the file into the page cache, so the runs after time the pty and not the disk
+        run_cat("cold", path, FRAME_MS);
+        run_cat("frame", path, FRAME_MS);
+        run_cat("busy", path, 0);
+    }
+
+    bench_remove_tree(root);
+    free(root);
+}
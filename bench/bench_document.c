@@ -0,0 +1,328 @@
+#include "bench.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define EDITS 100000
+// A gap buffer moves the gap across the file on every far edit, this bounds how long it gets at the large sizes
+#define GAP_BUDGET_NS 2000000000ull
+#define GAP_INITIAL (1 << 16)
+#define TYPING_BURSTS 2000
+#define TYPING_BURST_LEN 32
+#define UNDO_EDITS 10000
+#define LOOKUPS 100000
+#define COMPARE_WINDOWS 1000
+#define COMPARE_WINDOW_LEN 4096
+
+/* The usual alternative for an editor buffer: the text with a hole at the cursor that edits fill or widen. */
+typedef struct {
+    char *data;
+    size_t cap, gap_start, gap_end;
+} GapBuffer;
+
+static void gap_init(GapBuffer *gap, const char *text, size_t len)
+{
+    gap->cap = len + GAP_INITIAL;
+    gap->data = malloc(gap->cap);
+    memcpy(gap->data, text, len);
+    gap->gap_start = len;
+    gap->gap_end = gap->cap;
+}
+
+static size_t gap_length(const GapBuffer *gap)
+{
+    return gap->cap - (gap->gap_end - gap->gap_start);
+}
+
+static void gap_move(GapBuffer *gap, size_t offset)
+{
+    if (offset < gap->gap_start)
+    {
+        size_t n = gap->gap_start - offset;
+        memmove(&gap->data[gap->gap_end - n], &gap->data[offset], n);
+        gap->gap_start -= n;
+        gap->gap_end -= n;
+    }
+    else if (offset > gap->gap_start)
+    {
+        size_t n = offset - gap->gap_start;
+        memmove(&gap->data[gap->gap_start], &gap->data[gap->gap_end], n);
+        gap->gap_start += n;
+        gap->gap_end += n;
+    }
+}
+
+static void gap_insert(GapBuffer *gap, size_t offset, const char *text, size_t len)
+{
+    gap_move(gap, offset);
+
+    if (gap->gap_end - gap->gap_start < len)
+    {
+        size_t len_after = gap->cap - gap->gap_end;
+        size_t cap = gap->cap + len + GAP_INITIAL;
+
+        gap->data = realloc(gap->data, cap);
+        memmove(&gap->data[cap - len_after], &gap->data[gap->gap_end], len_after);
+        gap->gap_end = cap - len_after;
+        gap->cap = cap;
+    }
+
+    memcpy(&gap->data[gap->gap_start], text, len);
+    gap->gap_start += len;
+}
+
+static void gap_delete(GapBuffer *gap, size_t offset, size_t len)
+{
+    gap_move(gap, offset);
+    gap->gap_end += len;
+}
+
+static char gap_at(const GapBuffer *gap, size_t offset)
+{
+    return offset < gap->gap_start ? gap->data[offset] : gap->data[offset + gap->gap_end - gap->gap_start];
+}
+
+static uint64_t next_random(uint64_t *state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+typedef struct {
+    bool insert;
+    size_t offset, len;
+} Edit;
+
+/* Half inserts and half deletes of up to 16 bytes anywhere in the text, the same stream for both buffers. */
+static Edit next_edit(uint64_t *state, size_t length)
+{
+    uint64_t r = next_random(state);
+    Edit edit = {.insert = r & 1, .len = 1 + (r >> 1) % 16};
+
+    edit.offset = (size_t)(next_random(state) % (length + 1));
+
+    if (!edit.insert && edit.len > length - edit.offset)
+        edit.len = length - edit.offset;
+
+    return edit;
+}
+
+/* Source code shaped text: lines of up to 80 bytes, one megabyte of them repeated to fill the size. */
+static char *make_text(size_t len)
+{
+    size_t len_block = len < (1 << 20) ? len : (1 << 20);
+    char *text = malloc(len);
+    uint64_t state = 0x9e3779b97f4a7c15;
+
+    for (size_t i = 0, line = 0; i < len_block; i++)
+    {
+        if (i == line)
+            line += 1 + next_random(&state) % 80;
+        text[i] = i + 1 == line ? '\n' : (char)('a' + next_random(&state) % 26);
+    }
+
+    for (size_t i = len_block; i < len; i += len_block)
+        memcpy(&text[i], text, len - i < len_block ? len - i : len_block);
+
+    return text;
+}
+
+static bool same_text(const Document *doc, const GapBuffer *gap, uint64_t *state)
+{
+    size_t length = gap_length(gap);
+    char window[COMPARE_WINDOW_LEN];
+
+    if (doc_length(doc) != length)
+        return false;
+
+    for (size_t i = 0; i < COMPARE_WINDOWS; i++)
+    {
+        size_t offset = (size_t)(next_random(state) % (length + 1));
+        size_t got = doc_read(doc, offset, window, sizeof window);
+
+        for (size_t k = 0; k < got; k++)
+            if (window[k] != gap_at(gap, offset + k))
+                return false;
+    }
+
+    return true;
+}
+
+static void bench_size(size_t megabytes)
+{
+    size_t len = megabytes << 20;
+    char name[64];
+    char text[16];
+
+    memset(text, 'x', sizeof text);
+
+    char *original = make_text(len);
+    GapBuffer gap;
+    gap_init(&gap, original, len);
+
+    Document doc;
+    uint64_t start = platform_time_ns();
+    doc_init(&doc, original, len);
+    uint64_t end = platform_time_ns();
+
+    snprintf(name, sizeof name, "init_%zuMB", megabytes);
+    bench_report("document", name, (double)(end - start) / 1e6, "ms");
+
+    // The gap buffer goes first, for as many edits as fit in its budget
+    uint64_t gap_state = 1 + megabytes, doc_state = gap_state;
+    size_t gap_edits = 0;
+
+    start = platform_time_ns();
+    for (end = start; gap_edits < EDITS && end - start < GAP_BUDGET_NS; gap_edits++)
+    {
+        Edit edit = next_edit(&gap_state, gap_length(&gap));
+
+        if (edit.insert)
+            gap_insert(&gap, edit.offset, text, edit.len);
+        else
+            gap_delete(&gap, edit.offset, edit.len);
+
+        if (gap_edits % 16 == 0)
+            end = platform_time_ns();
+    }
+    end = platform_time_ns();
+
+    snprintf(name, sizeof name, "gap_random_%zuMB", megabytes);
+    bench_report("document", name, (double)(end - start) / (double)gap_edits, "ns/edit");
+
+    // The same edits on the piece table, stopping where the gap buffer did to check both hold the same text
+    uint64_t elapsed = 0;
+
+    for (size_t i = 0; i < EDITS; i++)
+    {
+        if (i == gap_edits)
+        {
+            uint64_t compare_state = 7;
+            if (!same_text(&doc, &gap, &compare_state))
+                fprintf(stderr, "The piece table and the gap buffer differ after %zu edits\n", gap_edits);
+        }
+
+        start = platform_time_ns();
+        size_t n = i < gap_edits ? gap_edits : EDITS;
+        for (; i < n; i++)
+        {
+            Edit edit = next_edit(&doc_state, doc_length(&doc));
+
+            if (edit.insert)
+                doc_insert(&doc, edit.offset, text, edit.len);
+            else
+                doc_delete(&doc, edit.offset, edit.len);
+        }
+        elapsed += platform_time_ns() - start;
+        i--;
+    }
+
+    snprintf(name, sizeof name, "piece_random_%zuMB", megabytes);
+    bench_report("document", name, (double)elapsed / EDITS, "ns/edit");
+    snprintf(name, sizeof name, "pieces_%zuMB", megabytes);
+    bench_report("document", name, (double)doc.len_nodes, "nodes");
+
+    // Typing: bursts of keystrokes one after another at a random place, which is what a gap buffer is good at
+    uint64_t gap_typing = 0, doc_typing = 0;
+
+    for (size_t burst = 0; burst < TYPING_BURSTS; burst++)
+    {
+        size_t offset = (size_t)(next_random(&gap_state) % (gap_length(&gap) + 1));
+
+        start = platform_time_ns();
+        for (size_t k = 0; k < TYPING_BURST_LEN; k++)
+            gap_insert(&gap, offset + k, text, 1);
+        end = platform_time_ns();
+        gap_typing += end - start;
+
+        offset = (size_t)(next_random(&doc_state) % (doc_length(&doc) + 1));
+
+        start = platform_time_ns();
+        for (size_t k = 0; k < TYPING_BURST_LEN; k++)
+            doc_insert(&doc, offset + k, text, 1);
+        end = platform_time_ns();
+        doc_typing += end - start;
+    }
+
+    snprintf(name, sizeof name, "gap_typing_%zuMB", megabytes);
+    bench_report("document", name, (double)gap_typing / (TYPING_BURSTS * TYPING_BURST_LEN), "ns/key");
+    snprintf(name, sizeof name, "piece_typing_%zuMB", megabytes);
+    bench_report("document", name, (double)doc_typing / (TYPING_BURSTS * TYPING_BURST_LEN), "ns/key");
+
+    // Lines are found from the counts in the tree, only a part of one piece is ever scanned
+    size_t length = doc_length(&doc), nlines = doc_line_count(&doc), sink = 0;
+
+    start = platform_time_ns();
+    for (size_t i = 0; i < LOOKUPS; i++)
+    {
+        size_t line, column;
+        doc_position(&doc, (size_t)(next_random(&doc_state) % (length + 1)), &line, &column);
+        sink += line + column;
+    }
+    end = platform_time_ns();
+
+    snprintf(name, sizeof name, "offset_to_line_%zuMB", megabytes);
+    bench_report("document", name, (double)(end - start) / LOOKUPS, "ns");
+
+    start = platform_time_ns();
+    for (size_t i = 0; i < LOOKUPS; i++)
+        sink += doc_line_start(&doc, (size_t)(next_random(&doc_state) % nlines));
+    end = platform_time_ns();
+
+    snprintf(name, sizeof name, "line_to_offset_%zuMB", megabytes);
+    bench_report("document", name, (double)(end - start) / LOOKUPS, "ns");
+
+    // An undo stack: a snapshot before every edit, each edit then copies only its path through the tree
+    DocSnapshot *undo = malloc(UNDO_EDITS * sizeof *undo);
+    size_t nodes_before = doc.len_nodes;
+
+    start = platform_time_ns();
+    for (size_t i = 0; i < UNDO_EDITS; i++)
+    {
+        undo[i] = doc_snapshot(&doc);
+
+        Edit edit = next_edit(&doc_state, doc_length(&doc));
+        if (edit.insert)
+            doc_insert(&doc, edit.offset, text, edit.len);
+        else
+            doc_delete(&doc, edit.offset, edit.len);
+    }
+    end = platform_time_ns();
+
+    snprintf(name, sizeof name, "piece_undoable_%zuMB", megabytes);
+    bench_report("document", name, (double)(end - start) / UNDO_EDITS, "ns/edit");
+    snprintf(name, sizeof name, "undo_nodes_%zuMB", megabytes);
+    bench_report("document", name, (double)(doc.len_nodes - nodes_before) / UNDO_EDITS, "nodes/edit");
+
+    start = platform_time_ns();
+    doc_restore(&doc, undo[0]);
+    end = platform_time_ns();
+
+    snprintf(name, sizeof name, "undo_all_%zuMB", megabytes);
+    bench_report("document", name, (double)(end - start) / 1e3, "us");
+
+    for (size_t i = 0; i < UNDO_EDITS; i++)
+        doc_release(&doc, undo[i]);
+    free(undo);
+
+    if (sink == 1)
+        fprintf(stderr, "\n");
+
+    doc_uninit(&doc);
+    free(gap.data);
+}
+
+/* Usage: document [megabytes...], defaults to 1, 100 and 1024. */
+void bench_document(int nargs, const char *argv[])
+{
+    static const size_t default_sizes[] = {1, 100, 1024};
+
+    if (nargs == 0)
+        for (size_t i = 0; i < sizeof default_sizes / sizeof default_sizes[0]; i++)
+            bench_size(default_sizes[i]);
+
+    for (int i = 0; i < nargs; i++)
+        bench_size((size_t)strtoull(argv[i], NULL, 10));
+}
@@ -0,0 +1,170 @@
+#include "bench.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define RUNS 5
+// A run first to bring the directories into the OS's caches, which is then left out
+#define WARMUP 1
+
+/* Fills `dir` with `count` entries, every 16th of them a directory so both entry types are enumerated. */
+static void make_synthetic_dir(const char *dir, size_t count)
+{
+    char path[2 * FILENAME_LEN];
+
+    bench_make_dir(dir);
+
+    for (size_t i = 0; i < count; i++)
+    {
+        if (snprintf(path, sizeof path, "%s%centry_%08zu%s", dir, PATH_SEPARATOR, i, i % 16 ? ".txt" : "")
+            >= (int)sizeof path)
+        {
+            fprintf(stderr, "The path to %s is too long to fill it\n", dir);
+            return;
+        }
+
+        if (i % 16)
+            bench_make_file(path, 0);
+        else
+            bench_make_dir(path);
+    }
+}
+
+static FileTreeIndex find_child(const FileTree *tree, FileTreeIndex parent, const char *name)
+{
+    for (FileTreeIndex c = tree->nodes[parent].first_child; c != FT_NONE; c = tree->nodes[c].next_sibling)
+    {
+        String s = ft_name(tree, c);
+        if (s.length == strlen(name) && !memcmp(s.data, name, s.length))
+            return c;
+    }
+
+    return FT_NONE;
+}
+
+static void run_size(size_t count)
+{
+    char *cwd = bench_current_dir();
+    char *root = bench_make_temp_dir();
+    char path[2 * FILENAME_LEN];
+    char name[64];
+
+    if (!root)
+    {
+        fprintf(stderr, "Could not create a temporary directory\n");
+        free(cwd);
+        return;
+    }
+
+    // `a` sits above the huge directory, so toggling it lands in front of all of its rows
+    snprintf(path, sizeof path, "%s%ca", root, PATH_SEPARATOR);
+    make_synthetic_dir(path, 16);
+    snprintf(path, sizeof path, "%s%cd", root, PATH_SEPARATOR);
+    make_synthetic_dir(path, count);
+    bench_change_dir(root);
+
+    uint64_t init_samples[RUNS], expand_samples[RUNS];
+    uint64_t best_worst_frame = UINT64_MAX, best_toggle = UINT64_MAX, best_lookup = UINT64_MAX;
+
+    for (int run = -WARMUP; run < RUNS; run++)
+    {
+        FileTree tree;
+
+        uint64_t start = platform_time_ns();
+        ft_init(&tree);
+        uint64_t inited = platform_time_ns();
+
+        FileTreeIndex dir = find_child(&tree, FT_ROOT, "d");
+        FileTreeIndex above = find_child(&tree, FT_ROOT, "a");
+        uint64_t expand_start = platform_time_ns();
+        ft_expand(&tree, dir);
+        uint64_t frame_start = platform_time_ns();
+        uint64_t worst_frame = 0;
+
+        // Expansion runs on the worker, so poll once per "frame" as the editor does
+        while (!(tree.nodes[dir].flags & FTI_EXPLORED))
+        {
+            ft_poll(&tree);
+            uint64_t frame_end = platform_time_ns();
+            if (frame_end - frame_start > worst_frame)
+                worst_frame = frame_end - frame_start;
+            frame_start = frame_end;
+        }
+        uint64_t expanded = platform_time_ns();
+
+        if (ft_visible_count(&tree) != count + 2)
+            fprintf(stderr, "Expected %zu rows, listed %zu\n", count + 2, ft_visible_count(&tree));
+
+        // Every other toggle finds `a` already explored, so these are pure row splices
+        ft_expand(&tree, above);
+        while (tree.nodes[above].flags & FTI_LOADING)
+            ft_poll(&tree);
+
+        uint64_t toggle_start = platform_time_ns();
+        for (int i = 0; i < 1000; i++)
+        {
+            ft_collapse(&tree, above);
+            ft_expand(&tree, above);
+        }
+        uint64_t toggled = platform_time_ns();
+
+        size_t nrows = ft_visible_count(&tree);
+        size_t checksum = 0;
+        uint64_t lookup_start = platform_time_ns();
+        for (size_t i = 0; i < 100000; i++)
+            checksum += ft_visible_row(&tree, (i * 7919) % nrows);
+        uint64_t looked_up = platform_time_ns();
+
+        if (!checksum)
+            fprintf(stderr, "Unexpected empty lookups\n");
+
+        ft_uninit(&tree);
+
+        if (run < 0)
+            continue;
+
+        init_samples[run] = inited - start;
+        expand_samples[run] = expanded - expand_start;
+        if (worst_frame < best_worst_frame)
+            best_worst_frame = worst_frame;
+        if ((toggled - toggle_start) / 2000 < best_toggle)
+            best_toggle = (toggled - toggle_start) / 2000;
+        if ((looked_up - lookup_start) / 100000 < best_lookup)
+            best_lookup = (looked_up - lookup_start) / 100000;
+    }
+
+    snprintf(name, sizeof name, "expand_%zu_time", count);
+    bench_report_timings("filetree", name, expand_samples, RUNS, 1e6, "ms");
+    // The fastest expansion again as a rate, the samples being sorted now
+    snprintf(name, sizeof name, "expand_%zu", count);
+    bench_report("filetree", name, (double)count / ((double)expand_samples[0] / 1e9), "entries/s");
+    snprintf(name, sizeof name, "expand_%zu_worst_poll", count);
+    bench_report("filetree", name, (double)best_worst_frame / 1e6, "ms");
+    snprintf(name, sizeof name, "toggle_above_%zu", count);
+    bench_report("filetree", name, (double)best_toggle, "ns");
+    snprintf(name, sizeof name, "visible_row_%zu", count);
+    bench_report("filetree", name, (double)best_lookup, "ns");
+    snprintf(name, sizeof name, "init_%zu_time", count);
+    bench_report_timings("filetree", name, init_samples, RUNS, 1e6, "ms");
+
+    bench_change_dir(cwd);
+    bench_remove_tree(root);
+    free(root);
+    free(cwd);
+}
+
+/* Usage: filetree [entries...], defaults to 10k, 100k and 1M entries. */
+void bench_filetree(int nargs, const char *argv[])
+{
+    static const size_t default_sizes[] = {10000, 100000, 1000000};
+
+    if (nargs == 0)
+    {
+        for (size_t i = 0; i < sizeof default_sizes / sizeof default_sizes[0]; i++)
+            run_size(default_sizes[i]);
+        return;
+    }
+
+    for (int i = 0; i < nargs; i++)
+        run_size((size_t)strtoull(argv[i], NULL, 10));
+}
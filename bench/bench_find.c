@@ -0,0 +1,248 @@
+#include "bench.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define FILES_PER_DIR 40
+#define DIRS_PER_DIR 6
+// Every so many files is binary, and every so many lines has something to find
+#define BINARY_EVERY 50
+#define MATCH_EVERY 400
+#define MIN_FILE_SIZE 2048
+#define MAX_FILE_SIZE 32768
+#define RUNS 3
+
+static const char *const words[] = {
+    "int", "return", "buffer", "length", "errno", "value", "if", "else", "for", "while", "node", "index", "the",
+    "error", "count", "offset", "static", "const", "char", "size_t", "=", "+", "(", ")", "{", "}", ";", "0", "1",
+};
+
+#define NUM_WORDS (sizeof words / sizeof words[0])
+
+static uint64_t next_random(uint64_t *state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+/* Writes a file of source-like lines, or of bytes with NULs among them, returns its size. */
+static size_t write_file(const char *path, bool binary, uint64_t *state, size_t *line)
+{
+    FILE *f = fopen(path, "wb");
+    size_t size = MIN_FILE_SIZE + (size_t)(next_random(state) % (MAX_FILE_SIZE - MIN_FILE_SIZE));
+    size_t written = 0;
+
+    if (!f)
+        return 0;
+
+    while (written < size)
+    {
+        char buffer[256];
+        int n = 0;
+
+        if (binary)
+        {
+            for (; n < 64; n++)
+                buffer[n] = (char)(next_random(state) & 0x7f);
+        }
+        else
+        {
+            if (++*line % MATCH_EVERY == 0)
+                n += snprintf(&buffer[n], sizeof buffer - n, "replace_me(%u); ", (unsigned)(next_random(state) % 100));
+            for (size_t k = next_random(state) % 12; k; k--)
+                n += snprintf(&buffer[n], sizeof buffer - n, "%s ", words[next_random(state) % NUM_WORDS]);
+            buffer[n++] = '\n';
+        }
+
+        fwrite(buffer, 1, (size_t)n, f);
+        written += (size_t)n;
+    }
+
+    fclose(f);
+
+    return written;
+}
+
+/* Builds nested directories holding `count` files in total, with an ignored build directory at the top. */
+static size_t make_tree(const char *dir, size_t count, uint64_t *state, size_t *bytes, size_t *line)
+{
+    char path[2 * FILENAME_LEN];
+    size_t made = 0;
+
+    bench_make_dir(dir);
+
+    for (size_t i = 0; i < FILES_PER_DIR && made < count; i++, made++)
+    {
+        bool binary = next_random(state) % BINARY_EVERY == 0;
+        snprintf(path, sizeof path, "%s%c%s_%zu.%s", dir, PATH_SEPARATOR, binary ? "blob" : "file", i,
+                 binary ? "bin" : "c");
+        *bytes += write_file(path, binary, state, line);
+    }
+
+    for (size_t i = 0; i < DIRS_PER_DIR && made < count; i++)
+    {
+        size_t share = (count - made + DIRS_PER_DIR - 1 - i) / (DIRS_PER_DIR - i);
+        snprintf(path, sizeof path, "%s%cdir_%zu", dir, PATH_SEPARATOR, i);
+        made += make_tree(path, share, state, bytes, line);
+    }
+
+    return made;
+}
+
+/* Runs the search to the end, polling the way a frame would.  Gives the time taken and until the first result. */
+static FindStats run_find(const char *pattern, SearchFlags flags, IgnoreCache *ignore, int nthreads, uint64_t *total,
+    uint64_t *first, size_t *nlines)
+{
+    Search *search = search_create(pattern, strlen(pattern), flags);
+    uint64_t start = platform_time_ns();
+    FindInFiles *find = find_start(".", search, ignore, nthreads);
+
+    *first = 0;
+    for (bool running = true; running;)
+    {
+        running = find_poll(find);
+
+        if (!*first && find_file_count(find))
+            *first = platform_time_ns() - start;
+        if (running)
+            bench_sleep_ms(1);
+    }
+
+    *total = platform_time_ns() - start;
+    *nlines = 0;
+    for (size_t i = 0; i < find_file_count(find); i++)
+        *nlines += find_file(find, i)->nlines;
+
+    FindStats stats = find_stats(find);
+    find_destroy(find);
+
+    return stats;
+}
+
+/* Usage: find [files [threads...]], defaults to 10000 files searched with 1, 2, 4 ... up to one thread per core. */
+void bench_find(int nargs, const char *argv[])
+{
+    size_t count = nargs > 0 ? (size_t)strtoull(argv[0], NULL, 10) : 10000;
+    char *cwd = bench_current_dir();
+    char *root = bench_make_temp_dir();
+    char path[2 * FILENAME_LEN];
+    char name[64];
+
+    if (!root)
+    {
+        fprintf(stderr, "Could not create a temporary directory\n");
+        free(cwd);
+        return;
+    }
+
+    uint64_t state = 0x9e3779b97f4a7c15;
+    size_t bytes = 0, line = 0;
+
+    snprintf(path, sizeof path, "%s%cw", root, PATH_SEPARATOR);
+    make_tree(path, count, &state, &bytes, &line);
+    bench_change_dir(path);
+
+    // A build directory as big as the tree's first subdirectory, which should cost nothing to skip
+    size_t ignored_bytes = 0;
+    FILE *f = fopen(".gitignore", "wb");
+    if (f)
+    {
+        fputs("build/\n", f);
+        fclose(f);
+    }
+    make_tree("build", count / DIRS_PER_DIR, &state, &ignored_bytes, &line);
+
+    bench_report("find", "tree_files", (double)count, "files");
+    bench_report("find", "tree_size", (double)bytes / (1 << 20), "MB");
+
+    int thread_counts[16];
+    int nthread_counts = 0;
+
+    if (nargs > 1)
+    {
+        for (int i = 1; i < nargs && nthread_counts < 16; i++)
+            thread_counts[nthread_counts++] = atoi(argv[i]);
+    }
+    else
+    {
+        int cores = platform_cpu_count();
+        for (int n = 1; n < cores && nthread_counts < 15; n *= 2)
+            thread_counts[nthread_counts++] = n;
+        thread_counts[nthread_counts++] = cores;
+    }
+
+    IgnoreCache *ignore = ignore_cache_create(".");
+    uint64_t total, first;
+    size_t nlines;
+
+    // Once through to bring the tree into the page cache, every run after reads it from memory
+    FindStats stats = run_find("replace_me", 0, ignore, 0, &total, &first, &nlines);
+    bench_report("find", "files_searched", (double)stats.files, "files");
+    bench_report("find", "binary_skipped", (double)stats.binary, "files");
+    bench_report("find", "matched_lines", (double)nlines, "lines");
+
+    uint64_t single = 0;
+
+    for (int t = 0; t < nthread_counts; t++)
+    {
+        uint64_t best = UINT64_MAX, best_first = UINT64_MAX;
+
+        for (int run = 0; run < RUNS; run++)
+        {
+            run_find("replace_me", 0, ignore, thread_counts[t], &total, &first, &nlines);
+
+            if (total < best)
+                best = total;
+            if (first < best_first)
+                best_first = first;
+        }
+
+        if (thread_counts[t] == 1)
+            single = best;
+
+        snprintf(name, sizeof name, "literal_threads_%d", thread_counts[t]);
+        bench_report("find", name, (double)best / 1e6, "ms");
+        snprintf(name, sizeof name, "literal_threads_%d_rate", thread_counts[t]);
+        bench_report("find", name, (double)bytes / (1 << 20) / ((double)best / 1e9), "MB/s");
+        snprintf(name, sizeof name, "literal_threads_%d_first_result", thread_counts[t]);
+        bench_report("find", name, (double)best_first / 1e6, "ms");
+
+        if (single)
+        {
+            snprintf(name, sizeof name, "literal_threads_%d_speedup", thread_counts[t]);
+            bench_report("find", name, (double)single / (double)best, "x");
+        }
+    }
+
+    run_find("replace_me\\(\\d+\\)", SEARCH_REGEX, ignore, 0, &total, &first, &nlines);
+    bench_report("find", "regex_all_threads", (double)total / 1e6, "ms");
+
+    // Changing the query: the search in flight is dropped as soon as the workers finish the files they are on
+    uint64_t worst = 0;
+
+    for (int run = 0; run < RUNS; run++)
+    {
+        Search *search = search_create("replace_me", strlen("replace_me"), 0);
+        FindInFiles *find = find_start(".", search, ignore, 0);
+
+        while (find_poll(find) && !find_file_count(find))
+            bench_sleep_ms(1);
+
+        uint64_t start = platform_time_ns();
+        find_destroy(find);
+        uint64_t elapsed = platform_time_ns() - start;
+
+        if (elapsed > worst)
+            worst = elapsed;
+    }
+
+    bench_report("find", "cancel", (double)worst / 1e6, "ms");
+
+    ignore_cache_destroy(ignore);
+    bench_change_dir(cwd);
+    bench_remove_tree(root);
+    free(root);
+    free(cwd);
+}
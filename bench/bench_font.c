@@ -0,0 +1,93 @@
+#include "bench.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#define DEFAULT_FONT "C:\\Windows\\Fonts\\consola.ttf"
+#else
+#define DEFAULT_FONT "/usr/share/fonts/truetype/dejavu/DejaVuSansMono.ttf"
+#endif
+
+#define ATLAS_WIDTH 1024
+#define ATLAS_HEIGHT 1024
+#define WARMUP 3
+#define SAMPLES 50
+
+/* The codepoints the editor's atlases are made of, the same ranges the UI rasterises. */
+static const struct {
+    uint32_t first, last;
+} ranges[] = {
+    {' ', '~'},
+    {0xa0, 0x17f},
+    {0x391, 0x3c9},
+    {0x400, 0x45f},
+    {UTF8_REPLACEMENT, UTF8_REPLACEMENT},
+};
+
+typedef struct {
+    FontId face;
+    uint8_t *atlas;
+    uint32_t *codes;
+    size_t ncodes;
+    GlyphInfo *glyphs;
+    bool failed;
+} Fill;
+
+static void fill(void *user)
+{
+    Fill *f = user;
+    FontAtlasFillState state = {0};
+
+    if (!font_atlas_fill(ATLAS_WIDTH, ATLAS_HEIGHT, f->atlas, f->ncodes, f->codes, f->face, f->glyphs, &state))
+        f->failed = true;
+}
+
+/* Usage: font [path], defaults to the editor's monospaced font.  Rasterises every glyph the editor uses. */
+void bench_font(int nargs, const char *argv[])
+{
+    const char *path = nargs > 0 ? argv[0] : DEFAULT_FONT;
+    uint64_t samples[SAMPLES];
+    Fill f = {0};
+
+    if (!font_init())
+    {
+        fprintf(stderr, "Failed to initialise the freetype library\n");
+        return;
+    }
+
+    f.face = font_create_face(path);
+    if (f.face < 0)
+    {
+        fprintf(stderr, "Could not load the font %s\n", path);
+        font_uninit();
+        return;
+    }
+
+    for (size_t i = 0; i < sizeof ranges / sizeof ranges[0]; i++)
+        f.ncodes += ranges[i].last - ranges[i].first + 1;
+
+    f.codes = malloc(f.ncodes * sizeof *f.codes);
+    f.glyphs = malloc(f.ncodes * sizeof *f.glyphs);
+    f.atlas = calloc(ATLAS_WIDTH * ATLAS_HEIGHT, 1);
+
+    size_t n = 0;
+    for (size_t i = 0; i < sizeof ranges / sizeof ranges[0]; i++)
+        for (uint32_t c = ranges[i].first; c <= ranges[i].last; c++)
+            f.codes[n++] = c;
+
+    bench_sample(fill, &f, WARMUP, samples, SAMPLES);
+
+    if (f.failed)
+        fprintf(stderr, "The glyphs of %s did not fit a %dx%d atlas\n", path, ATLAS_WIDTH, ATLAS_HEIGHT);
+
+    bench_report_timings("font", "atlas_fill", samples, SAMPLES, 1e6, "ms");
+    // The median again per glyph, the sort having left it in the middle
+    bench_report("font", "atlas_fill_per_glyph", (double)samples[SAMPLES / 2] / 1e3 / (double)f.ncodes, "us");
+
+    free(f.codes);
+    free(f.glyphs);
+    free(f.atlas);
+    font_delete_face(f.face);
+    font_uninit();
+}
@@ -0,0 +1,213 @@
+#include "bench.h"
+
+#include <stdio.h>
+#include <string.h>
+
+// About what fits in the editor pane
+#define VIEW_LINES 60
+#define MAX_LINE_SPANS 512
+#define KEYSTROKES 20000
+// The view jumps somewhere else after this many keystrokes, the way someone moves around a file
+#define KEYSTROKES_PER_PLACE 200
+// Every so often a keystroke is an Enter, which adds a line
+#define NEWLINE_EVERY 16
+#define COMMENT_OPENS 200
+#define FULL_LEXES 5
+
+/* A function's worth of C, with every kind of token and a block comment, repeated to fill the file. */
+static const char *const source_lines[] = {
+    "/*",
+    " * Walks the table and sums the entries that match, skipping \"empty\" slots.",
+    " */",
+    "#include <stdint.h>",
+    "#define TABLE_SIZE (1 << 12)",
+    "static uint32_t sum_matching(const Entry *table, size_t n, uint32_t key)",
+    "{",
+    "    uint32_t total = 0;",
+    "",
+    "    for (size_t i = 0; i < n; i++)",
+    "    {",
+    "        // Empty slots have a zero key",
+    "        if (table[i].key == 0 || table[i].key != key)",
+    "            continue;",
+    "        total += table[i].value * 0x9e3779b9u + 'x';",
+    "    }",
+    "",
+    "    printf(\"%u matches for \\\"%s\\\"\\n\", total, \"key\");",
+    "    return total > 1.5e3 ? total : 0;",
+    "}",
+    "",
+};
+
+#define NUM_SOURCE_LINES (sizeof source_lines / sizeof source_lines[0])
+
+static char *make_source(size_t nlines, size_t *len)
+{
+    size_t cap = 0;
+
+    for (size_t i = 0; i < nlines; i++)
+        cap += strlen(source_lines[i % NUM_SOURCE_LINES]) + 1;
+
+    char *text = malloc(cap);
+    size_t at = 0;
+
+    for (size_t i = 0; i < nlines; i++)
+    {
+        const char *line = source_lines[i % NUM_SOURCE_LINES];
+        size_t n = strlen(line);
+
+        memcpy(&text[at], line, n);
+        text[at + n] = '\n';
+        at += n + 1;
+    }
+
+    *len = at;
+    return text;
+}
+
+static uint64_t next_random(uint64_t *state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+static int compare_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+/* What a frame asks of the highlighter: the states up to the bottom of the view, then every line's spans. */
+static size_t draw_view(Highlighter *hl, const Document *doc, size_t top)
+{
+    TokenSpan spans[MAX_LINE_SPANS];
+    size_t nlines = doc_line_count(doc);
+    size_t end = top + VIEW_LINES < nlines ? top + VIEW_LINES : nlines;
+    size_t total = 0;
+
+    hl_update(hl, doc, end - 1);
+
+    for (size_t line = top; line < end; line++)
+    {
+        String text;
+        total += hl_line(hl, doc, line, &text, spans, MAX_LINE_SPANS);
+    }
+
+    return total;
+}
+
+static void report_percentiles(const char *name, uint64_t *samples, size_t n)
+{
+    char full[64];
+
+    qsort(samples, n, sizeof *samples, compare_u64);
+
+    snprintf(full, sizeof full, "%s_median", name);
+    bench_report("highlight", full, (double)samples[n / 2] / 1e3, "us");
+    snprintf(full, sizeof full, "%s_p99", name);
+    bench_report("highlight", full, (double)samples[n * 99 / 100] / 1e3, "us");
+}
+
+/* Usage: highlight [lines], defaults to 200000. */
+void bench_highlight(int nargs, const char *argv[])
+{
+    size_t nlines = nargs > 0 ? (size_t)strtoull(argv[0], NULL, 10) : 200000;
+    const Language *language = hl_language_for_path("bench.c");
+    size_t len, sink = 0;
+    char *text = make_source(nlines, &len);
+    Document doc;
+    Highlighter hl;
+
+    doc_init(&doc, text, len);
+
+    // Opening the file: only the first screen and the margin after it are lexed
+    uint64_t start = platform_time_ns();
+    hl_init(&hl, language);
+    sink += draw_view(&hl, &doc, 0);
+    uint64_t end = platform_time_ns();
+
+    bench_report("highlight", "first_screen", (double)(end - start) / 1e3, "us");
+    hl_uninit(&hl);
+
+    // What a highlighter without cached states would pay on every keystroke
+    uint64_t full[FULL_LEXES];
+
+    for (size_t i = 0; i < FULL_LEXES; i++)
+    {
+        hl_init(&hl, language);
+        start = platform_time_ns();
+        hl_update(&hl, &doc, doc_line_count(&doc) - 1);
+        full[i] = platform_time_ns() - start;
+        hl_uninit(&hl);
+    }
+    qsort(full, FULL_LEXES, sizeof *full, compare_u64);
+
+    bench_report("highlight", "full_lex", (double)full[FULL_LEXES / 2] / 1e6, "ms");
+    bench_report("highlight", "full_lex_rate", (double)len / (1 << 20) / ((double)full[FULL_LEXES / 2] / 1e9), "MB/s");
+
+    // Typing at random places in the view, each keystroke followed by the frame that shows it
+    uint64_t *samples = malloc(KEYSTROKES * sizeof *samples);
+    uint64_t state = 0x9e3779b97f4a7c15;
+    size_t top = 0;
+
+    hl_init(&hl, language);
+
+    for (size_t i = 0; i < KEYSTROKES; i++)
+    {
+        if (i % KEYSTROKES_PER_PLACE == 0)
+        {
+            // Scrolling there is not a keystroke, the states down to the view are lexed before timing
+            top = (size_t)(next_random(&state) % (doc_line_count(&doc) - VIEW_LINES));
+            sink += draw_view(&hl, &doc, top);
+        }
+
+        size_t line = top + (size_t)(next_random(&state) % VIEW_LINES);
+        size_t line_start = doc_line_start(&doc, line);
+        size_t line_len = doc_line_start(&doc, line + 1) - line_start - 1;
+        size_t offset = line_start + (size_t)(next_random(&state) % (line_len + 1));
+        bool newline = i % NEWLINE_EVERY == NEWLINE_EVERY - 1;
+
+        start = platform_time_ns();
+        doc_insert(&doc, offset, newline ? "\n" : "x", 1);
+        hl_edit(&hl, line, 0, newline ? 1 : 0);
+        sink += draw_view(&hl, &doc, top);
+        samples[i] = platform_time_ns() - start;
+    }
+
+    report_percentiles("keystroke", samples, KEYSTROKES);
+
+    // The worst keystroke: opening a block comment at the top of the view changes every line after it
+    for (size_t i = 0; i < COMMENT_OPENS; i++)
+    {
+        top = (size_t)(next_random(&state) % (doc_line_count(&doc) - VIEW_LINES));
+        sink += draw_view(&hl, &doc, top);
+
+        size_t offset = doc_line_start(&doc, top);
+
+        doc_insert(&doc, offset, "/", 1);
+        hl_edit(&hl, top, 0, 0);
+        sink += draw_view(&hl, &doc, top);
+
+        start = platform_time_ns();
+        doc_insert(&doc, offset + 1, "*", 1);
+        hl_edit(&hl, top, 0, 0);
+        sink += draw_view(&hl, &doc, top);
+        samples[i] = platform_time_ns() - start;
+
+        // Taking it out again relexes the same lines back, up to where the states agree
+        doc_delete(&doc, offset, 2);
+        hl_edit(&hl, top, 0, 0);
+        sink += draw_view(&hl, &doc, top);
+    }
+
+    report_percentiles("comment_open", samples, COMMENT_OPENS);
+
+    if (sink == 1)
+        fprintf(stderr, "\n");
+
+    free(samples);
+    hl_uninit(&hl);
+    doc_uninit(&doc);
+}
@@ -0,0 +1,272 @@
+#include "bench.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define PACKAGES 40
+#define SOURCES_PER_PACKAGE 200
+#define MATCH_ROUNDS 200
+
+// A mix of what the common .gitignore templates contain, most of it never matches
+static const char *gitignore =
+    "# Build output\n"
+    "build/\n"
+    "/dist\n"
+    "out/\n"
+    "*.o\n"
+    "*.obj\n"
+    "*.a\n"
+    "*.lib\n"
+    "*.so\n"
+    "*.dll\n"
+    "*.exe\n"
+    "*.pdb\n"
+    "*.ilk\n"
+    "*.py[cod]\n"
+    "__pycache__/\n"
+    "*.class\n"
+    "*.log\n"
+    "*.tmp\n"
+    "*~\n"
+    ".#*\n"
+    "*.sw?\n"
+    ".DS_Store\n"
+    "Thumbs.db\n"
+    "node_modules\n"
+    "**/coverage\n"
+    "target/\n"
+    "CMakeCache.txt\n"
+    "CMakeFiles/\n"
+    "cmake-build-*/\n"
+    "compile_commands.json\n"
+    ".vs/\n"
+    ".idea/\n"
+    "*.user\n"
+    "docs/**/generated\n"
+    "packages/*/tmp\n"
+    "!important.log\n";
+
+/* Entries and whether the .gitignore above keeps them. */
+static const struct {
+    const char *dir, *name;
+    FileTreeItemFlags type;
+    bool keep;
+} cases[] = {
+    {".", "dist", FTI_DIRECTORY, false},
+    {"pkg_0", "dist", FTI_DIRECTORY, true},
+    {".", "build", FTI_DIRECTORY, false},
+    {".", "build", FTI_FILE, true},
+    {"pkg_0/src", "main.o", FTI_FILE, false},
+    {"pkg_0/src", "main.c", FTI_FILE, true},
+    {".", "debug.log", FTI_FILE, false},
+    {".", "important.log", FTI_FILE, true},
+    {".", "module.pyc", FTI_FILE, false},
+    {".", "module.py", FTI_FILE, true},
+    {".", "coverage", FTI_DIRECTORY, false},
+    {"pkg_0/src", "coverage", FTI_DIRECTORY, false},
+    {"pkg_0", "xcoverage", FTI_DIRECTORY, true},
+    // "/**/" stands for whole directory levels, none or any number of them
+    {"docs", "generated", FTI_DIRECTORY, false},
+    {"docs/api/v1", "generated", FTI_DIRECTORY, false},
+    {"docsx", "generated", FTI_DIRECTORY, true},
+    {"docs/api", "xgenerated", FTI_DIRECTORY, true},
+    {"packages/core", "tmp", FTI_DIRECTORY, false},
+    {"packages/core/src", "tmp", FTI_DIRECTORY, true},
+    {".", ".git", FTI_DIRECTORY, false},
+};
+
+#define NUM_CASES (sizeof cases / sizeof cases[0])
+
+/* One package with sources, a build directory full of objects and a node_modules directory full of packages. */
+static size_t make_package(const char *dir, size_t index, size_t junk)
+{
+    char path[2 * FILENAME_LEN];
+    size_t made = 0;
+
+    if (snprintf(path, sizeof path, "%s%cpkg_%zu", dir, PATH_SEPARATOR, index) >= (int)sizeof path)
+    {
+        fprintf(stderr, "The path to %s is too long to make packages in\n", dir);
+        return 0;
+    }
+    bench_make_dir(path);
+
+    size_t len = strlen(path);
+
+    snprintf(path + len, sizeof path - len, "%csrc", PATH_SEPARATOR);
+    bench_make_dir(path);
+    for (size_t i = 0; i < SOURCES_PER_PACKAGE; i++, made++)
+    {
+        snprintf(path + len, sizeof path - len, "%csrc%cfile_%zu.c", PATH_SEPARATOR, PATH_SEPARATOR, i);
+        bench_make_file(path, 0);
+    }
+
+    snprintf(path + len, sizeof path - len, "%cbuild", PATH_SEPARATOR);
+    bench_make_dir(path);
+    for (size_t i = 0; i < junk / 2; i++, made++)
+    {
+        snprintf(path + len, sizeof path - len, "%cbuild%cfile_%zu.o", PATH_SEPARATOR, PATH_SEPARATOR, i);
+        bench_make_file(path, 0);
+    }
+
+    snprintf(path + len, sizeof path - len, "%cnode_modules", PATH_SEPARATOR);
+    bench_make_dir(path);
+    for (size_t i = 0; i < junk / 2; i += 10)
+    {
+        snprintf(path + len, sizeof path - len, "%cnode_modules%cdep_%zu", PATH_SEPARATOR, PATH_SEPARATOR, i);
+        bench_make_dir(path);
+
+        size_t len_dep = strlen(path);
+        for (size_t j = 0; j < 10; j++, made++)
+        {
+            snprintf(path + len_dep, sizeof path - len_dep, "%cindex_%zu.js", PATH_SEPARATOR, j);
+            bench_make_file(path, 0);
+        }
+    }
+
+    return made;
+}
+
+static uint64_t time_crawl(bool use_ignore, size_t *entries, IgnoreStats *stats)
+{
+    uint64_t best = UINT64_MAX;
+
+    for (int run = 0; run < 3; run++)
+    {
+        // A fresh cache each run, so reading and compiling the ignore files is part of the time
+        IgnoreCache *cache = use_ignore ? ignore_cache_create(".") : NULL;
+        WorkspaceSnapshot snapshot;
+
+        uint64_t start = platform_time_ns();
+        ws_index(&snapshot, ".", 0, cache);
+        uint64_t end = platform_time_ns();
+
+        if (end - start < best)
+            best = end - start;
+
+        *entries = snapshot.len;
+        *stats = snapshot.ignore_stats;
+
+        ws_snapshot_free(&snapshot);
+        if (cache)
+            ignore_cache_destroy(cache);
+    }
+
+    return best;
+}
+
+/* Checks the rules of the .gitignore in the current directory against what git makes of them. */
+static void check_rules(void)
+{
+    IgnoreCache *cache = ignore_cache_create(".");
+    IgnoreStats stats = {0};
+    size_t passed = 0;
+
+    for (size_t c = 0; c < NUM_CASES; c++)
+    {
+        const IgnoreRules *rules = ignore_rules_for(cache, cases[c].dir);
+        bool keep = ignore_keep(rules, cases[c].dir, cases[c].name, strlen(cases[c].name), cases[c].type, &stats);
+
+        if (keep == cases[c].keep)
+            passed++;
+        else
+            fprintf(stderr, "%s/%s should be %s\n", cases[c].dir, cases[c].name, cases[c].keep ? "kept" : "ignored");
+    }
+
+    ignore_cache_destroy(cache);
+
+    bench_report("ignore", "rules_passed", (double)passed, "entries");
+    if (passed < NUM_CASES)
+        fprintf(stderr, "%zu of %zu ignore rule checks failed\n", NUM_CASES - passed, NUM_CASES);
+}
+
+/* Usage: ignore [files], defaults to 200k files of which most sit in ignored build and node_modules directories. */
+void bench_ignore(int nargs, const char *argv[])
+{
+    size_t count = nargs > 0 ? (size_t)strtoull(argv[0], NULL, 10) : 200000;
+    size_t junk = count / PACKAGES > SOURCES_PER_PACKAGE ? count / PACKAGES - SOURCES_PER_PACKAGE : 0;
+    char *cwd = bench_current_dir();
+    char *root = bench_make_temp_dir();
+    char name[64];
+
+    if (!root)
+    {
+        fprintf(stderr, "Could not create a temporary directory\n");
+        free(cwd);
+        return;
+    }
+
+    char path[2 * FILENAME_LEN];
+    snprintf(path, sizeof path, "%s%cw", root, PATH_SEPARATOR);
+    bench_make_dir(path);
+
+    for (size_t i = 0; i < PACKAGES; i++)
+        make_package(path, i, junk);
+
+    bench_change_dir(path);
+
+    FILE *f = fopen(".gitignore", "wb");
+    if (f)
+    {
+        fputs(gitignore, f);
+        fclose(f);
+    }
+
+    check_rules();
+
+    size_t entries;
+    IgnoreStats stats;
+
+    uint64_t plain = time_crawl(false, &entries, &stats);
+    snprintf(name, sizeof name, "crawl_%zu_unfiltered", count);
+    bench_report("ignore", name, (double)plain / 1e6, "ms");
+    snprintf(name, sizeof name, "crawl_%zu_unfiltered_entries", count);
+    bench_report("ignore", name, (double)entries, "entries");
+
+    uint64_t filtered = time_crawl(true, &entries, &stats);
+    snprintf(name, sizeof name, "crawl_%zu_filtered", count);
+    bench_report("ignore", name, (double)filtered / 1e6, "ms");
+    snprintf(name, sizeof name, "crawl_%zu_filtered_entries", count);
+    bench_report("ignore", name, (double)entries, "entries");
+    snprintf(name, sizeof name, "crawl_%zu_evaluations", count);
+    bench_report("ignore", name, (double)stats.evaluations, "rules");
+    snprintf(name, sizeof name, "crawl_%zu_pruned", count);
+    bench_report("ignore", name, (double)stats.pruned, "entries");
+
+    // Matching alone, over names that mostly miss every rule like they do in a real source tree
+    IgnoreCache *cache = ignore_cache_create(".");
+    const IgnoreRules *rules = ignore_rules_for(cache, "pkg_0/src");
+    char names[256][32];
+    size_t len_names[256];
+
+    for (size_t i = 0; i < 256; i++)
+    {
+        static const char *extensions[] = {".c", ".h", ".cpp", ".o", ".log", ".md", ".js", ""};
+        len_names[i] = (size_t)snprintf(names[i], sizeof names[i], "name_%zu%s", i * 7919 % 1000, extensions[i % 8]);
+    }
+
+    IgnoreStats match_stats = {0};
+    size_t kept = 0;
+    uint64_t start = platform_time_ns();
+
+    for (int round = 0; round < MATCH_ROUNDS; round++)
+    {
+        for (size_t i = 0; i < 256; i++)
+            kept += ignore_keep(rules, "pkg_0/src", names[i], len_names[i], i % 5 ? FTI_FILE : FTI_DIRECTORY,
+                &match_stats);
+    }
+
+    uint64_t end = platform_time_ns();
+
+    if (kept != MATCH_ROUNDS * 256 - match_stats.pruned)
+        fprintf(stderr, "Kept %zu of %d names\n", kept, MATCH_ROUNDS * 256);
+
+    bench_report("ignore", "match", (double)(end - start) / (MATCH_ROUNDS * 256), "ns/entry");
+    bench_report("ignore", "match_evaluations", (double)match_stats.evaluations / (MATCH_ROUNDS * 256), "rules/entry");
+
+    ignore_cache_destroy(cache);
+
+    bench_change_dir(cwd);
+    bench_remove_tree(root);
+    free(root);
+    free(cwd);
+}
@@ -0,0 +1,116 @@
+#include "bench.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define FILES_PER_DIR 50
+#define DIRS_PER_DIR 8
+
+/* Builds a tree of nested directories holding `count` files in total, returns how many were made. */
+static size_t make_synthetic_tree(const char *dir, size_t count)
+{
+    char path[2 * FILENAME_LEN];
+    size_t made = 0;
+
+    bench_make_dir(dir);
+
+    for (size_t i = 0; i < FILES_PER_DIR && made < count; i++, made++)
+    {
+        snprintf(path, sizeof path, "%s%cfile_%zu.c", dir, PATH_SEPARATOR, i);
+        bench_make_file(path, 0);
+    }
+
+    for (size_t i = 0; i < DIRS_PER_DIR && made < count; i++)
+    {
+        size_t share = (count - made + DIRS_PER_DIR - 1 - i) / (DIRS_PER_DIR - i);
+        snprintf(path, sizeof path, "%s%cdir_%zu", dir, PATH_SEPARATOR, i);
+        made += make_synthetic_tree(path, share);
+    }
+
+    return made;
+}
+
+/* Usage: indexer [files [threads...]], defaults to 200k files crawled with 1, 2, 4 ... up to one thread per core. */
+void bench_indexer(int nargs, const char *argv[])
+{
+    size_t count = nargs > 0 ? (size_t)strtoull(argv[0], NULL, 10) : 200000;
+    char *cwd = bench_current_dir();
+    char *root = bench_make_temp_dir();
+    char name[64];
+
+    if (!root)
+    {
+        fprintf(stderr, "Could not create a temporary directory\n");
+        free(cwd);
+        return;
+    }
+
+    char path[2 * FILENAME_LEN];
+    snprintf(path, sizeof path, "%s%cw", root, PATH_SEPARATOR);
+    make_synthetic_tree(path, count);
+    bench_change_dir(path);
+
+    int thread_counts[16];
+    int nthread_counts = 0;
+
+    if (nargs > 1)
+    {
+        for (int i = 1; i < nargs && nthread_counts < 16; i++)
+            thread_counts[nthread_counts++] = atoi(argv[i]);
+    }
+    else
+    {
+        int cores = platform_cpu_count();
+        for (int n = 1; n < cores && nthread_counts < 15; n *= 2)
+            thread_counts[nthread_counts++] = n;
+        thread_counts[nthread_counts++] = cores;
+    }
+
+    for (int t = 0; t < nthread_counts; t++)
+    {
+        uint64_t best = UINT64_MAX;
+        size_t entries = 0;
+
+        for (int run = 0; run < 3; run++)
+        {
+            WorkspaceSnapshot snapshot;
+
+            uint64_t start = platform_time_ns();
+            ws_index(&snapshot, ".", thread_counts[t], NULL);
+            uint64_t end = platform_time_ns();
+
+            entries = snapshot.len;
+            if (end - start < best)
+                best = end - start;
+
+            ws_snapshot_free(&snapshot);
+        }
+
+        snprintf(name, sizeof name, "crawl_%zu_threads_%d", count, thread_counts[t]);
+        bench_report("indexer", name, (double)best / 1e6, "ms");
+        snprintf(name, sizeof name, "crawl_%zu_threads_%d_rate", count, thread_counts[t]);
+        bench_report("indexer", name, (double)entries / ((double)best / 1e9), "entries/s");
+    }
+
+    WorkspaceSnapshot snapshot;
+    ws_index(&snapshot, ".", 0, NULL);
+
+    FileTree tree = {.rows = FT_NONE};
+    uint64_t start = platform_time_ns();
+    ft_populate(&tree, &snapshot);
+    uint64_t end = platform_time_ns();
+
+    if (tree.len_nodes != snapshot.len)
+        fprintf(stderr, "Populated %zu nodes from %zu entries\n", tree.len_nodes, snapshot.len);
+
+    snprintf(name, sizeof name, "populate_%zu", count);
+    bench_report("indexer", name, (double)(end - start) / 1e6, "ms");
+
+    ft_uninit(&tree);
+    ws_snapshot_free(&snapshot);
+
+    bench_change_dir(cwd);
+    bench_remove_tree(root);
+    free(root);
+    free(cwd);
+}
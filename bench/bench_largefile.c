@@ -0,0 +1,171 @@
+#include "bench.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define WRITE_BLOCK (1 << 20)
+// About what fits in the editor pane
+#define FIRST_FRAME_LINES 80
+#define FRAME_MS 16
+
+/* Writes `size` bytes of lines up to 120 bytes long, a megabyte of them repeated, like a log file. */
+static bool make_log_file(const char *path, size_t size)
+{
+    FILE *f = fopen(path, "wb");
+    uint64_t state = 0x9e3779b97f4a7c15;
+
+    if (!f)
+        return false;
+
+    char *block = malloc(WRITE_BLOCK);
+
+    for (size_t i = 0, line = 0; i < WRITE_BLOCK; i++)
+    {
+        if (i == line)
+        {
+            state ^= state << 13;
+            state ^= state >> 7;
+            state ^= state << 17;
+            line += 1 + state % 120;
+        }
+        block[i] = i + 1 == line ? '\n' : (char)('a' + (i * 7 + state) % 26);
+    }
+
+    bool ok = true;
+    for (size_t left = size; left && ok; )
+    {
+        size_t n = left < WRITE_BLOCK ? left : WRITE_BLOCK;
+        ok = fwrite(block, 1, n, f) == n;
+        left -= n;
+    }
+
+    free(block);
+    return fclose(f) == 0 && ok;
+}
+
+/* What the first frame needs: where the lines on screen start and their bytes. */
+static size_t first_frame(Document *doc)
+{
+    static char screen[FIRST_FRAME_LINES * 256];
+
+    doc_poll(doc);
+
+    size_t end = doc_line_start(doc, FIRST_FRAME_LINES);
+    size_t len = end < sizeof screen ? end : sizeof screen;
+
+    return doc_read(doc, 0, screen, len);
+}
+
+/* Usage: largefile [gigabytes], defaults to a 4 GB file. */
+void bench_largefile(int nargs, const char *argv[])
+{
+    size_t gigabytes = nargs > 0 ? (size_t)strtoull(argv[0], NULL, 10) : 4;
+
+    // Nothing would be indexed or seeked in an empty file, and a size that is not a number reads as 0
+    if (gigabytes < 1)
+    {
+        fprintf(stderr, "The file has to be at least 1 GB, not '%s'\n", argv[0]);
+        return;
+    }
+
+    size_t size = gigabytes << 30;
+    char *root = bench_make_temp_dir();
+    char path[2 * FILENAME_LEN];
+    char name[64];
+
+    if (!root)
+    {
+        fprintf(stderr, "Could not create a temporary directory\n");
+        return;
+    }
+
+    snprintf(path, sizeof path, "%s%cbig.log", root, PATH_SEPARATOR);
+
+    if (!make_log_file(path, size))
+    {
+        fprintf(stderr, "Could not write %zu GB to %s\n", gigabytes, path);
+        bench_remove_tree(root);
+        free(root);
+        return;
+    }
+
+    // The file was just written so it is in the page cache, this leaves out the disk but not the page faults
+    Document doc;
+    size_t rss_before = platform_resident_memory();
+
+    uint64_t start = platform_time_ns();
+    bool loaded = doc_load(&doc, path);
+    if (loaded)
+        first_frame(&doc);
+    uint64_t end = platform_time_ns();
+
+    if (!loaded)
+    {
+        fprintf(stderr, "Could not open %s\n", path);
+        bench_remove_tree(root);
+        free(root);
+        return;
+    }
+
+    snprintf(name, sizeof name, "first_frame_%zuGB", gigabytes);
+    bench_report("largefile", name, (double)(end - start) / 1e6, "ms");
+    snprintf(name, sizeof name, "rss_first_frame_%zuGB", gigabytes);
+    bench_report("largefile", name, (double)(platform_resident_memory() - rss_before) / (1 << 20), "MB");
+
+    // Jumping most of the way down before the count gets there lands near the line rather than on it
+    size_t target = doc_line_count(&doc) / 10 * 9;
+
+    start = platform_time_ns();
+    size_t seek = doc_line_start(&doc, target);
+    end = platform_time_ns();
+
+    snprintf(name, sizeof name, "approximate_seek_%zuGB", gigabytes);
+    bench_report("largefile", name, (double)(end - start) / 1e3, "us");
+
+    // Polled once a frame, the way the editor would
+    size_t frames = 0;
+
+    start = platform_time_ns();
+    while (doc_poll(&doc))
+    {
+        bench_sleep_ms(FRAME_MS);
+        frames++;
+    }
+    doc_poll(&doc);
+    end = platform_time_ns();
+
+    snprintf(name, sizeof name, "index_%zuGB", gigabytes);
+    bench_report("largefile", name, (double)(end - start) / 1e6, "ms");
+    snprintf(name, sizeof name, "index_rate_%zuGB", gigabytes);
+    bench_report("largefile", name, (double)size / (1 << 30) / ((double)(end - start) / 1e9), "GB/s");
+    snprintf(name, sizeof name, "index_frames_%zuGB", gigabytes);
+    bench_report("largefile", name, (double)frames, "frames");
+
+    size_t line, column;
+    doc_position(&doc, seek, &line, &column);
+
+    snprintf(name, sizeof name, "seek_error_%zuGB", gigabytes);
+    bench_report("largefile", name, 100.0 * ((double)line - (double)target) / (double)doc_line_count(&doc), "%");
+
+    start = platform_time_ns();
+    seek = doc_line_start(&doc, target);
+    end = platform_time_ns();
+
+    snprintf(name, sizeof name, "exact_seek_%zuGB", gigabytes);
+    bench_report("largefile", name, (double)(end - start) / 1e3, "us");
+    snprintf(name, sizeof name, "rss_indexed_%zuGB", gigabytes);
+    bench_report("largefile", name, (double)(platform_resident_memory() - rss_before) / (1 << 20), "MB");
+
+    // Edits go to the add buffer and a few pieces, the file stays mapped and untouched
+    for (size_t i = 0; i < 10000; i++)
+        doc_insert(&doc, (seek + i * 4099) % doc_length(&doc), "edit", 4);
+
+    snprintf(name, sizeof name, "rss_edited_%zuGB", gigabytes);
+    bench_report("largefile", name, (double)(platform_resident_memory() - rss_before) / (1 << 20), "MB");
+    snprintf(name, sizeof name, "pieces_edited_%zuGB", gigabytes);
+    bench_report("largefile", name, (double)doc.len_nodes, "nodes");
+
+    doc_uninit(&doc);
+    bench_remove_tree(root);
+    free(root);
+}
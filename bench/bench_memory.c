@@ -0,0 +1,147 @@
+#include "bench.h"
+
+#include <stdio.h>
+
+#ifdef _WIN32
+#define DEFAULT_FONT "C:\\Windows\\Fonts\\consola.ttf"
+#else
+#define DEFAULT_FONT "/usr/share/fonts/truetype/dejavu/DejaVuSansMono.ttf"
+#endif
+
+#define ATLAS_WIDTH 1024
+#define ATLAS_HEIGHT 1024
+// The same shape of workspace as the render benchmark lists
+#define TREE_DIRS 16
+#define TREE_FILES 64
+
+/*
+ * Rasterises the printable ASCII the way the UI loads its code atlas, into memory counted as the fonts'.  Returns the
+ * glyphs' metrics, which the UI keeps, or NULL if the font could not be loaded.
+ */
+static GlyphInfo *load_atlas(const char *path)
+{
+    uint32_t codes['~' - ' ' + 1];
+    FontId face = font_create_face(path);
+
+    if (face < 0)
+        return NULL;
+
+    for (uint32_t c = ' '; c <= '~'; c++)
+        codes[c - ' '] = c;
+
+    size_t ncodes = sizeof codes / sizeof codes[0];
+    uint8_t *atlas = mem_calloc(MEM_FONTS, ATLAS_WIDTH * ATLAS_HEIGHT, 1);
+    GlyphInfo *glyphs = mem_alloc(MEM_FONTS, ncodes * sizeof *glyphs);
+    bool filled = font_atlas_fill(ATLAS_WIDTH, ATLAS_HEIGHT, atlas, ncodes, codes, face, glyphs, NULL);
+
+    // The pixels are the GL's once uploaded
+    mem_free(MEM_FONTS, atlas);
+    font_delete_face(face);
+
+    if (!filled)
+    {
+        mem_free(MEM_FONTS, glyphs);
+        return NULL;
+    }
+
+    return glyphs;
+}
+
+/* Lists a workspace of directories of files with every directory expanded. */
+static void load_tree(FileTree *tree, const char *root)
+{
+    char path[2 * FILENAME_LEN];
+
+    for (int d = 0; d < TREE_DIRS; d++)
+    {
+        snprintf(path, sizeof path, "%s%cmodule_%02d", root, PATH_SEPARATOR, d);
+        bench_make_dir(path);
+
+        for (int i = 0; i < TREE_FILES; i++)
+        {
+            snprintf(path, sizeof path, "%s%cmodule_%02d%csource_file_%03d.c", root, PATH_SEPARATOR, d, PATH_SEPARATOR,
+                     i);
+            bench_make_file(path, 0);
+        }
+    }
+
+    bench_change_dir(root);
+    ft_init(tree);
+
+    for (FileTreeIndex c = tree->nodes[FT_ROOT].first_child; c != FT_NONE; c = tree->nodes[c].next_sibling)
+        if (tree->nodes[c].flags & FTI_DIRECTORY)
+            ft_expand(tree, c);
+
+    while (ft_busy(tree))
+    {
+        ft_poll(tree);
+        bench_sleep_ms(1);
+    }
+    ft_poll(tree);
+}
+
+/*
+ * Usage: memory [font], defaults to the editor's monospaced font.  Loads a font atlas and an expanded file tree the way
+ * the editor does at startup, then reports what each allocation tag holds and how much of the process's memory that
+ * accounts for.  There is no GL here, so the GL tags stay empty.
+ */
+void bench_memory(int nargs, const char *argv[])
+{
+    const char *path = nargs > 0 ? argv[0] : DEFAULT_FONT;
+    char *cwd = bench_current_dir();
+    char *root = bench_make_temp_dir();
+    FileTree tree = {0};
+    GlyphInfo *glyphs = NULL;
+    PlatformMemoryUsage usage;
+    char name[64];
+    size_t heap = 0;
+
+    if (!root)
+    {
+        fprintf(stderr, "Could not create a temporary directory\n");
+        free(cwd);
+        return;
+    }
+
+    if (!font_init())
+        fprintf(stderr, "Failed to initialise the freetype library\n");
+    else if (!(glyphs = load_atlas(path)))
+        fprintf(stderr, "Could not load the font %s into an atlas\n", path);
+
+    load_tree(&tree, root);
+
+    for (int tag = 0; tag < NUM_MEM_TAGS; tag++)
+    {
+        MemStats stats = mem_stats(tag);
+
+        if (!stats.allocations)
+            continue;
+
+        snprintf(name, sizeof name, "%s_live", mem_tag_name(tag));
+        bench_report("memory", name, (double)stats.live / 1024, "KB");
+        snprintf(name, sizeof name, "%s_peak", mem_tag_name(tag));
+        bench_report("memory", name, (double)stats.peak / 1024, "KB");
+        snprintf(name, sizeof name, "%s_allocations", mem_tag_name(tag));
+        bench_report("memory", name, (double)stats.allocations, "allocations");
+
+        heap += stats.live;
+    }
+
+    if (platform_memory_usage(&usage))
+    {
+        bench_report("memory", "resident", (double)usage.resident / (1 << 20), "MB");
+        bench_report("memory", "proportional", (double)usage.proportional / (1 << 20), "MB");
+        bench_report("memory", "anonymous", (double)usage.anonymous / (1 << 20), "MB");
+        // What the tags do not explain: the C runtime, the libraries' own heaps and the benchmark itself
+        bench_report("memory", "anonymous_untagged", ((double)usage.anonymous - (double)heap) / (1 << 20), "MB");
+    }
+
+    ft_uninit(&tree);
+    mem_free(MEM_FONTS, glyphs);
+    font_uninit();
+
+    bench_change_dir(cwd);
+    bench_remove_tree(root);
+    free(root);
+    free(cwd);
+}
@@ -0,0 +1,212 @@
+#include "bench.h"
+
+#include <stdio.h>
+#include <string.h>
+
+// Directories this deep and this wide, with the files shared out evenly among them
+#define DEPTH 4
+#define DIRS_PER_DIR 8
+#define REPEATS 3
+
+static const char *const words[] = {
+    "src", "render", "font", "atlas", "buffer", "text", "core", "util", "test", "lib", "include", "platform", "linux",
+    "win32", "ui", "widget", "theme", "config", "parser", "lexer", "token", "index", "search", "tree", "node", "file",
+    "path", "input", "event", "window", "image", "cache", "memory", "thread", "pool", "queue", "log", "debug",
+};
+
+static const char *const extensions[] = {"c", "h", "cpp", "hpp", "md", "txt", "json", "py"};
+
+#define NUM_WORDS (sizeof words / sizeof words[0])
+#define NUM_EXTENSIONS (sizeof extensions / sizeof extensions[0])
+
+static uint64_t next_random(uint64_t *state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+static void add_entry(WorkspaceSnapshot *snapshot, uint32_t parent, const char *name, FileTreeItemFlags flags)
+{
+    size_t i = snapshot->len++;
+
+    snapshot->parent[i] = parent;
+    snapshot->name[i] = strarena_intern(&snapshot->strarena, name, strlen(name));
+    snapshot->flags[i] = (uint8_t)flags;
+    snapshot->size[i] = 0;
+    snapshot->mtime[i] = 0;
+}
+
+/* A workspace of `count` files laid out the way a crawl would list them, without touching the disk. */
+static void make_snapshot(WorkspaceSnapshot *snapshot, size_t count)
+{
+    size_t ndirs = 1;
+
+    for (size_t d = 0, width = 1; d < DEPTH; d++)
+        ndirs += width *= DIRS_PER_DIR;
+
+    size_t cap = ndirs + count;
+    uint64_t state = 0x9e3779b97f4a7c15;
+    char name[64];
+
+    *snapshot = (WorkspaceSnapshot){
+        .parent = malloc(cap * sizeof *snapshot->parent),
+        .name = malloc(cap * sizeof *snapshot->name),
+        .flags = malloc(cap * sizeof *snapshot->flags),
+        .size = malloc(cap * sizeof *snapshot->size),
+        .mtime = malloc(cap * sizeof *snapshot->mtime),
+    };
+    strarena_init(&snapshot->strarena);
+    add_entry(snapshot, 0, ".", FTI_DIRECTORY);
+
+    // Breadth first, so the children of each directory run together after everything listed before them
+    size_t made = 0;
+
+    for (size_t dir = 0; dir < ndirs; dir++)
+    {
+        size_t depth = 0;
+        for (size_t d = dir; d; d = snapshot->parent[d])
+            depth++;
+
+        if (depth < DEPTH)
+        {
+            for (size_t i = 0; i < DIRS_PER_DIR; i++)
+            {
+                snprintf(name, sizeof name, "%s_%zu", words[next_random(&state) % NUM_WORDS], i);
+                add_entry(snapshot, (uint32_t)dir, name, FTI_DIRECTORY);
+            }
+        }
+
+        // Files only in the deepest directories, which are all listed last
+        size_t leaves = ndirs - (ndirs - 1) / DIRS_PER_DIR;
+        size_t leaf = dir - (ndirs - leaves);
+        size_t share = depth == DEPTH ? (count - made) / (leaves - leaf) : 0;
+
+        for (size_t i = 0; i < share; i++, made++)
+        {
+            snprintf(name, sizeof name, "%s_%s%zu.%s", words[next_random(&state) % NUM_WORDS],
+                     words[next_random(&state) % NUM_WORDS], i, extensions[next_random(&state) % NUM_EXTENSIONS]);
+            add_entry(snapshot, (uint32_t)dir, name, FTI_FILE);
+        }
+    }
+}
+
+/* Types the query a character at a time, waiting out each one, and gives the slowest and the total. */
+static void type_query(QuickOpen *qo, const char *query, bool rescan, uint64_t *worst, uint64_t *total)
+{
+    size_t len = strlen(query);
+
+    *worst = 0;
+    *total = 0;
+
+    for (size_t i = 1; i <= len; i++)
+    {
+        // Going back to nothing first leaves no earlier matches to narrow from
+        if (rescan)
+        {
+            qo_set_query(qo, "", 0);
+            qo_wait(qo);
+        }
+
+        uint64_t start = platform_time_ns();
+        qo_set_query(qo, query, i);
+        qo_wait(qo);
+        uint64_t elapsed = platform_time_ns() - start;
+
+        *total += elapsed;
+        if (elapsed > *worst)
+            *worst = elapsed;
+    }
+}
+
+/* Usage: quickopen [files [threads [query]]], defaults to 2000000 files, one thread per core and "rendfontatlas". */
+void bench_quickopen(int nargs, const char *argv[])
+{
+    size_t count = nargs > 0 ? (size_t)strtoull(argv[0], NULL, 10) : 2000000;
+    int nthreads = nargs > 1 ? atoi(argv[1]) : 0;
+    const char *query = nargs > 2 ? argv[2] : "rendfontatlas";
+    size_t len_query = strlen(query);
+    WorkspaceSnapshot snapshot;
+    PathIndex index;
+
+    make_snapshot(&snapshot, count);
+
+    uint64_t start = platform_time_ns();
+    path_index_build(&index, &snapshot);
+    uint64_t end = platform_time_ns();
+
+    ws_snapshot_free(&snapshot);
+
+    bench_report("quickopen", "paths", (double)index.len, "paths");
+    bench_report("quickopen", "index_build", (double)(end - start) / 1e6, "ms");
+    double bytes = (double)index.offsets[index.len] + (double)index.len * (sizeof *index.offsets + sizeof *index.masks);
+    bench_report("quickopen", "index_size", bytes / (1 << 20), "MB");
+
+    QuickOpen *qo = qo_create_with_index(&index, nthreads);
+    uint64_t best_worst = UINT64_MAX, best_total = UINT64_MAX, worst, total;
+
+    for (int r = 0; r < REPEATS; r++)
+    {
+        qo_set_query(qo, "", 0);
+        type_query(qo, query, false, &worst, &total);
+
+        if (worst < best_worst)
+            best_worst = worst;
+        if (total < best_total)
+            best_total = total;
+    }
+
+    bench_report("quickopen", "keystroke_max", (double)best_worst / 1e6, "ms");
+    bench_report("quickopen", "keystroke_mean", (double)best_total / (double)len_query / 1e6, "ms");
+
+    QuickOpenMatch matches[QUICK_OPEN_MAX_RESULTS];
+    size_t nout, nmatches;
+
+    qo_poll(qo, matches, QUICK_OPEN_MAX_RESULTS, &nout, &nmatches);
+    bench_report("quickopen", "final_matches", (double)nmatches, "paths");
+
+    // Every character taken back lands on the matches kept for that query
+    uint64_t backspace = 0;
+
+    for (size_t i = len_query; i-- > 1;)
+    {
+        start = platform_time_ns();
+        qo_set_query(qo, query, i);
+        qo_poll(qo, matches, QUICK_OPEN_MAX_RESULTS, &nout, &nmatches);
+        end = platform_time_ns();
+
+        if (end - start > backspace)
+            backspace = end - start;
+    }
+
+    bench_report("quickopen", "backspace_max", (double)backspace / 1e6, "ms");
+    bench_report("quickopen", "first_char_matches", (double)nmatches, "paths");
+
+    best_worst = UINT64_MAX;
+    best_total = UINT64_MAX;
+
+    for (int r = 0; r < REPEATS; r++)
+    {
+        type_query(qo, query, true, &worst, &total);
+
+        if (worst < best_worst)
+            best_worst = worst;
+        if (total < best_total)
+            best_total = total;
+    }
+
+    bench_report("quickopen", "rescan_max", (double)best_worst / 1e6, "ms");
+    bench_report("quickopen", "rescan_mean", (double)best_total / (double)len_query / 1e6, "ms");
+
+    // A keystroke landing while the last one is still being matched
+    start = platform_time_ns();
+    qo_set_query(qo, "", 0);
+    qo_set_query(qo, query, 1);
+    qo_set_query(qo, query, len_query);
+    end = platform_time_ns();
+
+    bench_report("quickopen", "cancel", (double)(end - start) / 1e6, "ms");
+
+    qo_destroy(qo);
+}
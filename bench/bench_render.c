@@ -0,0 +1,353 @@
+#include "bench.h"
+
+#include <glad/gl.h>
+#include <GLFW/glfw3.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#define WINDOW_WIDTH 2000
+#define WINDOW_HEIGHT 1000
+// The same panels the editor lays out
+#define SIDE_PANEL_WIDTH 500
+#define FILE_TREE_CONTAINER_ID 1
+#define EDITOR_CONTAINER_ID 2
+#define MAX_LINE_SPANS 512
+// Quads pushed per sample, enough to fill the queue about a hundred times over
+#define QUADS 100000
+#define ATLAS_SIZE 256
+#define GLYPH_SIZE 16
+#define WARMUP 10
+#define SAMPLES 200
+#define FRAME_SAMPLES 500
+// The listing the frame draws: directories of files, and a source file far longer than the screen
+#define LISTING_DIRS 16
+#define LISTING_FILES 64
+#define LISTING_LINES 20000
+
+static uint64_t next_random(uint64_t *state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+/* Makes a window that is never shown, for a context to draw into.  Returns NULL if there is no display for it. */
+static GLFWwindow *open_window(void)
+{
+    if (!glfwInit())
+        return NULL;
+
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+
+    GLFWwindow *window = glfwCreateWindow(WINDOW_WIDTH, WINDOW_HEIGHT, "TheEditorBench", NULL, NULL);
+    if (!window)
+    {
+        glfwTerminate();
+        return NULL;
+    }
+
+    glfwMakeContextCurrent(window);
+    gladLoadGL(glfwGetProcAddress);
+    // Presenting is left to the driver's pacing in the editor, here only the work of a frame is of interest
+    glfwSwapInterval(0);
+
+    return window;
+}
+
+typedef struct {
+    int atlas;
+    uint64_t state;
+} Quads;
+
+static void push_textured(void *user)
+{
+    Quads *q = user;
+    int per_row = ATLAS_SIZE / GLYPH_SIZE;
+
+    for (int i = 0; i < QUADS; i++)
+    {
+        uint64_t r = next_random(&q->state);
+        Vec2 pos = {(float)(r % WINDOW_WIDTH), (float)(r >> 32 & 0xffff) * WINDOW_HEIGHT / 0x10000};
+
+        render_push_textured_quad(q->atlas, (int)(r >> 16 & 0xff) % (per_row * per_row), pos, COLOR_RGB(0xffffff), 1,
+                                  NULL);
+    }
+
+    render_draw();
+    glFinish();
+}
+
+static void push_colored(void *user)
+{
+    Quads *q = user;
+    FRect mask = {0, 0, WINDOW_WIDTH / 2, WINDOW_HEIGHT};
+
+    for (int i = 0; i < QUADS; i++)
+    {
+        uint64_t r = next_random(&q->state);
+        FRect where = {(float)(r % WINDOW_WIDTH), (float)(r >> 32 & 0xffff) * WINDOW_HEIGHT / 0x10000, 40, 20};
+
+        render_push_colored_quad(where, (Color)(r & 0xffffff00) | 0xff, 0, i & 1 ? &mask : NULL);
+    }
+
+    render_draw();
+    glFinish();
+}
+
+/* Queues quads in from random places, from an atlas of blank glyphs and in flat colors, drawing them all at the end. */
+static void time_quads(void)
+{
+    static uint8_t pixels[ATLAS_SIZE * ATLAS_SIZE];
+    int per_row = ATLAS_SIZE / GLYPH_SIZE;
+    Rect boxes[(ATLAS_SIZE / GLYPH_SIZE) * (ATLAS_SIZE / GLYPH_SIZE)];
+    uint64_t samples[SAMPLES];
+    Quads q = {.state = 0x2545f4914f6cdd1d};
+
+    for (int i = 0; i < per_row * per_row; i++)
+        boxes[i] = (Rect){i % per_row * GLYPH_SIZE, i / per_row * GLYPH_SIZE, GLYPH_SIZE, GLYPH_SIZE};
+    memset(pixels, 0xff, sizeof pixels);
+
+    q.atlas = render_init_texture_atlas(ATLAS_SIZE, ATLAS_SIZE, pixels, (size_t)(per_row * per_row), boxes);
+
+    bench_sample(push_textured, &q, WARMUP, samples, SAMPLES);
+    bench_report_timings("render", "push_textured_quad", samples, SAMPLES, QUADS, "ns");
+
+    bench_sample(push_colored, &q, WARMUP, samples, SAMPLES);
+    bench_report_timings("render", "push_colored_quad", samples, SAMPLES, QUADS, "ns");
+}
+
+typedef struct {
+    FileTree tree;
+    Document document;
+    Highlighter highlighter;
+} Listing;
+
+/* Writes a C file of functions with comments, strings and numbers, so every kind of span is on screen. */
+static bool make_source(const char *path, uint64_t *state)
+{
+    FILE *f = fopen(path, "wb");
+    if (!f)
+        return false;
+
+    for (int line = 0; line < LISTING_LINES; line++)
+    {
+        switch (line % 8)
+        {
+        case 0:
+            fprintf(f, "/* Step %d of the listing, which the frame draws some way down. */\n", line);
+            break;
+        case 1:
+            fprintf(f, "static int step_%d(const char *name, size_t len)\n", line);
+            break;
+        case 2:
+            fprintf(f, "{\n");
+            break;
+        case 3:
+            fprintf(f, "    int total = %d; // running\n", (int)(next_random(state) % 100000));
+            break;
+        case 4:
+            fprintf(f, "    if (len > %d && !strcmp(name, \"entry_%d\"))\n", (int)(next_random(state) % 512), line);
+            break;
+        case 5:
+            fprintf(f, "        total += (int)len * 0x%x;\n", (unsigned)(next_random(state) & 0xffff));
+            break;
+        case 6:
+            fprintf(f, "    return total;\n");
+            break;
+        default:
+            fprintf(f, "}\n");
+        }
+    }
+
+    fclose(f);
+    return true;
+}
+
+/* A workspace of directories of files with every directory expanded, and the source file open in the editor. */
+static bool make_listing(Listing *listing, const char *root)
+{
+    char path[2 * FILENAME_LEN];
+    uint64_t state = 11;
+
+    for (int d = 0; d < LISTING_DIRS; d++)
+    {
+        snprintf(path, sizeof path, "%s%cmodule_%02d", root, PATH_SEPARATOR, d);
+        bench_make_dir(path);
+
+        for (int i = 0; i < LISTING_FILES; i++)
+        {
+            snprintf(path, sizeof path, "%s%cmodule_%02d%csource_file_%03d.c", root, PATH_SEPARATOR, d, PATH_SEPARATOR,
+                     i);
+            bench_make_file(path, 0);
+        }
+    }
+
+    snprintf(path, sizeof path, "%s%clisting.c", root, PATH_SEPARATOR);
+    if (!make_source(path, &state) || !bench_change_dir(root))
+        return false;
+
+    ft_init(&listing->tree);
+    for (FileTreeIndex c = listing->tree.nodes[FT_ROOT].first_child; c != FT_NONE;
+         c = listing->tree.nodes[c].next_sibling)
+    {
+        if (listing->tree.nodes[c].flags & FTI_DIRECTORY)
+            ft_expand(&listing->tree, c);
+    }
+    while (ft_busy(&listing->tree))
+    {
+        ft_poll(&listing->tree);
+        bench_sleep_ms(1);
+    }
+    ft_poll(&listing->tree);
+
+    if (!doc_load(&listing->document, "listing.c"))
+        return false;
+    while (doc_poll(&listing->document))
+        bench_sleep_ms(1);
+
+    hl_init(&listing->highlighter, hl_language_for_path("listing.c"));
+
+    // Some way into both, so neither starts at its first row
+    ui_container_set_scroll(FILE_TREE_CONTAINER_ID, (Vec2){0, -20000});
+    ui_container_set_scroll(EDITOR_CONTAINER_ID, (Vec2){0, -180000});
+
+    return true;
+}
+
+/* A frame of the file tree and the editor laid out the way the editor's own render() does, until the GPU is done. */
+static void frame(void *user)
+{
+    Listing *listing = user;
+    const FileTree *tree = &listing->tree;
+    int id = FILE_TREE_CONTAINER_ID;
+
+    ui_begin();
+        ui_container_begin(C_SCROLLY, (FRect){0, 0, SIDE_PANEL_WIDTH, WINDOW_HEIGHT}, id);
+            ui_treelist_begin();
+            {
+                size_t nrows = ft_visible_count(tree);
+                size_t first, count;
+
+                ui_treelist_visible_rows(nrows, &first, &count);
+                ui_treelist_skip(first);
+
+                FileTreeIndex node = ft_visible_row(tree, first);
+                for (size_t row = 0; row < count && node != FT_NONE; row++, node = ft_next_visible(tree, node))
+                {
+                    const FileTreeItem *item = &tree->nodes[node];
+                    ui_treelist_item(item->depth, ft_name(tree, node), !!(item->flags & FTI_DIRECTORY),
+                                     id + 1 + (int)(first + row));
+                }
+
+                ui_treelist_skip(nrows - first - count);
+            }
+            ui_treelist_end();
+        ui_container_end();
+        ui_container_begin(C_SCROLLY, (FRect){SIDE_PANEL_WIDTH, 0, WINDOW_WIDTH - SIDE_PANEL_WIDTH, WINDOW_HEIGHT},
+                           EDITOR_CONTAINER_ID);
+            ui_code_begin();
+            {
+                size_t nlines = doc_line_count(&listing->document);
+                size_t first, count;
+                TokenSpan spans[MAX_LINE_SPANS];
+
+                ui_code_visible_lines(nlines, &first, &count);
+                ui_code_skip(first);
+
+                if (count)
+                    hl_update(&listing->highlighter, &listing->document, first + count - 1);
+
+                for (size_t line = first; line < first + count; line++)
+                {
+                    String text;
+                    size_t nspans = hl_line(&listing->highlighter, &listing->document, line, &text, spans,
+                                            MAX_LINE_SPANS);
+                    ui_code_line(text, spans, nspans);
+                }
+
+                ui_code_skip(nlines - first - count);
+            }
+            ui_code_end();
+        ui_container_end();
+    ui_end();
+
+    glFinish();
+}
+
+static void time_frame(void)
+{
+    char *cwd = bench_current_dir();
+    char *root = bench_make_temp_dir();
+    uint64_t *samples = malloc(FRAME_SAMPLES * sizeof *samples);
+    Listing listing = {0};
+
+    if (!root)
+    {
+        fprintf(stderr, "Could not create a temporary directory\n");
+        free(samples);
+        free(cwd);
+        return;
+    }
+
+    if (make_listing(&listing, root))
+    {
+        // The first frame rasterises the fonts, which the warmup takes care of
+        bench_sample(frame, &listing, WARMUP, samples, FRAME_SAMPLES);
+        bench_report_timings("render", "frame", samples, FRAME_SAMPLES, 1e3, "us");
+        bench_report("render", "frame_rows", (double)ft_visible_count(&listing.tree), "rows");
+
+        hl_uninit(&listing.highlighter);
+        doc_uninit(&listing.document);
+        ft_uninit(&listing.tree);
+    }
+    else
+    {
+        fprintf(stderr, "Could not make the listing in %s\n", root);
+    }
+
+    bench_change_dir(cwd);
+    bench_remove_tree(root);
+    free(root);
+    free(cwd);
+    free(samples);
+}
+
+/*
+ * Usage: render, in a hidden window.  Reports the cost of each quad queued, textured and flat, with the draws the full
+ * queue causes, then whole frames of the file tree and a highlighted source file drawn in the editor's own fonts.
+ */
+void bench_render(int nargs, const char *argv[])
+{
+    GLFWwindow *window = open_window();
+
+    if (!window)
+    {
+        fprintf(stderr, "Could not make an OpenGL 3.3 context, the render benchmarks need a display\n");
+        return;
+    }
+
+    if (!font_init())
+    {
+        fprintf(stderr, "Failed to initialise the freetype library\n");
+        glfwDestroyWindow(window);
+        glfwTerminate();
+        return;
+    }
+
+    render_init();
+    render_viewport((Rect){0, 0, WINDOW_WIDTH, WINDOW_HEIGHT});
+    ui_viewport(WINDOW_WIDTH, WINDOW_HEIGHT);
+
+    time_quads();
+    time_frame();
+
+    render_uninit();
+    font_uninit();
+    glfwDestroyWindow(window);
+    glfwTerminate();
+}
@@ -0,0 +1,230 @@
+#include "bench.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define COLUMNS 120
+#define ROWS 40
+// Output is made and fed this much at a time, rather than all of it held at once
+#define CHUNK (1 << 20)
+// A line in this many is copied as it is pushed, to check it comes back the same
+#define SAMPLE_EVERY 9973
+#define MAX_SAMPLES 4096
+#define PAGES 2000
+#define JUMPS 1000
+
+static uint64_t next_random(uint64_t *state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+static int compare_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static void report_percentiles(const char *name, uint64_t *samples, size_t n)
+{
+    char full[64];
+
+    qsort(samples, n, sizeof *samples, compare_u64);
+
+    snprintf(full, sizeof full, "%s_median", name);
+    bench_report("scrollback", full, (double)samples[n / 2] / 1e3, "us");
+    snprintf(full, sizeof full, "%s_p99", name);
+    bench_report("scrollback", full, (double)samples[n * 99 / 100] / 1e3, "us");
+    snprintf(full, sizeof full, "%s_max", name);
+    bench_report("scrollback", full, (double)samples[n - 1] / 1e3, "us");
+}
+
+typedef struct {
+    Scrollback *sb;
+    uint64_t pushed;
+    uint64_t sample_lines[MAX_SAMPLES];
+    TermCell *samples;
+    size_t nsamples;
+} Session;
+
+static void scrolled(void *user, const TermCell *cells, int columns)
+{
+    Session *session = user;
+
+    if (session->pushed % SAMPLE_EVERY == 0 && session->nsamples < MAX_SAMPLES)
+    {
+        session->sample_lines[session->nsamples] = session->pushed;
+        memcpy(&session->samples[session->nsamples++ * COLUMNS], cells, COLUMNS * sizeof *cells);
+    }
+
+    scrollback_push(session->sb, cells, columns);
+    session->pushed++;
+}
+
+static const char *const test_words[] = {
+    "parse", "render", "utf8", "search", "index", "empty", "long", "nested", "unicode", "scroll", "resize", "wide",
+    "invalid", "crlf", "tabs", "large", "ignore", "glob", "quoted", "escape", "partial", "overlap", "cursor", "color",
+};
+
+#define NUM_TEST_WORDS (sizeof test_words / sizeof test_words[0])
+
+/*
+ * Lines of a long build and test run: progress, colored warnings with positions and names that vary, and test
+ * results with their times.
+ */
+static size_t make_output(char *out, size_t cap, uint64_t *line, uint64_t *state)
+{
+    size_t len = 0;
+
+    while (cap - len > 512)
+    {
+        uint64_t n = (*line)++;
+        int percent = (int)(n / 1000 % 101);
+
+        switch (next_random(state) % 8)
+        {
+        case 0:
+            len += (size_t)snprintf(&out[len], cap - len,
+                                    "\x1b[1msrc/module_%llu.c:%d:%d: \x1b[35mwarning: \x1b[0m"
+                                    "unused variable 'len_%llu' [\x1b[35m-Wunused-variable\x1b[0m]\r\n",
+                                    (unsigned long long)(n % 5000), (int)(next_random(state) % 2000),
+                                    (int)(next_random(state) % 80), (unsigned long long)n);
+            break;
+        case 1:
+            len += (size_t)snprintf(&out[len], cap - len,
+                                    "\x1b[32m[%3d%%]\x1b[0m Linking C static library libpart_%llu.a\r\n", percent,
+                                    (unsigned long long)(n % 700));
+            break;
+        case 2:
+        case 3:
+        case 4:
+            len += (size_t)snprintf(&out[len], cap - len, "test_%s_%s_%s ... \x1b[32mok\x1b[0m (%d ms)\r\n",
+                                    test_words[next_random(state) % NUM_TEST_WORDS],
+                                    test_words[next_random(state) % NUM_TEST_WORDS],
+                                    test_words[next_random(state) % NUM_TEST_WORDS], (int)(next_random(state) % 900));
+            break;
+        default:
+            len += (size_t)snprintf(&out[len], cap - len,
+                                    "[%3d%%] Building C object src/CMakeFiles/TheEditor.dir/module_%llu.c.o\r\n",
+                                    percent, (unsigned long long)(n % 5000));
+        }
+    }
+
+    return len;
+}
+
+/* Whether cells look the same, colors the attributes say are the defaults not counting. */
+static bool same_cells(const TermCell *a, const TermCell *b, int columns)
+{
+    for (int x = 0; x < columns; x++)
+    {
+        if (a[x].codepoint != b[x].codepoint || a[x].attributes != b[x].attributes)
+            return false;
+        if (!(a[x].attributes & CELL_DEFAULT_FG) && a[x].fg != b[x].fg)
+            return false;
+        if (!(a[x].attributes & CELL_DEFAULT_BG) && a[x].bg != b[x].bg)
+            return false;
+    }
+
+    return true;
+}
+
+/* Reads a screenful of lines the way the console draws them when scrolled back. Returns the time it took. */
+static uint64_t read_page(Scrollback *sb, uint64_t top, TermCell *row)
+{
+    uint64_t start = platform_time_ns();
+
+    for (int i = 0; i < ROWS; i++)
+        scrollback_line(sb, top + i, row, COLUMNS);
+
+    return platform_time_ns() - start;
+}
+
+/*
+ * Usage: scrollback [million lines] [budget megabytes], defaults to 10 million lines of a build's output through a
+ * terminal into a 64 MB scrollback.  Reports the memory, then how long a screenful takes paging back from the end
+ * and jumping to anywhere kept.
+ */
+void bench_scrollback(int nargs, const char *argv[])
+{
+    uint64_t nlines = (nargs > 0 ? strtoull(argv[0], NULL, 10) : 10) * 1000000;
+    size_t budget = (size_t)(nargs > 1 ? strtoull(argv[1], NULL, 10) : 64) << 20;
+    Session *session = calloc(1, sizeof *session);
+    char *output = malloc(CHUNK);
+    TermCell row[COLUMNS];
+    Terminal term;
+    uint64_t state = 7, line = 0;
+
+    session->sb = scrollback_create(budget);
+    session->samples = malloc(MAX_SAMPLES * COLUMNS * sizeof *session->samples);
+
+    term_init(&term, COLUMNS, ROWS);
+    term.scrolled = scrolled;
+    term.scrolled_user = session;
+
+    uint64_t start = platform_time_ns();
+
+    while (session->pushed < nlines)
+    {
+        size_t len = make_output(output, CHUNK, &line, &state);
+        term_feed(&term, output, len);
+    }
+
+    double seconds = (double)(platform_time_ns() - start) / 1e9;
+    uint64_t first, end;
+
+    scrollback_range(session->sb, &first, &end);
+
+    size_t memory = scrollback_memory(session->sb);
+    double cells = (double)(end - first) * COLUMNS * sizeof(TermCell);
+
+    bench_report("scrollback", "push_rate", (double)session->pushed / seconds / 1e6, "Mlines/s");
+    bench_report("scrollback", "lines_pushed", (double)session->pushed, "lines");
+    bench_report("scrollback", "lines_kept", (double)(end - first), "lines");
+    bench_report("scrollback", "memory", (double)memory / (1 << 20), "MB");
+    bench_report("scrollback", "bytes_per_line", (double)memory / (double)(end - first), "B");
+    // What the kept lines would take as a grid of cells the width of the terminal
+    bench_report("scrollback", "as_cells", cells / (1 << 20), "MB");
+    bench_report("scrollback", "ratio_to_cells", cells / (double)memory, "x");
+
+    size_t checked = 0, mismatched = 0;
+    for (size_t i = 0; i < session->nsamples; i++)
+    {
+        if (session->sample_lines[i] < first)
+            continue;
+
+        scrollback_line(session->sb, session->sample_lines[i], row, COLUMNS);
+        mismatched += !same_cells(row, &session->samples[i * COLUMNS], COLUMNS);
+        checked++;
+    }
+    if (mismatched)
+        fprintf(stderr, "%zu of %zu sampled lines came back different\n", mismatched, checked);
+
+    // Paging back from the end, each page starting where the one before did
+    uint64_t *samples = malloc((PAGES > JUMPS ? PAGES : JUMPS) * sizeof *samples);
+    size_t npages = 0;
+    for (uint64_t top = end; npages < PAGES && top >= first + ROWS; npages++)
+    {
+        top -= ROWS;
+        samples[npages] = read_page(session->sb, top, row);
+    }
+    if (npages)
+        report_percentiles("page_back", samples, npages);
+
+    // Anywhere at all, which mostly means unpacking a block that is not cached
+    if (end - first >= ROWS)
+    {
+        for (size_t i = 0; i < JUMPS; i++)
+            samples[i] = read_page(session->sb, first + next_random(&state) % (end - first - ROWS + 1), row);
+        report_percentiles("jump", samples, JUMPS);
+    }
+
+    free(samples);
+    term_uninit(&term);
+    scrollback_destroy(session->sb);
+    free(session->samples);
+    free(session);
+    free(output);
+}
@@ -0,0 +1,203 @@
+#include "bench.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define BLOCK (1 << 20)
+// One line in this many has something to replace
+#define REPLACE_EVERY 64
+// Regular expressions without a literal run the whole program on every byte, they get a slice of the text
+#define SLOW_REGEX_BYTES (32ull << 20)
+#define EDITS 10000
+#define REPEATS 3
+
+static const char *const words[] = {
+    "int", "return", "buffer", "length", "errno", "value", "if", "else", "for", "while", "node", "index", "the",
+    "error", "count", "offset", "static", "const", "char", "size_t", "=", "+", "(", ")", "{", "}", ";", "0", "1",
+};
+
+#define NUM_WORDS (sizeof words / sizeof words[0])
+
+static uint64_t next_random(uint64_t *state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+/* Lines of source-like words with a date now and then, one megabyte of them repeated to fill the size. */
+static char *make_text(size_t len)
+{
+    char *text = malloc(len);
+    uint64_t state = 0x9e3779b97f4a7c15;
+    size_t at = 0, line = 0;
+    size_t len_block = len < BLOCK ? len : BLOCK;
+
+    while (at < len_block)
+    {
+        char buffer[256];
+        int n = 0;
+
+        if (line % REPLACE_EVERY == REPLACE_EVERY - 1)
+            n += snprintf(&buffer[n], sizeof buffer - n, "replace_me(%u); ", (unsigned)(next_random(&state) % 1000));
+        if (line % 16 == 0)
+            n += snprintf(&buffer[n], sizeof buffer - n, "// 2024-%02u-%02u ", (unsigned)(next_random(&state) % 12 + 1),
+                          (unsigned)(next_random(&state) % 28 + 1));
+
+        for (size_t k = next_random(&state) % 12; k; k--)
+            n += snprintf(&buffer[n], sizeof buffer - n, "%s ", words[next_random(&state) % NUM_WORDS]);
+        buffer[n++] = '\n';
+
+        size_t copy = (size_t)n < len_block - at ? (size_t)n : len_block - at;
+        memcpy(&text[at], buffer, copy);
+        at += copy;
+        line++;
+    }
+
+    for (size_t i = len_block; i < len; i += len_block)
+        memcpy(&text[i], text, len - i < len_block ? len - i : len_block);
+
+    return text;
+}
+
+/* The usual way without vector compares: memchr for the first byte, then the rest compared in place. */
+static size_t naive_find(const char *text, size_t len, const char *needle, size_t len_needle)
+{
+    for (const char *c = text; len_needle <= len - (size_t)(c - text);)
+    {
+        c = memchr(c, needle[0], len - len_needle - (size_t)(c - text) + 1);
+        if (!c)
+            break;
+        if (!memcmp(c, needle, len_needle))
+            return (size_t)(c - text);
+        c++;
+    }
+
+    return SIZE_MAX;
+}
+
+/* Runs the search over the buffer, counting every match, and reports the best of a few runs. */
+static size_t time_buffer(const char *name, const char *pattern, SearchFlags flags, const char *text, size_t len)
+{
+    Search *search = search_create(pattern, strlen(pattern), flags);
+    uint64_t best = UINT64_MAX;
+    size_t matches = 0;
+
+    for (int r = 0; r < REPEATS; r++)
+    {
+        DocRange match = {0};
+        matches = 0;
+
+        uint64_t start = platform_time_ns();
+        for (size_t from = 0; search_buffer(search, text, len, from, &match); matches++)
+            from = match.offset + match.len + !match.len;
+        uint64_t elapsed = platform_time_ns() - start;
+
+        if (elapsed < best)
+            best = elapsed;
+    }
+
+    bench_report("search", name, (double)len / (1 << 30) / ((double)best / 1e9), "GB/s");
+    search_destroy(search);
+
+    return matches;
+}
+
+/* Usage: search [megabytes], defaults to 500. */
+void bench_search(int nargs, const char *argv[])
+{
+    size_t megabytes = nargs > 0 ? (size_t)strtoull(argv[0], NULL, 10) : 500;
+    size_t len = megabytes << 20;
+    char *text = make_text(len);
+    char name[64];
+
+    // Nothing to find, so these go over every byte: what a search that turns up nothing costs
+    const char *absent = "errno_overflow";
+    uint64_t best = UINT64_MAX;
+
+    for (int r = 0; r < REPEATS; r++)
+    {
+        uint64_t start = platform_time_ns();
+        if (naive_find(text, len, absent, strlen(absent)) != SIZE_MAX)
+            fprintf(stderr, "Found %s, which is not in the text\n", absent);
+        uint64_t elapsed = platform_time_ns() - start;
+
+        if (elapsed < best)
+            best = elapsed;
+    }
+
+    bench_report("search", "memchr_literal", (double)len / (1 << 30) / ((double)best / 1e9), "GB/s");
+
+    time_buffer("literal", absent, 0, text, len);
+    time_buffer("literal_ignore_case", "ERRNO_OVERFLOW", SEARCH_IGNORE_CASE, text, len);
+    time_buffer("regex_literal", "errno_over(flow|run)", SEARCH_REGEX, text, len);
+
+    size_t matches = time_buffer("literal_matches", "replace_me", 0, text, len);
+    bench_report("search", "matches", (double)matches, "matches");
+    time_buffer("regex_matches", "replace_me\\(\\d+\\)", SEARCH_REGEX, text, len);
+
+    size_t slow = len < SLOW_REGEX_BYTES ? len : SLOW_REGEX_BYTES;
+    time_buffer("regex_no_literal", "[0-9]{4}-[0-9]{2}-[0-9]{2}", SEARCH_REGEX, text, slow);
+
+    // The same text as a document that has been edited here and there, searched through its pieces in place
+    char *copy = malloc(len);
+    memcpy(copy, text, len);
+    free(text);
+
+    Document doc;
+    uint64_t state = 7;
+    doc_init(&doc, copy, len);
+
+    for (size_t i = 0; i < EDITS; i++)
+        doc_insert(&doc, (size_t)(next_random(&state) % doc_length(&doc)), "edit ", 5);
+
+    Search *search = search_create(absent, strlen(absent), 0);
+    DocRange match;
+
+    uint64_t start = platform_time_ns();
+    if (search_document(search, &doc, 0, &match))
+        fprintf(stderr, "Found %s, which is not in the document\n", absent);
+    uint64_t end = platform_time_ns();
+
+    double gigabytes = (double)doc_length(&doc) / (1 << 30);
+    bench_report("search", "document_literal", gigabytes / ((double)(end - start) / 1e9), "GB/s");
+    bench_report("search", "document_pieces", (double)doc.len_nodes, "nodes");
+    search_destroy(search);
+
+    // Replacing everything at once, against the same replacements made one edit at a time
+    search = search_create("replace_me", strlen("replace_me"), 0);
+    DocSnapshot before = doc_snapshot(&doc);
+
+    start = platform_time_ns();
+    size_t replaced = search_replace_all(search, &doc, "replaced", strlen("replaced"));
+    end = platform_time_ns();
+
+    snprintf(name, sizeof name, "replace_all_%zuMB", megabytes);
+    bench_report("search", name, (double)(end - start) / 1e6, "ms");
+    bench_report("search", "replace_all_pieces", (double)doc.len_nodes, "nodes");
+
+    doc_restore(&doc, before);
+    doc_release(&doc, before);
+
+    // Found first so only the edits are timed, from the end back so the offsets before each edit stay put
+    DocRange *found = malloc(replaced * sizeof *found);
+    size_t nfound = 0;
+    for (size_t from = 0; nfound < replaced && search_document(search, &doc, from, &found[nfound]); nfound++)
+        from = found[nfound].offset + found[nfound].len;
+
+    start = platform_time_ns();
+    for (size_t i = nfound; i-- > 0;)
+    {
+        doc_delete(&doc, found[i].offset, found[i].len);
+        doc_insert(&doc, found[i].offset, "replaced", strlen("replaced"));
+    }
+    end = platform_time_ns();
+
+    snprintf(name, sizeof name, "replace_each_%zuMB", megabytes);
+    bench_report("search", name, (double)(end - start) / 1e6, "ms");
+
+    free(found);
+    search_destroy(search);
+    doc_uninit(&doc);
+}
@@ -0,0 +1,162 @@
+#include "bench.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define FILES_PER_DIR 50
+#define DIRS_PER_DIR 8
+// About what fits in the side panel
+#define FIRST_FRAME_ROWS 64
+#define SNAPSHOT_PATH "tree.snapshot"
+
+/* Builds a tree of nested directories holding `count` files in total, returns how many were made. */
+static size_t make_synthetic_tree(const char *dir, size_t count)
+{
+    char path[2 * FILENAME_LEN];
+    size_t made = 0;
+
+    bench_make_dir(dir);
+
+    for (size_t i = 0; i < FILES_PER_DIR && made < count; i++, made++)
+    {
+        snprintf(path, sizeof path, "%s%cfile_%zu.c", dir, PATH_SEPARATOR, i);
+        bench_make_file(path, 0);
+    }
+
+    for (size_t i = 0; i < DIRS_PER_DIR && made < count; i++)
+    {
+        size_t share = (count - made + DIRS_PER_DIR - 1 - i) / (DIRS_PER_DIR - i);
+        snprintf(path, sizeof path, "%s%cdir_%zu", dir, PATH_SEPARATOR, i);
+        made += make_synthetic_tree(path, share);
+    }
+
+    return made;
+}
+
+static void wait_idle(FileTree *tree)
+{
+    while (ft_busy(tree))
+        ft_poll(tree);
+}
+
+/* What the first frame needs from the tree: the row count, and the names of the rows on screen. */
+static size_t first_frame(FileTree *tree, size_t first_row)
+{
+    size_t bytes = 0;
+
+    ft_poll(tree);
+
+    size_t nrows = ft_visible_count(tree);
+    FileTreeIndex node = ft_visible_row(tree, first_row < nrows ? first_row : 0);
+
+    for (size_t row = 0; row < FIRST_FRAME_ROWS && node != FT_NONE; row++, node = ft_next_visible(tree, node))
+        bytes += ft_name(tree, node).length + (size_t)tree->nodes[node].depth;
+
+    return bytes;
+}
+
+/* Usage: snapshot [files], defaults to 200k files saved and loaded with none, a tenth and all the directories open. */
+void bench_snapshot(int nargs, const char *argv[])
+{
+    size_t count = nargs > 0 ? (size_t)strtoull(argv[0], NULL, 10) : 200000;
+    char *cwd = bench_current_dir();
+    char *root = bench_make_temp_dir();
+    char name[64];
+
+    if (!root)
+    {
+        fprintf(stderr, "Could not create a temporary directory\n");
+        free(cwd);
+        return;
+    }
+
+    char path[2 * FILENAME_LEN];
+    snprintf(path, sizeof path, "%s%cw", root, PATH_SEPARATOR);
+    make_synthetic_tree(path, count);
+    bench_change_dir(path);
+
+    WorkspaceSnapshot workspace;
+    ws_index(&workspace, ".", 0, NULL);
+
+    // Without a snapshot, the first frame only has the root listing to show
+    FileTree tree = {.rows = FT_NONE};
+    uint64_t start = platform_time_ns();
+    ft_init(&tree);
+    first_frame(&tree, 0);
+    uint64_t end = platform_time_ns();
+    bench_report("snapshot", "first_frame_fresh", (double)(end - start) / 1e3, "us");
+
+    static const int open_percents[] = {0, 10, 100};
+
+    for (size_t p = 0; p < sizeof open_percents / sizeof open_percents[0]; p++)
+    {
+        int percent = open_percents[p];
+
+        ft_populate(&tree, &workspace);
+
+        // Opening a directory lists it again, so the tree is only saved once every listing is back
+        size_t ndirs = 0;
+        for (FileTreeIndex x = 1; x < tree.len_nodes; x++)
+            if ((tree.nodes[x].flags & FTI_DIRECTORY) && ndirs++ % 100 < (size_t)percent)
+                ft_expand(&tree, x);
+        wait_idle(&tree);
+
+        size_t nrows = ft_visible_count(&tree);
+        float scroll = (float)(nrows / 2);
+
+        start = platform_time_ns();
+        bool saved = ft_save(&tree, SNAPSHOT_PATH, scroll);
+        end = platform_time_ns();
+
+        ft_uninit(&tree);
+
+        PlatformFileMap map = {0};
+        if (!saved || !platform_map_file(SNAPSHOT_PATH, &map))
+        {
+            fprintf(stderr, "Could not save the tree with %d%% open\n", percent);
+            continue;
+        }
+
+        snprintf(name, sizeof name, "save_%zu_open_%d", count, percent);
+        bench_report("snapshot", name, (double)(end - start) / 1e6, "ms");
+        snprintf(name, sizeof name, "size_%zu_open_%d", count, percent);
+        bench_report("snapshot", name, (double)map.size / (1 << 20), "MB");
+        snprintf(name, sizeof name, "rows_%zu_open_%d", count, percent);
+        bench_report("snapshot", name, (double)nrows, "rows");
+        platform_unmap_file(&map);
+
+        // The file was just written so it is in the page cache, this leaves out the disk but not the page faults
+        start = platform_time_ns();
+        bool loaded = ft_load(&tree, SNAPSHOT_PATH, &scroll);
+        if (loaded)
+            first_frame(&tree, (size_t)scroll);
+        end = platform_time_ns();
+
+        if (!loaded || ft_visible_count(&tree) != nrows)
+        {
+            fprintf(stderr, "Loaded %zu of %zu rows with %d%% open\n", loaded ? ft_visible_count(&tree) : 0, nrows,
+                    percent);
+            continue;
+        }
+
+        snprintf(name, sizeof name, "first_frame_%zu_open_%d", count, percent);
+        bench_report("snapshot", name, (double)(end - start) / 1e3, "us");
+
+        // Every directory that was watched is watched again and compared, nothing changed so none is listed
+        start = platform_time_ns();
+        wait_idle(&tree);
+        end = platform_time_ns();
+
+        snprintf(name, sizeof name, "catch_up_%zu_open_%d", count, percent);
+        bench_report("snapshot", name, (double)(end - start) / 1e6, "ms");
+    }
+
+    ft_uninit(&tree);
+    ws_snapshot_free(&workspace);
+    remove(SNAPSHOT_PATH);
+
+    bench_change_dir(cwd);
+    bench_remove_tree(root);
+    free(root);
+    free(cwd);
+}
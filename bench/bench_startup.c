@@ -0,0 +1,270 @@
+#include "bench.h"
+
+#include <stdio.h>
+
+// The fonts the UI rasterises before its first frame
+#ifdef _WIN32
+#define TREE_FONT "C:\\Windows\\Fonts\\segoeui.ttf"
+#define TREE_FONT_BOLD "C:\\Windows\\Fonts\\segoeuib.ttf"
+#define CODE_FONT "C:\\Windows\\Fonts\\consola.ttf"
+#else
+#define TREE_FONT "/usr/share/fonts/truetype/dejavu/DejaVuSans.ttf"
+#define TREE_FONT_BOLD "/usr/share/fonts/truetype/dejavu/DejaVuSans-Bold.ttf"
+#define CODE_FONT "/usr/share/fonts/truetype/dejavu/DejaVuSansMono.ttf"
+#endif
+
+#define TREE_ATLAS_WIDTH 2048
+#define TREE_ATLAS_HEIGHT 1024
+#define CODE_ATLAS_WIDTH 1024
+#define CODE_ATLAS_HEIGHT 1024
+// A workspace's top level, about as busy as a large repository's
+#define ROOT_DIRS 32
+#define ROOT_FILES 512
+#define DIR_FILES 64
+#define WARMUP 2
+#define SAMPLES 20
+
+/* The codepoints the editor's atlases are made of, the same ranges the UI rasterises. */
+static const struct {
+    uint32_t first, last;
+} ranges[] = {
+    {' ', '~'},
+    {0xa0, 0x17f},
+    {0x391, 0x3c9},
+    {0x400, 0x45f},
+    {UTF8_REPLACEMENT, UTF8_REPLACEMENT},
+};
+
+#define NUM_RANGES (sizeof ranges / sizeof ranges[0])
+
+typedef struct {
+    uint32_t *codes;
+    size_t ncodes;
+    uint8_t *tree_atlas, *code_atlas;
+    GlyphInfo *glyphs;
+    bool failed;
+} Fonts;
+
+typedef struct {
+    FileTree tree;
+    const char *snapshot;
+    float scroll;
+} Tree;
+
+typedef enum {
+    STAGE_FONTS = 1 << 0,
+    STAGE_TREE = 1 << 1,
+} Stages;
+
+static bool fill(size_t width, size_t height, uint8_t *atlas, Fonts *f, const char *path, GlyphInfo *glyphs,
+                 FontAtlasFillState *state)
+{
+    FontId face = font_create_face(path);
+
+    if (face < 0)
+        return false;
+
+    bool filled = font_atlas_fill(width, height, atlas, f->ncodes, f->codes, face, glyphs, state);
+
+    font_delete_face(face);
+    return filled;
+}
+
+/* What the UI rasterises before its first frame: both weights of the tree's font in one atlas, and the code font. */
+static void load_fonts(void *arg)
+{
+    Fonts *f = arg;
+    FontAtlasFillState tree_state = {0}, code_state = {0};
+
+    if (!font_init())
+    {
+        f->failed = true;
+        return;
+    }
+
+    f->failed = !fill(TREE_ATLAS_WIDTH, TREE_ATLAS_HEIGHT, f->tree_atlas, f, TREE_FONT, f->glyphs, &tree_state)
+             || !fill(TREE_ATLAS_WIDTH, TREE_ATLAS_HEIGHT, f->tree_atlas, f, TREE_FONT_BOLD, &f->glyphs[f->ncodes],
+                      &tree_state)
+             || !fill(CODE_ATLAS_WIDTH, CODE_ATLAS_HEIGHT, f->code_atlas, f, CODE_FONT, &f->glyphs[2 * f->ncodes],
+                      &code_state);
+}
+
+/* The workspace's tree restored from its snapshot if there is one, or else its top level listed. */
+static void load_tree(void *arg)
+{
+    Tree *t = arg;
+
+    if (!t->snapshot || !ft_load(&t->tree, t->snapshot, &t->scroll))
+        ft_init(&t->tree);
+}
+
+/* Starts the stages, one after another or alongside each other, and says how long it took. */
+static uint64_t cold_start(Stages stages, Fonts *fonts, const char *snapshot, bool concurrent)
+{
+    Startup *startup = startup_create();
+    Tree tree = {.snapshot = snapshot};
+
+    if (concurrent)
+    {
+        if (stages & STAGE_FONTS)
+            startup_spawn(startup, "fonts", load_fonts, fonts);
+        if (stages & STAGE_TREE)
+            startup_spawn(startup, "file tree", load_tree, &tree);
+        startup_join(startup);
+    }
+    else
+    {
+        if (stages & STAGE_FONTS)
+        {
+            startup_begin(startup, "fonts");
+            load_fonts(fonts);
+            startup_end(startup);
+        }
+
+        if (stages & STAGE_TREE)
+        {
+            startup_begin(startup, "file tree");
+            load_tree(&tree);
+            startup_end(startup);
+        }
+    }
+
+    uint64_t elapsed = startup_elapsed(startup);
+
+    startup_destroy(startup);
+    if (stages & STAGE_TREE)
+        ft_uninit(&tree.tree);
+    if (stages & STAGE_FONTS)
+        font_uninit();
+
+    return elapsed;
+}
+
+static void make_workspace(const char *root)
+{
+    char path[2 * FILENAME_LEN];
+
+    for (int d = 0; d < ROOT_DIRS; d++)
+    {
+        snprintf(path, sizeof path, "%s%cdir_%02d", root, PATH_SEPARATOR, d);
+        bench_make_dir(path);
+
+        for (int i = 0; i < DIR_FILES; i++)
+        {
+            snprintf(path, sizeof path, "%s%cdir_%02d%cfile_%03d.c", root, PATH_SEPARATOR, d, PATH_SEPARATOR, i);
+            bench_make_file(path, 0);
+        }
+    }
+
+    for (int i = 0; i < ROOT_FILES; i++)
+    {
+        snprintf(path, sizeof path, "%s%cfile_%03d.c", root, PATH_SEPARATOR, i);
+        bench_make_file(path, 0);
+    }
+}
+
+/* Saves the workspace's tree with every directory expanded, as it would have been left. */
+static bool save_snapshot(const char *path)
+{
+    FileTree tree = {0};
+
+    ft_init(&tree);
+
+    for (FileTreeIndex c = tree.nodes[FT_ROOT].first_child; c != FT_NONE; c = tree.nodes[c].next_sibling)
+        if (tree.nodes[c].flags & FTI_DIRECTORY)
+            ft_expand(&tree, c);
+
+    while (ft_busy(&tree))
+    {
+        ft_poll(&tree);
+        bench_sleep_ms(1);
+    }
+    ft_poll(&tree);
+
+    bool saved = ft_save(&tree, path, 0.0f);
+
+    ft_uninit(&tree);
+    return saved;
+}
+
+static void report(const char *name, Stages stages, Fonts *fonts, const char *snapshot, bool concurrent)
+{
+    uint64_t samples[SAMPLES];
+
+    fonts->failed = false;
+
+    for (int i = 0; i < WARMUP; i++)
+        cold_start(stages, fonts, snapshot, concurrent);
+
+    for (int i = 0; i < SAMPLES; i++)
+        samples[i] = cold_start(stages, fonts, snapshot, concurrent);
+
+    if ((stages & STAGE_FONTS) && fonts->failed)
+        fprintf(stderr, "Could not rasterise the fonts, %s does not include them\n", name);
+
+    bench_report_timings("startup", name, samples, SAMPLES, 1e6, "ms");
+}
+
+/*
+ * Usage: startup.  Times what the editor starts alongside making its window, the fonts rasterised and the file tree
+ * either listed afresh or restored from its snapshot, one after another and then on threads of their own as the editor
+ * runs them.  Making the window and compiling the shaders needs a display, so it is left out, and what the threads
+ * save is what those have to cover.
+ */
+void bench_startup(int nargs, const char *argv[])
+{
+    char *cwd = bench_current_dir();
+    char *root = bench_make_temp_dir();
+    char snapshot[2 * FILENAME_LEN];
+    Fonts fonts = {0};
+
+    if (!root)
+    {
+        fprintf(stderr, "Could not create a temporary directory\n");
+        free(cwd);
+        return;
+    }
+
+    for (size_t r = 0; r < NUM_RANGES; r++)
+        fonts.ncodes += ranges[r].last - ranges[r].first + 1;
+
+    fonts.codes = malloc(fonts.ncodes * sizeof *fonts.codes);
+    for (size_t r = 0, n = 0; r < NUM_RANGES; r++)
+        for (uint32_t c = ranges[r].first; c <= ranges[r].last; c++)
+            fonts.codes[n++] = c;
+
+    fonts.tree_atlas = malloc(TREE_ATLAS_WIDTH * TREE_ATLAS_HEIGHT);
+    fonts.code_atlas = malloc(CODE_ATLAS_WIDTH * CODE_ATLAS_HEIGHT);
+    fonts.glyphs = malloc(3 * fonts.ncodes * sizeof *fonts.glyphs);
+
+    make_workspace(root);
+    bench_change_dir(root);
+    snprintf(snapshot, sizeof snapshot, "%s%ctree.snapshot", root, PATH_SEPARATOR);
+
+    // Each stage by itself first, the longest being as short as starting them all can be
+    report("fonts", STAGE_FONTS, &fonts, NULL, false);
+    report("tree_listed", STAGE_TREE, &fonts, NULL, false);
+    report("listed_serial", STAGE_FONTS | STAGE_TREE, &fonts, NULL, false);
+    report("listed_concurrent", STAGE_FONTS | STAGE_TREE, &fonts, NULL, true);
+
+    if (save_snapshot(snapshot))
+    {
+        report("tree_restored", STAGE_TREE, &fonts, snapshot, false);
+        report("restored_serial", STAGE_FONTS | STAGE_TREE, &fonts, snapshot, false);
+        report("restored_concurrent", STAGE_FONTS | STAGE_TREE, &fonts, snapshot, true);
+    }
+    else
+    {
+        fprintf(stderr, "Could not save the tree's snapshot to %s\n", snapshot);
+    }
+
+    free(fonts.glyphs);
+    free(fonts.code_atlas);
+    free(fonts.tree_atlas);
+    free(fonts.codes);
+
+    bench_change_dir(cwd);
+    bench_remove_tree(root);
+    free(root);
+    free(cwd);
+}
@@ -0,0 +1,62 @@
+#include "bench.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define ENTRIES_PER_PACKAGE 20
+
+static const char *common_names[] = {
+    "src", "include", "CMakeLists.txt", "index.js", "package.json", "README.md", "LICENSE", ".gitignore",
+};
+
+#define NUM_COMMON (sizeof common_names / sizeof common_names[0])
+
+/* Names shaped like a workspace of many small packages: a few names in every one, and a shared pool of the rest. */
+static size_t synthetic_name(size_t i, char *buffer, size_t size)
+{
+    size_t package = i / ENTRIES_PER_PACKAGE;
+    size_t entry = i % ENTRIES_PER_PACKAGE;
+
+    if (entry == 0)
+        return snprintf(buffer, size, "package_%zu", package);
+    if (entry <= NUM_COMMON)
+        return snprintf(buffer, size, "%s", common_names[entry - 1]);
+
+    return snprintf(buffer, size, "module_%zu.js", (package * 31 + entry * 7) % 2000);
+}
+
+/* Usage: strarena [entries], defaults to a 1M file workspace. */
+void bench_strarena(int nargs, const char *argv[])
+{
+    size_t count = nargs > 0 ? (size_t)strtoull(argv[0], NULL, 10) : 1000000;
+    char name[64];
+    size_t len_names = 0;
+
+    StringArena arena;
+    strarena_init(&arena);
+    StringHandle *handles = malloc(count * sizeof *handles);
+
+    uint64_t start = platform_time_ns();
+    for (size_t i = 0; i < count; i++)
+    {
+        size_t len = synthetic_name(i, name, sizeof name);
+        len_names += len;
+        handles[i] = strarena_intern(&arena, name, len);
+    }
+    uint64_t end = platform_time_ns();
+
+    // The old arena kept every name, grown by doubling, and each item held a pointer and a length
+    size_t old_arena = STRARENA_FIRST_CHUNK;
+    while (old_arena < len_names)
+        old_arena *= 2;
+    size_t before = old_arena + count * (sizeof(const char *) + sizeof(size_t));
+    size_t after = strarena_memory(&arena) + count * sizeof *handles;
+
+    bench_report("strarena", "intern", (double)(end - start) / (double)count, "ns/name");
+    bench_report("strarena", "unique_names", (double)arena.len_table, "names");
+    bench_report("strarena", "memory_before", (double)before / (1024.0 * 1024.0), "MiB");
+    bench_report("strarena", "memory_after", (double)after / (1024.0 * 1024.0), "MiB");
+
+    free(handles);
+    strarena_uninit(&arena);
+}
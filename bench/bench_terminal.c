@@ -0,0 +1,522 @@
+#include "bench.h"
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#define COLUMNS 120
+#define ROWS 40
+// About what a pty hands over at once
+#define CHUNK 4096
+#define REPEATS 3
+// The screen the recorded captures are played onto, small enough to write out whole
+#define CAPTURE_COLUMNS 20
+#define CAPTURE_ROWS 6
+#define CAPTURE_STYLES 10
+
+static uint64_t next_random(uint64_t *state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+typedef struct {
+    char *data;
+    size_t len, cap;
+} Output;
+
+static void out_append(Output *out, const char *data, size_t len)
+{
+    if (out->len + len > out->cap)
+    {
+        out->cap = 2 * (out->len + len);
+        out->data = realloc(out->data, out->cap);
+    }
+
+    memcpy(&out->data[out->len], data, len);
+    out->len += len;
+}
+
+static void out_puts(Output *out, const char *text)
+{
+    out_append(out, text, strlen(text));
+}
+
+static void out_printf(Output *out, const char *format, ...)
+{
+    char buffer[512];
+    va_list args;
+
+    va_start(args, format);
+    int n = vsnprintf(buffer, sizeof buffer, format, args);
+    va_end(args);
+
+    out_append(out, buffer, (size_t)n < sizeof buffer ? (size_t)n : sizeof buffer - 1);
+}
+
+static const char *const words[] = {
+    "cc", "-O2", "-c", "src/document.c", "-o", "build/document.o", "warning:", "unused", "variable", "'len'",
+    "[-Wunused-variable]", "note:", "in", "expansion", "of", "macro", "Linking", "target", "TheEditor", "done",
+};
+
+static const char *const unicode_words[] = {
+    "naïve", "café", "Größe", "élève", "Łódź", "文字", "编辑器", "ファイル", "検索", "→", "✓", "…", "the", "and",
+};
+
+#define NUM_WORDS(words) (sizeof words / sizeof words[0])
+
+/* What a build prints, plain lines of words. */
+static void make_plain(Output *out, size_t len, uint64_t *state)
+{
+    while (out->len < len)
+    {
+        for (size_t k = 1 + next_random(state) % 14; k; k--)
+            out_printf(out, "%s ", words[next_random(state) % NUM_WORDS(words)]);
+        out_puts(out, "\r\n");
+    }
+}
+
+/* The same with a colored progress column and highlighted words, in all three ways of giving a color. */
+static void make_color(Output *out, size_t len, uint64_t *state)
+{
+    while (out->len < len)
+    {
+        out_printf(out, "\x1b[1;32m[%3d%%]\x1b[0m ", (int)(next_random(state) % 101));
+
+        for (size_t k = next_random(state) % 12; k; k--)
+        {
+            const char *word = words[next_random(state) % NUM_WORDS(words)];
+
+            switch (next_random(state) % 5)
+            {
+            case 0:
+                out_printf(out, "\x1b[36m%s\x1b[39m ", word);
+                break;
+            case 1:
+                out_printf(out, "\x1b[38;5;%dm%s\x1b[m ", (int)(next_random(state) % 256), word);
+                break;
+            case 2:
+                out_printf(out, "\x1b[38;2;%d;%d;%dm%s\x1b[0m ", (int)(next_random(state) % 256),
+                           (int)(next_random(state) % 256), (int)(next_random(state) % 256), word);
+                break;
+            default:
+                out_printf(out, "%s ", word);
+            }
+        }
+
+        out_puts(out, "\r\n");
+    }
+}
+
+static void make_unicode(Output *out, size_t len, uint64_t *state)
+{
+    while (out->len < len)
+    {
+        for (size_t k = 1 + next_random(state) % 14; k; k--)
+            out_printf(out, "%s ", unicode_words[next_random(state) % NUM_WORDS(unicode_words)]);
+        out_puts(out, "\r\n");
+    }
+}
+
+/*
+ * What a full-screen program sends: a status line kept apart by a scroll region, the text above it scrolled both
+ * ways, rows inserted and deleted, and rows redrawn in place by positioning the cursor and erasing.
+ */
+static void make_fullscreen(Output *out, size_t len, uint64_t *state)
+{
+    out_puts(out, "\x1b[?1049h\x1b[H\x1b[2J");
+
+    while (out->len < len)
+    {
+        out_printf(out, "\x1b[1;%dr", ROWS - 1);
+
+        switch (next_random(state) % 4)
+        {
+        case 0:
+            out_printf(out, "\x1b[%d;1H\n\x1b[K", ROWS - 1);
+            break;
+        case 1:
+            out_puts(out, "\x1b[H\x1bM");
+            break;
+        case 2:
+            out_printf(out, "\x1b[%d;1H\x1b[%dL", (int)(1 + next_random(state) % (ROWS - 1)),
+                       (int)(1 + next_random(state) % 3));
+            break;
+        default:
+            out_printf(out, "\x1b[%d;1H\x1b[%dM", (int)(1 + next_random(state) % (ROWS - 1)),
+                       (int)(1 + next_random(state) % 3));
+        }
+
+        out_puts(out, "\x1b[r");
+
+        for (size_t k = next_random(state) % 4; k; k--)
+        {
+            out_printf(out, "\x1b[%d;%dH\x1b[K\x1b[38;5;%dm", (int)(1 + next_random(state) % (ROWS - 1)),
+                       (int)(1 + next_random(state) % 8), (int)(next_random(state) % 256));
+            for (size_t w = next_random(state) % 10; w; w--)
+                out_printf(out, "%s ", words[next_random(state) % NUM_WORDS(words)]);
+            out_puts(out, "\x1b[m");
+        }
+
+        out_printf(out, "\x1b[%d;1H\x1b[7m %-*s\x1b[m", ROWS, COLUMNS - 2, "src/terminal.c");
+    }
+
+    out_puts(out, "\x1b[?1049l");
+}
+
+/* Whether two terminals show the same cells with the cursor in the same place. */
+static bool same_screen(const Terminal *a, const Terminal *b)
+{
+    if (a->cursor_x != b->cursor_x || a->cursor_y != b->cursor_y)
+        return false;
+
+    for (int row = 0; row < a->rows; row++)
+        if (memcmp(term_row(a, row), term_row(b, row), (size_t)a->columns * sizeof(TermCell)))
+            return false;
+
+    return true;
+}
+
+/*
+ * Feeds the output in chunks the size a pty gives, taking the dirty rows after each as a frame would, then a byte
+ * at a time, which goes through the parser's slow path for everything.  Both must end on the same screen.
+ */
+static void time_output(const char *name, const Output *out)
+{
+    uint64_t best = UINT64_MAX, best_bytewise = UINT64_MAX;
+    size_t dirty = 0, chunks = 0;
+    Terminal term, bytewise;
+    char label[64];
+
+    for (int r = 0; r < REPEATS; r++)
+    {
+        term_init(&term, COLUMNS, ROWS);
+        dirty = chunks = 0;
+
+        uint64_t start = platform_time_ns();
+
+        for (size_t at = 0; at < out->len; at += CHUNK, chunks++)
+        {
+            term_feed(&term, &out->data[at], out->len - at < CHUNK ? out->len - at : CHUNK);
+
+            for (int slot = 0; slot < ROWS; slot++)
+                dirty += term_take_dirty(&term, slot);
+        }
+
+        uint64_t elapsed = platform_time_ns() - start;
+        if (elapsed < best)
+            best = elapsed;
+
+        if (r < REPEATS - 1)
+            term_uninit(&term);
+    }
+
+    for (int r = 0; r < REPEATS; r++)
+    {
+        term_init(&bytewise, COLUMNS, ROWS);
+
+        uint64_t start = platform_time_ns();
+
+        for (size_t at = 0; at < out->len; at++)
+            term_feed(&bytewise, &out->data[at], 1);
+
+        uint64_t elapsed = platform_time_ns() - start;
+        if (elapsed < best_bytewise)
+            best_bytewise = elapsed;
+
+        if (r < REPEATS - 1)
+            term_uninit(&bytewise);
+    }
+
+    if (!same_screen(&term, &bytewise))
+        fprintf(stderr, "The %s output ends on a different screen fed a byte at a time\n", name);
+
+    term_uninit(&term);
+    term_uninit(&bytewise);
+
+    double megabytes = (double)out->len / (1 << 20);
+
+    snprintf(label, sizeof label, "%s_throughput", name);
+    bench_report("terminal", label, megabytes / ((double)best / 1e9), "MB/s");
+    snprintf(label, sizeof label, "%s_bytewise_throughput", name);
+    bench_report("terminal", label, megabytes / ((double)best_bytewise / 1e9), "MB/s");
+    snprintf(label, sizeof label, "%s_dirty_rows_per_chunk", name);
+    bench_report("terminal", label, (double)dirty / (double)chunks, "rows");
+}
+
+typedef struct {
+    char key;
+    // Colors are compared only where the attributes say they are not the defaults
+    uint8_t attributes, fg, bg;
+} CaptureStyle;
+
+/*
+ * What a test program wrote and the screen it leaves, written as vttest and xterm's own tests would check it.  Each
+ * row's text has its trailing blanks left off.  Its styles are a character a cell: ' ' is the defaults, '=' the right
+ * half of a wide character, and the rest are looked up in the legend.  Rows and cells left out are blank and default.
+ */
+typedef struct {
+    const char *name;
+    const char *input;
+    int cursor_x, cursor_y;
+    const char *text[CAPTURE_ROWS];
+    const char *styles[CAPTURE_ROWS];
+    CaptureStyle legend[CAPTURE_STYLES];
+} Capture;
+
+#define DEFAULT_COLORS (CELL_DEFAULT_FG | CELL_DEFAULT_BG)
+
+static const Capture captures[] = {
+    {
+        .name = "cursor_movement",
+        .input = "\x1b[2J\x1b[H"
+                 "\x1b[3;5HA\x1b[2AB\x1b[4CC\x1b[2BD\x1b[3DE\x1b[1GF\x1b[5dG"
+                 "\x1b[99;99HZ"
+                 "\x1b[2;2H\x1b" "7\x1b[5;10H\x1b" "8H",
+        .cursor_x = 2,
+        .cursor_y = 1,
+        .text = {"     B    C", " H", "F   A    E D", "", " G", "                   Z"},
+    },
+    {
+        .name = "scroll_region",
+        .input = "1\r\n2\r\n3\r\n4\r\n5\r\n6"
+                 "\x1b[2;4r\x1b[4;1H\na"
+                 "\x1b[2;1H\x1bMb"
+                 "\x1b[3;1H\x1b[Lc"
+                 "\x1b[6;1H\x1b[M"
+                 "\x1b[r\x1b[6;1H\nz",
+        .cursor_x = 1,
+        .cursor_y = 5,
+        .text = {"b", "c", "3", "5", "6", "z"},
+    },
+    {
+        .name = "sgr",
+        .input = "\x1b[1mB\x1b[4mU\x1b[0m \x1b[7mI\x1b[27m\x1b[31mr\x1b[38;5;208mo\x1b[38;2;0;0;255mb\x1b[44mx"
+                 "\x1b[39;49md\x1b[0m\x1b[92mg\x1b[0m\x1b[1;31;42mk\x1b[0m",
+        .cursor_x = 11,
+        .cursor_y = 0,
+        .text = {"BU Irobxdgk"},
+        .styles = {"bu irolx gk"},
+        .legend =
+            {
+                {'b', DEFAULT_COLORS | CELL_BOLD, 0, 0},
+                {'u', DEFAULT_COLORS | CELL_BOLD | CELL_UNDERLINE, 0, 0},
+                {'i', DEFAULT_COLORS | CELL_INVERSE, 0, 0},
+                {'r', CELL_DEFAULT_BG, 1, 0},
+                {'o', CELL_DEFAULT_BG, 208, 0},
+                // Pure blue is the cube's corner
+                {'l', CELL_DEFAULT_BG, 21, 0},
+                {'x', 0, 21, 4},
+                {'g', CELL_DEFAULT_BG, 10, 0},
+                {'k', CELL_BOLD, 1, 2},
+            },
+    },
+    {
+        .name = "erase",
+        // Six rows' worth of text that autowraps, then each kind of erase on a row of its own
+        .input = "abcdefghijklmnopqrstABCDEFGHIJKLMNOPQRST01234567890123456789"
+                 "abcdefghijklmnopqrstABCDEFGHIJKLMNOPQRST0123456789"
+                 "\x1b[1;4H\x1b[1J\x1b[1;6H\x1b[K"
+                 "\x1b[2;6H\x1b[1K"
+                 "\x1b[41m\x1b[3;1H\x1b[2K\x1b[0m"
+                 "\x1b[4;3H\x1b[3X\x1b[4;1H\x1b[2P"
+                 "\x1b[5;3H\x1b[2@"
+                 "\x1b[6;4H\x1b[J",
+        .cursor_x = 3,
+        .cursor_y = 5,
+        .text = {"    e", "      GHIJKLMNOPQRST", "", "   fghijklmnopqrst", "AB  CDEFGHIJKLMNOPQR", "012"},
+        // Erasing fills with the pen's background
+        .styles = {"", "", "RRRRRRRRRRRRRRRRRRRR"},
+        .legend = {{'R', CELL_DEFAULT_FG, 0, 1}},
+    },
+    {
+        .name = "wide_characters",
+        .input = "\xe6\xbc\xa2\xe5\xad\x97" "ab"
+                 // No room in the last column, so it goes to the next line
+                 "\x1b[2;20H\xe6\xbc\xa2x\xef\xbc\xa1"
+                 // Writing over either half of one blanks the other
+                 "\x1b[4;1H\xe6\x97\xa5\xe6\x9c\xac\xe8\xaa\x9e\x1b[4;2Hc\x1b[4;5Hd"
+                 "\x1b[5;1H\x1b[31m\xed\x95\x9c\x1b[0m\xf0\x9f\x8e\x89\xc3\xa9"
+                 // Without autowrap it goes back a column instead
+                 "\x1b[?7l\x1b[6;20H\xe6\xbc\xa2\x1b[?7h",
+        .cursor_x = 19,
+        .cursor_y = 5,
+        .text =
+            {
+                "\xe6\xbc\xa2\xe5\xad\x97" "ab",
+                "",
+                "\xe6\xbc\xa2x\xef\xbc\xa1",
+                " c\xe6\x9c\xac" "d",
+                "\xed\x95\x9c\xf0\x9f\x8e\x89\xc3\xa9",
+                "                  \xe6\xbc\xa2",
+            },
+        .styles = {" = =", "", " =  =", "   =", "r= = ", "                   ="},
+        .legend = {{'r', CELL_DEFAULT_BG, 1, 0}},
+    },
+};
+
+#define NUM_CAPTURES (sizeof captures / sizeof captures[0])
+
+/* A row's text as UTF-8 less its trailing blanks, the right halves of wide characters being part of the left. */
+static void row_text(const TermCell *cells, int columns, char *out)
+{
+    char *end = out;
+
+    for (int x = 0; x < columns; x++)
+    {
+        uint32_t c = cells[x].codepoint;
+
+        if (c == 0)
+            continue;
+
+        if (c < 0x80)
+            *out++ = (char)c;
+        else if (c < 0x800)
+        {
+            *out++ = (char)(0xc0 | c >> 6);
+            *out++ = (char)(0x80 | (c & 0x3f));
+        }
+        else if (c < 0x10000)
+        {
+            *out++ = (char)(0xe0 | c >> 12);
+            *out++ = (char)(0x80 | (c >> 6 & 0x3f));
+            *out++ = (char)(0x80 | (c & 0x3f));
+        }
+        else
+        {
+            *out++ = (char)(0xf0 | c >> 18);
+            *out++ = (char)(0x80 | (c >> 12 & 0x3f));
+            *out++ = (char)(0x80 | (c >> 6 & 0x3f));
+            *out++ = (char)(0x80 | (c & 0x3f));
+        }
+
+        if (c != ' ')
+            end = out;
+    }
+
+    *end = '\0';
+}
+
+static bool same_style(TermCell cell, CaptureStyle style)
+{
+    return cell.attributes == style.attributes && ((style.attributes & CELL_DEFAULT_FG) || cell.fg == style.fg)
+        && ((style.attributes & CELL_DEFAULT_BG) || cell.bg == style.bg);
+}
+
+/* Says on stderr where the screen differs from the capture's, and whether it was right. */
+static bool check_capture(const Capture *capture, const Terminal *term, const char *how)
+{
+    bool right = true;
+    char text[4 * CAPTURE_COLUMNS + 1];
+
+    if (term->cursor_x != capture->cursor_x || term->cursor_y != capture->cursor_y)
+    {
+        fprintf(stderr, "Capture %s fed %s leaves the cursor at %d,%d instead of %d,%d\n", capture->name, how,
+                term->cursor_x, term->cursor_y, capture->cursor_x, capture->cursor_y);
+        right = false;
+    }
+
+    for (int y = 0; y < CAPTURE_ROWS; y++)
+    {
+        const TermCell *cells = term_row(term, y);
+        const char *expected = capture->text[y] ? capture->text[y] : "";
+        const char *styles = capture->styles[y] ? capture->styles[y] : "";
+
+        row_text(cells, CAPTURE_COLUMNS, text);
+        if (strcmp(text, expected) != 0)
+        {
+            fprintf(stderr, "Capture %s fed %s has row %d as \"%s\" instead of \"%s\"\n", capture->name, how, y, text,
+                    expected);
+            right = false;
+        }
+
+        for (int x = 0; x < CAPTURE_COLUMNS; x++)
+        {
+            char key = x < (int)strlen(styles) ? styles[x] : ' ';
+            CaptureStyle style = {' ', DEFAULT_COLORS, 0, 0};
+            bool matches;
+
+            for (int s = 0; s < CAPTURE_STYLES && key != ' ' && key != '='; s++)
+                if (capture->legend[s].key == key)
+                    style = capture->legend[s];
+
+            if (key == '=')
+                matches = cells[x].codepoint == 0;
+            else
+                matches = cells[x].codepoint != 0 && same_style(cells[x], style);
+
+            if (!matches)
+            {
+                fprintf(stderr, "Capture %s fed %s has the wrong cell at %d,%d: codepoint %x, attributes %x, "
+                        "fg %d, bg %d\n",
+                        capture->name, how, x, y, (unsigned)cells[x].codepoint, cells[x].attributes, cells[x].fg,
+                        cells[x].bg);
+                right = false;
+            }
+        }
+    }
+
+    return right;
+}
+
+/* Plays each capture whole and then a byte at a time, so both the fast path and the parser's own are checked. */
+static void check_captures(void)
+{
+    size_t passed = 0;
+
+    for (size_t c = 0; c < NUM_CAPTURES; c++)
+    {
+        const Capture *capture = &captures[c];
+        size_t len = strlen(capture->input);
+        Terminal whole, bytewise;
+
+        term_init(&whole, CAPTURE_COLUMNS, CAPTURE_ROWS);
+        term_feed(&whole, capture->input, len);
+
+        term_init(&bytewise, CAPTURE_COLUMNS, CAPTURE_ROWS);
+        for (size_t at = 0; at < len; at++)
+            term_feed(&bytewise, &capture->input[at], 1);
+
+        bool right = check_capture(capture, &whole, "whole");
+        right = check_capture(capture, &bytewise, "a byte at a time") && right;
+        passed += right;
+
+        term_uninit(&whole);
+        term_uninit(&bytewise);
+    }
+
+    bench_report("terminal", "captures_passed", (double)passed, "captures");
+    if (passed < NUM_CAPTURES)
+        fprintf(stderr, "%zu of %zu terminal captures failed\n", NUM_CAPTURES - passed, NUM_CAPTURES);
+}
+
+/* Usage: terminal [megabytes], defaults to 32 of each kind of output. */
+void bench_terminal(int nargs, const char *argv[])
+{
+    size_t megabytes = nargs > 0 ? (size_t)strtoull(argv[0], NULL, 10) : 32;
+    size_t len = megabytes << 20;
+    uint64_t state = 0x9e3779b97f4a7c15;
+
+    static const struct {
+        const char *name;
+        void (*make)(Output *out, size_t len, uint64_t *state);
+    } kinds[] = {
+        {"plain", make_plain},
+        {"color", make_color},
+        {"unicode", make_unicode},
+        {"fullscreen", make_fullscreen},
+    };
+
+    check_captures();
+
+    for (size_t k = 0; k < sizeof kinds / sizeof kinds[0]; k++)
+    {
+        Output out = {0};
+
+        kinds[k].make(&out, len, &state);
+        time_output(kinds[k].name, &out);
+        free(out.data);
+    }
+}
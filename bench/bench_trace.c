@@ -0,0 +1,58 @@
+#include "bench.h"
+
+#include <stdio.h>
+
+#define PAIRS 100000
+#define WARMUP 10
+#define SAMPLES 200
+// The zones timed before fill the ring many times over, so each dump writes a full one
+#define DUMP_SAMPLES 20
+
+static void zones(void *user)
+{
+    for (int i = 0; i < PAIRS; i++)
+    {
+        trace_begin("bench_zone");
+        trace_end();
+    }
+}
+
+static void dump(void *user)
+{
+    if (!trace_dump(user))
+        fprintf(stderr, "Could not write the trace to %s\n", (const char *)user);
+}
+
+/*
+ * Usage: trace.  Reports what a zone costs, its beginning and end together, while recording and while not, then how
+ * long writing out a full ring takes.  Zones built without THE_EDITOR_TRACE cost nothing, so there is nothing to time.
+ */
+void bench_trace(int nargs, const char *argv[])
+{
+    uint64_t samples[SAMPLES];
+    char *root = bench_make_temp_dir();
+    char path[2 * FILENAME_LEN];
+
+    if (!root)
+    {
+        fprintf(stderr, "Could not create a temporary directory\n");
+        return;
+    }
+
+    trace_init();
+
+    bench_sample(zones, NULL, WARMUP, samples, SAMPLES);
+    bench_report_timings("trace", "zone_disabled", samples, SAMPLES, PAIRS, "ns");
+
+    trace_enable(true);
+    bench_sample(zones, NULL, WARMUP, samples, SAMPLES);
+    bench_report_timings("trace", "zone_enabled", samples, SAMPLES, PAIRS, "ns");
+
+    snprintf(path, sizeof path, "%s%ctrace.json", root, PATH_SEPARATOR);
+    bench_sample(dump, path, 1, samples, DUMP_SAMPLES);
+    bench_report_timings("trace", "dump", samples, DUMP_SAMPLES, 1e6, "ms");
+    trace_enable(false);
+
+    bench_remove_tree(root);
+    free(root);
+}
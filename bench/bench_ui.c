@@ -0,0 +1,74 @@
+#include "bench.h"
+
+#include <stdio.h>
+
+#define WINDOW_WIDTH 2000
+#define WINDOW_HEIGHT 1000
+// Containers past the window's own, the most the UI nests
+#define MAX_DEPTH 8
+#define CALLS 10000
+#define WARMUP 10
+#define SAMPLES 200
+// Well clear of the ids the editor gives its containers
+#define FIRST_CONTAINER_ID 1000
+
+typedef struct {
+    size_t nlines;
+    size_t checksum;
+} Listing;
+
+/*
+ * Asks which lines of a long listing fall inside the innermost container, which is what every list and code view does
+ * first each frame: the container stack's mask, then a rectangle moved through every container and the scroll.
+ */
+static void lay_out(void *user)
+{
+    Listing *listing = user;
+    size_t first, count;
+
+    for (int i = 0; i < CALLS; i++)
+    {
+        ui_code_visible_lines(listing->nlines, &first, &count);
+        listing->checksum += first + count;
+    }
+}
+
+/*
+ * Usage: ui, laying out a listing nested 1, 2, 4 and 8 containers deep, each inset in the one around it and scrolled
+ * part way down.  Reports the time a layout query takes at each depth.
+ */
+void bench_ui(int nargs, const char *argv[])
+{
+    static const int depths[] = {1, 2, 4, MAX_DEPTH};
+    uint64_t samples[SAMPLES];
+    Listing listing = {.nlines = 1000000};
+    char name[64];
+
+    ui_viewport(WINDOW_WIDTH, WINDOW_HEIGHT);
+
+    for (size_t d = 0; d < sizeof depths / sizeof depths[0]; d++)
+    {
+        // The window is the outermost container
+        ui_begin();
+        for (int i = 1; i < depths[d]; i++)
+        {
+            float inset = 16.0f * (float)i;
+            int id = FIRST_CONTAINER_ID + i;
+
+            ui_container_set_scroll(id, (Vec2){0.0f, -1000.0f * (float)i});
+            ui_container_begin(C_SCROLLY, (FRect){16, 16, WINDOW_WIDTH - 2 * inset, WINDOW_HEIGHT - 2 * inset}, id);
+        }
+
+        bench_sample(lay_out, &listing, WARMUP, samples, SAMPLES);
+
+        for (int i = 1; i < depths[d]; i++)
+            ui_container_end();
+
+        snprintf(name, sizeof name, "visible_lines_depth_%d", depths[d]);
+        bench_report_timings("ui", name, samples, SAMPLES, CALLS, "ns");
+    }
+
+    // Keeps the layouts from being optimised away
+    if (!listing.checksum)
+        fprintf(stderr, "No lines were ever visible\n");
+}
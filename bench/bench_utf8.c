@@ -0,0 +1,228 @@
+#include "bench.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define BLOCK (1 << 20)
+// One byte in this many is made stray in the invalid text
+#define INVALID_EVERY 4096
+#define REPEATS 3
+
+static const char *const ascii_words[] = {
+    "int", "return", "buffer", "length", "errno", "value", "if", "else", "for", "while", "node", "index", "the",
+    "error", "count", "offset", "static", "const", "char", "size_t", "=", "+", "(", ")", "{", "}", ";", "0", "1",
+};
+
+static const char *const latin_words[] = {
+    "naïve", "café", "Größe", "straße", "élève", "þorn", "œuvre", "déjà", "año", "Łódź", "the", "and", "of", "to",
+};
+
+static const char *const cjk_words[] = {
+    "文字", "编辑器", "ファイル", "検索", "한국어", "漢字", "設定", "表示", "保存", "行", "列", "。", "、",
+};
+
+#define NUM_WORDS(words) (sizeof words / sizeof words[0])
+
+static uint64_t next_random(uint64_t *state)
+{
+    *state ^= *state << 13;
+    *state ^= *state >> 7;
+    *state ^= *state << 17;
+    return *state;
+}
+
+/* Lines of the words, one megabyte of them repeated to fill the size. */
+static char *make_text(size_t len, const char *const *words, size_t nwords)
+{
+    char *text = malloc(len);
+    uint64_t state = 0x9e3779b97f4a7c15;
+    size_t at = 0;
+    size_t len_block = len < BLOCK ? len : BLOCK;
+
+    while (at < len_block)
+    {
+        char buffer[256];
+        int n = 0;
+
+        for (size_t k = next_random(&state) % 12; k; k--)
+            n += snprintf(&buffer[n], sizeof buffer - n, "%s ", words[next_random(&state) % nwords]);
+        buffer[n++] = '\n';
+
+        // Whole lines only, so the block does not end in the middle of a sequence
+        if ((size_t)n > len_block - at)
+        {
+            memset(&text[at], ' ', len_block - at);
+            break;
+        }
+
+        memcpy(&text[at], buffer, (size_t)n);
+        at += (size_t)n;
+    }
+
+    for (size_t i = len_block; i < len; i += len_block)
+        memcpy(&text[i], text, len - i < len_block ? len - i : len_block);
+
+    return text;
+}
+
+/* The usual way, one sequence at a time with the lead byte deciding how many follow. */
+static bool naive_validate(const unsigned char *s, size_t len)
+{
+    for (size_t i = 0; i < len;)
+    {
+        unsigned c = s[i];
+        size_t n;
+        uint32_t cp;
+
+        if (c < 0x80)
+        {
+            i++;
+            continue;
+        }
+        else if (c >= 0xc2 && c <= 0xdf)
+            n = 1, cp = c & 0x1f;
+        else if (c >= 0xe0 && c <= 0xef)
+            n = 2, cp = c & 0x0f;
+        else if (c >= 0xf0 && c <= 0xf4)
+            n = 3, cp = c & 0x07;
+        else
+            return false;
+
+        if (len - i <= n)
+            return false;
+
+        for (size_t k = 1; k <= n; k++)
+        {
+            if ((s[i + k] & 0xc0) != 0x80)
+                return false;
+            cp = cp << 6 | (s[i + k] & 0x3f);
+        }
+
+        if ((n == 2 && cp < 0x800) || (n == 3 && cp < 0x10000) || cp > 0x10ffff || (cp >= 0xd800 && cp <= 0xdfff))
+            return false;
+
+        i += n + 1;
+    }
+
+    return true;
+}
+
+/* The same, decoding as it goes.  Anything not well-formed gives a replacement character for its lead byte alone. */
+static size_t naive_decode(const unsigned char *s, size_t len, uint32_t *out)
+{
+    size_t count = 0;
+
+    for (size_t i = 0; i < len;)
+    {
+        unsigned c = s[i];
+        size_t n = 0;
+        uint32_t cp = c;
+
+        if (c >= 0xc2 && c <= 0xdf)
+            n = 1, cp = c & 0x1f;
+        else if (c >= 0xe0 && c <= 0xef)
+            n = 2, cp = c & 0x0f;
+        else if (c >= 0xf0 && c <= 0xf4)
+            n = 3, cp = c & 0x07;
+        else if (c >= 0x80)
+            cp = UTF8_REPLACEMENT;
+
+        bool ok = len - i > n;
+        for (size_t k = 1; ok && k <= n; k++)
+        {
+            ok = (s[i + k] & 0xc0) == 0x80;
+            cp = cp << 6 | (s[i + k] & 0x3f);
+        }
+
+        if (!ok || (n == 2 && cp < 0x800) || (n == 3 && cp < 0x10000) || cp > 0x10ffff ||
+            (cp >= 0xd800 && cp <= 0xdfff))
+        {
+            out[count++] = UTF8_REPLACEMENT;
+            i++;
+            continue;
+        }
+
+        out[count++] = cp;
+        i += n + 1;
+    }
+
+    return count;
+}
+
+/* Validates and decodes the text both ways, reporting the best of a few runs of each and checking they agree. */
+static void time_text(const char *name, const char *text, size_t len, uint32_t *out, uint32_t *naive_out)
+{
+    uint64_t best[4] = {UINT64_MAX, UINT64_MAX, UINT64_MAX, UINT64_MAX};
+    bool valid = false, naive_valid = false;
+    size_t count = 0, naive_count = 0;
+    char label[64];
+
+    for (int r = 0; r < REPEATS; r++)
+    {
+        uint64_t times[5];
+
+        times[0] = platform_time_ns();
+        valid = utf8_validate(text, len);
+        times[1] = platform_time_ns();
+        naive_valid = naive_validate((const unsigned char *)text, len);
+        times[2] = platform_time_ns();
+        count = utf8_decode(text, len, out, NULL);
+        times[3] = platform_time_ns();
+        naive_count = naive_decode((const unsigned char *)text, len, naive_out);
+        times[4] = platform_time_ns();
+
+        for (int k = 0; k < 4; k++)
+            if (times[k + 1] - times[k] < best[k])
+                best[k] = times[k + 1] - times[k];
+    }
+
+    if (valid != naive_valid)
+        fprintf(stderr, "The %s text is %svalid, the naive validator says otherwise\n", name, valid ? "" : "not ");
+
+    // The two only replace invalid bytes alike one at a time, so their output is compared on valid text
+    if (valid && (count != naive_count || memcmp(out, naive_out, count * sizeof *out)))
+        fprintf(stderr, "The %s text decodes differently the naive way\n", name);
+
+    const char *kinds[4] = {"validate", "validate_naive", "decode", "decode_naive"};
+    double gigabytes = (double)len / (1 << 30);
+
+    // Both validators stop early on bad text, so only how fast they pass good text means anything
+    for (int k = valid ? 0 : 2; k < 4; k++)
+    {
+        snprintf(label, sizeof label, "%s_%s", kinds[k], name);
+        bench_report("utf8", label, gigabytes / ((double)best[k] / 1e9), "GB/s");
+    }
+}
+
+/* Usage: utf8 [megabytes], defaults to 64. */
+void bench_utf8(int nargs, const char *argv[])
+{
+    size_t megabytes = nargs > 0 ? (size_t)strtoull(argv[0], NULL, 10) : 64;
+    size_t len = megabytes << 20;
+    uint32_t *out = malloc(len * sizeof *out);
+    uint32_t *naive_out = malloc(len * sizeof *naive_out);
+
+    bench_report("utf8", "avx2", platform_cpu_has_avx2(), "");
+
+    char *text = make_text(len, ascii_words, NUM_WORDS(ascii_words));
+    time_text("ascii", text, len, out, naive_out);
+    free(text);
+
+    text = make_text(len, latin_words, NUM_WORDS(latin_words));
+    time_text("latin", text, len, out, naive_out);
+    free(text);
+
+    text = make_text(len, cjk_words, NUM_WORDS(cjk_words));
+    time_text("cjk", text, len, out, naive_out);
+
+    // Continuation bytes with no lead byte here and there, the decoder replaces each and goes on
+    uint64_t state = 3;
+    for (size_t i = INVALID_EVERY; i < len; i += INVALID_EVERY)
+        text[i - next_random(&state) % 64] = (char)0x80;
+
+    time_text("invalid", text, len, out, naive_out);
+    free(text);
+
+    free(naive_out);
+    free(out);
+}
@@ -0,0 +1,153 @@
+#include "bench.h"
+
+#include <stdio.h>
+#include <string.h>
+
+// Gives up on a phase if the tree has not caught up by then, e.g. where watching is unsupported
+#define SETTLE_TIMEOUT_NS 30000000000ull
+
+typedef struct {
+    uint64_t settle;
+    uint64_t worst_poll;
+    bool settled;
+} Phase;
+
+static bool has_child(const FileTree *tree, FileTreeIndex parent, const char *name)
+{
+    for (FileTreeIndex c = tree->nodes[parent].first_child; c != FT_NONE; c = tree->nodes[c].next_sibling)
+    {
+        String s = ft_name(tree, c);
+        if (s.length == strlen(name) && !memcmp(s.data, name, s.length))
+            return true;
+    }
+
+    return false;
+}
+
+static FileTreeIndex find_child(const FileTree *tree, FileTreeIndex parent, const char *name)
+{
+    for (FileTreeIndex c = tree->nodes[parent].first_child; c != FT_NONE; c = tree->nodes[c].next_sibling)
+    {
+        String s = ft_name(tree, c);
+        if (s.length == strlen(name) && !memcmp(s.data, name, s.length))
+            return c;
+    }
+
+    return FT_NONE;
+}
+
+/* Polls like the editor until there are `nrows` visible rows and `dir` holds `sentinel`, which is created last. */
+static Phase settle(FileTree *tree, FileTreeIndex dir, size_t nrows, const char *sentinel)
+{
+    Phase phase = {0};
+    uint64_t start = platform_time_ns();
+    uint64_t frame_start = start;
+
+    while (platform_time_ns() - start < SETTLE_TIMEOUT_NS)
+    {
+        ft_poll(tree);
+
+        uint64_t frame_end = platform_time_ns();
+        if (frame_end - frame_start > phase.worst_poll)
+            phase.worst_poll = frame_end - frame_start;
+        frame_start = frame_end;
+
+        if (ft_visible_count(tree) == nrows && has_child(tree, dir, sentinel))
+        {
+            phase.settled = true;
+            break;
+        }
+    }
+
+    phase.settle = platform_time_ns() - start;
+
+    return phase;
+}
+
+static void report(const char *what, size_t count, Phase phase)
+{
+    char name[64];
+
+    if (!phase.settled)
+        fprintf(stderr, "The tree never caught up with the %s burst\n", what);
+
+    snprintf(name, sizeof name, "%s_%zu_settle", what, count);
+    bench_report("watch", name, (double)phase.settle / 1e6, "ms");
+    snprintf(name, sizeof name, "%s_%zu_worst_poll", what, count);
+    bench_report("watch", name, (double)phase.worst_poll / 1e6, "ms");
+}
+
+/* Times how long the tree takes to catch up after bursts of creations, renames and deletions in an open directory. */
+static void run_burst(size_t count)
+{
+    char *cwd = bench_current_dir();
+    char *root = bench_make_temp_dir();
+    char path[2 * FILENAME_LEN], to[2 * FILENAME_LEN];
+
+    if (!root)
+    {
+        fprintf(stderr, "Could not create a temporary directory\n");
+        free(cwd);
+        return;
+    }
+
+    bench_change_dir(root);
+    bench_make_dir("d");
+
+    FileTree tree;
+    ft_init(&tree);
+
+    FileTreeIndex dir = find_child(&tree, FT_ROOT, "d");
+    ft_expand(&tree, dir);
+    while (tree.nodes[dir].flags & FTI_LOADING)
+        ft_poll(&tree);
+
+    // Like a checkout, every file is touched in one go and the tree only hears about it through the watch
+    for (size_t i = 0; i < count; i++)
+    {
+        snprintf(path, sizeof path, "d%cfile_%08zu.c", PATH_SEPARATOR, i);
+        bench_make_file(path, 0);
+    }
+    snprintf(path, sizeof path, "d%ccreated", PATH_SEPARATOR);
+    bench_make_file(path, 0);
+    report("create", count, settle(&tree, dir, count + 2, "created"));
+
+    for (size_t i = 0; i < count; i++)
+    {
+        snprintf(path, sizeof path, "d%cfile_%08zu.c", PATH_SEPARATOR, i);
+        snprintf(to, sizeof to, "d%cfile_%08zu.h", PATH_SEPARATOR, i);
+        rename(path, to);
+    }
+    snprintf(path, sizeof path, "d%crenamed", PATH_SEPARATOR);
+    bench_make_file(path, 0);
+    report("rename", count, settle(&tree, dir, count + 3, "renamed"));
+
+    for (size_t i = 0; i < count; i++)
+    {
+        snprintf(path, sizeof path, "d%cfile_%08zu.h", PATH_SEPARATOR, i);
+        remove(path);
+    }
+    snprintf(path, sizeof path, "d%cdeleted", PATH_SEPARATOR);
+    bench_make_file(path, 0);
+    report("delete", count, settle(&tree, dir, 4, "deleted"));
+
+    ft_uninit(&tree);
+
+    bench_change_dir(cwd);
+    bench_remove_tree(root);
+    free(root);
+    free(cwd);
+}
+
+/* Usage: watch [entries...], defaults to a burst of 50k files. */
+void bench_watch(int nargs, const char *argv[])
+{
+    if (nargs == 0)
+    {
+        run_burst(50000);
+        return;
+    }
+
+    for (int i = 0; i < nargs; i++)
+        run_burst((size_t)strtoull(argv[i], NULL, 10));
+}
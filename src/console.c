@@ -0,0 +1,155 @@
+#include "theeditor.h"
+
+#include <string.h>
+
+// Sixteen megabytes taken every frame at 60 Hz is close to a gigabyte a second, more than a shell writes
+#define RING_SIZE (16u << 20)
+
+/*
+ * The reader thread is the only one to move `head` and the UI thread the only one to move `tail`, both of which
+ * count bytes from the start and are only masked to index the ring.  Each side reads the other's with a barrier, so
+ * the bytes before a head it has seen are in place, and the room before a tail it has seen is free.  The lock is
+ * only taken for the reader to sleep while the ring is full, and for the UI to wake it.
+ */
+struct Console {
+    PlatformPty *pty;
+    PlatformThread *reader;
+    char *ring;
+    volatile size_t head, tail;
+    // Set by the reader once the shell has gone, after its last head
+    volatile size_t exited;
+    PlatformMutex *mutex;
+    PlatformCond *room;
+    bool stopping;
+};
+
+static void read_main(void *arg)
+{
+    Console *console = arg;
+    size_t head = console->head;
+
+    for (;;)
+    {
+        size_t tail = platform_atomic_load_size(&console->tail);
+
+        // The UI has fallen a whole ring behind, the shell waits on the pty until it catches up
+        if (head - tail == RING_SIZE)
+        {
+            platform_mutex_lock(console->mutex);
+            while (head - platform_atomic_load_size(&console->tail) == RING_SIZE && !console->stopping)
+                platform_cond_wait(console->room, console->mutex);
+            bool stopping = console->stopping;
+            platform_mutex_unlock(console->mutex);
+
+            if (stopping)
+                return;
+            continue;
+        }
+
+        // Straight into the ring, as much as is free up to where it wraps
+        size_t at = head & (RING_SIZE - 1);
+        size_t room = RING_SIZE - (head - tail);
+        if (room > RING_SIZE - at)
+            room = RING_SIZE - at;
+
+        size_t n = platform_pty_read(console->pty, &console->ring[at], room);
+        if (!n)
+            break;
+
+        head += n;
+        platform_atomic_store_size(&console->head, head);
+    }
+
+    platform_atomic_store_size(&console->exited, 1);
+}
+
+Console *console_create(const char *shell, int columns, int rows)
+{
+    PlatformPty *pty = platform_pty_spawn(shell, columns, rows);
+
+    if (!pty)
+        return NULL;
+
+    Console *console = malloc(sizeof *console);
+
+    *console = (Console){
+        .pty = pty,
+        .ring = malloc(RING_SIZE),
+        .mutex = platform_mutex_create(),
+        .room = platform_cond_create(),
+    };
+
+    console->reader = platform_thread_create(read_main, console);
+
+    if (!console->reader)
+    {
+        platform_pty_close(pty);
+        platform_cond_destroy(console->room);
+        platform_mutex_destroy(console->mutex);
+        free(console->ring);
+        free(console);
+        return NULL;
+    }
+
+    return console;
+}
+
+void console_destroy(Console *console)
+{
+    platform_mutex_lock(console->mutex);
+    console->stopping = true;
+    platform_cond_broadcast(console->room);
+    platform_mutex_unlock(console->mutex);
+
+    platform_pty_wake(console->pty);
+    platform_thread_join(console->reader);
+    platform_pty_close(console->pty);
+
+    platform_cond_destroy(console->room);
+    platform_mutex_destroy(console->mutex);
+    free(console->ring);
+    free(console);
+}
+
+bool console_poll(Console *console, ConsoleOutputCallback callback, void *user)
+{
+    // Read before the head, so no output can come after it is seen
+    bool exited = platform_atomic_load_size(&console->exited);
+    size_t head = platform_atomic_load_size(&console->head);
+    size_t tail = console->tail;
+
+    if (head == tail)
+        return !exited;
+
+    size_t at = tail & (RING_SIZE - 1);
+    size_t len = head - tail;
+
+    if (len > RING_SIZE - at)
+    {
+        callback(user, &console->ring[at], RING_SIZE - at);
+        callback(user, console->ring, len - (RING_SIZE - at));
+    }
+    else
+    {
+        callback(user, &console->ring[at], len);
+    }
+
+    platform_atomic_store_size(&console->tail, head);
+
+    // Once a frame, so cheap enough to do whether or not the reader is waiting
+    platform_mutex_lock(console->mutex);
+    platform_cond_signal(console->room);
+    platform_mutex_unlock(console->mutex);
+
+    return true;
+}
+
+size_t console_write(Console *console, const char *data, size_t len)
+{
+    return platform_pty_write(console->pty, data, len);
+}
+
+void console_resize(Console *console, int columns, int rows)
+{
+    platform_pty_resize(console->pty, columns, rows);
+}
@@ -0,0 +1,1023 @@
+#include "theeditor.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define HAVE_SSE2
+#endif
+
+// Pieces never grow past this, so cutting one in two only ever scans a bounded run of bytes for newlines
+#define PIECE_MAX (1 << 16)
+// Set in a piece's start when it points into the add buffer rather than the original
+#define PIECE_ADD (1ull << 63)
+#define NODE_NONE UINT32_MAX
+#define LOAD_BLOCK (1 << 20)
+// Files this large are mapped rather than read, and their lines counted in the background
+#define MAP_THRESHOLD (64ull << 20)
+// The indexer hands over its counts this many pieces at a time
+#define INDEX_BATCH 64
+
+/**
+ * A piece of the document and a node of the treap holding the pieces in order.  Nodes are shared between the current
+ * contents and any snapshots, so a node held more than once is copied before it is changed.
+ */
+struct PieceNode {
+    uint64_t start;
+    uint32_t len, newlines;
+
+    uint32_t left, right;
+    uint32_t priority;
+    uint32_t refs;
+
+    // Totals over the subtree
+    uint64_t bytes, subtree_newlines;
+    // The first block of the original with a piece in the subtree whose newlines are only estimated
+    uint32_t pending;
+    bool estimated;
+};
+
+/** Counts the newlines of a mapped file a block of PIECE_MAX bytes at a time, on a thread of its own. */
+struct DocIndexer {
+    PlatformThread *thread;
+    PlatformMutex *mutex;
+    const char *data;
+    size_t len;
+    size_t nblocks;
+    uint32_t *block_newlines;
+    PlatformFileMap map;
+
+    // Guarded by the mutex
+    size_t indexed;
+    bool stop;
+};
+
+static uint32_t next_priority(void)
+{
+    static uint32_t state = 0x2545f491;
+
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+
+    return state;
+}
+
+size_t doc_count_newlines(const char *s, size_t len)
+{
+    size_t count = 0, i = 0;
+
+#ifdef HAVE_SSE2
+    const __m128i newline = _mm_set1_epi8('\n');
+
+    while (len - i >= 16)
+    {
+        // Each byte lane counts its matches, and the lanes are summed before any of them can wrap
+        size_t n = (len - i) / 16 < 255 ? (len - i) / 16 : 255;
+        __m128i lanes = _mm_setzero_si128();
+
+        for (size_t k = 0; k < n; k++, i += 16)
+            lanes = _mm_sub_epi8(lanes, _mm_cmpeq_epi8(_mm_loadu_si128((const __m128i *)&s[i]), newline));
+
+        __m128i sums = _mm_sad_epu8(lanes, _mm_setzero_si128());
+        count += (size_t)_mm_cvtsi128_si32(sums) + (size_t)_mm_extract_epi16(sums, 4);
+    }
+#endif
+
+    for (; i < len; i++)
+        count += s[i] == '\n';
+
+    return count;
+}
+
+/* Pieces and blocks are far below 4 GB, so their counts always fit. */
+static uint32_t count_newlines(const char *s, size_t len)
+{
+    return (uint32_t)doc_count_newlines(s, len);
+}
+
+static const char *piece_data(const Document *doc, const PieceNode *n)
+{
+    return n->start & PIECE_ADD ? &doc->add[n->start & ~PIECE_ADD] : &doc->original[n->start];
+}
+
+static uint64_t subtree_bytes(const Document *doc, uint32_t t)
+{
+    return t == NODE_NONE ? 0 : doc->nodes[t].bytes;
+}
+
+static uint64_t subtree_newlines(const Document *doc, uint32_t t)
+{
+    return t == NODE_NONE ? 0 : doc->nodes[t].subtree_newlines;
+}
+
+static uint32_t subtree_pending(const Document *doc, uint32_t t)
+{
+    return t == NODE_NONE ? NODE_NONE : doc->nodes[t].pending;
+}
+
+static void node_update(Document *doc, uint32_t t)
+{
+    PieceNode *n = &doc->nodes[t];
+
+    n->bytes = n->len + subtree_bytes(doc, n->left) + subtree_bytes(doc, n->right);
+    n->subtree_newlines = n->newlines + subtree_newlines(doc, n->left) + subtree_newlines(doc, n->right);
+
+    uint32_t left = subtree_pending(doc, n->left), right = subtree_pending(doc, n->right);
+    n->pending = n->estimated ? (uint32_t)(n->start / PIECE_MAX) : NODE_NONE;
+    if (left < n->pending)
+        n->pending = left;
+    if (right < n->pending)
+        n->pending = right;
+}
+
+static uint32_t node_alloc(Document *doc)
+{
+    if (doc->free_nodes != NODE_NONE)
+    {
+        uint32_t x = doc->free_nodes;
+        doc->free_nodes = doc->nodes[x].left;
+        return x;
+    }
+
+    if (doc->len_nodes >= doc->cap_nodes)
+    {
+        doc->cap_nodes = doc->cap_nodes < 64 ? 64 : 2 * doc->cap_nodes;
+        doc->nodes = realloc(doc->nodes, doc->cap_nodes * sizeof *doc->nodes);
+        assert(doc->nodes != NULL);
+    }
+
+    return (uint32_t)doc->len_nodes++;
+}
+
+static uint32_t piece_create(Document *doc, uint64_t start, uint32_t len, uint32_t newlines)
+{
+    uint32_t x = node_alloc(doc);
+
+    doc->nodes[x] = (PieceNode){
+        .start = start,
+        .len = len,
+        .newlines = newlines,
+        .left = NODE_NONE,
+        .right = NODE_NONE,
+        .priority = next_priority(),
+        .refs = 1,
+        .bytes = len,
+        .subtree_newlines = newlines,
+        .pending = NODE_NONE,
+    };
+
+    return x;
+}
+
+static void node_retain(Document *doc, uint32_t t)
+{
+    if (t != NODE_NONE)
+        doc->nodes[t].refs++;
+}
+
+/* Drops a reference, freeing whatever no version holds any more. */
+static void node_release(Document *doc, uint32_t t)
+{
+    // Loops down the right spine, so only the left side recurses
+    while (t != NODE_NONE && --doc->nodes[t].refs == 0)
+    {
+        uint32_t right = doc->nodes[t].right;
+
+        node_release(doc, doc->nodes[t].left);
+        doc->nodes[t].left = doc->free_nodes;
+        doc->free_nodes = t;
+
+        t = right;
+    }
+}
+
+/* The node itself if only one version holds it, otherwise a copy of it that can be changed freely. */
+static uint32_t node_own(Document *doc, uint32_t t)
+{
+    if (doc->nodes[t].refs == 1)
+        return t;
+
+    uint32_t copy = node_alloc(doc);
+
+    doc->nodes[copy] = doc->nodes[t];
+    doc->nodes[copy].refs = 1;
+    node_retain(doc, doc->nodes[copy].left);
+    node_retain(doc, doc->nodes[copy].right);
+    doc->nodes[t].refs--;
+
+    return copy;
+}
+
+/* Concatenates two treaps, taking over the references to both. */
+static uint32_t treap_merge(Document *doc, uint32_t a, uint32_t b)
+{
+    if (a == NODE_NONE)
+        return b;
+    if (b == NODE_NONE)
+        return a;
+
+    if (doc->nodes[a].priority > doc->nodes[b].priority)
+    {
+        a = node_own(doc, a);
+        uint32_t right = treap_merge(doc, doc->nodes[a].right, b);
+        doc->nodes[a].right = right;
+        node_update(doc, a);
+        return a;
+    }
+    else
+    {
+        b = node_own(doc, b);
+        uint32_t left = treap_merge(doc, a, doc->nodes[b].left);
+        doc->nodes[b].left = left;
+        node_update(doc, b);
+        return b;
+    }
+}
+
+/* Splits off the first k bytes into `a` and the rest into `b`, cutting a piece in two if k falls inside it. */
+static void treap_split(Document *doc, uint32_t t, uint64_t k, uint32_t *a, uint32_t *b)
+{
+    if (t == NODE_NONE)
+    {
+        *a = *b = NODE_NONE;
+        return;
+    }
+
+    t = node_own(doc, t);
+
+    uint64_t len_left = subtree_bytes(doc, doc->nodes[t].left);
+    uint32_t len = doc->nodes[t].len;
+    uint32_t l, r;
+
+    if (k <= len_left)
+    {
+        treap_split(doc, doc->nodes[t].left, k, &l, &r);
+        doc->nodes[t].left = r;
+        node_update(doc, t);
+        *a = l;
+        *b = t;
+    }
+    else if (k >= len_left + len)
+    {
+        treap_split(doc, doc->nodes[t].right, k - len_left - len, &l, &r);
+        doc->nodes[t].right = l;
+        node_update(doc, t);
+        *a = t;
+        *b = r;
+    }
+    else
+    {
+        uint32_t at = (uint32_t)(k - len_left);
+        const char *data = piece_data(doc, &doc->nodes[t]);
+        bool estimated = doc->nodes[t].estimated;
+        uint32_t right_newlines;
+
+        // Only the shorter half is scanned, the other one gets the remaining newlines
+        if (estimated)
+            right_newlines = (uint32_t)((uint64_t)doc->nodes[t].newlines * (len - at) / len);
+        else if (at < len - at)
+            right_newlines = doc->nodes[t].newlines - count_newlines(data, at);
+        else
+            right_newlines = count_newlines(data + at, len - at);
+
+        uint32_t half = piece_create(doc, doc->nodes[t].start + at, len - at, right_newlines);
+        uint32_t right = doc->nodes[t].right;
+
+        if (estimated)
+        {
+            doc->nodes[half].estimated = true;
+            node_update(doc, half);
+        }
+
+        PieceNode *n = &doc->nodes[t];
+        n->len = at;
+        n->newlines -= right_newlines;
+        n->right = NODE_NONE;
+        node_update(doc, t);
+
+        *a = t;
+        *b = treap_merge(doc, half, right);
+    }
+}
+
+/* Builds a treap over pieces in order in linear time, rather than merging them in one at a time. */
+static uint32_t treap_build(Document *doc, const uint32_t *pieces, size_t count)
+{
+    uint32_t *stack = malloc(count * sizeof *stack);
+    size_t height = 0;
+
+    // The stack holds the right spine, whatever is popped off it is complete
+    for (size_t i = 0; i < count; i++)
+    {
+        uint32_t x = pieces[i], last = NODE_NONE;
+
+        while (height && doc->nodes[stack[height - 1]].priority < doc->nodes[x].priority)
+        {
+            last = stack[--height];
+            node_update(doc, last);
+        }
+
+        doc->nodes[x].left = last;
+        if (height)
+            doc->nodes[stack[height - 1]].right = x;
+        stack[height++] = x;
+    }
+
+    while (height > 1)
+        node_update(doc, stack[--height]);
+
+    uint32_t root = NODE_NONE;
+    if (height)
+    {
+        root = stack[0];
+        node_update(doc, root);
+    }
+
+    free(stack);
+
+    return root;
+}
+
+/* Builds pieces over a run of bytes in one of the buffers, none of them longer than PIECE_MAX. */
+static uint32_t pieces_create(Document *doc, uint64_t start, const char *data, size_t len)
+{
+    if (len <= PIECE_MAX)
+        return piece_create(doc, start, (uint32_t)len, count_newlines(data, len));
+
+    size_t count = (len + PIECE_MAX - 1) / PIECE_MAX;
+    uint32_t *pieces = malloc(count * sizeof *pieces);
+
+    for (size_t i = 0, at = 0; i < count; i++, at += PIECE_MAX)
+    {
+        uint32_t n = len - at < PIECE_MAX ? (uint32_t)(len - at) : PIECE_MAX;
+        pieces[i] = piece_create(doc, start + at, n, count_newlines(&data[at], n));
+    }
+
+    uint32_t t = treap_build(doc, pieces, count);
+    free(pieces);
+
+    return t;
+}
+
+/* Whether the last piece of a treap ends where the add buffer did, with room to run on. */
+static bool can_extend(const Document *doc, uint32_t t, uint64_t end_add, size_t len)
+{
+    if (t == NODE_NONE)
+        return false;
+
+    while (doc->nodes[t].right != NODE_NONE)
+        t = doc->nodes[t].right;
+
+    const PieceNode *n = &doc->nodes[t];
+
+    return (n->start & PIECE_ADD) && (n->start & ~PIECE_ADD) + n->len == end_add && n->len + len <= PIECE_MAX;
+}
+
+static uint32_t extend_last(Document *doc, uint32_t t, uint32_t len, uint32_t newlines)
+{
+    t = node_own(doc, t);
+
+    if (doc->nodes[t].right != NODE_NONE)
+    {
+        uint32_t right = extend_last(doc, doc->nodes[t].right, len, newlines);
+        doc->nodes[t].right = right;
+    }
+    else
+    {
+        doc->nodes[t].len += len;
+        doc->nodes[t].newlines += newlines;
+    }
+
+    node_update(doc, t);
+
+    return t;
+}
+
+void doc_init(Document *doc, char *text, size_t len)
+{
+    *doc = (Document){
+        .original = text,
+        .len_original = len,
+        .free_nodes = NODE_NONE,
+        .root = NODE_NONE,
+    };
+
+    doc->root = pieces_create(doc, 0, text, len);
+}
+
+static void index_blocks(void *arg)
+{
+    DocIndexer *indexer = arg;
+    bool stop = false;
+
+    for (size_t block = indexer->indexed; block < indexer->nblocks && !stop;)
+    {
+        size_t first = block;
+        size_t end = block + INDEX_BATCH < indexer->nblocks ? block + INDEX_BATCH : indexer->nblocks;
+
+        for (; block < end; block++)
+        {
+            size_t at = block * PIECE_MAX;
+            size_t len = indexer->len - at < PIECE_MAX ? indexer->len - at : PIECE_MAX;
+            indexer->block_newlines[block] = count_newlines(&indexer->data[at], len);
+        }
+
+        // Counted pages are not needed again, reading the whole file should not leave all of it in the process
+        size_t at = first * PIECE_MAX;
+        size_t len = end * PIECE_MAX < indexer->len ? (end - first) * PIECE_MAX : indexer->len - at;
+        platform_map_release(&indexer->map, at, len);
+
+        platform_mutex_lock(indexer->mutex);
+        indexer->indexed = block;
+        stop = indexer->stop;
+        platform_mutex_unlock(indexer->mutex);
+    }
+}
+
+/* Opens a mapped file with only its first block counted, the rest of the pieces have their newlines estimated. */
+static void init_mapped(Document *doc, PlatformFileMap map)
+{
+    size_t nblocks = (map.size + PIECE_MAX - 1) / PIECE_MAX;
+    DocIndexer *indexer = malloc(sizeof *indexer);
+
+    *indexer = (DocIndexer){
+        .mutex = platform_mutex_create(),
+        .data = map.data,
+        .len = map.size,
+        .nblocks = nblocks,
+        .block_newlines = malloc(nblocks * sizeof *indexer->block_newlines),
+        .map = map,
+        .indexed = 1,
+    };
+
+    *doc = (Document){
+        .original = map.data,
+        .len_original = map.size,
+        .free_nodes = NODE_NONE,
+        .root = NODE_NONE,
+        .indexer = indexer,
+    };
+
+    uint32_t first = count_newlines(doc->original, PIECE_MAX);
+    uint32_t *pieces = malloc(nblocks * sizeof *pieces);
+
+    indexer->block_newlines[0] = first;
+    pieces[0] = piece_create(doc, 0, PIECE_MAX, first);
+
+    for (size_t block = 1; block < nblocks; block++)
+    {
+        size_t at = block * PIECE_MAX;
+        uint32_t len = map.size - at < PIECE_MAX ? (uint32_t)(map.size - at) : PIECE_MAX;
+
+        pieces[block] = piece_create(doc, at, len, (uint32_t)((uint64_t)first * len / PIECE_MAX));
+        doc->nodes[pieces[block]].estimated = true;
+    }
+
+    doc->root = treap_build(doc, pieces, nblocks);
+    free(pieces);
+
+    indexer->thread = platform_thread_create(index_blocks, indexer);
+
+    // Without a thread the whole file is counted now, and the first poll takes it all in
+    if (!indexer->thread)
+        index_blocks(indexer);
+}
+
+bool doc_load(Document *doc, const char *path)
+{
+    PlatformFileMap map = {0};
+
+    if (platform_map_file_readonly(path, &map))
+    {
+        if (map.size >= MAP_THRESHOLD)
+        {
+            init_mapped(doc, map);
+            return true;
+        }
+
+        platform_unmap_file(&map);
+    }
+
+    FILE *f = fopen(path, "rb");
+
+    if (!f)
+        return false;
+
+    size_t len = 0, cap = LOAD_BLOCK;
+    char *text = malloc(cap);
+
+    for (size_t nread; (nread = fread(&text[len], 1, cap - len, f)) > 0;)
+    {
+        len += nread;
+
+        if (len == cap)
+        {
+            cap *= 2;
+            text = realloc(text, cap);
+        }
+    }
+
+    bool ok = !ferror(f);
+    fclose(f);
+
+    if (!ok)
+    {
+        free(text);
+        return false;
+    }
+
+    doc_init(doc, text, len);
+
+    return true;
+}
+
+void doc_uninit(Document *doc)
+{
+    DocIndexer *indexer = doc->indexer;
+
+    if (indexer)
+    {
+        platform_mutex_lock(indexer->mutex);
+        indexer->stop = true;
+        platform_mutex_unlock(indexer->mutex);
+
+        if (indexer->thread)
+            platform_thread_join(indexer->thread);
+
+        platform_mutex_destroy(indexer->mutex);
+        platform_unmap_file(&indexer->map);
+        free(indexer->block_newlines);
+        free(indexer);
+    }
+    else
+    {
+        free(doc->original);
+    }
+
+    free(doc->add);
+    free(doc->nodes);
+
+    *doc = (Document){.free_nodes = NODE_NONE, .root = NODE_NONE};
+}
+
+/* Replaces the estimates of pieces whose blocks the indexer has counted, copying the paths to them. */
+static uint32_t apply_counts(Document *doc, uint32_t t, size_t indexed)
+{
+    if (subtree_pending(doc, t) >= indexed)
+        return t;
+
+    t = node_own(doc, t);
+
+    uint32_t left = apply_counts(doc, doc->nodes[t].left, indexed);
+    doc->nodes[t].left = left;
+    uint32_t right = apply_counts(doc, doc->nodes[t].right, indexed);
+    doc->nodes[t].right = right;
+
+    PieceNode *n = &doc->nodes[t];
+    size_t block = (size_t)(n->start / PIECE_MAX);
+
+    if (n->estimated && block < indexed)
+    {
+        // A piece cut out of a block since is counted again, it is at most one block to scan
+        bool whole = n->start % PIECE_MAX == 0 && (n->len == PIECE_MAX || n->start + n->len == doc->len_original);
+
+        n->newlines = whole ? doc->indexer->block_newlines[block] : count_newlines(&doc->original[n->start], n->len);
+        n->estimated = false;
+    }
+
+    node_update(doc, t);
+
+    return t;
+}
+
+bool doc_poll(Document *doc)
+{
+    DocIndexer *indexer = doc->indexer;
+
+    if (!indexer)
+        return false;
+
+    platform_mutex_lock(indexer->mutex);
+    size_t indexed = indexer->indexed;
+    platform_mutex_unlock(indexer->mutex);
+
+    doc->root = apply_counts(doc, doc->root, indexed);
+
+    if (indexed == indexer->nblocks && indexer->thread)
+    {
+        platform_thread_join(indexer->thread);
+        indexer->thread = NULL;
+    }
+
+    return indexed < indexer->nblocks;
+}
+
+size_t doc_counted_length(const Document *doc)
+{
+    uint64_t base = 0;
+
+    for (uint32_t t = doc->root; t != NODE_NONE;)
+    {
+        const PieceNode *n = &doc->nodes[t];
+
+        if (subtree_pending(doc, n->left) != NODE_NONE)
+        {
+            t = n->left;
+            continue;
+        }
+
+        base += subtree_bytes(doc, n->left);
+
+        if (n->estimated)
+            break;
+
+        base += n->len;
+        t = n->right;
+    }
+
+    return (size_t)base;
+}
+
+size_t doc_length(const Document *doc)
+{
+    return (size_t)subtree_bytes(doc, doc->root);
+}
+
+size_t doc_line_count(const Document *doc)
+{
+    return (size_t)subtree_newlines(doc, doc->root) + 1;
+}
+
+/* Copies text to the end of the add buffer, returns where it starts there. */
+static uint64_t add_append(Document *doc, const char *text, size_t len)
+{
+    if (doc->len_add + len > doc->cap_add)
+    {
+        doc->cap_add = 2 * doc->cap_add;
+        if (doc->cap_add < doc->len_add + len)
+            doc->cap_add = doc->len_add + len + LOAD_BLOCK;
+        doc->add = realloc(doc->add, doc->cap_add);
+    }
+
+    uint64_t start = doc->len_add;
+    memcpy(&doc->add[start], text, len);
+    doc->len_add += len;
+
+    return start;
+}
+
+void doc_insert(Document *doc, size_t offset, const char *text, size_t len)
+{
+    assert(offset <= doc_length(doc));
+
+    if (!len)
+        return;
+
+    uint64_t start = add_append(doc, text, len);
+    uint32_t a, b;
+    treap_split(doc, doc->root, offset, &a, &b);
+
+    // Typing runs on in the piece the last keystroke added, rather than adding a piece per keystroke
+    if (can_extend(doc, a, start, len))
+        a = extend_last(doc, a, (uint32_t)len, count_newlines(text, len));
+    else
+        a = treap_merge(doc, a, pieces_create(doc, start | PIECE_ADD, text, len));
+
+    doc->root = treap_merge(doc, a, b);
+}
+
+void doc_delete(Document *doc, size_t offset, size_t len)
+{
+    assert(offset + len <= doc_length(doc));
+
+    if (!len)
+        return;
+
+    uint32_t a, rest, gone, b;
+
+    treap_split(doc, doc->root, offset, &a, &rest);
+    treap_split(doc, rest, len, &gone, &b);
+    node_release(doc, gone);
+
+    doc->root = treap_merge(doc, a, b);
+}
+
+typedef struct {
+    const DocRange *ranges;
+    size_t nranges;
+    // The first range not yet passed, and whether its text is in yet
+    size_t next;
+    bool replaced;
+    uint64_t text_start;
+    size_t len_text;
+
+    uint32_t *pieces;
+    size_t len_pieces, cap_pieces;
+} ReplaceState;
+
+static void replace_push(Document *doc, ReplaceState *state, uint32_t x)
+{
+    if (state->len_pieces == state->cap_pieces)
+    {
+        state->cap_pieces = state->cap_pieces < 64 ? 64 : 2 * state->cap_pieces;
+        state->pieces = realloc(state->pieces, state->cap_pieces * sizeof *state->pieces);
+    }
+
+    state->pieces[state->len_pieces++] = x;
+}
+
+/* Adds a new piece over part of an old one, whose newlines stay an estimate if they were. */
+static void replace_keep(Document *doc, ReplaceState *state, uint32_t t, uint32_t at, uint32_t len)
+{
+    // Copied, making the piece can move the pool
+    PieceNode n = doc->nodes[t];
+    uint32_t newlines;
+
+    if (at == 0 && len == n.len)
+        newlines = n.newlines;
+    else if (n.estimated)
+        newlines = (uint32_t)((uint64_t)n.newlines * len / n.len);
+    else
+        newlines = count_newlines(piece_data(doc, &n) + at, len);
+
+    uint32_t x = piece_create(doc, n.start + at, len, newlines);
+    doc->nodes[x].estimated = n.estimated;
+    replace_push(doc, state, x);
+}
+
+/* Adds pieces over the replacement text, which every range shares in the add buffer. */
+static void replace_text(Document *doc, ReplaceState *state)
+{
+    for (size_t at = 0; at < state->len_text; at += PIECE_MAX)
+    {
+        uint64_t start = state->text_start + at;
+        uint32_t n = state->len_text - at < PIECE_MAX ? (uint32_t)(state->len_text - at) : PIECE_MAX;
+
+        replace_push(doc, state, piece_create(doc, start | PIECE_ADD, n, count_newlines(&doc->add[start], n)));
+    }
+
+    state->replaced = true;
+}
+
+/* Walks the pieces in order, keeping what falls outside the ranges and putting the text in place of each range. */
+static void replace_in(Document *doc, uint32_t t, uint64_t base, ReplaceState *state)
+{
+    while (t != NODE_NONE)
+    {
+        replace_in(doc, doc->nodes[t].left, base, state);
+        base += subtree_bytes(doc, doc->nodes[t].left);
+
+        uint64_t pos = base, end = base + doc->nodes[t].len;
+
+        while (pos < end)
+        {
+            const DocRange *range = &state->ranges[state->next];
+
+            if (state->next < state->nranges && range->offset <= pos)
+            {
+                if (!state->replaced)
+                    replace_text(doc, state);
+
+                // A range running on past the piece drops the rest of it, and is passed in a later one
+                if (range->offset + range->len > end)
+                    break;
+
+                pos = range->offset + range->len;
+                state->next++;
+                state->replaced = false;
+                continue;
+            }
+
+            uint64_t stop = state->next < state->nranges && range->offset < end ? range->offset : end;
+
+            replace_keep(doc, state, t, (uint32_t)(pos - base), (uint32_t)(stop - pos));
+            pos = stop;
+        }
+
+        base = end;
+        t = doc->nodes[t].right;
+    }
+}
+
+void doc_replace_ranges(Document *doc, const DocRange *ranges, size_t nranges, const char *text, size_t len)
+{
+    if (!nranges)
+        return;
+
+    ReplaceState state = {
+        .ranges = ranges,
+        .nranges = nranges,
+        .text_start = len ? add_append(doc, text, len) : 0,
+        .len_text = len,
+    };
+
+    // Every piece there is kept in parts, at most one more part per range and the pieces of its text
+    size_t need = 2 * doc->len_nodes + nranges * (2 + len / PIECE_MAX);
+    if (need > doc->cap_nodes)
+    {
+        doc->cap_nodes = need;
+        doc->nodes = realloc(doc->nodes, doc->cap_nodes * sizeof *doc->nodes);
+        assert(doc->nodes != NULL);
+    }
+
+    replace_in(doc, doc->root, 0, &state);
+
+    // Only empty ranges at the very end are left
+    for (; state.next < nranges; state.next++, state.replaced = false)
+        if (!state.replaced)
+            replace_text(doc, &state);
+
+    uint32_t root = treap_build(doc, state.pieces, state.len_pieces);
+    node_release(doc, doc->root);
+    doc->root = root;
+
+    free(state.pieces);
+}
+
+size_t doc_chunk(const Document *doc, size_t offset, const char **data)
+{
+    uint64_t rest = offset;
+
+    for (uint32_t t = doc->root; t != NODE_NONE;)
+    {
+        const PieceNode *n = &doc->nodes[t];
+        uint64_t len_left = subtree_bytes(doc, n->left);
+
+        if (rest < len_left)
+        {
+            t = n->left;
+            continue;
+        }
+
+        rest -= len_left;
+
+        if (rest < n->len)
+        {
+            *data = piece_data(doc, n) + rest;
+            return (size_t)(n->len - rest);
+        }
+
+        rest -= n->len;
+        t = n->right;
+    }
+
+    *data = NULL;
+    return 0;
+}
+
+static size_t read_range(const Document *doc, uint32_t t, uint64_t offset, char *out, size_t len)
+{
+    size_t copied = 0;
+
+    while (t != NODE_NONE && len)
+    {
+        const PieceNode *n = &doc->nodes[t];
+        uint64_t len_left = subtree_bytes(doc, n->left);
+
+        if (offset < len_left)
+        {
+            size_t got = read_range(doc, n->left, offset, out, len);
+            out += got;
+            len -= got;
+            copied += got;
+            offset = len_left;
+        }
+
+        if (len && offset < len_left + n->len)
+        {
+            size_t at = (size_t)(offset - len_left);
+            size_t got = n->len - at < len ? n->len - at : len;
+
+            memcpy(out, piece_data(doc, n) + at, got);
+            out += got;
+            len -= got;
+            copied += got;
+            offset = len_left + n->len;
+        }
+
+        offset -= len_left + n->len;
+        t = n->right;
+    }
+
+    return copied;
+}
+
+size_t doc_read(const Document *doc, size_t offset, char *out, size_t len)
+{
+    if (offset >= doc_length(doc))
+        return 0;
+
+    return read_range(doc, doc->root, offset, out, len);
+}
+
+size_t doc_line_start(const Document *doc, size_t line)
+{
+    if (line == 0)
+        return 0;
+    if (line > subtree_newlines(doc, doc->root))
+        return doc_length(doc);
+
+    // Looks for the newline ending the line before, the line starts right after it
+    uint64_t base = 0, need = line;
+
+    for (uint32_t t = doc->root; t != NODE_NONE;)
+    {
+        const PieceNode *n = &doc->nodes[t];
+        uint64_t newlines_left = subtree_newlines(doc, n->left);
+
+        if (need <= newlines_left)
+        {
+            t = n->left;
+            continue;
+        }
+
+        need -= newlines_left;
+        base += subtree_bytes(doc, n->left);
+
+        if (need <= n->newlines)
+        {
+            const char *data = piece_data(doc, n), *end = data + n->len;
+            const char *c = data - 1;
+
+            for (uint64_t k = need; k && c; k--)
+                c = memchr(c + 1, '\n', (size_t)(end - c - 1));
+
+            if (c)
+                return (size_t)(base + (uint64_t)(c - data) + 1);
+
+            // Only an estimate can promise more lines than there are, the seek lands on a line start in proportion
+            assert(n->estimated);
+            c = data + (uint64_t)n->len * need / n->newlines;
+            while (c > data && c[-1] != '\n')
+                c--;
+
+            return (size_t)(base + (uint64_t)(c - data));
+        }
+
+        need -= n->newlines;
+        base += n->len;
+        t = n->right;
+    }
+
+    return doc_length(doc);
+}
+
+void doc_position(const Document *doc, size_t offset, size_t *line, size_t *column)
+{
+    uint64_t newlines = 0, rest = offset;
+
+    for (uint32_t t = doc->root; t != NODE_NONE;)
+    {
+        const PieceNode *n = &doc->nodes[t];
+        uint64_t len_left = subtree_bytes(doc, n->left);
+
+        if (rest < len_left)
+        {
+            t = n->left;
+            continue;
+        }
+
+        newlines += subtree_newlines(doc, n->left);
+        rest -= len_left;
+
+        if (rest < n->len)
+        {
+            const char *data = piece_data(doc, n);
+
+            if (n->estimated || rest < n->len - rest)
+                newlines += count_newlines(data, (size_t)rest);
+            else
+                newlines += n->newlines - count_newlines(data + rest, (size_t)(n->len - rest));
+            break;
+        }
+
+        newlines += n->newlines;
+        rest -= n->len;
+        t = n->right;
+    }
+
+    *line = (size_t)newlines;
+    *column = offset - doc_line_start(doc, (size_t)newlines);
+}
+
+DocSnapshot doc_snapshot(Document *doc)
+{
+    node_retain(doc, doc->root);
+    return doc->root;
+}
+
+void doc_restore(Document *doc, DocSnapshot snapshot)
+{
+    // Taken first, the snapshot may be the current contents
+    node_retain(doc, snapshot);
+    node_release(doc, doc->root);
+    doc->root = snapshot;
+}
+
+void doc_release(Document *doc, DocSnapshot snapshot)
+{
+    node_release(doc, snapshot);
+}
@@ -1,207 +1,2102 @@
-#include "theeditor.h"
-
-#ifdef UNICODE
-#undef UNICODE
-#endif
-#include <windows.h>
-#include <stdio.h>
-#include <string.h>
-#include <assert.h>
-
-void ft_init(size_t *len_listing, FileTreeItem **listing, StringArena *strarena)
-{
-    WIN32_FIND_DATA ffd;
-    HANDLE hfind = NULL;
-    const char search[] = ".\\*";
-
-    hfind = FindFirstFile(search, &ffd);
-    *len_listing = 0;
-
-    if (hfind != INVALID_HANDLE_VALUE)
-    {
-        do
-        {
-            if (strncmp(ffd.cFileName, ".", sizeof ffd.cFileName)
-                && strncmp(ffd.cFileName, "..", sizeof ffd.cFileName))
-                (*len_listing)++;
-        }
-        while (FindNextFile(hfind, &ffd));
-    }
-
-    *listing = calloc(*len_listing, sizeof **listing);
-    *strarena = (StringArena){
-        .cap = FILENAME_LEN * *len_listing,
-        .len = 0,
-        .buffer = malloc(*len_listing * FILENAME_LEN * sizeof *strarena->buffer),
-    };
-
-    hfind = FindFirstFile(search, &ffd);
-    if (hfind != INVALID_HANDLE_VALUE)
-    {
-        int i = 0;
-        do
-        {
-            if (!strncmp(ffd.cFileName, ".", sizeof ffd.cFileName)
-                || !strncmp(ffd.cFileName, "..", sizeof ffd.cFileName))
-                continue;
-
-            FileTreeItemFlags type;
-
-            if (ffd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
-                type = FTI_DIRECTORY;
-            else
-                type = FTI_FILE;
-
-            size_t len_name = strnlen(ffd.cFileName, sizeof ffd.cFileName);
-            strncpy(&strarena->buffer[strarena->len], ffd.cFileName, sizeof ffd.cFileName);
-            const char *name = &strarena->buffer[strarena->len];
-            strarena->len += len_name;
-
-            assert(strarena->len <= strarena->cap && "Enough memory should have been allocated to the arena already");
-
-            (*listing)[i++] = (FileTreeItem){
-                .depth = 1,
-                .len_name = len_name,
-                .name = name,
-                .flags = type,
-            };
-        }
-        while (FindNextFile(hfind, &ffd));
-    }
-}
-
-void ft_uninit(size_t len_listing, FileTreeItem *listing, StringArena *strarena)
-{
-    free(strarena->buffer);
-    free(listing);
-}
-
-void ft_expand(size_t *len_listing, FileTreeItem **listing, StringArena *strarena, int index)
-{
-    assert(0 <= index && index < *len_listing);
-    assert((*listing)[index].flags & FTI_DIRECTORY);
-
-    FileTreeItem *node = &(*listing)[index];
-
-    if (node->flags & FTI_EXPLORED)
-    {
-        node->flags |= FTI_OPEN;
-        return;
-    }
-
-    size_t num_dirs_in_path;
-    char *path;
-
-    { // Build the path
-        struct DirectoryName {
-            size_t len_name;
-            const char *name;
-        };
-
-        num_dirs_in_path = node->depth;
-        struct DirectoryName *dirs = malloc(num_dirs_in_path * sizeof *dirs);
-
-        size_t len_path = strlen("\\*") + 1;
-        for (int i = (int)num_dirs_in_path - 1; i >= 0; i--)
-        {
-            dirs[i].len_name = node->len_name;
-            dirs[i].name = node->name;
-
-            len_path += node->len_name;
-            if (i > 0)
-                len_path++;
-
-            int depth = node->depth;
-            while (node >= *listing && node->depth >= depth)
-                node--;
-
-            assert(node < *listing && i == 0 || node >= *listing);
-        }
-
-        path = malloc(len_path * sizeof *path);
-        char *c = path;
-
-        for (int i = 0; i < num_dirs_in_path; i++)
-        {
-            strncpy(c, dirs[i].name, dirs[i].len_name);
-            c += dirs[i].len_name;
-            if (i < num_dirs_in_path - 1)
-                *c++ = '\\';
-        }
-
-        strncpy(c, "\\*", 3);
-
-        free(dirs);
-    }
-
-    WIN32_FIND_DATA ffd;
-    HANDLE hfind = NULL;
-    size_t len_sub_listing = 0;
-
-    { // Calculate sub listing length
-        hfind = FindFirstFile(path, &ffd);
-
-        assert(hfind != INVALID_HANDLE_VALUE);
-
-        do
-        {
-            if (strncmp(ffd.cFileName, ".", sizeof ffd.cFileName)
-                && strncmp(ffd.cFileName, "..", sizeof ffd.cFileName))
-                len_sub_listing++;
-        }
-        while (FindNextFile(hfind, &ffd));
-    }
-
-    size_t len_initial = *len_listing;
-    *len_listing += len_sub_listing;
-    *listing = realloc(*listing, *len_listing * sizeof **listing);
-    assert(*listing != NULL);
-    memmove(&(*listing)[index + 1 + len_sub_listing], &(*listing)[index + 1], (len_initial - (index + 1)) * sizeof **listing);
-
-    hfind = FindFirstFile(path, &ffd);
-
-    int next_idx = index + 1;
-
-	do
-	{
-        if (!strncmp(ffd.cFileName, ".", sizeof ffd.cFileName)
-            || !strncmp(ffd.cFileName, "..", sizeof ffd.cFileName))
-            continue;
-
-        FileTreeItemFlags type;
-        if (ffd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
-            type = FTI_DIRECTORY;
-        else
-            type = FTI_FILE;
-
-        size_t len_name = strnlen(ffd.cFileName, sizeof ffd.cFileName);
-
-        if (len_name + strarena->len > strarena->cap)
-        {
-            strarena->cap += len_sub_listing;
-            strarena->buffer = realloc(strarena->buffer, strarena->cap * sizeof *strarena->buffer);
-        }
-
-        strncpy(&strarena->buffer[strarena->len], ffd.cFileName, sizeof ffd.cFileName);
-        const char *name = &strarena->buffer[strarena->len];
-        strarena->len += len_name;
-
-        (*listing)[next_idx++] = (FileTreeItem){
-            .depth = (int)num_dirs_in_path + 1,
-            .len_name = len_name,
-            .name = name,
-            .flags = type
-        };
-	}
-	while (FindNextFile(hfind, &ffd));
-
-    (*listing)[index].flags |= FTI_EXPLORED | FTI_OPEN;
-}
-
-void ft_collapse(size_t len_listing, FileTreeItem* listing, int index)
-{
-    assert(0 <= index && index < len_listing);
-    assert(listing[index].flags & FTI_DIRECTORY);
-
-    listing[index].flags &= ~FTI_OPEN;
-}
+#include "theeditor.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <assert.h>
+
+// Entries are handed to the UI thread in chunks, so huge directories stream in
+#define EXPAND_CHUNK_LEN 4096
+// At most this many entries are spliced per frame, the rest wait for the next one
+#define EXPAND_FRAME_BUDGET 16384
+
+// Filesystem events are applied once they have been quiet this long, or at the latest after the max delay
+#define WATCH_QUIET_NS 50000000ull
+#define WATCH_MAX_DELAY_NS 250000000ull
+// At most this many coalesced changes are applied per frame
+#define WATCH_FRAME_BUDGET 4096
+// Never more than this many watches, or half of what the system allows
+#define WATCH_MAX 8192
+
+// After ft_load, at most this many directories are watched and checked for changes per frame
+#define RESTORE_FRAME_BUDGET 256
+// Nodes are patched on their way into a snapshot this many at a time
+#define SNAPSHOT_BLOCK_LEN 4096
+#define SNAPSHOT_MAGIC "TEFTREE"
+#define SNAPSHOT_VERSION 1
+#define SNAPSHOT_ALIGN 64
+
+// Internal flags, kept clear of the public ones
+// A listing of the directory is in flight on the worker
+#define FTI_LISTING (1 << 5)
+// Still present in the listing being reconciled with the children
+#define FTI_SEEN    (1 << 6)
+// Removed while its listing was in flight, freed once the last chunk arrives
+#define FTI_REMOVED (1 << 7)
+
+typedef struct {
+    size_t len_name;
+    FileTreeItemFlags flags;
+} SubListingEntry;
+
+/* Entries of one directory, collected in a single pass before they are spliced into the tree. */
+typedef struct {
+    size_t len, cap;
+    SubListingEntry *entries;
+    size_t len_names, cap_names;
+    char *names;
+} SubListing;
+
+typedef struct {
+    FileTreeIndex node;
+    char *path;
+    IgnoreCache *ignore;
+    // The directory was listed before, so its children are reconciled rather than appended
+    bool reconcile;
+    // Only listed if the directory's modification time moved on from this, always if 0
+    int64_t mtime;
+} ExpandJob;
+
+typedef struct ExpandChunk {
+    struct ExpandChunk *next;
+    FileTreeIndex node;
+    bool reconcile;
+    bool last;
+    // The directory had not changed, so it was not listed and its children stand as they are
+    bool unchanged;
+    // Taken just before listing, on the last chunk
+    int64_t mtime;
+    SubListing entries;
+    IgnoreStats ignore_stats;
+} ExpandChunk;
+
+static struct {
+    PlatformThread *thread;
+    PlatformMutex *mutex;
+    PlatformCond *wake;
+    bool quit;
+
+    // Shared with the worker, guarded by the mutex
+    size_t jobs_head, len_jobs, cap_jobs;
+    ExpandJob *jobs;
+    ExpandChunk *results_head, *results_tail;
+
+    // Only touched on the UI thread
+    size_t len_pending;
+} worker;
+
+typedef enum {
+    WATCH_PRESENT,
+    WATCH_ABSENT,
+    // Renamed to the second name, or moved out of sight if to_watch is -1
+    WATCH_MOVE,
+    // The watched directory itself was deleted
+    WATCH_GONE,
+} WatchOpKind;
+
+/* The net effect of the events on one entry. */
+typedef struct {
+    WatchOpKind kind;
+    FileTreeItemFlags type;
+    int watch, to_watch;
+    // Offsets into the batch's names
+    size_t name, len_name, to_name, len_to_name;
+    uint32_t hash;
+    // The entry was deleted or moved over since the last flush, so an existing node is stale even if its type matches
+    bool replace;
+    // Later events on the same entry fold into this op, until a rename or a flush closes it
+    bool open;
+} WatchOp;
+
+static struct {
+    PlatformWatcher *platform;
+    size_t limit, len_watched;
+    // The directory each watch id belongs to, or FT_NONE
+    size_t cap_dirs;
+    FileTreeIndex *dirs;
+
+    // Events since the last flush, in order, with open ops found through the lookup table by watch and name
+    size_t len_ops, cap_ops, next_op;
+    WatchOp *ops;
+    size_t len_names, cap_names;
+    char *names;
+    size_t cap_lookup;
+    uint32_t *lookup;
+
+    // A rename whose second half has not arrived yet
+    bool move_pending;
+    uint32_t move_cookie;
+    size_t move_op;
+
+    bool overflow;
+    uint64_t first_event, last_event;
+
+    // Rules of the directory changes were last applied to, valid for one pass over the batch
+    FileTreeIndex rules_dir;
+    char *rules_path;
+    const IgnoreRules *rules;
+} watches;
+
+/**
+ * The snapshot a tree was loaded from.  Its nodes, child table and strings are used in place until they have to grow,
+ * and the directories that were watched when it was saved are caught up with a few at a time.
+ */
+static struct {
+    PlatformFileMap map;
+    const uint32_t *dirs;
+    size_t len_dirs, next_dir;
+} restore;
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    // The nodes are stored as they are in memory, so only a build with the same layout can use them
+    uint32_t node_size;
+    float scroll;
+    FileTreeIndex free_nodes, rows;
+
+    uint64_t len_nodes, cap_nodes, len_children, cap_children;
+    uint64_t nchunks, len_last, len_table, cap_table;
+    uint64_t len_dirs;
+
+    // Offsets of the sections, each aligned to SNAPSHOT_ALIGN
+    uint64_t nodes, children, chunks, table, dirs;
+} SnapshotHeader;
+
+static bool sub_listing_append(void *user, const char *name, size_t len_name, FileTreeItemFlags type)
+{
+    SubListing *sub = user;
+
+    if (sub->len >= sub->cap)
+    {
+        sub->cap = sub->cap < 64 ? 64 : 2 * sub->cap;
+        sub->entries = mem_realloc(MEM_FILETREE, sub->entries, sub->cap * sizeof *sub->entries);
+    }
+
+    if (sub->len_names + len_name > sub->cap_names)
+    {
+        sub->cap_names = 2 * sub->cap_names;
+        if (sub->cap_names < sub->len_names + len_name)
+            sub->cap_names = sub->len_names + len_name + FILENAME_LEN;
+        sub->names = mem_realloc(MEM_FILETREE, sub->names, sub->cap_names * sizeof *sub->names);
+    }
+
+    memcpy(&sub->names[sub->len_names], name, len_name);
+    sub->len_names += len_name;
+
+    sub->entries[sub->len++] = (SubListingEntry){
+        .len_name = len_name,
+        .flags = type,
+    };
+
+    return true;
+}
+
+static void sub_listing_free(SubListing *sub)
+{
+    mem_free(MEM_FILETREE, sub->entries);
+    mem_free(MEM_FILETREE, sub->names);
+}
+
+static uint32_t next_priority(void)
+{
+    static uint32_t state = 0x9e3779b9;
+
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+
+    return state;
+}
+
+static uint32_t treap_size(const FileTree *tree, FileTreeIndex t)
+{
+    return t == FT_NONE ? 0 : tree->nodes[t].size;
+}
+
+static void treap_update(FileTree *tree, FileTreeIndex t)
+{
+    FileTreeItem *n = &tree->nodes[t];
+
+    n->size = 1 + treap_size(tree, n->left) + treap_size(tree, n->right);
+
+    if (n->left != FT_NONE)
+        tree->nodes[n->left].up = t;
+    if (n->right != FT_NONE)
+        tree->nodes[n->right].up = t;
+}
+
+static FileTreeIndex treap_merge_(FileTree *tree, FileTreeIndex a, FileTreeIndex b)
+{
+    if (a == FT_NONE)
+        return b;
+    if (b == FT_NONE)
+        return a;
+
+    if (tree->nodes[a].priority > tree->nodes[b].priority)
+    {
+        tree->nodes[a].right = treap_merge_(tree, tree->nodes[a].right, b);
+        treap_update(tree, a);
+        return a;
+    }
+    else
+    {
+        tree->nodes[b].left = treap_merge_(tree, a, tree->nodes[b].left);
+        treap_update(tree, b);
+        return b;
+    }
+}
+
+static void treap_split_(FileTree *tree, FileTreeIndex t, size_t k, FileTreeIndex *a, FileTreeIndex *b)
+{
+    if (t == FT_NONE)
+    {
+        *a = *b = FT_NONE;
+        return;
+    }
+
+    FileTreeItem *n = &tree->nodes[t];
+    size_t len_left = treap_size(tree, n->left);
+
+    if (k <= len_left)
+    {
+        treap_split_(tree, n->left, k, a, &n->left);
+        treap_update(tree, t);
+        *b = t;
+    }
+    else
+    {
+        treap_split_(tree, n->right, k - len_left - 1, &n->right, b);
+        treap_update(tree, t);
+        *a = t;
+    }
+}
+
+static FileTreeIndex treap_root(FileTree *tree, FileTreeIndex t)
+{
+    if (t != FT_NONE)
+        tree->nodes[t].up = FT_NONE;
+    return t;
+}
+
+/* Concatenates the rows of two treaps. */
+static FileTreeIndex treap_merge(FileTree *tree, FileTreeIndex a, FileTreeIndex b)
+{
+    return treap_root(tree, treap_merge_(tree, a, b));
+}
+
+/* Splits the first k rows of a treap into `a`, and the rest into `b`. */
+static void treap_split(FileTree *tree, FileTreeIndex t, size_t k, FileTreeIndex *a, FileTreeIndex *b)
+{
+    treap_split_(tree, t, k, a, b);
+    treap_root(tree, *a);
+    treap_root(tree, *b);
+}
+
+/* The position of a row within its treap, found by walking up to the root. */
+static size_t treap_position(const FileTree *tree, FileTreeIndex x)
+{
+    size_t pos = treap_size(tree, tree->nodes[x].left);
+
+    for (FileTreeIndex up = tree->nodes[x].up; up != FT_NONE; x = up, up = tree->nodes[up].up)
+        if (tree->nodes[up].right == x)
+            pos += treap_size(tree, tree->nodes[up].left) + 1;
+
+    return pos;
+}
+
+static void treap_fix_sizes(FileTree *tree, FileTreeIndex t)
+{
+    if (t == FT_NONE)
+        return;
+
+    treap_fix_sizes(tree, tree->nodes[t].left);
+    treap_fix_sizes(tree, tree->nodes[t].right);
+    treap_update(tree, t);
+}
+
+/* Builds a treap over a run of consecutive nodes in O(n), keeping them in index order. */
+static FileTreeIndex treap_build(FileTree *tree, FileTreeIndex first, size_t count)
+{
+    FileTreeIndex *spine = mem_alloc(MEM_FILETREE, count * sizeof *spine);
+    size_t len_spine = 0;
+
+    for (FileTreeIndex x = first; x < first + count; x++)
+    {
+        FileTreeIndex last = FT_NONE;
+
+        while (len_spine && tree->nodes[spine[len_spine - 1]].priority < tree->nodes[x].priority)
+            last = spine[--len_spine];
+
+        tree->nodes[x].left = last;
+        if (len_spine)
+            tree->nodes[spine[len_spine - 1]].right = x;
+
+        spine[len_spine++] = x;
+    }
+
+    FileTreeIndex root = len_spine ? spine[0] : FT_NONE;
+    mem_free(MEM_FILETREE, spine);
+
+    treap_fix_sizes(tree, root);
+
+    return treap_root(tree, root);
+}
+
+/* The treap holding a node's row: the visible rows, or the hidden rows of its nearest collapsed ancestor. */
+static FileTreeIndex *row_owner(FileTree *tree, FileTreeIndex node)
+{
+    for (FileTreeIndex a = tree->nodes[node].parent; a != FT_ROOT; a = tree->nodes[a].parent)
+        if (!(tree->nodes[a].flags & FTI_OPEN))
+            return &tree->nodes[a].hidden;
+
+    return &tree->rows;
+}
+
+/* The last row shown below an open directory, or the directory itself if it has none. */
+static FileTreeIndex last_row_below(const FileTree *tree, FileTreeIndex node)
+{
+    while ((tree->nodes[node].flags & FTI_OPEN) && tree->nodes[node].last_child != FT_NONE)
+        node = tree->nodes[node].last_child;
+
+    return node;
+}
+
+/* Whether memory lies in the mapped snapshot, where it can be written but never freed or reallocated. */
+static bool in_snapshot(const void *p)
+{
+    const char *c = p, *base = restore.map.data;
+    return base && c >= base && c < base + restore.map.size;
+}
+
+static uint32_t child_hash(FileTreeIndex parent, StringHandle name)
+{
+    uint64_t key = ((uint64_t)parent << 32 | name) * 0x9e3779b97f4a7c15ull;
+    return (uint32_t)(key >> 32);
+}
+
+/* The slot holding the child of a directory with the given name, or the empty slot where it would go. */
+static size_t child_slot(const FileTree *tree, FileTreeIndex parent, StringHandle name)
+{
+    size_t mask = tree->cap_children - 1;
+    size_t slot = child_hash(parent, name) & mask;
+
+    for (; tree->children[slot] != FT_NONE; slot = (slot + 1) & mask)
+    {
+        const FileTreeItem *c = &tree->nodes[tree->children[slot]];
+        if (c->parent == parent && c->name == name)
+            break;
+    }
+
+    return slot;
+}
+
+static FileTreeIndex child_find(const FileTree *tree, FileTreeIndex parent, StringHandle name)
+{
+    if (!tree->cap_children || name == STRING_NONE)
+        return FT_NONE;
+
+    return tree->children[child_slot(tree, parent, name)];
+}
+
+static void child_insert(FileTree *tree, FileTreeIndex node)
+{
+    // Kept at most three quarters full, like the string table
+    if (4 * (tree->len_children + 1) > 3 * tree->cap_children)
+    {
+        size_t cap = tree->cap_children;
+        FileTreeIndex *children = tree->children;
+
+        tree->cap_children = cap ? 2 * cap : 1024;
+        tree->children = mem_alloc(MEM_FILETREE, tree->cap_children * sizeof *tree->children);
+        for (size_t i = 0; i < tree->cap_children; i++)
+            tree->children[i] = FT_NONE;
+
+        for (size_t i = 0; i < cap; i++)
+        {
+            if (children[i] == FT_NONE)
+                continue;
+
+            const FileTreeItem *c = &tree->nodes[children[i]];
+
+            tree->children[child_slot(tree, c->parent, c->name)] = children[i];
+        }
+
+        if (!in_snapshot(children))
+            mem_free(MEM_FILETREE, children);
+    }
+
+    size_t slot = child_slot(tree, tree->nodes[node].parent, tree->nodes[node].name);
+    assert(tree->children[slot] == FT_NONE && "duplicate name in a directory");
+
+    tree->children[slot] = node;
+    tree->len_children++;
+}
+
+static void child_remove(FileTree *tree, FileTreeIndex node)
+{
+    size_t mask = tree->cap_children - 1;
+    size_t slot = child_slot(tree, tree->nodes[node].parent, tree->nodes[node].name);
+
+    assert(tree->children[slot] == node);
+
+    // Shifts later entries of the probe run back into the hole, so no tombstones are needed
+    for (size_t next = (slot + 1) & mask; tree->children[next] != FT_NONE; next = (next + 1) & mask)
+    {
+        const FileTreeItem *c = &tree->nodes[tree->children[next]];
+        size_t home = child_hash(c->parent, c->name) & mask;
+
+        if (((next - home) & mask) >= ((next - slot) & mask))
+        {
+            tree->children[slot] = tree->children[next];
+            slot = next;
+        }
+    }
+
+    tree->children[slot] = FT_NONE;
+    tree->len_children--;
+}
+
+static FileTreeIndex tree_alloc(FileTree *tree, size_t count)
+{
+    // Single nodes reuse removed ones, longer runs must stay consecutive for treap_build
+    if (count == 1 && tree->free_nodes != FT_NONE)
+    {
+        FileTreeIndex x = tree->free_nodes;
+        tree->free_nodes = tree->nodes[x].next_sibling;
+        return x;
+    }
+
+    if (tree->len_nodes + count > tree->cap_nodes)
+    {
+        tree->cap_nodes = 2 * tree->cap_nodes;
+        if (tree->cap_nodes < tree->len_nodes + count)
+            tree->cap_nodes = tree->len_nodes + count;
+
+        if (in_snapshot(tree->nodes))
+        {
+            FileTreeItem *nodes = mem_alloc(MEM_FILETREE, tree->cap_nodes * sizeof *tree->nodes);
+            memcpy(nodes, tree->nodes, tree->len_nodes * sizeof *tree->nodes);
+            tree->nodes = nodes;
+        }
+        else
+        {
+            tree->nodes = mem_realloc(MEM_FILETREE, tree->nodes, tree->cap_nodes * sizeof *tree->nodes);
+        }
+        assert(tree->nodes != NULL);
+    }
+
+    FileTreeIndex first = (FileTreeIndex)tree->len_nodes;
+    tree->len_nodes += count;
+
+    return first;
+}
+
+static void tree_free(FileTree *tree, FileTreeIndex node)
+{
+    tree->nodes[node].flags = 0;
+    tree->nodes[node].next_sibling = tree->free_nodes;
+    tree->free_nodes = node;
+}
+
+/* Inserts rows after the last row below a directory.  Must come before they are linked in as its children. */
+static void place_rows(FileTree *tree, FileTreeIndex parent, FileTreeIndex rows)
+{
+    FileTreeItem *p = &tree->nodes[parent];
+
+    if (parent == FT_ROOT || (p->flags & FTI_OPEN))
+    {
+        FileTreeIndex *owner = parent == FT_ROOT ? &tree->rows : row_owner(tree, parent);
+        FileTreeIndex after = last_row_below(tree, parent);
+        size_t at = after == FT_ROOT ? 0 : treap_position(tree, after) + 1;
+        FileTreeIndex a, b;
+
+        treap_split(tree, *owner, at, &a, &b);
+        *owner = treap_merge(tree, a, treap_merge(tree, rows, b));
+    }
+    else
+    {
+        p->hidden = treap_merge(tree, p->hidden, rows);
+    }
+}
+
+/* Links a run of siblings in as the last children of a directory. */
+static void link_children(FileTree *tree, FileTreeIndex parent, FileTreeIndex first, FileTreeIndex last)
+{
+    FileTreeItem *p = &tree->nodes[parent];
+
+    tree->nodes[first].prev_sibling = p->last_child;
+
+    if (p->last_child != FT_NONE)
+        tree->nodes[p->last_child].next_sibling = first;
+    else
+        p->first_child = first;
+    p->last_child = last;
+}
+
+/* Appends entries as the last children of a directory, and their rows after its last row.  Returns the first one. */
+static FileTreeIndex tree_append_children(FileTree *tree, FileTreeIndex parent, const SubListing *sub)
+{
+    if (!sub->len)
+        return FT_NONE;
+
+    const char *name = sub->names;
+    FileTreeIndex first = tree_alloc(tree, sub->len);
+    int depth = tree->nodes[parent].depth + 1;
+
+    for (size_t i = 0; i < sub->len; i++)
+    {
+        FileTreeIndex x = first + (FileTreeIndex)i;
+
+        tree->nodes[x] = (FileTreeItem){
+            .name = strarena_intern(&tree->strarena, name, sub->entries[i].len_name),
+            .depth = depth,
+            .flags = sub->entries[i].flags,
+            .parent = parent,
+            .first_child = FT_NONE,
+            .last_child = FT_NONE,
+            .prev_sibling = i > 0 ? x - 1 : FT_NONE,
+            .next_sibling = i + 1 < sub->len ? x + 1 : FT_NONE,
+            .left = FT_NONE,
+            .right = FT_NONE,
+            .up = FT_NONE,
+            .priority = next_priority(),
+            .size = 1,
+            .hidden = FT_NONE,
+            .watch = -1,
+        };
+
+        child_insert(tree, x);
+        name += sub->entries[i].len_name;
+    }
+
+    place_rows(tree, parent, treap_build(tree, first, sub->len));
+    link_children(tree, parent, first, first + (FileTreeIndex)sub->len - 1);
+
+    return first;
+}
+
+/* Cuts a node's row and every row shown below it out of the treap holding them. */
+static FileTreeIndex cut_rows(FileTree *tree, FileTreeIndex node)
+{
+    FileTreeIndex *owner = row_owner(tree, node);
+    size_t begin = treap_position(tree, node);
+    size_t end = treap_position(tree, last_row_below(tree, node)) + 1;
+    FileTreeIndex a, rest, rows, b;
+
+    treap_split(tree, *owner, begin, &a, &rest);
+    treap_split(tree, rest, end - begin, &rows, &b);
+    *owner = treap_merge(tree, a, b);
+
+    return rows;
+}
+
+static void unlink_node(FileTree *tree, FileTreeIndex node)
+{
+    FileTreeItem *n = &tree->nodes[node];
+    FileTreeItem *p = &tree->nodes[n->parent];
+
+    if (n->prev_sibling != FT_NONE)
+        tree->nodes[n->prev_sibling].next_sibling = n->next_sibling;
+    else
+        p->first_child = n->next_sibling;
+
+    if (n->next_sibling != FT_NONE)
+        tree->nodes[n->next_sibling].prev_sibling = n->prev_sibling;
+    else
+        p->last_child = n->prev_sibling;
+
+    n->prev_sibling = n->next_sibling = FT_NONE;
+    child_remove(tree, node);
+}
+
+/* The node after x in a pre-order walk of everything below root, or FT_NONE at the end. */
+static FileTreeIndex subtree_next(const FileTree *tree, FileTreeIndex root, FileTreeIndex x)
+{
+    if (tree->nodes[x].first_child != FT_NONE)
+        return tree->nodes[x].first_child;
+
+    while (x != root && tree->nodes[x].next_sibling == FT_NONE)
+        x = tree->nodes[x].parent;
+
+    return x == root ? FT_NONE : tree->nodes[x].next_sibling;
+}
+
+/* Allocates the path of a node, which must be freed. */
+static char *path_alloc(const FileTree *tree, FileTreeIndex node)
+{
+    size_t len = 2;
+    for (FileTreeIndex n = node; n != FT_ROOT; n = tree->nodes[n].parent)
+        len += ft_name(tree, n).length + 1;
+
+    char *path = mem_alloc(MEM_FILETREE, len);
+    ft_path(tree, node, path, len);
+
+    return path;
+}
+
+static void watch_start(FileTree *tree, FileTreeIndex node)
+{
+    if (!watches.platform || tree->nodes[node].watch >= 0 || watches.len_watched >= watches.limit)
+        return;
+
+    char *path = path_alloc(tree, node);
+    int watch = platform_watch_add(watches.platform, path);
+    mem_free(MEM_FILETREE, path);
+
+    if (watch < 0)
+        return;
+
+    if ((size_t)watch >= watches.cap_dirs)
+    {
+        size_t cap = watches.cap_dirs < 64 ? 64 : 2 * watches.cap_dirs;
+        if (cap <= (size_t)watch)
+            cap = (size_t)watch + 1;
+
+        watches.dirs = mem_realloc(MEM_FILETREE, watches.dirs, cap * sizeof *watches.dirs);
+        for (size_t i = watches.cap_dirs; i < cap; i++)
+            watches.dirs[i] = FT_NONE;
+        watches.cap_dirs = cap;
+    }
+
+    watches.dirs[watch] = node;
+    tree->nodes[node].watch = watch;
+    watches.len_watched++;
+}
+
+static void watch_stop(FileTree *tree, FileTreeIndex node)
+{
+    int watch = tree->nodes[node].watch;
+
+    if (watch < 0)
+        return;
+
+    platform_watch_remove(watches.platform, watch);
+    watches.dirs[watch] = FT_NONE;
+    tree->nodes[node].watch = -1;
+    watches.len_watched--;
+}
+
+/* The directory a watch id belongs to, or FT_NONE if it was removed since. */
+static FileTreeIndex watch_dir(int watch)
+{
+    if (watch < 0 || (size_t)watch >= watches.cap_dirs)
+        return FT_NONE;
+
+    return watches.dirs[watch];
+}
+
+/* Removes a node with everything below it, along with their rows and watches. */
+static void tree_remove(FileTree *tree, FileTreeIndex node)
+{
+    cut_rows(tree, node);
+    unlink_node(tree, node);
+
+    // Collected first, since freeing a node overwrites the links the walk follows
+    size_t len = 0, cap = 64;
+    FileTreeIndex *doomed = mem_alloc(MEM_FILETREE, cap * sizeof *doomed);
+
+    for (FileTreeIndex x = node; x != FT_NONE; x = subtree_next(tree, node, x))
+    {
+        if (len >= cap)
+        {
+            cap *= 2;
+            doomed = mem_realloc(MEM_FILETREE, doomed, cap * sizeof *doomed);
+        }
+        doomed[len++] = x;
+    }
+
+    for (size_t i = 0; i < len; i++)
+    {
+        FileTreeIndex x = doomed[i];
+
+        if (x != node)
+            child_remove(tree, x);
+        watch_stop(tree, x);
+
+        if (tree->nodes[x].flags & FTI_LISTING)
+            tree->nodes[x].flags |= FTI_REMOVED;
+        else
+            tree_free(tree, x);
+    }
+
+    mem_free(MEM_FILETREE, doomed);
+}
+
+/* Moves a node with everything below it to the end of another directory, or renames it in place. */
+static void tree_move(FileTree *tree, FileTreeIndex node, FileTreeIndex parent, StringHandle name)
+{
+    FileTreeItem *n = &tree->nodes[node];
+
+    if (n->parent == parent)
+    {
+        child_remove(tree, node);
+        n->name = name;
+        child_insert(tree, node);
+        return;
+    }
+
+    FileTreeIndex rows = cut_rows(tree, node);
+    unlink_node(tree, node);
+
+    int delta = tree->nodes[parent].depth + 1 - n->depth;
+    if (delta)
+        for (FileTreeIndex x = node; x != FT_NONE; x = subtree_next(tree, node, x))
+            tree->nodes[x].depth += delta;
+
+    n->parent = parent;
+    n->name = name;
+
+    place_rows(tree, parent, rows);
+    link_children(tree, parent, node, node);
+    child_insert(tree, node);
+}
+
+static bool same_type(FileTreeItemFlags a, FileTreeItemFlags b)
+{
+    return (a & FTI_DIRECTORY) == (b & FTI_DIRECTORY);
+}
+
+/* Makes sure a directory has a child with this name and type, adding it or replacing one of the other type. */
+static void tree_ensure_child(FileTree *tree, FileTreeIndex parent, const char *name, size_t len_name,
+                              FileTreeItemFlags type)
+{
+    FileTreeIndex child = child_find(tree, parent, strarena_find(&tree->strarena, name, len_name));
+
+    if (child != FT_NONE)
+    {
+        if (same_type(tree->nodes[child].flags, type))
+            return;
+        tree_remove(tree, child);
+    }
+
+    SubListingEntry entry = {.len_name = len_name, .flags = type};
+    SubListing sub = {.len = 1, .entries = &entry, .names = (char *)name};
+
+    tree_append_children(tree, parent, &sub);
+}
+
+/* Folds a chunk of a fresh listing into a directory's existing children, marking the ones it still holds. */
+static void tree_merge_children(FileTree *tree, FileTreeIndex parent, const SubListing *sub)
+{
+    SubListing added = {0};
+    const char *name = sub->names;
+
+    for (size_t i = 0; i < sub->len; i++)
+    {
+        size_t len_name = sub->entries[i].len_name;
+        FileTreeIndex child = child_find(tree, parent, strarena_find(&tree->strarena, name, len_name));
+
+        if (child != FT_NONE && same_type(tree->nodes[child].flags, sub->entries[i].flags))
+        {
+            tree->nodes[child].flags |= FTI_SEEN;
+        }
+        else
+        {
+            if (child != FT_NONE)
+                tree_remove(tree, child);
+            sub_listing_append(&added, name, len_name, sub->entries[i].flags | FTI_SEEN);
+        }
+
+        name += len_name;
+    }
+
+    tree_append_children(tree, parent, &added);
+    sub_listing_free(&added);
+}
+
+/* Drops the children that the reconciled listing no longer held. */
+static void tree_sweep_children(FileTree *tree, FileTreeIndex parent)
+{
+    for (FileTreeIndex c = tree->nodes[parent].first_child, next; c != FT_NONE; c = next)
+    {
+        next = tree->nodes[c].next_sibling;
+
+        if (tree->nodes[c].flags & FTI_SEEN)
+            tree->nodes[c].flags &= ~FTI_SEEN;
+        else
+            tree_remove(tree, c);
+    }
+}
+
+/*
+ * A modification time to compare against later, or 0 if it is too recent to trust: another change within the same
+ * clock tick would leave it as it is, and the filesystem's clock may be coarse.
+ */
+static int64_t settled_mtime(int64_t mtime)
+{
+    return mtime / 1000000000 + 2 > (int64_t)time(NULL) ? 0 : mtime;
+}
+
+static void worker_push_chunk(ExpandChunk *chunk)
+{
+    platform_mutex_lock(worker.mutex);
+
+    if (worker.results_tail)
+        worker.results_tail->next = chunk;
+    else
+        worker.results_head = chunk;
+    worker.results_tail = chunk;
+
+    platform_mutex_unlock(worker.mutex);
+}
+
+typedef struct {
+    const ExpandJob *job;
+    const IgnoreRules *rules;
+    ExpandChunk *chunk;
+} ChunkWriter;
+
+static ExpandChunk *chunk_create(const ExpandJob *job)
+{
+    ExpandChunk *chunk = mem_calloc(MEM_FILETREE, 1, sizeof *chunk);
+    chunk->node = job->node;
+    chunk->reconcile = job->reconcile;
+    return chunk;
+}
+
+static bool chunk_writer_append(void *user, const char *name, size_t len_name, FileTreeItemFlags type)
+{
+    ChunkWriter *writer = user;
+
+    if (!ignore_keep(writer->rules, writer->job->path, name, len_name, type, &writer->chunk->ignore_stats))
+        return true;
+
+    sub_listing_append(&writer->chunk->entries, name, len_name, type);
+
+    if (writer->chunk->entries.len < EXPAND_CHUNK_LEN)
+        return true;
+
+    worker_push_chunk(writer->chunk);
+    writer->chunk = chunk_create(writer->job);
+
+    platform_mutex_lock(worker.mutex);
+    bool quit = worker.quit;
+    platform_mutex_unlock(worker.mutex);
+
+    return !quit;
+}
+
+static void worker_main(void *arg)
+{
+    platform_mutex_lock(worker.mutex);
+
+    for (;;)
+    {
+        while (!worker.quit && worker.jobs_head == worker.len_jobs)
+            platform_cond_wait(worker.wake, worker.mutex);
+
+        if (worker.quit)
+            break;
+
+        ExpandJob job = worker.jobs[worker.jobs_head++];
+        if (worker.jobs_head == worker.len_jobs)
+            worker.jobs_head = worker.len_jobs = 0;
+
+        platform_mutex_unlock(worker.mutex);
+
+        ChunkWriter writer = {
+            .job = &job,
+            .rules = ignore_rules_for(job.ignore, job.path),
+            .chunk = chunk_create(&job),
+        };
+
+        TRACE_BEGIN("ft_list_directory");
+
+        // Taken before listing, so a change made while it runs shows up as a newer time the next time round
+        int64_t mtime = platform_file_mtime(job.path);
+
+        if (job.mtime && mtime == job.mtime)
+            writer.chunk->unchanged = true;
+        else if (!platform_list_directory(job.path, chunk_writer_append, &writer))
+        {
+            fprintf(stderr, "Failed to list directory %s\n", job.path);
+            // Without a time the listing is not trusted as it stands, it is done again the next time
+            mtime = 0;
+        }
+
+        TRACE_END();
+
+        // The final chunk is pushed even when empty, it marks the directory as done
+        writer.chunk->last = true;
+        writer.chunk->mtime = settled_mtime(mtime);
+        worker_push_chunk(writer.chunk);
+        mem_free(MEM_FILETREE, job.path);
+
+        platform_mutex_lock(worker.mutex);
+    }
+
+    platform_mutex_unlock(worker.mutex);
+}
+
+static void worker_submit(ExpandJob job)
+{
+    if (!worker.thread)
+    {
+        worker.mutex = platform_mutex_create();
+        worker.wake = platform_cond_create();
+        worker.quit = false;
+        worker.thread = platform_thread_create(worker_main, NULL);
+        assert(worker.thread && "could not start the file tree worker");
+    }
+
+    platform_mutex_lock(worker.mutex);
+
+    if (worker.len_jobs >= worker.cap_jobs)
+    {
+        worker.cap_jobs = worker.cap_jobs < 16 ? 16 : 2 * worker.cap_jobs;
+        worker.jobs = mem_realloc(MEM_FILETREE, worker.jobs, worker.cap_jobs * sizeof *worker.jobs);
+    }
+    worker.jobs[worker.len_jobs++] = job;
+
+    platform_cond_signal(worker.wake);
+    platform_mutex_unlock(worker.mutex);
+}
+
+static void worker_stop(void)
+{
+    if (!worker.thread)
+        return;
+
+    platform_mutex_lock(worker.mutex);
+    worker.quit = true;
+    platform_cond_broadcast(worker.wake);
+    platform_mutex_unlock(worker.mutex);
+
+    platform_thread_join(worker.thread);
+
+    for (size_t i = worker.jobs_head; i < worker.len_jobs; i++)
+        mem_free(MEM_FILETREE, worker.jobs[i].path);
+
+    for (ExpandChunk *chunk = worker.results_head, *next; chunk; chunk = next)
+    {
+        next = chunk->next;
+        sub_listing_free(&chunk->entries);
+        mem_free(MEM_FILETREE, chunk);
+    }
+
+    platform_cond_destroy(worker.wake);
+    platform_mutex_destroy(worker.mutex);
+    mem_free(MEM_FILETREE, worker.jobs);
+    memset(&worker, 0, sizeof worker);
+}
+
+/*
+ * Lists a directory on the worker, reconciling the result with its children if it was listed before.  If asked, it is
+ * left alone when its modification time still matches the one of its last listing.
+ */
+static void submit_listing(FileTree *tree, FileTreeIndex node, bool only_if_changed)
+{
+    FileTreeItem *n = &tree->nodes[node];
+    bool reconcile = n->flags & FTI_EXPLORED;
+
+    n->flags |= FTI_LISTING;
+    if (!reconcile)
+        n->flags |= FTI_LOADING;
+
+    worker.len_pending++;
+    worker_submit((ExpandJob){
+        .node = node,
+        .path = path_alloc(tree, node),
+        .ignore = tree->ignore,
+        .reconcile = reconcile,
+        .mtime = only_if_changed ? n->mtime : 0,
+    });
+}
+
+/* Splices the chunks the worker has finished into the tree, within the frame budget. */
+static void poll_listings(FileTree *tree)
+{
+    if (!worker.thread || !worker.len_pending)
+        return;
+
+    size_t budget = EXPAND_FRAME_BUDGET;
+
+    while (budget)
+    {
+        platform_mutex_lock(worker.mutex);
+        ExpandChunk *chunk = worker.results_head;
+        if (chunk)
+        {
+            worker.results_head = chunk->next;
+            if (!worker.results_head)
+                worker.results_tail = NULL;
+        }
+        platform_mutex_unlock(worker.mutex);
+
+        if (!chunk)
+            break;
+
+        FileTreeIndex node = chunk->node;
+
+        if (tree->nodes[node].flags & FTI_REMOVED)
+        {
+            if (chunk->last)
+                tree_free(tree, node);
+        }
+        else
+        {
+            if (chunk->reconcile)
+                tree_merge_children(tree, node, &chunk->entries);
+            else
+                tree_append_children(tree, node, &chunk->entries);
+
+            if (chunk->last)
+            {
+                if (chunk->reconcile && !chunk->unchanged)
+                    tree_sweep_children(tree, node);
+
+                FileTreeItem *n = &tree->nodes[node];
+                n->flags &= ~(FTI_LOADING | FTI_LISTING);
+                n->flags |= FTI_EXPLORED;
+                n->mtime = chunk->mtime;
+            }
+        }
+
+        if (chunk->last)
+            worker.len_pending--;
+
+        tree->ignore_stats.evaluations += chunk->ignore_stats.evaluations;
+        tree->ignore_stats.pruned += chunk->ignore_stats.pruned;
+        budget = chunk->entries.len < budget ? budget - chunk->entries.len : 0;
+
+        sub_listing_free(&chunk->entries);
+        mem_free(MEM_FILETREE, chunk);
+    }
+}
+
+static void watches_start(FileTree *tree)
+{
+    if (!watches.platform)
+    {
+        watches.platform = platform_watcher_create();
+        if (!watches.platform)
+            return;
+
+        // Leaves room for other programs watching the same user's files
+        watches.limit = platform_watch_limit() / 2;
+        if (watches.limit > WATCH_MAX)
+            watches.limit = WATCH_MAX;
+    }
+
+    watch_start(tree, FT_ROOT);
+}
+
+static void watches_stop(void)
+{
+    if (watches.platform)
+        platform_watcher_destroy(watches.platform);
+
+    mem_free(MEM_FILETREE, watches.rules_path);
+    mem_free(MEM_FILETREE, watches.dirs);
+    mem_free(MEM_FILETREE, watches.ops);
+    mem_free(MEM_FILETREE, watches.names);
+    mem_free(MEM_FILETREE, watches.lookup);
+    memset(&watches, 0, sizeof watches);
+}
+
+static uint32_t watch_hash(int watch, const char *name, size_t len_name)
+{
+    uint32_t hash = 2166136261u ^ (uint32_t)watch;
+
+    for (size_t i = 0; i < len_name; i++)
+    {
+        hash ^= (uint8_t)name[i];
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+static size_t watch_push_name(const char *name, size_t len_name)
+{
+    if (watches.len_names + len_name > watches.cap_names)
+    {
+        watches.cap_names = 2 * watches.cap_names;
+        if (watches.cap_names < watches.len_names + len_name)
+            watches.cap_names = watches.len_names + len_name + 16 * FILENAME_LEN;
+        watches.names = mem_realloc(MEM_FILETREE, watches.names, watches.cap_names);
+    }
+
+    memcpy(&watches.names[watches.len_names], name, len_name);
+    watches.len_names += len_name;
+
+    return watches.len_names - len_name;
+}
+
+static void lookup_insert(size_t op)
+{
+    size_t mask = watches.cap_lookup - 1;
+    size_t slot = watches.ops[op].hash & mask;
+
+    while (watches.lookup[slot])
+        slot = (slot + 1) & mask;
+
+    watches.lookup[slot] = (uint32_t)op + 1;
+}
+
+/* The open op on an entry, which a new event on it folds into. */
+static WatchOp *watch_find_open(int watch, const char *name, size_t len_name, uint32_t hash)
+{
+    if (!watches.cap_lookup)
+        return NULL;
+
+    size_t mask = watches.cap_lookup - 1;
+
+    for (size_t slot = hash & mask; watches.lookup[slot]; slot = (slot + 1) & mask)
+    {
+        WatchOp *op = &watches.ops[watches.lookup[slot] - 1];
+
+        if (op->open && op->hash == hash && op->watch == watch && op->len_name == len_name
+            && !memcmp(&watches.names[op->name], name, len_name))
+            return op;
+    }
+
+    return NULL;
+}
+
+static void watch_push_op(WatchOpKind kind, const PlatformWatchEvent *event, uint32_t hash)
+{
+    if (watches.len_ops >= watches.cap_ops)
+    {
+        watches.cap_ops = watches.cap_ops < 256 ? 256 : 2 * watches.cap_ops;
+        watches.ops = mem_realloc(MEM_FILETREE, watches.ops, watches.cap_ops * sizeof *watches.ops);
+    }
+
+    size_t index = watches.len_ops++;
+
+    watches.ops[index] = (WatchOp){
+        .kind = kind,
+        .type = event->type,
+        .watch = event->watch,
+        .to_watch = -1,
+        .name = watch_push_name(event->name, event->len_name),
+        .len_name = event->len_name,
+        .hash = hash,
+        .open = kind == WATCH_PRESENT || kind == WATCH_ABSENT,
+    };
+
+    if (!watches.ops[index].open)
+        return;
+
+    // The lookup table stays at most half full of ops, open or not
+    if (2 * watches.len_ops > watches.cap_lookup)
+    {
+        watches.cap_lookup = watches.cap_lookup ? 2 * watches.cap_lookup : 1024;
+        mem_free(MEM_FILETREE, watches.lookup);
+        watches.lookup = mem_calloc(MEM_FILETREE, watches.cap_lookup, sizeof *watches.lookup);
+
+        for (size_t i = 0; i < watches.len_ops; i++)
+            if (watches.ops[i].open)
+                lookup_insert(i);
+    }
+    else
+    {
+        lookup_insert(index);
+    }
+}
+
+/* Coalesces an event into the batch, so an entry touched many times in a burst is only updated once. */
+static void watch_event(void *user, const PlatformWatchEvent *event)
+{
+    uint64_t now = platform_time_ns();
+
+    if (watches.len_ops == watches.next_op && !watches.overflow)
+        watches.first_event = now;
+    watches.last_event = now;
+
+    uint32_t hash = watch_hash(event->watch, event->name, event->len_name);
+    WatchOp *op;
+
+    switch (event->kind)
+    {
+    case PLATFORM_WATCH_MOVED_TO:
+        if (watches.move_pending && watches.move_cookie == event->cookie)
+        {
+            // A rename ends the run of events that can fold together on both of its names
+            if ((op = watch_find_open(event->watch, event->name, event->len_name, hash)))
+                op->open = false;
+
+            size_t to_name = watch_push_name(event->name, event->len_name);
+
+            op = &watches.ops[watches.move_op];
+            op->to_watch = event->watch;
+            op->to_name = to_name;
+            op->len_to_name = event->len_name;
+            watches.move_pending = false;
+            break;
+        }
+        // Moved in from somewhere unwatched, which looks like a creation over whatever had the name
+        // fallthrough
+    case PLATFORM_WATCH_CREATED:
+    case PLATFORM_WATCH_DELETED:
+    {
+        WatchOpKind kind = event->kind == PLATFORM_WATCH_DELETED ? WATCH_ABSENT : WATCH_PRESENT;
+
+        if ((op = watch_find_open(event->watch, event->name, event->len_name, hash)))
+        {
+            op->replace |= op->kind == WATCH_ABSENT;
+            op->kind = kind;
+            op->type = event->type;
+        }
+        else
+        {
+            watch_push_op(kind, event, hash);
+            op = &watches.ops[watches.len_ops - 1];
+        }
+
+        op->replace |= event->kind == PLATFORM_WATCH_MOVED_TO;
+        break;
+    }
+    case PLATFORM_WATCH_MOVED_FROM:
+        if ((op = watch_find_open(event->watch, event->name, event->len_name, hash)))
+            op->open = false;
+
+        watch_push_op(WATCH_MOVE, event, hash);
+        watches.move_pending = true;
+        watches.move_cookie = event->cookie;
+        watches.move_op = watches.len_ops - 1;
+        break;
+    case PLATFORM_WATCH_GONE:
+        watch_push_op(WATCH_GONE, event, hash);
+        break;
+    case PLATFORM_WATCH_OVERFLOW:
+        watches.overflow = true;
+        break;
+    }
+}
+
+/* Whether an op touches a directory that is still being listed, whose listing could undo it. */
+static bool watch_op_waits(const FileTree *tree, const WatchOp *op)
+{
+    FileTreeIndex dir = watch_dir(op->watch);
+    FileTreeIndex to = watch_dir(op->to_watch);
+
+    return (dir != FT_NONE && (tree->nodes[dir].flags & FTI_LISTING))
+        || (to != FT_NONE && (tree->nodes[to].flags & FTI_LISTING));
+}
+
+/* Whether a directory's ignore rules let an entry in, remembering the rules of the last directory asked about. */
+static bool watch_keeps(FileTree *tree, FileTreeIndex dir, const char *name, size_t len_name, FileTreeItemFlags type)
+{
+    if (dir != watches.rules_dir)
+    {
+        mem_free(MEM_FILETREE, watches.rules_path);
+        watches.rules_dir = dir;
+        watches.rules_path = path_alloc(tree, dir);
+        watches.rules = ignore_rules_for(tree->ignore, watches.rules_path);
+    }
+
+    return ignore_keep(watches.rules, watches.rules_path, name, len_name, type, &tree->ignore_stats);
+}
+
+static void watch_apply(FileTree *tree, const WatchOp *op)
+{
+    FileTreeIndex dir = watch_dir(op->watch);
+
+    // The directory went away earlier in the batch
+    if (dir == FT_NONE)
+        return;
+
+    const char *name = &watches.names[op->name];
+    FileTreeIndex child = child_find(tree, dir, strarena_find(&tree->strarena, name, op->len_name));
+
+    switch (op->kind)
+    {
+    case WATCH_PRESENT:
+        if (op->replace && child != FT_NONE)
+            tree_remove(tree, child);
+        if (watch_keeps(tree, dir, name, op->len_name, op->type))
+            tree_ensure_child(tree, dir, name, op->len_name, op->type);
+        break;
+    case WATCH_ABSENT:
+        if (child != FT_NONE)
+            tree_remove(tree, child);
+        break;
+    case WATCH_MOVE:
+    {
+        FileTreeIndex to = watch_dir(op->to_watch);
+        const char *to_name = &watches.names[op->to_name];
+
+        if (to != FT_NONE && !watch_keeps(tree, to, to_name, op->len_to_name, op->type))
+            to = FT_NONE;
+
+        if (child == FT_NONE)
+        {
+            if (to != FT_NONE)
+                tree_ensure_child(tree, to, to_name, op->len_to_name, op->type);
+            break;
+        }
+
+        if (to == FT_NONE)
+        {
+            tree_remove(tree, child);
+            break;
+        }
+
+        // Renaming over an existing entry replaces it
+        FileTreeIndex existing = child_find(tree, to, strarena_find(&tree->strarena, to_name, op->len_to_name));
+        if (existing == child)
+            break;
+        if (existing != FT_NONE)
+            tree_remove(tree, existing);
+
+        tree_move(tree, child, to, strarena_intern(&tree->strarena, to_name, op->len_to_name));
+        break;
+    }
+    case WATCH_GONE:
+        // When the parent is watched too, its own deletion event already took care of it
+        if (dir != FT_ROOT && tree->nodes[tree->nodes[dir].parent].watch < 0)
+            tree_remove(tree, dir);
+        break;
+    }
+}
+
+/* Applies the batch once the burst has settled, a frame budget at a time. */
+static void poll_watches(FileTree *tree)
+{
+    if (!watches.platform)
+        return;
+
+    platform_watcher_poll(watches.platform, watch_event, NULL);
+
+    if (watches.overflow)
+    {
+        // Whatever was dropped is found by listing every watched directory again
+        for (size_t i = 0; i < watches.cap_dirs; i++)
+            if (watches.dirs[i] != FT_NONE && !(tree->nodes[watches.dirs[i]].flags & FTI_LISTING))
+                submit_listing(tree, watches.dirs[i], false);
+
+        watches.next_op = watches.len_ops;
+        watches.overflow = false;
+    }
+
+    if (watches.next_op == watches.len_ops)
+        return;
+
+    // A batch is held back until it settles, but once it has started it is applied without waiting again
+    uint64_t now = platform_time_ns();
+    if (!watches.next_op
+        && now - watches.last_event < WATCH_QUIET_NS
+        && now - watches.first_event < WATCH_MAX_DELAY_NS)
+        return;
+
+    // Nodes freed during the pass may come back as other directories, but never as watched ones
+    watches.rules_dir = FT_NONE;
+
+    for (size_t end = watches.next_op + WATCH_FRAME_BUDGET; watches.next_op < watches.len_ops && watches.next_op < end;)
+    {
+        WatchOp *op = &watches.ops[watches.next_op];
+
+        if (watch_op_waits(tree, op))
+            return;
+
+        // Applied without its second half, it was moved out of sight
+        if (watches.move_pending && watches.move_op == watches.next_op)
+            watches.move_pending = false;
+
+        op->open = false;
+        watch_apply(tree, op);
+        watches.next_op++;
+    }
+
+    if (watches.next_op == watches.len_ops)
+    {
+        watches.len_ops = watches.next_op = 0;
+        watches.len_names = 0;
+        if (watches.lookup)
+            memset(watches.lookup, 0, watches.cap_lookup * sizeof *watches.lookup);
+    }
+}
+
+/* Starts an empty tree holding only the root. */
+static void tree_reset(FileTree *tree)
+{
+    *tree = (FileTree){.rows = FT_NONE, .free_nodes = FT_NONE};
+    strarena_init(&tree->strarena);
+    tree->ignore = ignore_cache_create(".");
+
+    FileTreeIndex root = tree_alloc(tree, 1);
+    tree->nodes[root] = (FileTreeItem){
+        .name = strarena_intern(&tree->strarena, ".", 1),
+        .depth = 0,
+        .flags = FTI_DIRECTORY | FTI_OPEN | FTI_EXPLORED,
+        .parent = FT_NONE,
+        .first_child = FT_NONE,
+        .last_child = FT_NONE,
+        .prev_sibling = FT_NONE,
+        .next_sibling = FT_NONE,
+        .left = FT_NONE,
+        .right = FT_NONE,
+        .up = FT_NONE,
+        .hidden = FT_NONE,
+        .watch = -1,
+    };
+
+    watches_start(tree);
+}
+
+typedef struct {
+    SubListing sub;
+    const IgnoreRules *rules;
+    IgnoreStats *stats;
+} RootListing;
+
+static bool root_listing_append(void *user, const char *name, size_t len_name, FileTreeItemFlags type)
+{
+    RootListing *listing = user;
+
+    if (ignore_keep(listing->rules, ".", name, len_name, type, listing->stats))
+        sub_listing_append(&listing->sub, name, len_name, type);
+
+    return true;
+}
+
+void ft_init(FileTree *tree)
+{
+    TRACE_BEGIN("ft_init");
+    tree_reset(tree);
+
+    RootListing listing = {
+        .rules = ignore_rules_for(tree->ignore, "."),
+        .stats = &tree->ignore_stats,
+    };
+
+    platform_list_directory(".", root_listing_append, &listing);
+    tree_append_children(tree, FT_ROOT, &listing.sub);
+
+    sub_listing_free(&listing.sub);
+    TRACE_END();
+}
+
+void ft_populate(FileTree *tree, const WorkspaceSnapshot *snapshot)
+{
+    ft_uninit(tree);
+    tree_reset(tree);
+
+    // Snapshot entries map to tree nodes; a directory's entry always comes before the run of its children
+    FileTreeIndex *nodes = mem_alloc(MEM_FILETREE, snapshot->len * sizeof *nodes);
+    nodes[0] = FT_ROOT;
+
+    SubListing sub = {0};
+
+    for (size_t i = 1; i < snapshot->len;)
+    {
+        uint32_t parent = snapshot->parent[i];
+        size_t run = i;
+
+        sub.len = sub.len_names = 0;
+
+        for (; run < snapshot->len && snapshot->parent[run] == parent; run++)
+        {
+            String name = strarena_get(&snapshot->strarena, snapshot->name[run]);
+            FileTreeItemFlags flags = snapshot->flags[run] & FTI_DIRECTORY ? FTI_DIRECTORY | FTI_EXPLORED : FTI_FILE;
+
+            sub_listing_append(&sub, name.data, name.length, flags);
+        }
+
+        FileTreeIndex first = tree_append_children(tree, nodes[parent], &sub);
+
+        for (size_t j = i; j < run; j++)
+        {
+            nodes[j] = first + (FileTreeIndex)(j - i);
+
+            // Stat'ed by the crawl before it listed the directory, so it dates the children it found
+            if (snapshot->flags[j] & FTI_DIRECTORY)
+                tree->nodes[nodes[j]].mtime = settled_mtime(snapshot->mtime[j]);
+        }
+
+        i = run;
+    }
+
+    sub_listing_free(&sub);
+    mem_free(MEM_FILETREE, nodes);
+}
+
+void ft_uninit(FileTree *tree)
+{
+    worker_stop();
+    watches_stop();
+    strarena_uninit(&tree->strarena);
+    if (!in_snapshot(tree->nodes))
+        mem_free(MEM_FILETREE, tree->nodes);
+    if (!in_snapshot(tree->children))
+        mem_free(MEM_FILETREE, tree->children);
+    ignore_cache_destroy(tree->ignore);
+    platform_unmap_file(&restore.map);
+    memset(&restore, 0, sizeof restore);
+    *tree = (FileTree){.rows = FT_NONE, .free_nodes = FT_NONE};
+}
+
+void ft_expand(FileTree *tree, FileTreeIndex node)
+{
+    assert(node != FT_ROOT && node < tree->len_nodes);
+    assert(tree->nodes[node].flags & FTI_DIRECTORY);
+
+    FileTreeItem *n = &tree->nodes[node];
+
+    if (n->flags & FTI_OPEN)
+        return;
+
+    TRACE_BEGIN("ft_expand");
+    n->flags |= FTI_OPEN;
+    watch_start(tree, node);
+
+    // Changes made while the directory was closed went unwatched, so it is always listed again
+    if (!(n->flags & FTI_LISTING))
+        submit_listing(tree, node, false);
+
+    if (n->hidden != FT_NONE)
+    {
+        FileTreeIndex *owner = row_owner(tree, node);
+        FileTreeIndex a, b;
+
+        treap_split(tree, *owner, treap_position(tree, node) + 1, &a, &b);
+        *owner = treap_merge(tree, treap_merge(tree, a, n->hidden), b);
+        n->hidden = FT_NONE;
+    }
+
+    TRACE_END();
+}
+
+/* Watches the directories that were watched when the snapshot was saved, and lists the ones that changed since. */
+static void poll_restore(FileTree *tree)
+{
+    size_t end = restore.next_dir + RESTORE_FRAME_BUDGET;
+
+    while (restore.next_dir < restore.len_dirs && restore.next_dir < end)
+    {
+        FileTreeIndex node = restore.dirs[restore.next_dir++];
+
+        if (node >= tree->len_nodes)
+            continue;
+
+        // Gone by now, or collapsed and expanded again which listed it already
+        FileTreeItem *n = &tree->nodes[node];
+        if ((n->flags & (FTI_DIRECTORY | FTI_OPEN)) != (FTI_DIRECTORY | FTI_OPEN) || (n->flags & FTI_LISTING))
+            continue;
+
+        // Watched before the modification time is compared, so no change can fall between the two
+        watch_start(tree, node);
+        submit_listing(tree, node, true);
+    }
+}
+
+void ft_poll(FileTree *tree)
+{
+    TRACE_BEGIN("ft_poll");
+    poll_listings(tree);
+    poll_restore(tree);
+    poll_watches(tree);
+    TRACE_END();
+}
+
+bool ft_busy(const FileTree *tree)
+{
+    return worker.len_pending || restore.next_dir < restore.len_dirs;
+}
+
+typedef struct {
+    FILE *file;
+    uint64_t offset;
+    bool ok;
+} SnapshotWriter;
+
+static void snapshot_write(SnapshotWriter *writer, const void *data, size_t size)
+{
+    writer->ok = writer->ok && fwrite(data, 1, size, writer->file) == size;
+    writer->offset += size;
+}
+
+/* Moves past bytes that are only ever read as zeros, which leaves a hole where the filesystem supports them. */
+static void snapshot_skip(SnapshotWriter *writer, uint64_t size)
+{
+    writer->ok = writer->ok && !fseek(writer->file, (long)size, SEEK_CUR);
+    writer->offset += size;
+}
+
+/* Starts a section, returns its offset. */
+static uint64_t snapshot_section(SnapshotWriter *writer)
+{
+    snapshot_skip(writer, (SNAPSHOT_ALIGN - writer->offset % SNAPSHOT_ALIGN) % SNAPSHOT_ALIGN);
+    return writer->offset;
+}
+
+bool ft_save(const FileTree *tree, const char *path, float scroll)
+{
+    size_t len_path = strlen(path);
+    char *temp = mem_alloc(MEM_FILETREE, len_path + 5);
+    memcpy(temp, path, len_path);
+    memcpy(&temp[len_path], ".new", 5);
+
+    SnapshotWriter writer = {.file = fopen(temp, "wb"), .ok = true};
+
+    if (!writer.file)
+    {
+        mem_free(MEM_FILETREE, temp);
+        return false;
+    }
+
+    const StringArena *arena = &tree->strarena;
+    SnapshotHeader header = {
+        .magic = SNAPSHOT_MAGIC,
+        .version = SNAPSHOT_VERSION,
+        .node_size = sizeof(FileTreeItem),
+        .scroll = scroll,
+        .free_nodes = tree->free_nodes,
+        .rows = tree->rows,
+        .len_nodes = tree->len_nodes,
+        // Room to grow without copying the nodes out of the mapping, left as a hole in the file
+        .cap_nodes = tree->len_nodes + tree->len_nodes / 4 + 1024,
+        .len_children = tree->len_children,
+        .cap_children = tree->cap_children,
+        .nchunks = arena->nchunks,
+        .len_last = arena->len_last,
+        .len_table = arena->len_table,
+        .cap_table = arena->cap_table,
+    };
+
+    snapshot_skip(&writer, sizeof header);
+
+    // Nodes are written as they are, except for the state that only made sense while this run was going
+    size_t len_dirs = 0, cap_dirs = 64;
+    uint32_t *dirs = mem_alloc(MEM_FILETREE, cap_dirs * sizeof *dirs);
+    FileTreeItem *block = mem_alloc(MEM_FILETREE, SNAPSHOT_BLOCK_LEN * sizeof *block);
+
+    header.nodes = snapshot_section(&writer);
+
+    for (size_t first = 0; first < tree->len_nodes; first += SNAPSHOT_BLOCK_LEN)
+    {
+        size_t len = tree->len_nodes - first < SNAPSHOT_BLOCK_LEN ? tree->len_nodes - first : SNAPSHOT_BLOCK_LEN;
+        memcpy(block, &tree->nodes[first], len * sizeof *block);
+
+        for (size_t i = 0; i < len; i++)
+        {
+            FileTreeItem *n = &block[i];
+            FileTreeIndex x = (FileTreeIndex)(first + i);
+
+            // Waiting for its listing to finish before it could be freed
+            if (n->flags & FTI_REMOVED)
+            {
+                n->flags = 0;
+                n->next_sibling = header.free_nodes;
+                header.free_nodes = x;
+                continue;
+            }
+
+            bool restored = n->watch >= 0;
+
+            // A listing cut short keeps what arrived, and is listed again in full after loading
+            if (n->flags & FTI_LISTING)
+            {
+                n->flags |= FTI_EXPLORED;
+                n->mtime = 0;
+                restored = true;
+            }
+
+            n->flags &= ~(FTI_LOADING | FTI_LISTING | FTI_SEEN);
+            n->watch = -1;
+
+            if (restored)
+            {
+                if (len_dirs >= cap_dirs)
+                {
+                    cap_dirs *= 2;
+                    dirs = mem_realloc(MEM_FILETREE, dirs, cap_dirs * sizeof *dirs);
+                }
+                dirs[len_dirs++] = x;
+            }
+        }
+
+        snapshot_write(&writer, block, len * sizeof *block);
+    }
+
+    snapshot_skip(&writer, (header.cap_nodes - header.len_nodes) * sizeof *block);
+    mem_free(MEM_FILETREE, block);
+
+    // Every chunk is stored whole, so handles keep their offsets and the last chunk can still be appended to
+    header.chunks = snapshot_section(&writer);
+    for (size_t i = 0; i < arena->nchunks; i++)
+    {
+        size_t size = (size_t)STRARENA_FIRST_CHUNK << i;
+        size_t used = i + 1 == arena->nchunks ? arena->len_last : size;
+
+        snapshot_write(&writer, arena->chunks[i], used);
+        snapshot_skip(&writer, size - used);
+    }
+
+    header.children = snapshot_section(&writer);
+    snapshot_write(&writer, tree->children, tree->cap_children * sizeof *tree->children);
+
+    header.table = snapshot_section(&writer);
+    snapshot_write(&writer, arena->table, arena->cap_table * sizeof *arena->table);
+    snapshot_write(&writer, arena->hashes, arena->cap_table * sizeof *arena->hashes);
+
+    header.dirs = snapshot_section(&writer);
+    header.len_dirs = len_dirs;
+    snapshot_write(&writer, dirs, len_dirs * sizeof *dirs);
+    mem_free(MEM_FILETREE, dirs);
+
+    // The header goes in last, so a snapshot cut short never looks complete
+    writer.ok = writer.ok && !fseek(writer.file, 0, SEEK_SET);
+    snapshot_write(&writer, &header, sizeof header);
+
+    bool ok = !fclose(writer.file) && writer.ok && platform_replace_file(temp, path);
+    if (!ok)
+        remove(temp);
+
+    mem_free(MEM_FILETREE, temp);
+
+    return ok;
+}
+
+/* Whether a section of `count` elements lies inside the file after the end of the one before, moving `end` past it. */
+static bool section_fits(size_t size, uint64_t *end, uint64_t offset, uint64_t count, size_t len_element)
+{
+    if (offset % SNAPSHOT_ALIGN || offset < *end || offset > size || count > (size - offset) / len_element)
+        return false;
+
+    *end = offset + count * len_element;
+    return true;
+}
+
+static bool is_pow2(uint64_t x)
+{
+    return x && !(x & (x - 1));
+}
+
+/* Checks that a header describes a complete snapshot of this build's layout, with its sections in order in the file. */
+static bool snapshot_valid(const SnapshotHeader *h, size_t size)
+{
+    if (size < sizeof *h || memcmp(h->magic, SNAPSHOT_MAGIC, sizeof h->magic) || h->version != SNAPSHOT_VERSION
+        || h->node_size != sizeof(FileTreeItem))
+        return false;
+
+    if (!h->len_nodes || h->len_nodes > h->cap_nodes || h->cap_nodes >= FT_NONE
+        || (h->rows != FT_NONE && h->rows >= h->len_nodes)
+        || !is_pow2(h->cap_children) || h->len_children >= h->cap_children
+        || !h->nchunks || h->nchunks > STRARENA_MAX_CHUNKS
+        || h->len_last > (uint64_t)STRARENA_FIRST_CHUNK << (h->nchunks - 1)
+        || !is_pow2(h->cap_table) || h->len_table >= h->cap_table)
+        return false;
+
+    uint64_t end = sizeof *h;
+
+    return section_fits(size, &end, h->nodes, h->cap_nodes, sizeof(FileTreeItem))
+        && section_fits(size, &end, h->chunks, ((uint64_t)1 << h->nchunks) - 1, STRARENA_FIRST_CHUNK)
+        && section_fits(size, &end, h->children, h->cap_children, sizeof(FileTreeIndex))
+        && section_fits(size, &end, h->table, 2 * h->cap_table, sizeof(uint32_t))
+        && section_fits(size, &end, h->dirs, h->len_dirs, sizeof(uint32_t));
+}
+
+/* Whether an index read from a snapshot is FT_NONE or a node in use. */
+static bool link_valid(const FileTree *tree, FileTreeIndex x)
+{
+    return x == FT_NONE || (x < tree->len_nodes && tree->nodes[x].flags);
+}
+
+/* The row after x among those shown below `top` when it is open, or FT_NONE after the last. */
+static FileTreeIndex shown_next(const FileTree *tree, FileTreeIndex top, FileTreeIndex x)
+{
+    if ((tree->nodes[x].flags & FTI_OPEN) && tree->nodes[x].first_child != FT_NONE)
+        return tree->nodes[x].first_child;
+
+    while (x != top && tree->nodes[x].next_sibling == FT_NONE)
+        x = tree->nodes[x].parent;
+
+    return x == top ? FT_NONE : tree->nodes[x].next_sibling;
+}
+
+/* Whether a treap holds exactly the rows shown below `top` when it is open, in order. */
+static bool snapshot_rows_valid(const FileTree *tree, FileTreeIndex top, FileTreeIndex treap)
+{
+    FileTreeIndex row = treap;
+    while (row != FT_NONE && tree->nodes[row].left != FT_NONE)
+        row = tree->nodes[row].left;
+
+    for (FileTreeIndex x = tree->nodes[top].first_child; x != FT_NONE; x = shown_next(tree, top, x))
+    {
+        if (row != x)
+            return false;
+        row = ft_next_visible(tree, row);
+    }
+
+    return row == FT_NONE;
+}
+
+/* Checks the links and name of one node in use, and that its flags are ones ft_save leaves. */
+static bool snapshot_node_valid(const FileTree *tree, FileTreeIndex x)
+{
+    const FileTreeItem *nodes = tree->nodes, *n = &nodes[x];
+    bool dir = n->flags & FTI_DIRECTORY;
+
+    if ((n->flags & ~(FTI_FILE | FTI_DIRECTORY | FTI_OPEN | FTI_EXPLORED))
+        || dir == (bool)(n->flags & FTI_FILE) || (!dir && (n->flags & (FTI_OPEN | FTI_EXPLORED)))
+        || (n->first_child != FT_NONE && !(n->flags & FTI_EXPLORED))
+        || (n->hidden != FT_NONE && (n->flags & FTI_OPEN)))
+        return false;
+
+    if (!strarena_handle_valid(&tree->strarena, n->name) || n->watch != -1 || !link_valid(tree, n->parent)
+        || !link_valid(tree, n->first_child) || !link_valid(tree, n->last_child) || !link_valid(tree, n->prev_sibling)
+        || !link_valid(tree, n->next_sibling) || !link_valid(tree, n->left) || !link_valid(tree, n->right)
+        || !link_valid(tree, n->up) || !link_valid(tree, n->hidden))
+        return false;
+
+    // Parents are always one level up and treap sizes always shrink going down, so no walk goes round in circles
+    if (x != FT_ROOT
+        && (n->parent == FT_NONE || !(nodes[n->parent].flags & FTI_DIRECTORY)
+            || (int64_t)n->depth != (int64_t)nodes[n->parent].depth + 1
+            || n->size != 1 + treap_size(tree, n->left) + treap_size(tree, n->right)
+            || tree->children[child_slot(tree, n->parent, n->name)] != x))
+        return false;
+
+    return (n->prev_sibling == FT_NONE || nodes[n->prev_sibling].next_sibling == x)
+        && (n->next_sibling == FT_NONE
+            || (nodes[n->next_sibling].prev_sibling == x && nodes[n->next_sibling].parent == n->parent))
+        && (n->first_child == FT_NONE) == (n->last_child == FT_NONE)
+        && (n->first_child == FT_NONE
+            || (nodes[n->first_child].parent == x && nodes[n->first_child].prev_sibling == FT_NONE))
+        && (n->last_child == FT_NONE
+            || (nodes[n->last_child].parent == x && nodes[n->last_child].next_sibling == FT_NONE))
+        && (n->left == FT_NONE || nodes[n->left].up == x) && (n->right == FT_NONE || nodes[n->right].up == x)
+        && (n->up == FT_NONE || nodes[n->up].left == x || nodes[n->up].right == x)
+        && (n->hidden == FT_NONE || nodes[n->hidden].up == FT_NONE);
+}
+
+/*
+ * Checks a tree read from a snapshot before anything walks it: every index against the node count and every name
+ * against the arena, every link against its other end, and every treap against the rows its directories show.
+ */
+static bool snapshot_tree_valid(const FileTree *tree, const uint32_t *dirs, size_t len_dirs)
+{
+    const FileTreeItem *nodes = tree->nodes, *root = &nodes[FT_ROOT];
+    size_t len_children = 0, len_used = 0, len_reached = 0;
+
+    // First, as the nodes are then looked up in it
+    for (size_t i = 0; i < tree->cap_children; i++)
+    {
+        if (tree->children[i] == FT_NONE)
+            continue;
+
+        if (tree->children[i] == FT_ROOT || !link_valid(tree, tree->children[i]))
+            return false;
+        len_children++;
+    }
+
+    if (len_children != tree->len_children || root->flags != (FTI_DIRECTORY | FTI_OPEN | FTI_EXPLORED)
+        || root->depth || root->parent != FT_NONE || root->prev_sibling != FT_NONE || root->next_sibling != FT_NONE
+        || root->left != FT_NONE || root->right != FT_NONE || root->up != FT_NONE || root->hidden != FT_NONE)
+        return false;
+
+    for (size_t i = 0; i < tree->len_nodes; i++)
+    {
+        // Not in use, and only reached through the free list
+        if (!nodes[i].flags)
+            continue;
+
+        if (!snapshot_node_valid(tree, (FileTreeIndex)i))
+            return false;
+        len_used++;
+    }
+
+    // Every node in use hangs off the root, each found once in the children table and once in a treap
+    for (FileTreeIndex x = subtree_next(tree, FT_ROOT, FT_ROOT); x != FT_NONE; x = subtree_next(tree, FT_ROOT, x))
+    {
+        len_reached++;
+
+        if ((nodes[x].flags & FTI_DIRECTORY) && !(nodes[x].flags & FTI_OPEN)
+            && !snapshot_rows_valid(tree, x, nodes[x].hidden))
+            return false;
+    }
+
+    if (len_reached + 1 != len_used || len_children != len_reached || !link_valid(tree, tree->rows)
+        || (tree->rows != FT_NONE && nodes[tree->rows].up != FT_NONE)
+        || !snapshot_rows_valid(tree, FT_ROOT, tree->rows))
+        return false;
+
+    // Bounded by the node count, so a free list that loops back on itself ends too
+    size_t len_free = 0;
+    for (FileTreeIndex x = tree->free_nodes; x != FT_NONE; x = nodes[x].next_sibling)
+        if (x >= tree->len_nodes || nodes[x].flags || ++len_free > tree->len_nodes)
+            return false;
+
+    for (size_t i = 0; i < len_dirs; i++)
+        if (dirs[i] >= tree->len_nodes)
+            return false;
+
+    // Every entry of the table is then one of the names found in it
+    return strarena_table_valid(&tree->strarena);
+}
+
+bool ft_load(FileTree *tree, const char *path, float *scroll)
+{
+    PlatformFileMap map;
+
+    if (!platform_map_file(path, &map))
+        return false;
+
+    const SnapshotHeader *header = map.data;
+    char *base = map.data;
+
+    if (!snapshot_valid(header, map.size))
+    {
+        platform_unmap_file(&map);
+        return false;
+    }
+
+    FileTree loaded = {
+        .len_nodes = header->len_nodes,
+        .cap_nodes = header->cap_nodes,
+        .nodes = (FileTreeItem *)&base[header->nodes],
+        .free_nodes = header->free_nodes,
+        .rows = header->rows,
+        .len_children = header->len_children,
+        .cap_children = header->cap_children,
+        .children = (FileTreeIndex *)&base[header->children],
+    };
+    const uint32_t *dirs = (const uint32_t *)&base[header->dirs];
+
+    TRACE_BEGIN("snapshot_tree_valid");
+    strarena_init(&loaded.strarena);
+    strarena_borrow(&loaded.strarena, &base[header->chunks], header->nchunks, header->len_last, &base[header->table],
+        header->len_table, header->cap_table);
+
+    bool valid = snapshot_tree_valid(&loaded, dirs, header->len_dirs);
+    TRACE_END();
+
+    if (!valid)
+    {
+        platform_unmap_file(&map);
+        return false;
+    }
+
+    *tree = loaded;
+    tree->ignore = ignore_cache_create(".");
+
+    restore.map = map;
+    restore.dirs = dirs;
+    restore.len_dirs = header->len_dirs;
+    restore.next_dir = 0;
+
+    *scroll = header->scroll;
+    watches_start(tree);
+
+    return true;
+}
+
+void ft_collapse(FileTree *tree, FileTreeIndex node)
+{
+    assert(node != FT_ROOT && node < tree->len_nodes);
+    assert(tree->nodes[node].flags & FTI_DIRECTORY);
+
+    if (!(tree->nodes[node].flags & FTI_OPEN))
+        return;
+
+    TRACE_BEGIN("ft_collapse");
+    FileTreeIndex last = last_row_below(tree, node);
+
+    if (last != node)
+    {
+        FileTreeIndex *owner = row_owner(tree, node);
+        size_t begin = treap_position(tree, node) + 1;
+        size_t end = treap_position(tree, last) + 1;
+        FileTreeIndex a, rest, below, b;
+
+        treap_split(tree, *owner, begin, &a, &rest);
+        treap_split(tree, rest, end - begin, &below, &b);
+        *owner = treap_merge(tree, a, b);
+        tree->nodes[node].hidden = below;
+    }
+
+    tree->nodes[node].flags &= ~FTI_OPEN;
+    watch_stop(tree, node);
+    TRACE_END();
+}
+
+size_t ft_visible_count(const FileTree *tree)
+{
+    return treap_size(tree, tree->rows);
+}
+
+FileTreeIndex ft_visible_row(const FileTree *tree, size_t row)
+{
+    FileTreeIndex t = tree->rows;
+
+    while (t != FT_NONE)
+    {
+        size_t len_left = treap_size(tree, tree->nodes[t].left);
+
+        if (row < len_left)
+        {
+            t = tree->nodes[t].left;
+        }
+        else if (row == len_left)
+        {
+            return t;
+        }
+        else
+        {
+            row -= len_left + 1;
+            t = tree->nodes[t].right;
+        }
+    }
+
+    return FT_NONE;
+}
+
+FileTreeIndex ft_next_visible(const FileTree *tree, FileTreeIndex node)
+{
+    const FileTreeItem *nodes = tree->nodes;
+
+    if (nodes[node].right != FT_NONE)
+    {
+        node = nodes[node].right;
+        while (nodes[node].left != FT_NONE)
+            node = nodes[node].left;
+        return node;
+    }
+
+    while (nodes[node].up != FT_NONE && nodes[nodes[node].up].right == node)
+        node = nodes[node].up;
+
+    return nodes[node].up;
+}
+
+String ft_name(const FileTree *tree, FileTreeIndex node)
+{
+    return strarena_get(&tree->strarena, tree->nodes[node].name);
+}
+
+size_t ft_path(const FileTree *tree, FileTreeIndex node, char *buffer, size_t size)
+{
+    if (node == FT_ROOT)
+    {
+        if (size < 2)
+            return 0;
+        buffer[0] = '.';
+        buffer[1] = '\0';
+        return 1;
+    }
+
+    size_t len = 0;
+    for (FileTreeIndex n = node; n != FT_ROOT; n = tree->nodes[n].parent)
+        len += ft_name(tree, n).length + 1;
+    len--;
+
+    if (len + 1 > size)
+        return 0;
+
+    char *c = &buffer[len];
+    *c = '\0';
+
+    for (FileTreeIndex n = node; n != FT_ROOT; n = tree->nodes[n].parent)
+    {
+        String name = ft_name(tree, n);
+        c -= name.length;
+        memcpy(c, name.data, name.length);
+        if (c > buffer)
+            *--c = PATH_SEPARATOR;
+    }
+
+    return len;
+}
@@ -0,0 +1,627 @@
+#include "theeditor.h"
+
+#include <stdio.h>
+#include <string.h>
+
+// Files at least this big are mapped, smaller ones are read into a buffer each worker keeps
+#define MAP_THRESHOLD (1 << 20)
+// A NUL byte this near the start marks a file as binary, the same test git and grep make
+#define SNIFF_BYTES 8192
+// Lines past this many in one file are not kept
+#define MAX_FILE_LINES 1000
+// Excerpts are cut to this many bytes, starting this far before the match when the whole line does not fit
+#define EXCERPT_BYTES 200
+#define EXCERPT_BEFORE 40
+// Files are searched this much at a time, so a cancelled search stops partway into a big one
+#define SCAN_CHUNK (1 << 20)
+
+typedef struct {
+    char *path;
+    uint64_t size;
+    // For a directory, the rules of its parent; its own ignore files are only read if its listing holds them
+    const IgnoreRules *rules;
+    bool is_dir;
+} FindTask;
+
+/* A file's results as a worker hands them over, in one allocation with the lines, excerpts and path after it. */
+typedef struct ResultNode {
+    void *volatile next;
+    FindFileResult result;
+} ResultNode;
+
+/*
+ * Results go from the workers to the UI thread through an intrusive queue: a worker swaps its node in as the head in
+ * one atomic step and then links the old head to it, and the UI thread alone walks from the tail.  Workers never wait
+ * on each other or on the UI, and the UI never waits on a worker.
+ */
+typedef struct {
+    void *volatile head;
+    ResultNode *tail;
+    ResultNode stub;
+} ResultQueue;
+
+typedef struct {
+    uint32_t len_name;
+    uint8_t type;
+    uint64_t size;
+} ListedEntry;
+
+typedef struct {
+    FindInFiles *find;
+    PlatformThread *thread;
+
+    char *buffer;
+    size_t cap_buffer;
+
+    // One directory's listing, and the tasks made from it
+    size_t len_entries, cap_entries;
+    ListedEntry *entries;
+    size_t len_names, cap_names;
+    char *names;
+    size_t cap_tasks;
+    FindTask *tasks;
+
+    // One file's matches, with the excerpts laid end to end and their data pointing nowhere until packed
+    size_t len_lines, cap_lines;
+    FindLine *lines;
+    size_t len_excerpts, cap_excerpts;
+    char *excerpts;
+
+    FindStats stats;
+} FindWorker;
+
+struct FindInFiles {
+    Search *search;
+    IgnoreCache *ignore;
+    size_t len_root;
+    int nworkers;
+    FindWorker *workers;
+
+    PlatformMutex *mutex;
+    PlatformCond *wake;
+    // Taken last in first out, so the crawl goes depth first and the queue stays short
+    size_t len_tasks, cap_tasks;
+    FindTask *tasks;
+    // Tasks queued or being worked on; the search is over when it reaches 0
+    size_t pending;
+    bool cancelled;
+    FindStats stats;
+
+    ResultQueue queue;
+    // Only touched by the thread that polls
+    size_t len_files, cap_files;
+    ResultNode **files;
+};
+
+static void queue_init(ResultQueue *queue)
+{
+    queue->stub.next = NULL;
+    queue->head = &queue->stub;
+    queue->tail = &queue->stub;
+}
+
+static void queue_push(ResultQueue *queue, ResultNode *node)
+{
+    node->next = NULL;
+
+    ResultNode *prev = platform_atomic_exchange_ptr(&queue->head, node);
+
+    // Until this store the list seems to end at prev, and the consumer picks the node up on a later pop
+    platform_atomic_store_ptr(&prev->next, node);
+}
+
+/* Returns NULL when the queue is empty, or when the only node left is still being linked in by its worker. */
+static ResultNode *queue_pop(ResultQueue *queue)
+{
+    ResultNode *tail = queue->tail;
+    ResultNode *next = platform_atomic_load_ptr(&tail->next);
+
+    if (tail == &queue->stub)
+    {
+        if (!next)
+            return NULL;
+
+        queue->tail = next;
+        tail = next;
+        next = platform_atomic_load_ptr(&tail->next);
+    }
+
+    if (next)
+    {
+        queue->tail = next;
+        return tail;
+    }
+
+    if (tail != platform_atomic_load_ptr(&queue->head))
+        return NULL;
+
+    // The last node can only be taken once something follows it, so the stub goes back in behind it
+    queue_push(queue, &queue->stub);
+    next = platform_atomic_load_ptr(&tail->next);
+
+    if (next)
+    {
+        queue->tail = next;
+        return tail;
+    }
+
+    return NULL;
+}
+
+static void add_stats(FindStats *to, const FindStats *from)
+{
+    to->files += from->files;
+    to->bytes += from->bytes;
+    to->binary += from->binary;
+    to->lines += from->lines;
+    to->ignore_stats.evaluations += from->ignore_stats.evaluations;
+    to->ignore_stats.pruned += from->ignore_stats.pruned;
+}
+
+/* Finishes the worker's last task, if it had one, and waits for the next.  False once there is nothing left to do. */
+static bool take_task(FindWorker *self, bool finished, FindTask *task)
+{
+    FindInFiles *find = self->find;
+    bool found = false;
+
+    platform_mutex_lock(find->mutex);
+
+    if (finished)
+    {
+        add_stats(&find->stats, &self->stats);
+        self->stats = (FindStats){0};
+
+        if (!--find->pending)
+            platform_cond_broadcast(find->wake);
+    }
+
+    for (;;)
+    {
+        if (find->cancelled || !find->pending)
+            break;
+
+        if (find->len_tasks)
+        {
+            *task = find->tasks[--find->len_tasks];
+            found = true;
+            break;
+        }
+
+        platform_cond_wait(find->wake, find->mutex);
+    }
+
+    platform_mutex_unlock(find->mutex);
+
+    return found;
+}
+
+static bool list_entry(void *user, const PlatformDirEntry *entry)
+{
+    FindWorker *self = user;
+
+    if (self->len_entries >= self->cap_entries)
+    {
+        self->cap_entries = self->cap_entries < 64 ? 64 : 2 * self->cap_entries;
+        self->entries = realloc(self->entries, self->cap_entries * sizeof *self->entries);
+    }
+
+    if (self->len_names + entry->len_name > self->cap_names)
+    {
+        self->cap_names = 2 * self->cap_names + entry->len_name + FILENAME_LEN;
+        self->names = realloc(self->names, self->cap_names);
+    }
+
+    memcpy(&self->names[self->len_names], entry->name, entry->len_name);
+    self->len_names += entry->len_name;
+
+    self->entries[self->len_entries++] = (ListedEntry){
+        .len_name = (uint32_t)entry->len_name,
+        .type = (uint8_t)entry->type,
+        .size = entry->size,
+    };
+
+    return true;
+}
+
+/* Lists a directory and queues everything in it that is not ignored.  Only the queueing itself holds the lock. */
+static void search_directory(FindWorker *self, const FindTask *task)
+{
+    FindInFiles *find = self->find;
+    const char *rel = task->path[find->len_root] ? &task->path[find->len_root + 1] : ".";
+    const IgnoreRules *rules = task->rules;
+
+    self->len_entries = 0;
+    self->len_names = 0;
+    platform_list_directory_stat(task->path, list_entry, self);
+
+    if (find->ignore)
+    {
+        bool has_files = false;
+        const char *name = self->names;
+
+        for (size_t i = 0; i < self->len_entries; name += self->entries[i++].len_name)
+            has_files |= ignore_is_rule_file(name, self->entries[i].len_name);
+
+        rules = ignore_rules_child(find->ignore, rules, rel, has_files);
+    }
+
+    size_t len_path = strlen(task->path);
+    const char *name = self->names;
+    size_t len_tasks = 0;
+
+    if (self->cap_tasks < self->len_entries)
+    {
+        self->cap_tasks = self->len_entries;
+        self->tasks = realloc(self->tasks, self->cap_tasks * sizeof *self->tasks);
+    }
+
+    for (size_t i = 0; i < self->len_entries; name += self->entries[i++].len_name)
+    {
+        const ListedEntry *entry = &self->entries[i];
+
+        if (!ignore_keep(rules, rel, name, entry->len_name, entry->type, &self->stats.ignore_stats))
+            continue;
+
+        char *path = malloc(len_path + entry->len_name + 2);
+        memcpy(path, task->path, len_path);
+        path[len_path] = PATH_SEPARATOR;
+        memcpy(&path[len_path + 1], name, entry->len_name);
+        path[len_path + 1 + entry->len_name] = '\0';
+
+        self->tasks[len_tasks++] = (FindTask){
+            .path = path,
+            .size = entry->size,
+            .rules = rules,
+            .is_dir = entry->type & FTI_DIRECTORY,
+        };
+    }
+
+    if (!len_tasks)
+        return;
+
+    platform_mutex_lock(find->mutex);
+
+    if (find->len_tasks + len_tasks > find->cap_tasks)
+    {
+        find->cap_tasks = 2 * find->cap_tasks + len_tasks;
+        find->tasks = realloc(find->tasks, find->cap_tasks * sizeof *find->tasks);
+    }
+
+    memcpy(&find->tasks[find->len_tasks], self->tasks, len_tasks * sizeof *self->tasks);
+    find->len_tasks += len_tasks;
+    find->pending += len_tasks;
+
+    if (len_tasks > 1)
+        platform_cond_broadcast(find->wake);
+    else
+        platform_cond_signal(find->wake);
+
+    platform_mutex_unlock(find->mutex);
+}
+
+/* Reads a small file whole into the worker's buffer, returns false if it could not be read. */
+static bool read_file(FindWorker *self, const char *path, uint64_t size_hint, size_t *len)
+{
+    FILE *f = fopen(path, "rb");
+
+    if (!f)
+        return false;
+
+    // Reads go straight into the buffer, a stdio buffer of its own would only be one more copy
+    setvbuf(f, NULL, _IONBF, 0);
+
+    // One byte more than expected, so a file read whole is known to be at its end without another pass
+    if (self->cap_buffer < size_hint + 1)
+    {
+        self->cap_buffer = (size_t)size_hint + 1;
+        self->buffer = realloc(self->buffer, self->cap_buffer);
+    }
+
+    size_t at = 0;
+
+    for (size_t nread; (nread = fread(&self->buffer[at], 1, self->cap_buffer - at, f)) > 0;)
+    {
+        at += nread;
+
+        // The file grew since it was listed
+        if (at == self->cap_buffer)
+        {
+            self->cap_buffer *= 2;
+            self->buffer = realloc(self->buffer, self->cap_buffer);
+        }
+    }
+
+    bool ok = !ferror(f);
+    fclose(f);
+    *len = at;
+
+    return ok;
+}
+
+static void add_line(FindWorker *self, const char *text, size_t line, size_t line_start, size_t line_end,
+    DocRange match)
+{
+    size_t start = line_start;
+    size_t end = match.offset + match.len;
+
+    if (end - line_start > EXCERPT_BYTES)
+        start = match.offset - line_start > EXCERPT_BEFORE ? match.offset - EXCERPT_BEFORE : line_start;
+    end = line_end - start > EXCERPT_BYTES ? start + EXCERPT_BYTES : line_end;
+
+    if (self->len_lines >= self->cap_lines)
+    {
+        self->cap_lines = self->cap_lines < 16 ? 16 : 2 * self->cap_lines;
+        self->lines = realloc(self->lines, self->cap_lines * sizeof *self->lines);
+    }
+
+    if (self->len_excerpts + (end - start) > self->cap_excerpts)
+    {
+        self->cap_excerpts = 2 * self->cap_excerpts + EXCERPT_BYTES;
+        self->excerpts = realloc(self->excerpts, self->cap_excerpts);
+    }
+
+    memcpy(&self->excerpts[self->len_excerpts], &text[start], end - start);
+
+    size_t match_end = match.offset + match.len < end ? match.offset + match.len : end;
+
+    self->lines[self->len_lines++] = (FindLine){
+        .line = line,
+        .column = match.offset - line_start,
+        // The offset into the excerpts until packed
+        .excerpt = {.length = end - start, .data = (char *)(uintptr_t)self->len_excerpts},
+        .match_start = (uint32_t)(match.offset - start),
+        .match_len = (uint32_t)(match_end - match.offset),
+    };
+    self->len_excerpts += end - start;
+}
+
+/* Copies the lines found in a file into a node of their own and hands it to the UI thread. */
+static void push_result(FindWorker *self, const char *rel, bool truncated)
+{
+    size_t len_rel = strlen(rel);
+    ResultNode *node = malloc(sizeof *node + self->len_lines * sizeof *self->lines + self->len_excerpts + len_rel);
+    FindLine *lines = (FindLine *)(node + 1);
+    char *excerpts = (char *)&lines[self->len_lines];
+    char *path = &excerpts[self->len_excerpts];
+
+    memcpy(lines, self->lines, self->len_lines * sizeof *lines);
+    memcpy(excerpts, self->excerpts, self->len_excerpts);
+    memcpy(path, rel, len_rel);
+
+    for (size_t i = 0; i < self->len_lines; i++)
+        lines[i].excerpt.data = &excerpts[(uintptr_t)lines[i].excerpt.data];
+
+    node->result = (FindFileResult){
+        .path = {.length = len_rel, .data = path},
+        .nlines = self->len_lines,
+        .lines = lines,
+        .truncated = truncated,
+    };
+
+    queue_push(&self->find->queue, node);
+}
+
+static bool is_cancelled(FindInFiles *find)
+{
+    platform_mutex_lock(find->mutex);
+    bool cancelled = find->cancelled;
+    platform_mutex_unlock(find->mutex);
+
+    return cancelled;
+}
+
+static void search_file(FindWorker *self, const FindTask *task)
+{
+    FindInFiles *find = self->find;
+    PlatformFileMap map = {0};
+    const char *text;
+    size_t len;
+
+    if (task->size >= MAP_THRESHOLD && platform_map_file_readonly(task->path, &map))
+    {
+        text = map.data;
+        len = map.size;
+    }
+    else if (read_file(self, task->path, task->size, &len))
+    {
+        text = self->buffer;
+    }
+    else
+    {
+        return;
+    }
+
+    if (memchr(text, '\0', len < SNIFF_BYTES ? len : SNIFF_BYTES))
+    {
+        self->stats.binary++;
+        platform_unmap_file(&map);
+        return;
+    }
+
+    self->stats.files++;
+    self->stats.bytes += len;
+    self->len_lines = 0;
+    self->len_excerpts = 0;
+
+    // Lines are only counted up to each match, a file with none is never counted at all
+    size_t line = 0, counted = 0;
+    size_t overlap = search_overlap(find->search);
+    bool truncated = false;
+    DocRange match;
+
+    for (size_t from = 0; from <= len;)
+    {
+        // Chunks end on a newline, so the first match in one is the first in the file from `from` on
+        const char *newline = len - from > overlap + SCAN_CHUNK
+                                ? memchr(&text[from + overlap + SCAN_CHUNK], '\n', len - from - overlap - SCAN_CHUNK)
+                                : NULL;
+        size_t end = newline ? (size_t)(newline - text) : len;
+
+        if (!search_buffer(find->search, text, end, from, &match))
+        {
+            if (end == len || is_cancelled(find))
+                break;
+
+            from = end + 1 - overlap;
+            continue;
+        }
+
+        line += doc_count_newlines(&text[counted], match.offset - counted);
+        counted = match.offset;
+
+        size_t line_start = match.offset;
+        while (line_start > 0 && text[line_start - 1] != '\n')
+            line_start--;
+
+        if (self->len_lines == MAX_FILE_LINES)
+        {
+            truncated = true;
+            break;
+        }
+
+        const char *line_newline = memchr(&text[match.offset], '\n', len - match.offset);
+        size_t line_end = line_newline ? (size_t)(line_newline - text) : len;
+
+        add_line(self, text, line, line_start, line_end, match);
+
+        // Only the first match of a line is reported
+        from = line_end + 1;
+    }
+
+    self->stats.lines += self->len_lines;
+
+    if (self->len_lines)
+        push_result(self, &task->path[find->len_root + 1], truncated);
+
+    platform_unmap_file(&map);
+}
+
+static void find_worker_main(void *arg)
+{
+    FindWorker *self = arg;
+    FindTask task;
+
+    for (bool finished = false; take_task(self, finished, &task); finished = true)
+    {
+        if (task.is_dir)
+            search_directory(self, &task);
+        else
+            search_file(self, &task);
+
+        free(task.path);
+    }
+}
+
+FindInFiles *find_start(const char *root, Search *search, IgnoreCache *ignore, int nthreads)
+{
+    FindInFiles *find = calloc(1, sizeof *find);
+
+    if (nthreads <= 0)
+        nthreads = platform_cpu_count();
+
+    find->search = search;
+    find->ignore = ignore;
+    find->len_root = strlen(root);
+    find->mutex = platform_mutex_create();
+    find->wake = platform_cond_create();
+    queue_init(&find->queue);
+
+    char *root_path = malloc(find->len_root + 1);
+    memcpy(root_path, root, find->len_root + 1);
+
+    find->cap_tasks = 256;
+    find->tasks = malloc(find->cap_tasks * sizeof *find->tasks);
+    find->tasks[find->len_tasks++] = (FindTask){.path = root_path, .is_dir = true};
+    find->pending = 1;
+
+    find->workers = calloc(nthreads, sizeof *find->workers);
+
+    for (int i = 0; i < nthreads; i++)
+    {
+        find->workers[i].find = find;
+        find->workers[i].thread = platform_thread_create(find_worker_main, &find->workers[i]);
+        if (find->workers[i].thread)
+            find->nworkers = i + 1;
+    }
+
+    return find;
+}
+
+bool find_poll(FindInFiles *find)
+{
+    // Read first: once the count is 0 every node has been pushed, so the pops below take in all of them
+    platform_mutex_lock(find->mutex);
+    bool running = find->pending && !find->cancelled;
+    platform_mutex_unlock(find->mutex);
+
+    for (ResultNode *node; (node = queue_pop(&find->queue));)
+    {
+        if (find->len_files >= find->cap_files)
+        {
+            find->cap_files = find->cap_files < 64 ? 64 : 2 * find->cap_files;
+            find->files = realloc(find->files, find->cap_files * sizeof *find->files);
+        }
+
+        find->files[find->len_files++] = node;
+    }
+
+    return running;
+}
+
+size_t find_file_count(const FindInFiles *find)
+{
+    return find->len_files;
+}
+
+const FindFileResult *find_file(const FindInFiles *find, size_t index)
+{
+    return &find->files[index]->result;
+}
+
+FindStats find_stats(FindInFiles *find)
+{
+    platform_mutex_lock(find->mutex);
+    FindStats stats = find->stats;
+    platform_mutex_unlock(find->mutex);
+
+    return stats;
+}
+
+void find_destroy(FindInFiles *find)
+{
+    platform_mutex_lock(find->mutex);
+    find->cancelled = true;
+    platform_cond_broadcast(find->wake);
+    platform_mutex_unlock(find->mutex);
+
+    for (int i = 0; i < find->nworkers; i++)
+    {
+        FindWorker *worker = &find->workers[i];
+
+        if (worker->thread)
+            platform_thread_join(worker->thread);
+
+        free(worker->buffer);
+        free(worker->entries);
+        free(worker->names);
+        free(worker->tasks);
+        free(worker->lines);
+        free(worker->excerpts);
+    }
+
+    // Every worker is gone, so nothing is halfway into the queue any more
+    find_poll(find);
+
+    for (size_t i = 0; i < find->len_files; i++)
+        free(find->files[i]);
+    for (size_t i = 0; i < find->len_tasks; i++)
+        free(find->tasks[i].path);
+
+    free(find->files);
+    free(find->tasks);
+    free(find->workers);
+    platform_cond_destroy(find->wake);
+    platform_mutex_destroy(find->mutex);
+    search_destroy(find->search);
+    free(find);
+}
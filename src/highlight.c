@@ -0,0 +1,678 @@
+#include "theeditor.h"
+
+#include <assert.h>
+#include <string.h>
+
+// Lines past the last one asked for that are lexed as well, so scrolling a little needs no lexing
+#define HL_MARGIN 64
+#define HL_READ_BLOCK (1 << 16)
+#define KEYWORD_SLOTS 512
+#define KEYWORD_MAX_LEN 16
+// A raw string's delimiter is at most this long, so one is only looked for that far after a ')'
+#define RAW_DELIMITER_MAX 16
+
+/*
+ * The state a line starts in.  The low bits say what construct is still open at the end of the line before, for a raw
+ * string the rest hold a hash of its delimiter.
+ */
+#define STATE_NORMAL 0u
+#define STATE_BLOCK_COMMENT 1u
+#define STATE_LINE_COMMENT 2u
+#define STATE_STRING 3u
+#define STATE_CHAR 4u
+#define STATE_RAW_STRING 5u
+#define STATE_MODE_MASK 7u
+#define STATE_UNKNOWN UINT32_MAX
+
+typedef enum {
+    CC_OTHER,
+    CC_SPACE,
+    CC_IDENT,
+    CC_DIGIT,
+    CC_QUOTE,
+    CC_APOSTROPHE,
+    CC_SLASH,
+    CC_HASH,
+    CC_DOT,
+} CharClass;
+
+typedef struct {
+    const char *word;
+    TokenKind kind;
+} Keyword;
+
+typedef struct {
+    const char *word;
+    uint8_t len;
+    uint8_t kind;
+} KeywordSlot;
+
+/**
+ * What a lexer needs to know about a language of the C family: its keywords and whether it has raw strings.  The
+ * lookup tables are built the first time the language is used.
+ */
+struct Language {
+    const char *const *extensions;
+    const Keyword *keywords;
+    size_t nkeywords;
+    bool raw_strings;
+
+    bool built;
+    uint8_t classes[256];
+    KeywordSlot slots[KEYWORD_SLOTS];
+};
+
+#define C_KEYWORDS \
+    {"auto", TOKEN_KEYWORD}, {"break", TOKEN_KEYWORD}, {"case", TOKEN_KEYWORD}, {"const", TOKEN_KEYWORD}, \
+    {"continue", TOKEN_KEYWORD}, {"default", TOKEN_KEYWORD}, {"do", TOKEN_KEYWORD}, {"else", TOKEN_KEYWORD}, \
+    {"enum", TOKEN_KEYWORD}, {"extern", TOKEN_KEYWORD}, {"for", TOKEN_KEYWORD}, {"goto", TOKEN_KEYWORD}, \
+    {"if", TOKEN_KEYWORD}, {"inline", TOKEN_KEYWORD}, {"register", TOKEN_KEYWORD}, {"restrict", TOKEN_KEYWORD}, \
+    {"return", TOKEN_KEYWORD}, {"sizeof", TOKEN_KEYWORD}, {"static", TOKEN_KEYWORD}, {"struct", TOKEN_KEYWORD}, \
+    {"switch", TOKEN_KEYWORD}, {"typedef", TOKEN_KEYWORD}, {"union", TOKEN_KEYWORD}, {"volatile", TOKEN_KEYWORD}, \
+    {"while", TOKEN_KEYWORD}, {"_Alignas", TOKEN_KEYWORD}, {"_Alignof", TOKEN_KEYWORD}, \
+    {"_Atomic", TOKEN_KEYWORD}, {"_Generic", TOKEN_KEYWORD}, {"_Noreturn", TOKEN_KEYWORD}, \
+    {"_Static_assert", TOKEN_KEYWORD}, {"_Thread_local", TOKEN_KEYWORD}, \
+    {"char", TOKEN_TYPE}, {"double", TOKEN_TYPE}, {"float", TOKEN_TYPE}, {"int", TOKEN_TYPE}, \
+    {"long", TOKEN_TYPE}, {"short", TOKEN_TYPE}, {"signed", TOKEN_TYPE}, {"unsigned", TOKEN_TYPE}, \
+    {"void", TOKEN_TYPE}, {"bool", TOKEN_TYPE}, {"_Bool", TOKEN_TYPE}, {"size_t", TOKEN_TYPE}, \
+    {"ptrdiff_t", TOKEN_TYPE}, {"int8_t", TOKEN_TYPE}, {"int16_t", TOKEN_TYPE}, {"int32_t", TOKEN_TYPE}, \
+    {"int64_t", TOKEN_TYPE}, {"uint8_t", TOKEN_TYPE}, {"uint16_t", TOKEN_TYPE}, {"uint32_t", TOKEN_TYPE}, \
+    {"uint64_t", TOKEN_TYPE}, {"uintptr_t", TOKEN_TYPE}, {"intptr_t", TOKEN_TYPE}, \
+    {"true", TOKEN_NUMBER}, {"false", TOKEN_NUMBER}, {"NULL", TOKEN_NUMBER}
+
+static const Keyword c_keywords[] = {
+    C_KEYWORDS,
+};
+
+static const Keyword cpp_keywords[] = {
+    C_KEYWORDS,
+    {"alignas", TOKEN_KEYWORD}, {"alignof", TOKEN_KEYWORD}, {"catch", TOKEN_KEYWORD}, {"class", TOKEN_KEYWORD},
+    {"concept", TOKEN_KEYWORD}, {"const_cast", TOKEN_KEYWORD}, {"consteval", TOKEN_KEYWORD},
+    {"constexpr", TOKEN_KEYWORD}, {"constinit", TOKEN_KEYWORD}, {"co_await", TOKEN_KEYWORD},
+    {"co_return", TOKEN_KEYWORD}, {"co_yield", TOKEN_KEYWORD}, {"decltype", TOKEN_KEYWORD},
+    {"delete", TOKEN_KEYWORD}, {"dynamic_cast", TOKEN_KEYWORD}, {"explicit", TOKEN_KEYWORD},
+    {"export", TOKEN_KEYWORD}, {"final", TOKEN_KEYWORD}, {"friend", TOKEN_KEYWORD}, {"mutable", TOKEN_KEYWORD},
+    {"namespace", TOKEN_KEYWORD}, {"new", TOKEN_KEYWORD}, {"noexcept", TOKEN_KEYWORD}, {"operator", TOKEN_KEYWORD},
+    {"override", TOKEN_KEYWORD}, {"private", TOKEN_KEYWORD}, {"protected", TOKEN_KEYWORD},
+    {"public", TOKEN_KEYWORD}, {"reinterpret_cast", TOKEN_KEYWORD}, {"requires", TOKEN_KEYWORD},
+    {"static_assert", TOKEN_KEYWORD}, {"static_cast", TOKEN_KEYWORD}, {"template", TOKEN_KEYWORD},
+    {"this", TOKEN_KEYWORD}, {"thread_local", TOKEN_KEYWORD}, {"throw", TOKEN_KEYWORD}, {"try", TOKEN_KEYWORD},
+    {"typeid", TOKEN_KEYWORD}, {"typename", TOKEN_KEYWORD}, {"using", TOKEN_KEYWORD}, {"virtual", TOKEN_KEYWORD},
+    {"char8_t", TOKEN_TYPE}, {"char16_t", TOKEN_TYPE}, {"char32_t", TOKEN_TYPE}, {"wchar_t", TOKEN_TYPE},
+    {"nullptr", TOKEN_NUMBER},
+};
+
+static const char *const c_extensions[] = {".c", ".h", NULL};
+static const char *const cpp_extensions[] = {".cpp", ".cc", ".cxx", ".hpp", ".hh", ".hxx", ".inl", NULL};
+
+// The tables past what is given here start out empty and are built on first use
+static Language languages[] = {
+    {
+        .extensions = c_extensions,
+        .keywords = c_keywords,
+        .nkeywords = sizeof c_keywords / sizeof c_keywords[0],
+    },
+    {
+        .extensions = cpp_extensions,
+        .keywords = cpp_keywords,
+        .nkeywords = sizeof cpp_keywords / sizeof cpp_keywords[0],
+        .raw_strings = true,
+    },
+};
+
+#define NUM_LANGUAGES (sizeof languages / sizeof languages[0])
+
+static const Color token_colors[NUM_TOKEN_KINDS] = {
+    [TOKEN_PLAIN] = COLOR_RGB(0xd4d4d4),
+    [TOKEN_KEYWORD] = COLOR_RGB(0x569cd6),
+    [TOKEN_TYPE] = COLOR_RGB(0x4ec9b0),
+    [TOKEN_NUMBER] = COLOR_RGB(0xb5cea8),
+    [TOKEN_STRING] = COLOR_RGB(0xce9178),
+    [TOKEN_COMMENT] = COLOR_RGB(0x6a9955),
+    [TOKEN_PREPROCESSOR] = COLOR_RGB(0xc586c0),
+};
+
+static uint32_t hash_word(const char *s, size_t len)
+{
+    uint32_t h = 2166136261u;
+
+    for (size_t i = 0; i < len; i++)
+        h = (h ^ (uint8_t)s[i]) * 16777619u;
+
+    return h;
+}
+
+static void language_build(Language *language)
+{
+    for (int c = 0; c < 256; c++)
+    {
+        uint8_t class = CC_OTHER;
+
+        if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_' || c >= 0x80)
+            class = CC_IDENT;
+        else if (c >= '0' && c <= '9')
+            class = CC_DIGIT;
+        else if (c == ' ' || c == '\t' || c == '\f' || c == '\v' || c == '\r')
+            class = CC_SPACE;
+        else if (c == '"')
+            class = CC_QUOTE;
+        else if (c == '\'')
+            class = CC_APOSTROPHE;
+        else if (c == '/')
+            class = CC_SLASH;
+        else if (c == '#')
+            class = CC_HASH;
+        else if (c == '.')
+            class = CC_DOT;
+
+        language->classes[c] = class;
+    }
+
+    for (size_t i = 0; i < language->nkeywords; i++)
+    {
+        const Keyword *k = &language->keywords[i];
+        size_t len = strlen(k->word);
+        uint32_t slot = hash_word(k->word, len) % KEYWORD_SLOTS;
+
+        assert(len <= KEYWORD_MAX_LEN);
+
+        while (language->slots[slot].word)
+            slot = (slot + 1) % KEYWORD_SLOTS;
+
+        language->slots[slot] = (KeywordSlot){k->word, (uint8_t)len, (uint8_t)k->kind};
+    }
+
+    language->built = true;
+}
+
+static TokenKind keyword_kind(const Language *language, const char *s, size_t len)
+{
+    if (len > KEYWORD_MAX_LEN)
+        return TOKEN_PLAIN;
+
+    uint32_t slot = hash_word(s, len) % KEYWORD_SLOTS;
+
+    for (const KeywordSlot *k; (k = &language->slots[slot])->word; slot = (slot + 1) % KEYWORD_SLOTS)
+        if (k->len == len && !memcmp(k->word, s, len))
+            return (TokenKind)k->kind;
+
+    return TOKEN_PLAIN;
+}
+
+const Language *hl_language_for_path(const char *path)
+{
+    const char *dot = strrchr(path, '.');
+
+    if (!dot)
+        return NULL;
+
+    for (size_t i = 0; i < NUM_LANGUAGES; i++)
+        for (const char *const *ext = languages[i].extensions; *ext; ext++)
+            if (!strcmp(dot, *ext))
+            {
+                if (!languages[i].built)
+                    language_build(&languages[i]);
+                return &languages[i];
+            }
+
+    return NULL;
+}
+
+Color hl_token_color(TokenKind kind)
+{
+    return token_colors[kind];
+}
+
+typedef struct {
+    TokenSpan *spans;
+    size_t len, cap;
+} SpanWriter;
+
+static void emit(SpanWriter *out, size_t begin, size_t end, TokenKind kind)
+{
+    if (!out || kind == TOKEN_PLAIN)
+        return;
+
+    // Tokens longer than a span can say are cut into several
+    while (begin < end && out->len < out->cap)
+    {
+        size_t len = end - begin < UINT16_MAX ? end - begin : UINT16_MAX;
+        out->spans[out->len++] = (TokenSpan){(uint32_t)begin, (uint16_t)len, (uint8_t)kind};
+        begin += len;
+    }
+}
+
+static uint32_t raw_state(const char *delimiter, size_t len)
+{
+    // Never 0, which would make an empty delimiter look like no raw string at all
+    return STATE_RAW_STRING | ((hash_word(delimiter, len) | 1) << 8);
+}
+
+/* Looks for the end of a raw string, returns the offset just past it or 0 if the line ends first. */
+static size_t raw_string_end(const char *s, size_t len, size_t at, uint32_t state)
+{
+    for (const char *c; at < len && (c = memchr(&s[at], ')', len - at)); )
+    {
+        size_t close = (size_t)(c - s);
+        size_t limit = close + 2 + RAW_DELIMITER_MAX < len ? close + 2 + RAW_DELIMITER_MAX : len;
+
+        for (size_t k = close + 1; k < limit; k++)
+            if (s[k] == '"')
+            {
+                if (raw_state(&s[close + 1], k - close - 1) == state)
+                    return k + 1;
+                break;
+            }
+
+        at = close + 1;
+    }
+
+    return 0;
+}
+
+/* Scans a quoted literal from `at`, which is just past the opening quote.  Returns the offset past the closing one. */
+static size_t quoted_end(const char *s, size_t len, size_t at, char quote, bool *open)
+{
+    while (at < len)
+    {
+        char c = s[at++];
+
+        if (c == '\\')
+        {
+            // A backslash ending the line carries the literal on to the next
+            if (at == len)
+            {
+                *open = true;
+                return len;
+            }
+            at++;
+        }
+        else if (c == quote)
+        {
+            *open = false;
+            return at;
+        }
+    }
+
+    // Unterminated literals end with the line, as compilers treat them
+    *open = false;
+    return len;
+}
+
+/* Lexes one line that starts in `state`, writing its colored tokens if `out` is given, and returns its end state. */
+static uint32_t lex_line(const Language *language, const char *s, size_t len, uint32_t state, SpanWriter *out)
+{
+    const uint8_t *classes = language->classes;
+    size_t at = 0;
+    bool open;
+
+    switch (state & STATE_MODE_MASK)
+    {
+    case STATE_BLOCK_COMMENT:
+        for (const char *c = s; (c = memchr(c, '*', (size_t)(s + len - c))); c++)
+            if (c + 1 < s + len && c[1] == '/')
+            {
+                at = (size_t)(c - s) + 2;
+                break;
+            }
+        if (!at)
+        {
+            emit(out, 0, len, TOKEN_COMMENT);
+            return STATE_BLOCK_COMMENT;
+        }
+        emit(out, 0, at, TOKEN_COMMENT);
+        break;
+
+    case STATE_LINE_COMMENT:
+        emit(out, 0, len, TOKEN_COMMENT);
+        return len && s[len - 1] == '\\' ? STATE_LINE_COMMENT : STATE_NORMAL;
+
+    case STATE_STRING:
+    case STATE_CHAR:
+        at = quoted_end(s, len, 0, (state & STATE_MODE_MASK) == STATE_STRING ? '"' : '\'', &open);
+        emit(out, 0, at, TOKEN_STRING);
+        if (open)
+            return state;
+        break;
+
+    case STATE_RAW_STRING:
+        at = raw_string_end(s, len, 0, state);
+        if (!at)
+        {
+            emit(out, 0, len, TOKEN_STRING);
+            return state;
+        }
+        emit(out, 0, at, TOKEN_STRING);
+        break;
+    }
+
+    bool line_start = at == 0;
+
+    while (at < len)
+    {
+        size_t begin = at;
+        uint8_t class = classes[(uint8_t)s[at]];
+
+        switch (class)
+        {
+        case CC_SPACE:
+            at++;
+            continue;
+
+        case CC_HASH:
+        {
+            if (!line_start)
+            {
+                at++;
+                break;
+            }
+
+            // The directive's name, with any spaces after the #
+            at++;
+            while (at < len && classes[(uint8_t)s[at]] == CC_SPACE)
+                at++;
+            size_t name = at;
+            while (at < len && classes[(uint8_t)s[at]] == CC_IDENT)
+                at++;
+            emit(out, begin, at, TOKEN_PREPROCESSOR);
+
+            if (at - name == 7 && !memcmp(&s[name], "include", 7))
+            {
+                while (at < len && classes[(uint8_t)s[at]] == CC_SPACE)
+                    at++;
+                if (at < len && s[at] == '<')
+                {
+                    const char *close = memchr(&s[at], '>', len - at);
+                    size_t end = close ? (size_t)(close - s) + 1 : len;
+                    emit(out, at, end, TOKEN_STRING);
+                    at = end;
+                }
+            }
+            break;
+        }
+
+        case CC_SLASH:
+            if (at + 1 < len && s[at + 1] == '/')
+            {
+                emit(out, at, len, TOKEN_COMMENT);
+                return s[len - 1] == '\\' ? STATE_LINE_COMMENT : STATE_NORMAL;
+            }
+            if (at + 1 < len && s[at + 1] == '*')
+            {
+                at += 2;
+                for (;;)
+                {
+                    const char *c = at < len ? memchr(&s[at], '*', len - at) : NULL;
+                    if (!c)
+                    {
+                        emit(out, begin, len, TOKEN_COMMENT);
+                        return STATE_BLOCK_COMMENT;
+                    }
+                    at = (size_t)(c - s) + 1;
+                    if (at < len && s[at] == '/')
+                    {
+                        at++;
+                        break;
+                    }
+                }
+                emit(out, begin, at, TOKEN_COMMENT);
+                break;
+            }
+            at++;
+            break;
+
+        case CC_QUOTE:
+        case CC_APOSTROPHE:
+            at = quoted_end(s, len, at + 1, s[at], &open);
+            emit(out, begin, at, TOKEN_STRING);
+            if (open)
+                return class == CC_QUOTE ? STATE_STRING : STATE_CHAR;
+            break;
+
+        case CC_DOT:
+            if (at + 1 >= len || classes[(uint8_t)s[at + 1]] != CC_DIGIT)
+            {
+                at++;
+                break;
+            }
+            // A number like .5
+            // fallthrough
+        case CC_DIGIT:
+            // Takes in suffixes, hex digits and digit separators, and a sign right after an exponent
+            for (at++; at < len; at++)
+            {
+                uint8_t c = classes[(uint8_t)s[at]];
+                char prev = s[at - 1];
+
+                if (c == CC_IDENT || c == CC_DIGIT || c == CC_DOT || c == CC_APOSTROPHE)
+                    continue;
+                if ((s[at] == '+' || s[at] == '-') && (prev == 'e' || prev == 'E' || prev == 'p' || prev == 'P'))
+                    continue;
+                break;
+            }
+            emit(out, begin, at, TOKEN_NUMBER);
+            break;
+
+        case CC_IDENT:
+            while (at < len && (classes[(uint8_t)s[at]] == CC_IDENT || classes[(uint8_t)s[at]] == CC_DIGIT))
+                at++;
+
+            if (at < len && s[at] == '"')
+            {
+                size_t prefix = at - begin;
+                const char *p = &s[begin];
+                bool is_raw = language->raw_strings && p[prefix - 1] == 'R';
+                size_t encoding = is_raw ? prefix - 1 : prefix;
+
+                // Only an encoding prefix, and R in C++, make an identifier part of the string after it
+                if (encoding == 0 || (encoding == 1 && (*p == 'L' || *p == 'u' || *p == 'U'))
+                    || (encoding == 2 && p[0] == 'u' && p[1] == '8'))
+                {
+                    if (is_raw)
+                    {
+                        const char *paren = memchr(&s[at + 1], '(', len - at - 1);
+                        size_t len_delimiter = paren ? (size_t)(paren - s) - at - 1 : 0;
+
+                        if (paren && len_delimiter <= RAW_DELIMITER_MAX)
+                        {
+                            uint32_t raw = raw_state(&s[at + 1], len_delimiter);
+                            size_t end = raw_string_end(s, len, (size_t)(paren - s) + 1, raw);
+
+                            emit(out, begin, end ? end : len, TOKEN_STRING);
+                            if (!end)
+                                return raw;
+                            at = end;
+                            break;
+                        }
+                    }
+
+                    at = quoted_end(s, len, at + 1, '"', &open);
+                    emit(out, begin, at, TOKEN_STRING);
+                    if (open)
+                        return STATE_STRING;
+                    break;
+                }
+            }
+
+            emit(out, begin, at, keyword_kind(language, &s[begin], at - begin));
+            break;
+
+        default:
+            at++;
+            break;
+        }
+
+        line_start = false;
+    }
+
+    return STATE_NORMAL;
+}
+
+static void states_reserve(Highlighter *hl, size_t len)
+{
+    if (len > hl->cap_states)
+    {
+        hl->cap_states = 2 * hl->cap_states > len ? 2 * hl->cap_states : len;
+        hl->states = realloc(hl->states, hl->cap_states * sizeof *hl->states);
+    }
+}
+
+/* Follows a change to the line count the highlighter was not told about, lexing from the first line that may differ. */
+static void sync_line_count(Highlighter *hl, const Document *doc)
+{
+    size_t nlines = doc_line_count(doc);
+
+    if (nlines == hl->len_states)
+        return;
+
+    states_reserve(hl, nlines);
+    for (size_t i = hl->len_states; i < nlines; i++)
+        hl->states[i] = STATE_UNKNOWN;
+
+    hl->len_states = nlines;
+    hl->dirty_end = nlines;
+    if (hl->valid > nlines)
+        hl->valid = nlines;
+}
+
+void hl_init(Highlighter *hl, const Language *language)
+{
+    *hl = (Highlighter){.language = language, .valid = 1, .len_states = 1};
+
+    states_reserve(hl, 1);
+    hl->states[0] = STATE_NORMAL;
+}
+
+void hl_uninit(Highlighter *hl)
+{
+    free(hl->states);
+    free(hl->buffer);
+
+    *hl = (Highlighter){0};
+}
+
+void hl_edit(Highlighter *hl, size_t line, size_t removed, size_t added)
+{
+    // Lines the highlighter never got to have no states to move, the next update catches up with the line count
+    if (line + removed >= hl->len_states)
+    {
+        if (hl->valid > line + 1)
+            hl->valid = line + 1;
+        return;
+    }
+
+    size_t len = hl->len_states - removed + added;
+    size_t after = line + 1;
+
+    // The edited line still starts where it did, the lines replaced after it start in states yet to be found
+    states_reserve(hl, len);
+    memmove(&hl->states[after + added], &hl->states[after + removed],
+        (hl->len_states - after - removed) * sizeof *hl->states);
+    for (size_t i = after; i < after + added; i++)
+        hl->states[i] = STATE_UNKNOWN;
+
+    // Lines from dirty_end on are untouched so their states still chain, that range moves with the lines around it
+    size_t dirty_end = hl->valid >= hl->len_states ? 0 : hl->dirty_end;
+    if (dirty_end > line + removed)
+        dirty_end = dirty_end + added - removed;
+    if (dirty_end < after + added)
+        dirty_end = after + added;
+
+    hl->len_states = len;
+    hl->dirty_end = dirty_end;
+    if (hl->valid > after)
+        hl->valid = after;
+}
+
+/* Makes room for another `need` bytes after what the buffer holds. */
+static void buffer_reserve(Highlighter *hl, size_t len, size_t need)
+{
+    if (len + need > hl->cap_buffer)
+    {
+        hl->cap_buffer = 2 * hl->cap_buffer > len + need ? 2 * hl->cap_buffer : len + need;
+        hl->buffer = realloc(hl->buffer, hl->cap_buffer);
+    }
+}
+
+void hl_update(Highlighter *hl, const Document *doc, size_t last_line)
+{
+    sync_line_count(hl, doc);
+
+    size_t target = last_line + HL_MARGIN < hl->len_states ? last_line + HL_MARGIN : hl->len_states - 1;
+
+    if (!hl->language || hl->valid > target)
+        return;
+
+    // Lexes on from the last line whose start state is known, reading the document a block at a time
+    size_t line = hl->valid - 1;
+    size_t offset = doc_line_start(doc, line);
+    size_t len = 0, at = 0;
+
+    while (line < target)
+    {
+        const char *nl = at < len ? memchr(&hl->buffer[at], '\n', len - at) : NULL;
+
+        if (!nl)
+        {
+            if (len > at)
+                memmove(hl->buffer, &hl->buffer[at], len - at);
+            len -= at;
+            at = 0;
+
+            buffer_reserve(hl, len, HL_READ_BLOCK);
+            size_t got = doc_read(doc, offset, &hl->buffer[len], hl->cap_buffer - len);
+            offset += got;
+            len += got;
+
+            // Every line before the last ends in a newline, so this only runs out if the line count is stale
+            if (!got)
+                break;
+            continue;
+        }
+
+        size_t end = (size_t)(nl - hl->buffer);
+        size_t len_line = end - at > 0 && hl->buffer[end - 1] == '\r' ? end - at - 1 : end - at;
+        uint32_t state = lex_line(hl->language, &hl->buffer[at], len_line, hl->states[line], NULL);
+
+        at = end + 1;
+        line++;
+
+        // Past the edits, a line that starts in the state it did before is lexed as it was, and so is everything after
+        if (line >= hl->dirty_end && hl->states[line] == state)
+        {
+            hl->valid = hl->len_states;
+            return;
+        }
+
+        hl->states[line] = state;
+        hl->valid = line + 1;
+    }
+
+    // The states after where this stopped follow from the ones it overwrote, not from the new ones
+    if (hl->dirty_end < hl->valid)
+        hl->dirty_end = hl->valid;
+}
+
+size_t hl_line(Highlighter *hl, const Document *doc, size_t line, String *text, TokenSpan *spans, size_t max_spans)
+{
+    hl_update(hl, doc, line);
+
+    size_t start = doc_line_start(doc, line);
+    size_t end = doc_line_start(doc, line + 1);
+
+    buffer_reserve(hl, 0, end - start);
+    size_t len = doc_read(doc, start, hl->buffer, end - start);
+
+    while (len && (hl->buffer[len - 1] == '\n' || hl->buffer[len - 1] == '\r'))
+        len--;
+
+    *text = (String){.length = len, .data = hl->buffer};
+
+    if (!hl->language || line >= hl->valid)
+        return 0;
+
+    SpanWriter out = {spans, 0, max_spans};
+    lex_line(hl->language, hl->buffer, len, hl->states[line], &out);
+
+    return out.len;
+}
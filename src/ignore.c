@@ -0,0 +1,750 @@
+#include "theeditor.h"
+
+#include <stdio.h>
+#include <string.h>
+
+// A glob compiles to at most this many states, one bit each in the automaton
+#define GLOB_MAX_STATES 63
+// Suffix rules are only hashed when their literal part fits the length mask
+#define SUFFIX_MAX_LEN 63
+
+typedef enum {
+    RULE_NEGATE   = 1 << 0,
+    RULE_DIR_ONLY = 1 << 1,
+    // The pattern holds a slash, so it matches the path below the ignore file rather than the name
+    RULE_PATH     = 1 << 2,
+} RuleFlags;
+
+typedef struct {
+    uint32_t start, len;
+    RuleFlags flags;
+} IgnoreRule;
+
+/* A rule in one of the hash tables, keyed by the whole name or by a literal suffix. */
+typedef struct {
+    uint32_t hash;
+    uint32_t rule;
+} HashedRule;
+
+/**
+ * A glob as a bit-parallel NFA.  State i moves to i + 1 on the bytes whose class mask has bit i, `*` and `**` are
+ * self loops on the state they sit at, and bytes are grouped into classes so the transition table stays small.
+ */
+typedef struct {
+    uint32_t rule;
+    uint32_t nstates;
+    uint64_t star, globstar;
+    // Entering one of these states by a byte enters the next one as well, skipping the slash after a "/**"
+    uint64_t skip;
+    uint8_t byte_class[256];
+    uint64_t *class_mask;
+} Glob;
+
+struct IgnoreRules {
+    // The nearest ancestor with rules of its own, consulted when nothing here matches
+    const IgnoreRules *parent;
+    IgnoreRules *next_owned;
+
+    // The directory holding the ignore files, relative to the root with '/' separators, empty for the root itself
+    char *rel;
+    size_t len_rel;
+
+    char *text;
+    size_t len_rules;
+    IgnoreRule *rules;
+
+    size_t cap_literals, cap_suffixes;
+    HashedRule *literals, *suffixes;
+    // Bit n is set if some suffix rule has n literal bytes
+    uint64_t suffix_lengths;
+
+    // In rule order, so they can be tried from the last one back
+    size_t len_globs;
+    Glob *globs;
+};
+
+typedef struct {
+    uint32_t hash;
+    char *rel;
+    size_t len_rel;
+    const IgnoreRules *rules;
+} CacheEntry;
+
+struct IgnoreCache {
+    char *root;
+    PlatformMutex *mutex;
+    // Every directory looked up so far, with the rules in effect inside it
+    size_t len_entries, cap_entries;
+    CacheEntry *entries;
+    IgnoreRules *owned;
+};
+
+static uint32_t hash_bytes(const char *s, size_t len)
+{
+    uint32_t hash = 2166136261u;
+
+    for (size_t i = 0; i < len; i++)
+    {
+        hash ^= (uint8_t)s[i];
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+static bool has_wildcards(const char *s, size_t len)
+{
+    for (size_t i = 0; i < len; i++)
+        if (s[i] == '*' || s[i] == '?' || s[i] == '[' || s[i] == '\\')
+            return true;
+
+    return false;
+}
+
+static void hashed_insert(HashedRule *table, size_t cap, uint32_t hash, uint32_t rule)
+{
+    size_t slot = hash & (cap - 1);
+
+    while (table[slot].rule != UINT32_MAX)
+        slot = (slot + 1) & (cap - 1);
+
+    table[slot] = (HashedRule){hash, rule};
+}
+
+static HashedRule *hashed_alloc(size_t count, size_t *cap)
+{
+    *cap = 16;
+    while (*cap < 2 * count)
+        *cap *= 2;
+
+    HashedRule *table = malloc(*cap * sizeof *table);
+    for (size_t i = 0; i < *cap; i++)
+        table[i].rule = UINT32_MAX;
+
+    return table;
+}
+
+typedef struct {
+    bool accepts[256];
+} Token;
+
+/* Parses a bracket expression starting after the '['.  Returns the length consumed, or 0 if it is unterminated. */
+static size_t parse_class(const char *p, size_t len, Token *token)
+{
+    size_t i = 0;
+    bool negate = false;
+
+    if (i < len && (p[i] == '!' || p[i] == '^'))
+    {
+        negate = true;
+        i++;
+    }
+
+    memset(token->accepts, 0, sizeof token->accepts);
+
+    // A ']' right at the start is part of the set
+    for (bool first = true; i < len && (first || p[i] != ']'); first = false)
+    {
+        uint8_t lo = (uint8_t)p[i++];
+
+        if (lo == '\\' && i < len)
+            lo = (uint8_t)p[i++];
+
+        uint8_t hi = lo;
+        if (i + 1 < len && p[i] == '-' && p[i + 1] != ']')
+        {
+            hi = (uint8_t)p[i + 1];
+            i += 2;
+        }
+
+        for (unsigned c = lo; c <= hi; c++)
+            token->accepts[c] = true;
+    }
+
+    if (i >= len)
+        return 0;
+
+    for (unsigned c = 0; c < 256; c++)
+        token->accepts[c] = token->accepts[c] != negate && c != '/';
+
+    return i + 1;
+}
+
+/* Compiles a glob, returns false if it needs more states than the automaton has bits. */
+static bool glob_compile(Glob *glob, const char *p, size_t len, bool path)
+{
+    Token *tokens = malloc(GLOB_MAX_STATES * sizeof *tokens);
+    uint32_t n = 0;
+
+    *glob = (Glob){0};
+
+    for (size_t i = 0; i < len;)
+    {
+        // "/**/" matches zero or more whole directory levels and "/**" at the end everything below.  The slash is a
+        // token of its own with the loop after it, so the loop only starts on a new level, and in the middle the slash
+        // that follows is skipped on the way in, for no levels at all.
+        if (path && p[i] == '/' && i + 2 < len && p[i + 1] == '*' && p[i + 2] == '*'
+            && (i + 3 == len || p[i + 3] == '/'))
+        {
+            if (n == GLOB_MAX_STATES)
+                goto too_long;
+            memset(tokens[n].accepts, 0, sizeof tokens[n].accepts);
+            tokens[n++].accepts['/'] = true;
+
+            glob->globstar |= 1ull << n;
+            if (i + 3 < len)
+                glob->skip |= 1ull << n;
+            i += 3;
+            continue;
+        }
+
+        if (p[i] == '*')
+        {
+            glob->star |= 1ull << n;
+            i++;
+            continue;
+        }
+
+        if (n == GLOB_MAX_STATES)
+            goto too_long;
+
+        Token *token = &tokens[n];
+        size_t used;
+
+        if (p[i] == '?')
+        {
+            for (unsigned c = 0; c < 256; c++)
+                token->accepts[c] = c != '/';
+            i++;
+        }
+        else if (p[i] == '[' && (used = parse_class(&p[i + 1], len - i - 1, token)))
+        {
+            i += 1 + used;
+        }
+        else
+        {
+            if (p[i] == '\\' && i + 1 < len)
+                i++;
+
+            memset(token->accepts, 0, sizeof token->accepts);
+            token->accepts[(uint8_t)p[i++]] = true;
+        }
+
+        n++;
+    }
+
+    glob->nstates = n;
+
+    // Bytes that every token treats alike share a class, and the class mask is the set of transitions they take
+    uint64_t masks[256];
+    size_t nclasses = 0;
+    glob->class_mask = malloc(256 * sizeof *glob->class_mask);
+
+    for (unsigned c = 0; c < 256; c++)
+    {
+        uint64_t mask = 0;
+        for (uint32_t t = 0; t < n; t++)
+            if (tokens[t].accepts[c])
+                mask |= 1ull << t;
+
+        size_t k = 0;
+        while (k < nclasses && masks[k] != mask)
+            k++;
+        if (k == nclasses)
+            masks[nclasses++] = mask;
+
+        glob->byte_class[c] = (uint8_t)k;
+    }
+
+    memcpy(glob->class_mask, masks, nclasses * sizeof *masks);
+    glob->class_mask = realloc(glob->class_mask, nclasses * sizeof *glob->class_mask);
+    free(tokens);
+
+    return true;
+
+too_long:
+    free(tokens);
+    return false;
+}
+
+static bool glob_match(const Glob *glob, const char *s, size_t len)
+{
+    uint64_t states = 1;
+
+    for (size_t i = 0; i < len && states; i++)
+    {
+        uint8_t c = (uint8_t)s[i];
+        uint64_t loops = glob->globstar | (c == '/' ? 0 : glob->star);
+
+        uint64_t entered = (states & glob->class_mask[glob->byte_class[c]]) << 1;
+
+        states = entered | ((entered & glob->skip) << 1) | (states & loops);
+    }
+
+    return (states >> glob->nstates) & 1;
+}
+
+/* Appends the lines of an ignore file to the rules, returns false if it could not be read. */
+static bool read_rules(IgnoreRules *rules, size_t *len_text, size_t *cap_rules, const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    if (!f)
+        return false;
+
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    if (size <= 0)
+    {
+        fclose(f);
+        return true;
+    }
+
+    // Each pattern is stored with a leading slash added, so room for one more byte per line
+    size_t cap_text = *len_text + 2 * (size_t)size + 1;
+    rules->text = realloc(rules->text, cap_text);
+    char *data = &rules->text[cap_text - size];
+    size_t nread = fread(data, 1, size, f);
+    fclose(f);
+
+    for (size_t i = 0; i < nread;)
+    {
+        size_t start = i;
+        while (i < nread && data[i] != '\n')
+            i++;
+
+        size_t end = i++;
+        if (end > start && data[end - 1] == '\r')
+            end--;
+
+        // Trailing spaces are dropped unless escaped
+        while (end > start && data[end - 1] == ' ' && !(end - 1 > start && data[end - 2] == '\\'))
+            end--;
+
+        if (end == start || data[start] == '#')
+            continue;
+
+        RuleFlags flags = 0;
+
+        if (data[start] == '!')
+        {
+            flags |= RULE_NEGATE;
+            start++;
+        }
+
+        if (end > start && data[end - 1] == '/')
+        {
+            flags |= RULE_DIR_ONLY;
+            end--;
+        }
+
+        if (memchr(&data[start], '/', end - start))
+            flags |= RULE_PATH;
+
+        if (end == start || (end - start == 1 && data[start] == '/'))
+            continue;
+
+        if (*cap_rules <= rules->len_rules)
+        {
+            *cap_rules = *cap_rules < 32 ? 32 : 2 * *cap_rules;
+            rules->rules = realloc(rules->rules, *cap_rules * sizeof *rules->rules);
+        }
+
+        // Path patterns are matched against the path with a leading slash, so they are stored with exactly one
+        IgnoreRule *rule = &rules->rules[rules->len_rules++];
+        rule->start = (uint32_t)*len_text;
+        rule->flags = flags;
+
+        if ((flags & RULE_PATH) && data[start] != '/')
+            rules->text[(*len_text)++] = '/';
+
+        // The source always sits ahead of where it is copied to, so this never overwrites unread bytes
+        memmove(&rules->text[*len_text], &data[start], end - start);
+        *len_text += end - start;
+        rule->len = (uint32_t)(*len_text - rule->start);
+    }
+
+    return true;
+}
+
+static void rules_free(IgnoreRules *rules)
+{
+    for (size_t i = 0; i < rules->len_globs; i++)
+        free(rules->globs[i].class_mask);
+
+    free(rules->globs);
+    free(rules->literals);
+    free(rules->suffixes);
+    free(rules->rules);
+    free(rules->text);
+    free(rules->rel);
+    free(rules);
+}
+
+/* Reads and compiles the ignore files of a directory, or returns NULL if it has none. */
+static IgnoreRules *rules_load(const IgnoreCache *cache, const char *rel, size_t len_rel, const IgnoreRules *parent)
+{
+    static const char *const files[] = {".gitignore", ".ignore"};
+
+    IgnoreRules *rules = calloc(1, sizeof *rules);
+    size_t len_text = 0, cap_rules = 0;
+    bool found = false;
+    char *path = malloc(strlen(cache->root) + len_rel + 16);
+
+    // .ignore comes last, so its rules win over those of .gitignore
+    for (size_t f = 0; f < sizeof files / sizeof files[0]; f++)
+    {
+        if (len_rel)
+            sprintf(path, "%s%c%.*s%c%s", cache->root, PATH_SEPARATOR, (int)len_rel, rel, PATH_SEPARATOR, files[f]);
+        else
+            sprintf(path, "%s%c%s", cache->root, PATH_SEPARATOR, files[f]);
+
+        found |= read_rules(rules, &len_text, &cap_rules, path);
+    }
+
+    free(path);
+
+    if (!found)
+    {
+        rules_free(rules);
+        return NULL;
+    }
+
+    rules->parent = parent;
+    rules->rel = malloc(len_rel + 1);
+    memcpy(rules->rel, rel, len_rel);
+    rules->rel[len_rel] = '\0';
+    rules->len_rel = len_rel;
+
+    size_t nliterals = 0, nsuffixes = 0;
+    for (size_t i = 0; i < rules->len_rules; i++)
+    {
+        const IgnoreRule *r = &rules->rules[i];
+        const char *p = &rules->text[r->start];
+
+        if (r->flags & RULE_PATH)
+            continue;
+        if (!has_wildcards(p, r->len))
+            nliterals++;
+        else if (p[0] == '*' && r->len - 1 <= SUFFIX_MAX_LEN && r->len > 1 && !has_wildcards(p + 1, r->len - 1))
+            nsuffixes++;
+    }
+
+    rules->literals = hashed_alloc(nliterals, &rules->cap_literals);
+    rules->suffixes = hashed_alloc(nsuffixes, &rules->cap_suffixes);
+    rules->globs = malloc((rules->len_rules - nliterals - nsuffixes + 1) * sizeof *rules->globs);
+
+    for (size_t i = 0; i < rules->len_rules; i++)
+    {
+        const IgnoreRule *r = &rules->rules[i];
+        const char *p = &rules->text[r->start];
+
+        if (!(r->flags & RULE_PATH) && !has_wildcards(p, r->len))
+        {
+            hashed_insert(rules->literals, rules->cap_literals, hash_bytes(p, r->len), (uint32_t)i);
+        }
+        else if (!(r->flags & RULE_PATH) && p[0] == '*' && r->len - 1 <= SUFFIX_MAX_LEN && r->len > 1
+            && !has_wildcards(p + 1, r->len - 1))
+        {
+            hashed_insert(rules->suffixes, rules->cap_suffixes, hash_bytes(p + 1, r->len - 1), (uint32_t)i);
+            rules->suffix_lengths |= 1ull << (r->len - 1);
+        }
+        else if (glob_compile(&rules->globs[rules->len_globs], p, r->len, r->flags & RULE_PATH))
+        {
+            rules->globs[rules->len_globs++].rule = (uint32_t)i;
+        }
+        else
+        {
+            fprintf(stderr, "Ignoring overlong pattern %.*s in %s\n", (int)r->len, p, len_rel ? rules->rel : ".");
+        }
+    }
+
+    return rules;
+}
+
+IgnoreCache *ignore_cache_create(const char *root)
+{
+    IgnoreCache *cache = calloc(1, sizeof *cache);
+    size_t len_root = strlen(root);
+
+    cache->root = malloc(len_root + 1);
+    memcpy(cache->root, root, len_root + 1);
+    cache->mutex = platform_mutex_create();
+
+    return cache;
+}
+
+void ignore_cache_destroy(IgnoreCache *cache)
+{
+    if (!cache)
+        return;
+
+    for (IgnoreRules *rules = cache->owned, *next; rules; rules = next)
+    {
+        next = rules->next_owned;
+        rules_free(rules);
+    }
+
+    for (size_t i = 0; i < cache->cap_entries; i++)
+        free(cache->entries[i].rel);
+
+    free(cache->entries);
+    platform_mutex_destroy(cache->mutex);
+    free(cache->root);
+    free(cache);
+}
+
+/* The entry for a directory, or the empty slot it would go in.  The mutex must be held. */
+static CacheEntry *cache_slot(const IgnoreCache *cache, const char *rel, size_t len_rel, uint32_t hash)
+{
+    size_t mask = cache->cap_entries - 1;
+    size_t slot = hash & mask;
+
+    for (; cache->entries[slot].rel; slot = (slot + 1) & mask)
+    {
+        const CacheEntry *e = &cache->entries[slot];
+        if (e->hash == hash && e->len_rel == len_rel && !memcmp(e->rel, rel, len_rel))
+            break;
+    }
+
+    return &cache->entries[slot];
+}
+
+static void cache_grow(IgnoreCache *cache)
+{
+    size_t cap = cache->cap_entries;
+    CacheEntry *entries = cache->entries;
+
+    cache->cap_entries = cap ? 2 * cap : 256;
+    cache->entries = calloc(cache->cap_entries, sizeof *cache->entries);
+
+    for (size_t i = 0; i < cap; i++)
+        if (entries[i].rel)
+            *cache_slot(cache, entries[i].rel, entries[i].len_rel, entries[i].hash) = entries[i];
+
+    free(entries);
+}
+
+/* Returns the rules in effect inside a directory, compiling its ignore files the first time if it may have any. */
+static const IgnoreRules *cache_lookup(IgnoreCache *cache, const char *rel, size_t len_rel, const IgnoreRules *parent,
+    bool may_have_files)
+{
+    uint32_t hash = hash_bytes(rel, len_rel);
+
+    platform_mutex_lock(cache->mutex);
+    if (cache->cap_entries)
+    {
+        CacheEntry *e = cache_slot(cache, rel, len_rel, hash);
+        if (e->rel)
+        {
+            platform_mutex_unlock(cache->mutex);
+            return e->rules;
+        }
+    }
+    platform_mutex_unlock(cache->mutex);
+
+    // Files are read outside the lock, so workers only wait on each other for the table itself
+    IgnoreRules *loaded = may_have_files ? rules_load(cache, rel, len_rel, parent) : NULL;
+    const IgnoreRules *rules = loaded ? loaded : parent;
+
+    platform_mutex_lock(cache->mutex);
+
+    if (4 * (cache->len_entries + 1) > 3 * cache->cap_entries)
+        cache_grow(cache);
+
+    CacheEntry *e = cache_slot(cache, rel, len_rel, hash);
+    if (e->rel)
+    {
+        // Another thread got here first
+        if (loaded)
+            rules_free(loaded);
+        rules = e->rules;
+    }
+    else
+    {
+        e->hash = hash;
+        e->rel = malloc(len_rel + 1);
+        memcpy(e->rel, rel, len_rel);
+        e->rel[len_rel] = '\0';
+        e->len_rel = len_rel;
+        e->rules = rules;
+        cache->len_entries++;
+
+        if (loaded)
+        {
+            loaded->next_owned = cache->owned;
+            cache->owned = loaded;
+        }
+    }
+
+    platform_mutex_unlock(cache->mutex);
+
+    return rules;
+}
+
+/* Copies a path relative to the root with '/' separators, leaving "." as the empty string. */
+static char *rel_alloc(const char *path, size_t *len_rel)
+{
+    if (!strcmp(path, "."))
+        path = "";
+
+    *len_rel = strlen(path);
+    char *rel = malloc(*len_rel + 1);
+
+    for (size_t i = 0; i <= *len_rel; i++)
+        rel[i] = path[i] == PATH_SEPARATOR ? '/' : path[i];
+
+    return rel;
+}
+
+const IgnoreRules *ignore_rules_for(IgnoreCache *cache, const char *path)
+{
+    size_t len_rel;
+    char *rel = rel_alloc(path, &len_rel);
+    const IgnoreRules *rules = cache_lookup(cache, rel, 0, NULL, true);
+
+    // Every ancestor on the way down may add rules of its own
+    for (size_t end = 0; end < len_rel;)
+    {
+        end++;
+        while (end < len_rel && rel[end] != '/')
+            end++;
+
+        rules = cache_lookup(cache, rel, end, rules, true);
+    }
+
+    free(rel);
+
+    return rules;
+}
+
+const IgnoreRules *ignore_rules_child(IgnoreCache *cache, const IgnoreRules *parent, const char *path, bool has_files)
+{
+    if (!has_files)
+        return parent;
+
+    size_t len_rel;
+    char *rel = rel_alloc(path, &len_rel);
+    const IgnoreRules *rules = cache_lookup(cache, rel, len_rel, parent, true);
+    free(rel);
+
+    return rules;
+}
+
+bool ignore_is_rule_file(const char *name, size_t len_name)
+{
+    return (len_name == 10 && !memcmp(name, ".gitignore", 10)) || (len_name == 7 && !memcmp(name, ".ignore", 7));
+}
+
+/* The last rule of one directory's files matching the entry, or -1. */
+static int64_t match_rules(const IgnoreRules *rules, const char *name, size_t len_name, const char *path,
+    size_t len_path, bool is_dir, IgnoreStats *stats)
+{
+    int64_t best = -1;
+    uint32_t hash = hash_bytes(name, len_name);
+
+    stats->evaluations++;
+    for (size_t slot = hash & (rules->cap_literals - 1); rules->literals[slot].rule != UINT32_MAX;
+        slot = (slot + 1) & (rules->cap_literals - 1))
+    {
+        const IgnoreRule *r = &rules->rules[rules->literals[slot].rule];
+
+        if (rules->literals[slot].hash == hash && r->len == len_name && !memcmp(&rules->text[r->start], name, len_name)
+            && (is_dir || !(r->flags & RULE_DIR_ONLY)) && (int64_t)rules->literals[slot].rule > best)
+            best = rules->literals[slot].rule;
+    }
+
+    for (uint64_t lengths = rules->suffix_lengths; lengths; lengths &= lengths - 1)
+    {
+        size_t len_suffix = 0;
+        while (!((lengths >> len_suffix) & 1))
+            len_suffix++;
+
+        if (len_suffix > len_name)
+            break;
+
+        const char *suffix = &name[len_name - len_suffix];
+        uint32_t suffix_hash = hash_bytes(suffix, len_suffix);
+
+        stats->evaluations++;
+        for (size_t slot = suffix_hash & (rules->cap_suffixes - 1); rules->suffixes[slot].rule != UINT32_MAX;
+            slot = (slot + 1) & (rules->cap_suffixes - 1))
+        {
+            const IgnoreRule *r = &rules->rules[rules->suffixes[slot].rule];
+
+            if (rules->suffixes[slot].hash == suffix_hash && r->len - 1 == len_suffix
+                && !memcmp(&rules->text[r->start + 1], suffix, len_suffix)
+                && (is_dir || !(r->flags & RULE_DIR_ONLY)) && (int64_t)rules->suffixes[slot].rule > best)
+                best = rules->suffixes[slot].rule;
+        }
+    }
+
+    // Only globs later than the best hashed match can still change the outcome
+    for (size_t i = rules->len_globs; i-- > 0 && (int64_t)rules->globs[i].rule > best;)
+    {
+        const Glob *glob = &rules->globs[i];
+        const IgnoreRule *r = &rules->rules[glob->rule];
+
+        if (!is_dir && (r->flags & RULE_DIR_ONLY))
+            continue;
+
+        stats->evaluations++;
+        if (r->flags & RULE_PATH ? glob_match(glob, path, len_path) : glob_match(glob, name, len_name))
+        {
+            best = glob->rule;
+            break;
+        }
+    }
+
+    return best;
+}
+
+bool ignore_keep(const IgnoreRules *rules, const char *dir, const char *name, size_t len_name, FileTreeItemFlags type,
+    IgnoreStats *stats)
+{
+    // Never anything to browse in there, whatever the rules say
+    if (len_name == 4 && !memcmp(name, ".git", 4))
+    {
+        stats->pruned++;
+        return false;
+    }
+
+    if (!rules)
+        return true;
+
+    // The path from the root with a leading slash, path rules look at the part below their own directory
+    size_t len_dir = strcmp(dir, ".") ? strlen(dir) : 0;
+    size_t len_path = 1 + len_dir + (len_dir ? 1 : 0) + len_name;
+    char buffer[2 * FILENAME_LEN];
+    char *path = len_path <= sizeof buffer ? buffer : malloc(len_path);
+
+    path[0] = '/';
+    for (size_t i = 0; i < len_dir; i++)
+        path[1 + i] = dir[i] == PATH_SEPARATOR ? '/' : dir[i];
+    if (len_dir)
+        path[1 + len_dir] = '/';
+    memcpy(&path[len_path - len_name], name, len_name);
+
+    bool keep = true;
+
+    for (; rules; rules = rules->parent)
+    {
+        size_t skip = rules->len_rel ? rules->len_rel + 1 : 0;
+        int64_t rule = match_rules(rules, name, len_name, &path[skip], len_path - skip, type & FTI_DIRECTORY, stats);
+
+        if (rule >= 0)
+        {
+            keep = rules->rules[rule].flags & RULE_NEGATE;
+            break;
+        }
+    }
+
+    if (!keep)
+        stats->pruned++;
+
+    if (path != buffer)
+        free(path);
+
+    return keep;
+}
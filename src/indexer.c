@@ -0,0 +1,490 @@
+#include "theeditor.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <string.h>
+
+#define NO_DIR UINT32_MAX
+
+typedef struct {
+    uint32_t dir;
+    char *path;
+    // Inherited from the parent, the directory's own ignore files are only read if its listing holds them
+    const IgnoreRules *rules;
+} CrawlTask;
+
+/* Owners push and pop at the bottom, thieves take from the top so they get the oldest, largest subtrees. */
+typedef struct {
+    PlatformMutex *mutex;
+    size_t top, bottom, cap;
+    CrawlTask *tasks;
+} TaskDeque;
+
+typedef struct {
+    uint32_t len_name;
+    uint8_t flags;
+    uint32_t child_dir;
+    uint64_t size;
+    int64_t mtime;
+} CrawlEntry;
+
+/* Everything listed in one directory, in the worker's private memory until the merge. */
+typedef struct {
+    uint32_t dir;
+    size_t len, cap;
+    CrawlEntry *entries;
+    size_t len_names, cap_names;
+    char *names;
+} DirResult;
+
+typedef struct Crawl Crawl;
+
+typedef struct {
+    Crawl *crawl;
+    int id;
+    PlatformThread *thread;
+    TaskDeque deque;
+    size_t len_results, cap_results;
+    DirResult *results;
+    IgnoreStats ignore_stats;
+} CrawlWorker;
+
+struct Crawl {
+    int nworkers;
+    CrawlWorker *workers;
+    IgnoreCache *ignore;
+    size_t len_root;
+
+    PlatformMutex *mutex;
+    PlatformCond *wake;
+    // Directories queued or being listed; the crawl is over when it reaches 0
+    size_t pending;
+    uint32_t next_dir;
+    int idle;
+    bool done;
+};
+
+static void deque_push(TaskDeque *deque, CrawlTask task)
+{
+    platform_mutex_lock(deque->mutex);
+
+    if (deque->bottom >= deque->cap)
+    {
+        if (deque->top > 0)
+        {
+            memmove(deque->tasks, &deque->tasks[deque->top], (deque->bottom - deque->top) * sizeof *deque->tasks);
+            deque->bottom -= deque->top;
+            deque->top = 0;
+        }
+
+        if (deque->bottom >= deque->cap)
+        {
+            deque->cap = deque->cap < 64 ? 64 : 2 * deque->cap;
+            deque->tasks = realloc(deque->tasks, deque->cap * sizeof *deque->tasks);
+        }
+    }
+
+    deque->tasks[deque->bottom++] = task;
+
+    platform_mutex_unlock(deque->mutex);
+}
+
+static bool deque_pop(TaskDeque *deque, CrawlTask *task)
+{
+    bool found = false;
+
+    platform_mutex_lock(deque->mutex);
+
+    if (deque->bottom > deque->top)
+    {
+        *task = deque->tasks[--deque->bottom];
+        found = true;
+    }
+
+    if (deque->bottom == deque->top)
+        deque->bottom = deque->top = 0;
+
+    platform_mutex_unlock(deque->mutex);
+
+    return found;
+}
+
+static bool deque_steal(TaskDeque *deque, CrawlTask *task)
+{
+    bool found = false;
+
+    platform_mutex_lock(deque->mutex);
+
+    if (deque->bottom > deque->top)
+    {
+        *task = deque->tasks[deque->top++];
+        found = true;
+    }
+
+    platform_mutex_unlock(deque->mutex);
+
+    return found;
+}
+
+static bool deque_empty(TaskDeque *deque)
+{
+    platform_mutex_lock(deque->mutex);
+    bool empty = deque->bottom == deque->top;
+    platform_mutex_unlock(deque->mutex);
+
+    return empty;
+}
+
+static bool dir_result_append(void *user, const PlatformDirEntry *entry)
+{
+    DirResult *result = user;
+
+    if (result->len >= result->cap)
+    {
+        result->cap = result->cap < 16 ? 16 : 2 * result->cap;
+        result->entries = realloc(result->entries, result->cap * sizeof *result->entries);
+    }
+
+    if (result->len_names + entry->len_name > result->cap_names)
+    {
+        result->cap_names = 2 * result->cap_names;
+        if (result->cap_names < result->len_names + entry->len_name)
+            result->cap_names = result->len_names + entry->len_name + FILENAME_LEN;
+        result->names = realloc(result->names, result->cap_names);
+    }
+
+    memcpy(&result->names[result->len_names], entry->name, entry->len_name);
+    result->len_names += entry->len_name;
+
+    result->entries[result->len++] = (CrawlEntry){
+        .len_name = (uint32_t)entry->len_name,
+        .flags = (uint8_t)entry->type,
+        .child_dir = NO_DIR,
+        .size = entry->size,
+        .mtime = entry->mtime,
+    };
+
+    return true;
+}
+
+/* Drops the ignored entries of a listing before any of them is descended. */
+static const IgnoreRules *dir_result_filter(CrawlWorker *self, DirResult *result, const CrawlTask *task)
+{
+    Crawl *crawl = self->crawl;
+    const char *rel = task->path[crawl->len_root] ? &task->path[crawl->len_root + 1] : ".";
+    bool has_files = false;
+    const char *name = result->names;
+
+    for (size_t i = 0; i < result->len; name += result->entries[i++].len_name)
+        has_files |= ignore_is_rule_file(name, result->entries[i].len_name);
+
+    const IgnoreRules *rules = ignore_rules_child(crawl->ignore, task->rules, rel, has_files);
+    size_t len = 0, len_names = 0;
+
+    name = result->names;
+    for (size_t i = 0; i < result->len; name += result->entries[i++].len_name)
+    {
+        CrawlEntry *entry = &result->entries[i];
+
+        if (!ignore_keep(rules, rel, name, entry->len_name, entry->flags, &self->ignore_stats))
+            continue;
+
+        memmove(&result->names[len_names], name, entry->len_name);
+        len_names += entry->len_name;
+        result->entries[len++] = *entry;
+    }
+
+    result->len = len;
+    result->len_names = len_names;
+
+    return rules;
+}
+
+static void crawl_directory(CrawlWorker *self, CrawlTask task)
+{
+    Crawl *crawl = self->crawl;
+    DirResult result = {.dir = task.dir};
+    const IgnoreRules *rules = NULL;
+
+    platform_list_directory_stat(task.path, dir_result_append, &result);
+
+    if (crawl->ignore)
+        rules = dir_result_filter(self, &result, &task);
+
+    uint32_t ndirs = 0;
+    for (size_t i = 0; i < result.len; i++)
+        if (result.entries[i].flags & FTI_DIRECTORY)
+            ndirs++;
+
+    // Children are counted as pending before this directory stops being pending, so the count never dips to 0 early
+    platform_mutex_lock(crawl->mutex);
+    uint32_t first_dir = crawl->next_dir;
+    crawl->next_dir += ndirs;
+    crawl->pending += ndirs;
+    crawl->pending--;
+    if (!crawl->pending)
+    {
+        crawl->done = true;
+        platform_cond_broadcast(crawl->wake);
+    }
+    platform_mutex_unlock(crawl->mutex);
+
+    size_t len_path = strlen(task.path);
+    const char *name = result.names;
+
+    for (size_t i = 0; i < result.len; i++)
+    {
+        CrawlEntry *entry = &result.entries[i];
+
+        if (entry->flags & FTI_DIRECTORY)
+        {
+            char *path = malloc(len_path + entry->len_name + 2);
+            memcpy(path, task.path, len_path);
+            path[len_path] = PATH_SEPARATOR;
+            memcpy(&path[len_path + 1], name, entry->len_name);
+            path[len_path + 1 + entry->len_name] = '\0';
+
+            entry->child_dir = first_dir++;
+            deque_push(&self->deque, (CrawlTask){entry->child_dir, path, rules});
+        }
+
+        name += entry->len_name;
+    }
+
+    if (ndirs)
+    {
+        platform_mutex_lock(crawl->mutex);
+        if (crawl->idle)
+            platform_cond_broadcast(crawl->wake);
+        platform_mutex_unlock(crawl->mutex);
+    }
+
+    if (self->len_results >= self->cap_results)
+    {
+        self->cap_results = self->cap_results < 64 ? 64 : 2 * self->cap_results;
+        self->results = realloc(self->results, self->cap_results * sizeof *self->results);
+    }
+    self->results[self->len_results++] = result;
+
+    free(task.path);
+}
+
+static bool crawl_steal(CrawlWorker *self, CrawlTask *task)
+{
+    Crawl *crawl = self->crawl;
+
+    for (int i = 1; i < crawl->nworkers; i++)
+    {
+        CrawlWorker *victim = &crawl->workers[(self->id + i) % crawl->nworkers];
+        if (deque_steal(&victim->deque, task))
+            return true;
+    }
+
+    return false;
+}
+
+static bool crawl_has_work(Crawl *crawl)
+{
+    for (int i = 0; i < crawl->nworkers; i++)
+        if (!deque_empty(&crawl->workers[i].deque))
+            return true;
+
+    return false;
+}
+
+static void crawl_worker_main(void *arg)
+{
+    CrawlWorker *self = arg;
+    Crawl *crawl = self->crawl;
+
+    for (;;)
+    {
+        CrawlTask task;
+
+        if (deque_pop(&self->deque, &task) || crawl_steal(self, &task))
+        {
+            crawl_directory(self, task);
+            continue;
+        }
+
+        platform_mutex_lock(crawl->mutex);
+
+        // Checked again under the lock, a push that lands after this will see us idle and wake us
+        if (!crawl->done && !crawl_has_work(crawl))
+        {
+            crawl->idle++;
+            platform_cond_wait(crawl->wake, crawl->mutex);
+            crawl->idle--;
+        }
+
+        bool done = crawl->done;
+        platform_mutex_unlock(crawl->mutex);
+
+        if (done)
+            break;
+    }
+}
+
+/* Lays the per-directory results out depth first, each directory's children as one run.  False if the root failed. */
+static bool snapshot_merge(WorkspaceSnapshot *snapshot, const Crawl *crawl)
+{
+    size_t ndirs = crawl->next_dir;
+    const DirResult **by_dir = calloc(ndirs, sizeof *by_dir);
+    size_t len = 1;
+
+    for (int w = 0; w < crawl->nworkers; w++)
+    {
+        for (size_t i = 0; i < crawl->workers[w].len_results; i++)
+        {
+            const DirResult *result = &crawl->workers[w].results[i];
+            by_dir[result->dir] = result;
+            len += result->len;
+        }
+    }
+
+    snapshot->parent = malloc(len * sizeof *snapshot->parent);
+    snapshot->name = malloc(len * sizeof *snapshot->name);
+    snapshot->flags = malloc(len * sizeof *snapshot->flags);
+    snapshot->size = malloc(len * sizeof *snapshot->size);
+    snapshot->mtime = malloc(len * sizeof *snapshot->mtime);
+
+    snapshot->parent[0] = UINT32_MAX;
+    snapshot->name[0] = strarena_intern(&snapshot->strarena, ".", 1);
+    snapshot->flags[0] = FTI_DIRECTORY;
+    snapshot->size[0] = 0;
+    snapshot->mtime[0] = 0;
+    snapshot->len = 1;
+
+    struct { uint32_t dir, index; } *stack = malloc(ndirs * sizeof *stack);
+    size_t len_stack = 0;
+
+    stack[len_stack].dir = 0;
+    stack[len_stack].index = 0;
+    len_stack++;
+
+    while (len_stack)
+    {
+        len_stack--;
+        uint32_t dir = stack[len_stack].dir;
+        uint32_t parent = stack[len_stack].index;
+        const DirResult *result = by_dir[dir];
+
+        // Directories that could not be opened have no result, they just stay empty
+        if (!result)
+            continue;
+
+        size_t base = snapshot->len;
+        const char *name = result->names;
+
+        for (size_t i = 0; i < result->len; i++)
+        {
+            const CrawlEntry *entry = &result->entries[i];
+            size_t at = snapshot->len++;
+
+            snapshot->parent[at] = parent;
+            snapshot->name[at] = strarena_intern(&snapshot->strarena, name, entry->len_name);
+            snapshot->flags[at] = entry->flags;
+            snapshot->size[at] = entry->size;
+            snapshot->mtime[at] = entry->mtime;
+
+            name += entry->len_name;
+        }
+
+        // Pushed in reverse so the first subdirectory is laid out first
+        for (size_t i = result->len; i-- > 0;)
+        {
+            if (result->entries[i].child_dir == NO_DIR)
+                continue;
+
+            stack[len_stack].dir = result->entries[i].child_dir;
+            stack[len_stack].index = (uint32_t)(base + i);
+            len_stack++;
+        }
+    }
+
+    bool listed_root = by_dir[0] != NULL;
+
+    free(stack);
+    free(by_dir);
+
+    return listed_root;
+}
+
+bool ws_index(WorkspaceSnapshot *snapshot, const char *root, int nthreads, IgnoreCache *ignore)
+{
+    *snapshot = (WorkspaceSnapshot){0};
+    strarena_init(&snapshot->strarena);
+
+    if (nthreads <= 0)
+        nthreads = platform_cpu_count();
+
+    Crawl crawl = {
+        .nworkers = nthreads,
+        .workers = calloc(nthreads, sizeof *crawl.workers),
+        .mutex = platform_mutex_create(),
+        .wake = platform_cond_create(),
+        .ignore = ignore,
+        .pending = 1,
+        .next_dir = 1,
+    };
+
+    size_t len_root = strlen(root);
+    crawl.len_root = len_root;
+    char *root_path = malloc(len_root + 1);
+    memcpy(root_path, root, len_root + 1);
+
+    for (int i = 0; i < nthreads; i++)
+    {
+        crawl.workers[i].crawl = &crawl;
+        crawl.workers[i].id = i;
+        crawl.workers[i].deque.mutex = platform_mutex_create();
+    }
+
+    deque_push(&crawl.workers[0].deque, (CrawlTask){0, root_path, NULL});
+
+    // The calling thread works as worker 0
+    for (int i = 1; i < nthreads; i++)
+        crawl.workers[i].thread = platform_thread_create(crawl_worker_main, &crawl.workers[i]);
+    crawl_worker_main(&crawl.workers[0]);
+    for (int i = 1; i < nthreads; i++)
+        if (crawl.workers[i].thread)
+            platform_thread_join(crawl.workers[i].thread);
+
+    bool listed_root = snapshot_merge(snapshot, &crawl);
+
+    for (int i = 0; i < nthreads; i++)
+    {
+        CrawlWorker *worker = &crawl.workers[i];
+
+        snapshot->ignore_stats.evaluations += worker->ignore_stats.evaluations;
+        snapshot->ignore_stats.pruned += worker->ignore_stats.pruned;
+
+        for (size_t r = 0; r < worker->len_results; r++)
+        {
+            free(worker->results[r].entries);
+            free(worker->results[r].names);
+        }
+
+        free(worker->results);
+        free(worker->deque.tasks);
+        platform_mutex_destroy(worker->deque.mutex);
+    }
+
+    free(crawl.workers);
+    platform_cond_destroy(crawl.wake);
+    platform_mutex_destroy(crawl.mutex);
+
+    return listed_root;
+}
+
+void ws_snapshot_free(WorkspaceSnapshot *snapshot)
+{
+    free(snapshot->parent);
+    free(snapshot->name);
+    free(snapshot->flags);
+    free(snapshot->size);
+    free(snapshot->mtime);
+    strarena_uninit(&snapshot->strarena);
+
+    *snapshot = (WorkspaceSnapshot){0};
+}
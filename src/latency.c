@@ -0,0 +1,204 @@
+#include "theeditor.h"
+
+#include <stdio.h>
+#include <string.h>
+
+// Frames swapped that the GPU may still be on before the oldest is waited for
+#define LATENCY_FRAMES 4
+// Events timed a frame, more than a fast mouse sends
+#define LATENCY_EVENTS 256
+// The widest bar in a histogram
+#define REPORT_BAR 50
+
+typedef struct {
+    InputKind kind;
+    uint64_t time;
+} LatencyEvent;
+
+typedef struct {
+    RenderFence *fence;
+    uint64_t frame;
+    size_t nevents;
+    LatencyEvent events[LATENCY_EVENTS];
+} LatencyFrame;
+
+struct Latency {
+    // The events come in since the last frame was swapped, then the frames swapped that are still on the GPU
+    LatencyFrame next;
+    LatencyFrame in_flight[LATENCY_FRAMES];
+    size_t first, count;
+    // Events past the most a frame times, which go uncounted
+    size_t dropped;
+    LatencyHistogram histograms[NUM_INPUT_KINDS];
+};
+
+Latency *latency_create(void)
+{
+    return calloc(1, sizeof(Latency));
+}
+
+void latency_destroy(Latency *latency)
+{
+    latency_poll(latency, true);
+    free(latency);
+}
+
+void latency_input(Latency *latency, InputKind kind, uint64_t time)
+{
+    if (latency->next.nevents == LATENCY_EVENTS)
+    {
+        latency->dropped++;
+        return;
+    }
+
+    latency->next.events[latency->next.nevents++] = (LatencyEvent){kind, time};
+}
+
+/* Counts the events a frame showed as having taken until `now` to be seen. */
+static void frame_shown(Latency *latency, const LatencyFrame *frame, uint64_t now)
+{
+    for (size_t i = 0; i < frame->nevents; i++)
+    {
+        LatencyHistogram *h = &latency->histograms[frame->events[i].kind];
+        uint64_t ns = now - frame->events[i].time;
+        size_t bucket = ns / LATENCY_BUCKET_NS;
+
+        h->buckets[bucket < LATENCY_BUCKETS ? bucket : LATENCY_BUCKETS - 1]++;
+        h->count++;
+        h->total_ns += ns;
+
+        if (ns > h->max_ns)
+        {
+            h->max_ns = ns;
+            h->max_frame = frame->frame;
+        }
+    }
+}
+
+void latency_frame(Latency *latency, uint64_t frame)
+{
+    // A frame showing nothing new has nothing to time
+    if (!latency->next.nevents)
+        return;
+
+    if (latency->count == LATENCY_FRAMES)
+    {
+        LatencyFrame *oldest = &latency->in_flight[latency->first];
+
+        render_fence_passed(oldest->fence, true);
+        frame_shown(latency, oldest, platform_time_ns());
+        latency->first = (latency->first + 1) % LATENCY_FRAMES;
+        latency->count--;
+    }
+
+    LatencyFrame *swapped = &latency->in_flight[(latency->first + latency->count) % LATENCY_FRAMES];
+
+    swapped->fence = render_fence();
+    swapped->frame = frame;
+    swapped->nevents = latency->next.nevents;
+    memcpy(swapped->events, latency->next.events, latency->next.nevents * sizeof *latency->next.events);
+
+    // With no fence there is no knowing when the frame was done, so its events go uncounted
+    latency->next.nevents = 0;
+    if (swapped->fence)
+        latency->count++;
+}
+
+void latency_poll(Latency *latency, bool wait)
+{
+    // The GPU finishes frames in the order they were swapped, so the first one not done is as far as it has got
+    while (latency->count)
+    {
+        LatencyFrame *oldest = &latency->in_flight[latency->first];
+
+        if (!render_fence_passed(oldest->fence, wait))
+            break;
+
+        frame_shown(latency, oldest, platform_time_ns());
+        latency->first = (latency->first + 1) % LATENCY_FRAMES;
+        latency->count--;
+    }
+}
+
+const LatencyHistogram *latency_histogram(const Latency *latency, InputKind kind)
+{
+    return &latency->histograms[kind];
+}
+
+/* The latency the fraction of events took at most, to the end of the bucket it falls in. */
+static uint64_t percentile(const LatencyHistogram *h, double fraction)
+{
+    size_t rank = (size_t)(fraction * (double)(h->count - 1)), seen = 0;
+
+    for (size_t b = 0; b < LATENCY_BUCKETS; b++)
+    {
+        seen += h->buckets[b];
+        if (seen > rank)
+        {
+            uint64_t end = (b + 1) * (uint64_t)LATENCY_BUCKET_NS;
+            return end < h->max_ns ? end : h->max_ns;
+        }
+    }
+
+    return h->max_ns;
+}
+
+static double milliseconds(uint64_t ns)
+{
+    return (double)ns / 1e6;
+}
+
+void latency_report(const Latency *latency)
+{
+    fprintf(stderr, "%-8s %8s %8s %8s %8s %8s %8s %10s\n", "event", "count", "mean ms", "p50 ms", "p90 ms", "p99 ms",
+            "max ms", "max frame");
+
+    for (int kind = 0; kind < NUM_INPUT_KINDS; kind++)
+    {
+        const LatencyHistogram *h = &latency->histograms[kind];
+
+        if (!h->count)
+            continue;
+
+        fprintf(stderr, "%-8s %8zu %8.2f %8.2f %8.2f %8.2f %8.2f %10llu\n", input_kind_name(kind), h->count,
+                milliseconds(h->total_ns / h->count), milliseconds(percentile(h, 0.5)),
+                milliseconds(percentile(h, 0.9)), milliseconds(percentile(h, 0.99)), milliseconds(h->max_ns),
+                (unsigned long long)h->max_frame);
+    }
+
+    if (latency->dropped)
+        fprintf(stderr, "%zu events came in too many to a frame to be timed\n", latency->dropped);
+
+    static const char bar[REPORT_BAR + 1] = "##################################################";
+
+    for (int kind = 0; kind < NUM_INPUT_KINDS; kind++)
+    {
+        const LatencyHistogram *h = &latency->histograms[kind];
+        size_t widest = 0;
+
+        for (size_t b = 0; b < LATENCY_BUCKETS; b++)
+            widest = h->buckets[b] > widest ? h->buckets[b] : widest;
+
+        if (!widest)
+            continue;
+
+        fprintf(stderr, "\n%s\n", input_kind_name(kind));
+
+        for (size_t b = 0; b < LATENCY_BUCKETS; b++)
+        {
+            if (!h->buckets[b])
+                continue;
+
+            int width = (int)((h->buckets[b] * REPORT_BAR + widest - 1) / widest);
+            double from = milliseconds(b * (uint64_t)LATENCY_BUCKET_NS);
+            char range[32];
+
+            if (b == LATENCY_BUCKETS - 1)
+                snprintf(range, sizeof range, "%5.1f+", from);
+            else
+                snprintf(range, sizeof range, "%5.1f-%5.1f", from, from + milliseconds(LATENCY_BUCKET_NS));
+
+            fprintf(stderr, "  %-11s ms %8zu %.*s\n", range, h->buckets[b], width, bar);
+        }
+    }
+}
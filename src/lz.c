@@ -0,0 +1,183 @@
+#include "theeditor.h"
+
+#include <string.h>
+
+/*
+ * A byte-oriented LZ77 in the manner of LZ4: a sequence is a token, literals and a match.  The token's high four
+ * bits are the number of literals and its low four the match length less LZ_MIN_MATCH, either of which carries on
+ * in following bytes of 255 until one is less, when it is 15.  The literals come next, then the match's distance
+ * back as two bytes little-endian and the rest of its length.  The last sequence has literals only.
+ */
+#define LZ_MIN_MATCH 4
+#define LZ_MAX_OFFSET 65535
+#define LZ_HASH_BITS 12
+// Searching skips ahead faster the longer it goes without a match, so text that does not compress goes quickly
+#define LZ_SKIP_SHIFT 5
+
+static uint32_t read32(const uint8_t *p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof v);
+    return v;
+}
+
+static uint32_t hash4(uint32_t v)
+{
+    return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+static uint8_t *put_length(uint8_t *out, size_t len)
+{
+    for (; len >= 255; len -= 255)
+        *out++ = 255;
+    *out++ = (uint8_t)len;
+
+    return out;
+}
+
+/* Reads the rest of a length after its 15 in the token.  Returns false if the input ends first. */
+static bool get_length(const uint8_t **in, const uint8_t *end, size_t *len)
+{
+    uint8_t b;
+
+    do
+    {
+        if (*in == end)
+            return false;
+        b = *(*in)++;
+        *len += b;
+    } while (b == 255);
+
+    return true;
+}
+
+static uint8_t *put_sequence(uint8_t *out, const uint8_t *literals, size_t len_literals, size_t offset, size_t len)
+{
+    uint8_t *token = out++;
+    size_t match = len - LZ_MIN_MATCH;
+
+    *token = (uint8_t)((len_literals < 15 ? len_literals : 15) << 4 | (match < 15 ? match : 15));
+
+    if (len_literals >= 15)
+        out = put_length(out, len_literals - 15);
+    memcpy(out, literals, len_literals);
+    out += len_literals;
+
+    out[0] = (uint8_t)offset;
+    out[1] = (uint8_t)(offset >> 8);
+    out += 2;
+
+    if (match >= 15)
+        out = put_length(out, match - 15);
+
+    return out;
+}
+
+size_t lz_bound(size_t len)
+{
+    return len + len / 255 + 16;
+}
+
+size_t lz_compress(const void *src, size_t len, void *dst)
+{
+    const uint8_t *in = src, *end = in + len;
+    const uint8_t *p = in, *anchor = in;
+    const uint8_t *last_match = len > LZ_MIN_MATCH ? end - LZ_MIN_MATCH : in;
+    uint8_t *out = dst;
+    // Where the last four bytes with each hash were, as offsets from the start
+    uint32_t table[1 << LZ_HASH_BITS] = {0};
+
+    while (p < last_match)
+    {
+        uint32_t v = read32(p), h = hash4(v);
+        const uint8_t *candidate = in + table[h];
+
+        table[h] = (uint32_t)(p - in);
+
+        if (candidate >= p || p - candidate > LZ_MAX_OFFSET || read32(candidate) != v)
+        {
+            p += 1 + ((size_t)(p - anchor) >> LZ_SKIP_SHIFT);
+            continue;
+        }
+
+        const uint8_t *q = p + LZ_MIN_MATCH, *c = candidate + LZ_MIN_MATCH;
+        while (q < end && *q == *c)
+            q++, c++;
+
+        out = put_sequence(out, anchor, (size_t)(p - anchor), (size_t)(p - candidate), (size_t)(q - p));
+        p = anchor = q;
+    }
+
+    size_t len_literals = (size_t)(end - anchor);
+
+    *out++ = (uint8_t)((len_literals < 15 ? len_literals : 15) << 4);
+    if (len_literals >= 15)
+        out = put_length(out, len_literals - 15);
+    memcpy(out, anchor, len_literals);
+    out += len_literals;
+
+    return (size_t)(out - (uint8_t *)dst);
+}
+
+bool lz_decompress(const void *src, size_t len, void *dst, size_t len_dst)
+{
+    const uint8_t *in = src, *in_end = in + len;
+    uint8_t *out = dst, *out_end = out + len_dst;
+
+    while (in < in_end)
+    {
+        uint8_t token = *in++;
+        size_t len_literals = token >> 4, len_match = token & 15;
+
+        if (len_literals == 15 && !get_length(&in, in_end, &len_literals))
+            return false;
+        if (len_literals > (size_t)(in_end - in) || len_literals > (size_t)(out_end - out))
+            return false;
+
+        memcpy(out, in, len_literals);
+        in += len_literals;
+        out += len_literals;
+
+        // Only the last sequence ends after its literals
+        if (in == in_end)
+            break;
+        if (in_end - in < 2)
+            return false;
+
+        size_t offset = (size_t)in[0] | (size_t)in[1] << 8;
+        in += 2;
+
+        if (len_match == 15 && !get_length(&in, in_end, &len_match))
+            return false;
+        len_match += LZ_MIN_MATCH;
+
+        if (!offset || offset > (size_t)(out - (uint8_t *)dst) || len_match > (size_t)(out_end - out))
+            return false;
+
+        const uint8_t *from = out - offset;
+
+        if (offset >= len_match)
+        {
+            memcpy(out, from, len_match);
+        }
+        else if (offset >= 8)
+        {
+            // Overlapping, but by enough that each eight bytes come from ones already written
+            size_t i = 0;
+            for (; i + 8 <= len_match; i += 8)
+                memcpy(&out[i], &from[i], 8);
+            for (; i < len_match; i++)
+                out[i] = from[i];
+        }
+        else
+        {
+            // A short repeat, such as a run of one byte
+            for (size_t i = 0; i < len_match; i++)
+                out[i] = from[i];
+        }
+
+        out += len_match;
+    }
+
+    return out == out_end;
+}
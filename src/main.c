@@ -1,263 +1,1512 @@
-﻿#include <glad/gl.h>
-#include <GLFW/glfw3.h>
-
-#include <stdio.h>
-#include <stdlib.h>
-#include <stdint.h>
-#include <stdbool.h>
-#include <assert.h>
-// #include <processthreadsapi.h>
-#include <ft2build.h>
-#include FT_FREETYPE_H
-
-#include "theeditor.h"
-
-typedef struct {
-    int atlas_id, subtexture_id;
-    int width, height;
-    SidePanel side_panel;
-    BottomPanel bottom_panel;
-    size_t ft_listing_len;
-    FileTreeItem *ft_listing;
-    StringArena ft_arena;
-} SceneData;
-
-static SceneData sd = {0};
-
-static void glfw_error_callback(int error, const char *description);
-static void glfw_key_callback(GLFWwindow *window, int key, int scancode, int action, int mods);
-static void glfw_cursor_pos_callback(GLFWwindow *window, double pos_x, double pos_y);
-static void glfw_mouse_button_callback(GLFWwindow *window, int button, int action, int mods);
-static void glfw_window_refresh_callback(GLFWwindow *window);
-static void glfw_framebuffer_size_callback(GLFWwindow *window, int width, int height);
-static void glfw_scroll_callback(GLFWwindow *window, double scrollx, double scrolly);
-static void glad_post_callback(void *ret, const char *name, GLADapiproc apiproc, int len_args, ...);
-
-static void render();
-
-int main(int nargs, const char *argv[])
-{
-    GLFWwindow *window;
-
-    glfwSetErrorCallback(glfw_error_callback);
-
-    if (!glfwInit())
-    {
-        fprintf(stderr, "Failed to initialise glfw\n");
-        glfwTerminate();
-        return EXIT_FAILURE;
-    }
-
-    if (!font_init())
-    {
-        fprintf(stderr, "Failed to initalise the freetype library\n");
-        return EXIT_FAILURE;
-    }
-
-    // FT_Face face;
-    // if (FT_New_Face(ft, "C:/Windows/Fonts/Consola.ttf", 0, &face))
-    // {
-    //     fprintf(stderr, "FreeType: Failed to load font consolas from C:/Windows/Fonts/Consola.ttf\n");
-    //     return EXIT_FAILURE;
-    // }
-
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-    glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, true);
-    window = glfwCreateWindow(2000, 1000, "GLFW Window", NULL, NULL);
-    glfwMakeContextCurrent(window);
-    gladLoadGL(glfwGetProcAddress);
-    gladSetGLPostCallback(glad_post_callback);
-    glfwSetKeyCallback(window, glfw_key_callback);
-    glfwSetCursorPosCallback(window, glfw_cursor_pos_callback);
-    glfwSetMouseButtonCallback(window, glfw_mouse_button_callback);
-    glfwSetScrollCallback(window, glfw_scroll_callback);
-    glfwSetWindowRefreshCallback(window, glfw_window_refresh_callback);
-    glfwSetFramebufferSizeCallback(window, glfw_framebuffer_size_callback);
-
-    double now, last_frame = 0.0, delta;
-    const double SPF_LIMIT = 1. / 60.;
-
-    int width, height;
-    glfwGetFramebufferSize(window, &width, &height);
-    render_init();
-    render_viewport((Rect){0, 0, width, height});
-
-    ft_init(&sd.ft_listing_len, &sd.ft_listing, &sd.ft_arena);
-
-    while (!glfwWindowShouldClose(window))
-    {
-        glfwPollEvents();
-
-        now = glfwGetTime();
-
-        glfwGetFramebufferSize(window, &width, &height);
-        render_viewport((Rect){0, 0, width, height});
-        sd.width = width;
-        sd.height = height;
-
-        delta = now - last_frame;
-
-        if (delta >= SPF_LIMIT)
-        {
-            render();
-            glfwSwapBuffers(window);
-            last_frame = now;
-            // printf("Frame time = %.1lfms\n", 1000. * delta);
-        }
-    }
-    glfwDestroyWindow(window);
-
-    glfwTerminate();
-    return EXIT_SUCCESS;
-}
-
-static void glfw_error_callback(int error, const char *description)
-{
-    fprintf(stderr, "GLFW error: %s\n", description);
-}
-
-static void glfw_key_callback(GLFWwindow *window, int key, int scancode, int action, int mods)
-{
-    if (action != GLFW_PRESS)
-        return;
-
-    switch (key)
-    {
-    case GLFW_KEY_S:
-        sd.side_panel.hidden = !sd.side_panel.hidden;
-        break;
-    case GLFW_KEY_B:
-        sd.bottom_panel.hidden = !sd.bottom_panel.hidden;
-        break;
-    }
-}
-
-static void glfw_cursor_pos_callback(GLFWwindow *window, double pos_x, double pos_y)
-{
-    ui_mouse_position((float)pos_x, (float)pos_y);
-}
-
-static void glfw_mouse_button_callback(GLFWwindow *window, int button, int action, int mods)
-{
-    if (button == GLFW_MOUSE_BUTTON_LEFT)
-        switch (action)
-        {
-        case GLFW_PRESS:
-            ui_mouse_button(true);
-            break;
-        case GLFW_RELEASE:
-            ui_mouse_button(false);
-            break;
-        }
-}
-
-static void glfw_window_refresh_callback(GLFWwindow *window)
-{
-    render();
-    glfwSwapBuffers(window);
-}
-
-static void glfw_framebuffer_size_callback(GLFWwindow *window, int width, int height)
-{
-    ui_viewport((float)width, (float)height);
-    render_viewport((Rect){0, 0, width, height});
-    sd.width = width;
-    sd.height = height;
-}
-
-static void glfw_scroll_callback(GLFWwindow *window, double scrollx, double scrolly)
-{
-    ui_scroll((Vec2) {(float)scrollx, (float)scrolly});
-}
-
-static void render()
-{
-    int id = 0;
-
-    typedef enum {
-        OP_NONE = 0,
-        OP_EXPAND_FILE_TREE = 1,
-        OP_COLLAPSE_FILE_TREE,
-    } PostUiOperation;
-
-    PostUiOperation op = OP_NONE;
-    int op_arg = OP_NONE;
-
-    ui_viewport((float)sd.width, (float)sd.height);
-
-    ui_begin();
-        ui_container_begin(C_SCROLLY, (FRect) {0, 0, 500, sd.height}, ++id);
-            // ui_button((FRect) {0, 0, 300, 150}, ++id);
-            ui_treelist_begin();
-                for (int i = 0; i < sd.ft_listing_len; i++)
-                {
-                    String name = (String)
-                    {
-                        .data = sd.ft_listing[i].name,
-                        .length = sd.ft_listing[i].len_name
-                    };
-
-                    bool bold = !!(sd.ft_listing[i].flags & FTI_DIRECTORY);
-
-                    if (ui_treelist_item(sd.ft_listing[i].depth, name, bold, ++id))
-                    {
-                        if (sd.ft_listing[i].flags & FTI_FILE)
-                            continue;
-
-                        assert(!op && "only one item should ever be activated per render loop");
-
-                        if (sd.ft_listing[i].flags & FTI_OPEN)
-                        {
-                            op = OP_COLLAPSE_FILE_TREE;
-                        }
-                        else
-                        {
-                            op = OP_EXPAND_FILE_TREE;
-                        }
-
-                        op_arg = i;
-                    }
-
-                    if (!(sd.ft_listing[i].flags & FTI_OPEN))
-                    {
-                        int parent_depth = sd.ft_listing[i].depth;
-
-                        while (
-                            i + 1 < sd.ft_listing_len
-                            && sd.ft_listing[i + 1].depth > parent_depth)
-                            i++;
-                    }
-                }
-            ui_treelist_end();
-        ui_container_end();
-    ui_end();
-
-    switch (op)
-    {
-    case OP_EXPAND_FILE_TREE:
-        ft_expand(&sd.ft_listing_len, &sd.ft_listing, &sd.ft_arena, op_arg);
-        break;
-    case OP_COLLAPSE_FILE_TREE:
-        ft_collapse(sd.ft_listing_len, sd.ft_listing, op_arg);
-        break;
-    default:
-        break;
-    }
-
-    // render_push_colored_quad((FRect) {0, 0, 200, 200}, COLOR_RGB(0xff0000), 0, NULL);
-    // render_push_colored_quad((FRect) {400, 300, 200, 200}, COLOR_RGB(0x00ff00), 0, NULL);
-    // render_draw();
-}
-
-static void glad_post_callback(void *ret, const char *name, GLADapiproc apiproc, int len_args, ...)
-{
-    // This crashes the program for some reason:
-
-    // if (glGetError())
-    // {
-    //     fprintf(stderr, "GL call failed: %s()\n", name);
-    //     exit(EXIT_FAILURE);
-    // }
-}
+﻿#include <glad/gl.h>
+#include <GLFW/glfw3.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <assert.h>
+// #include <processthreadsapi.h>
+#include <ft2build.h>
+#include FT_FREETYPE_H
+
+#include "theeditor.h"
+
+// Written at exit and loaded at startup, so the tree comes back as it was left, one per workspace in the cache
+#define FILE_TREE_SNAPSHOT "tree-%016llx"
+// The side panel's container, whose scroll offset is saved with the tree
+#define FILE_TREE_CONTAINER_ID 1
+// Containers keep their state apart from widget ids, so this does not clash with the tree rows
+#define EDITOR_CONTAINER_ID 2
+#define SIDE_PANEL_WIDTH 500
+// Spans past this many on one line are left plain
+#define MAX_LINE_SPANS 512
+// Takes the editor's place while searching, with a scroll offset of its own
+#define FIND_CONTAINER_ID 3
+#define FIND_QUERY_MAX 256
+#define QUICK_OPEN_CONTAINER_ID 4
+#define CONSOLE_CONTAINER_ID 5
+#define CONSOLE_HEIGHT 400
+// The console's size until its panel is first laid out
+#define CONSOLE_COLUMNS 120
+#define CONSOLE_ROWS 10
+// What the lines scrolled off the console may take, about four million lines of a build's output
+#define CONSOLE_SCROLLBACK_BUDGET (64 << 20)
+// After a slow frame's trace is written, later ones wait this long, or writing it would trigger the next
+#define TRACE_SLOW_COOLDOWN_NS 5000000000ull
+// The window's size when it opens, and what is drawn headless unless told otherwise
+#define WINDOW_WIDTH 2000
+#define WINDOW_HEIGHT 1000
+
+typedef struct {
+    int atlas_id, subtexture_id;
+    int width, height;
+    SidePanel side_panel;
+    BottomPanel bottom_panel;
+    FileTree file_tree;
+    bool has_document;
+    Document document;
+    Highlighter highlighter;
+    // Find in files, started again on every change to the query
+    bool finding, find_running;
+    char find_query[FIND_QUERY_MAX];
+    size_t len_find_query;
+    FindInFiles *find;
+    // The row each file's results start on below the query, a row for its path and one per line after it
+    size_t len_find_rows, cap_find_rows;
+    size_t *find_rows;
+    size_t find_nrows;
+    // Quick open, matching the query against every file path, which are indexed the first time it is opened
+    bool quick_opening;
+    char quick_open_query[QUICK_OPEN_QUERY_MAX];
+    size_t len_quick_open_query;
+    QuickOpen *quick_open;
+    size_t quick_open_selected;
+    // The shell in the bottom panel, started the first time it is shown and again if it exits, and what it wrote
+    Console *console;
+    Terminal console_term;
+    Scrollback *console_scrollback;
+    // The frames drawn so far, input being recorded and replayed by the frame it came in before
+    uint64_t frame;
+    InputRecording *recording;
+    double recording_start;
+    InputReplay *replay;
+    // A line for each frame with how long it took on each side, and a hash of what it drew if asked for
+    FILE *timings;
+    bool checksums;
+    // Where the last frames' time went, kept always and drawn over the editor when asked for
+    FrameStats *stats;
+    bool stats_overlay;
+    // How long each event took to be seen, from its callback to the GPU finishing the frame swapped after it
+    Latency *latency;
+    // With no display there is nothing to swap
+    bool headless;
+    // Frames that take longer than this on the CPU have the trace of them written out, unless it is 0
+    uint64_t trace_slow_ns, trace_written;
+} SceneData;
+
+typedef struct {
+    bool headless;
+    int width, height;
+    const char *record, *replay, *timings, *stats;
+    bool checksums;
+    // 0 to run until the window is closed
+    uint64_t frames;
+    bool trace;
+    double trace_slow_ms;
+    bool memory;
+    bool latency;
+    bool startup;
+} Options;
+
+static SceneData sd = {0};
+
+static void glfw_error_callback(int error, const char *description);
+static void glfw_key_callback(GLFWwindow *window, int key, int scancode, int action, int mods);
+static void glfw_char_callback(GLFWwindow *window, unsigned int codepoint);
+static void glfw_cursor_pos_callback(GLFWwindow *window, double pos_x, double pos_y);
+static void glfw_mouse_button_callback(GLFWwindow *window, int button, int action, int mods);
+static void glfw_window_refresh_callback(GLFWwindow *window);
+static void glfw_framebuffer_size_callback(GLFWwindow *window, int width, int height);
+static void glfw_scroll_callback(GLFWwindow *window, double scrollx, double scrolly);
+static void glad_post_callback(void *ret, const char *name, GLADapiproc apiproc, int len_args, ...);
+
+static bool parse_options(int nargs, const char *argv[], Options *options);
+static GLFWwindow *create_window(const Options *options);
+static void frame(GLFWwindow *window);
+static void trace_write(const char *why);
+static void stats_write(void);
+static void render();
+static bool open_document(const char *path);
+static void console_output(void *user, const char *data, size_t len);
+static void console_scrolled(void *user, const TermCell *cells, int columns);
+
+/* The fonts, rasterised while the window is made, and whether FreeType could be started to do it. */
+static void startup_fonts(void *arg)
+{
+    bool *started = arg;
+
+    *started = font_init();
+    if (*started)
+        ui_fonts_rasterise();
+}
+
+typedef struct {
+    // A session recorded or replayed starts from the workspace as it is on disk, not as the tree was last left
+    bool session;
+    bool restored;
+    float scroll;
+    // Empty with nowhere to keep the tree
+    char snapshot[4 * FILENAME_LEN];
+} TreeStartup;
+
+/* Where the tree of the workspace in the current directory is kept, named for a hash of its path. */
+static bool file_tree_snapshot(char *path, size_t size)
+{
+    char dir[4 * FILENAME_LEN], cwd[4 * FILENAME_LEN];
+    uint64_t hash = 14695981039346656037ull;
+
+    if (!platform_cache_dir(dir, sizeof dir) || !platform_current_dir(cwd, sizeof cwd))
+        return false;
+
+    for (const char *c = cwd; *c; c++)
+    {
+        hash ^= (uint8_t)*c;
+        hash *= 1099511628211ull;
+    }
+
+    int n = snprintf(path, size, "%s%c" FILE_TREE_SNAPSHOT, dir, PATH_SEPARATOR, (unsigned long long)hash);
+    return n > 0 && (size_t)n < size;
+}
+
+/* The file tree as it was last left, or else listed afresh, while the window is made. */
+static void startup_file_tree(void *arg)
+{
+    TreeStartup *tree = arg;
+
+    tree->restored = !tree->session && tree->snapshot[0] && ft_load(&sd.file_tree, tree->snapshot, &tree->scroll);
+    if (!tree->restored)
+        ft_init(&sd.file_tree);
+}
+
+int main(int nargs, const char *argv[])
+{
+    GLFWwindow *window;
+    Options options;
+    Startup *startup = startup_create();
+
+    if (!parse_options(nargs, argv, &options))
+        goto failure;
+
+    trace_init();
+    trace_enable(options.trace);
+    sd.trace_slow_ns = (uint64_t)(options.trace_slow_ms * 1e6);
+    TRACE_BEGIN("startup");
+
+    // Only the window and the GL need the main thread, everything else gets going alongside
+    bool fonts_started = false;
+    TreeStartup tree = {.session = options.record || options.replay};
+
+    if (!tree.session && !file_tree_snapshot(tree.snapshot, sizeof tree.snapshot))
+        tree.snapshot[0] = '\0';
+
+    startup_spawn(startup, "fonts", startup_fonts, &fonts_started);
+    startup_spawn(startup, "file tree", startup_file_tree, &tree);
+
+    startup_begin(startup, "glfw");
+    glfwSetErrorCallback(glfw_error_callback);
+
+    // With no display the window is never shown, and the context draws in memory on whatever GL the system has
+    if (options.headless)
+        glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+
+    if (!glfwInit())
+    {
+        fprintf(stderr, "Failed to initialise glfw\n");
+        goto failure;
+    }
+    startup_end(startup);
+
+    // FT_Face face;
+    // if (FT_New_Face(ft, "C:/Windows/Fonts/Consola.ttf", 0, &face))
+    // {
+    //     fprintf(stderr, "FreeType: Failed to load font consolas from C:/Windows/Fonts/Consola.ttf\n");
+    //     return EXIT_FAILURE;
+    // }
+
+    startup_begin(startup, "window");
+    window = create_window(&options);
+    if (!window)
+    {
+        fprintf(stderr, "Failed to create a window\n");
+        goto failure;
+    }
+
+    glfwMakeContextCurrent(window);
+    gladLoadGL(glfwGetProcAddress);
+    gladSetGLPostCallback(glad_post_callback);
+    glfwSetKeyCallback(window, glfw_key_callback);
+    glfwSetCharCallback(window, glfw_char_callback);
+    glfwSetCursorPosCallback(window, glfw_cursor_pos_callback);
+    glfwSetMouseButtonCallback(window, glfw_mouse_button_callback);
+    glfwSetScrollCallback(window, glfw_scroll_callback);
+    glfwSetWindowRefreshCallback(window, glfw_window_refresh_callback);
+    glfwSetFramebufferSizeCallback(window, glfw_framebuffer_size_callback);
+    startup_end(startup);
+
+    double now, last_frame = 0.0, delta;
+    const double SPF_LIMIT = 1. / 60.;
+
+    int width = options.width, height = options.height;
+    startup_begin(startup, "renderer");
+    render_init();
+    if (options.headless)
+    {
+        if (!render_init_offscreen(width, height))
+        {
+            fprintf(stderr, "Failed to make a %dx%d framebuffer to draw into\n", width, height);
+            goto failure;
+        }
+    }
+    else
+    {
+        glfwGetFramebufferSize(window, &width, &height);
+    }
+    render_viewport((Rect){0, 0, width, height});
+    sd.width = width;
+    sd.height = height;
+    startup_end(startup);
+
+    if (options.record)
+    {
+        sd.recording = input_record_start(options.record);
+        sd.recording_start = glfwGetTime();
+        if (!sd.recording)
+            fprintf(stderr, "Failed to create %s to record input into\n", options.record);
+    }
+
+    if (options.replay)
+    {
+        sd.replay = input_replay_load(options.replay);
+        if (!sd.replay)
+            goto failure;
+
+        // Until the frame its last event comes in before has been drawn
+        if (!options.frames)
+            options.frames = input_replay_last_frame(sd.replay) + 1;
+    }
+
+    if (options.timings)
+    {
+        sd.timings = fopen(options.timings, "w");
+        if (!sd.timings)
+        {
+            fprintf(stderr, "Failed to create %s to write frame timings into\n", options.timings);
+            goto failure;
+        }
+
+        sd.checksums = options.checksums;
+        fputs(sd.checksums ? "frame,cpu_ms,gpu_ms,checksum\n" : "frame,cpu_ms,gpu_ms\n", sd.timings);
+    }
+
+    sd.headless = options.headless;
+    sd.latency = latency_create();
+    sd.stats = stats_create();
+    if (options.stats && !stats_csv_start(sd.stats, options.stats))
+    {
+        fprintf(stderr, "Failed to create %s to write frame statistics into\n", options.stats);
+        goto failure;
+    }
+
+    sd.bottom_panel.height = CONSOLE_HEIGHT;
+    sd.bottom_panel.hidden = true;
+    term_init(&sd.console_term, CONSOLE_COLUMNS, CONSOLE_ROWS);
+    sd.console_scrollback = scrollback_create(CONSOLE_SCROLLBACK_BUDGET);
+    sd.console_term.scrolled = console_scrolled;
+
+    startup_join(startup);
+
+    if (!fonts_started)
+    {
+        fprintf(stderr, "Failed to initalise the freetype library\n");
+        goto failure;
+    }
+
+    if (tree.restored)
+        ui_container_set_scroll(FILE_TREE_CONTAINER_ID, (Vec2){0.0f, tree.scroll});
+
+    startup_begin(startup, "font upload");
+    ui_fonts_load();
+    startup_end(startup);
+
+    TRACE_END();
+
+    while (!glfwWindowShouldClose(window))
+    {
+        glfwPollEvents();
+        latency_poll(sd.latency, false);
+
+        now = glfwGetTime();
+
+        if (!options.headless)
+        {
+            glfwGetFramebufferSize(window, &width, &height);
+            render_viewport((Rect){0, 0, width, height});
+            sd.width = width;
+            sd.height = height;
+        }
+
+        delta = now - last_frame;
+
+        // Headless, frames are drawn one after another as fast as they go
+        if (options.headless || delta >= SPF_LIMIT)
+        {
+            if (startup)
+                startup_begin(startup, "first frame");
+
+            frame(window);
+            last_frame = now;
+
+            // Starting up is over once there is something on screen
+            if (startup)
+            {
+                startup_end(startup);
+                if (options.startup)
+                    startup_report(startup);
+                startup_destroy(startup);
+                startup = NULL;
+            }
+            // printf("Frame time = %.1lfms\n", 1000. * delta);
+        }
+
+        if (options.frames && sd.frame >= options.frames)
+            break;
+    }
+
+    // Closed before the first frame was drawn
+    if (startup)
+        startup_destroy(startup);
+
+    // Before anything is freed, so it is what the editor held while it ran
+    if (options.memory)
+        mem_report();
+
+    latency_poll(sd.latency, true);
+    if (options.latency)
+        latency_report(sd.latency);
+
+    if (sd.recording)
+        input_record_stop(sd.recording);
+    if (sd.replay)
+        input_replay_destroy(sd.replay);
+    if (sd.timings)
+        fclose(sd.timings);
+    stats_destroy(sd.stats);
+    latency_destroy(sd.latency);
+
+    if (!tree.session && tree.snapshot[0]
+        && !ft_save(&sd.file_tree, tree.snapshot, ui_container_scroll(FILE_TREE_CONTAINER_ID).y))
+        fprintf(stderr, "Failed to save the file tree to %s\n", tree.snapshot);
+    ft_uninit(&sd.file_tree);
+
+    if (sd.has_document)
+    {
+        hl_uninit(&sd.highlighter);
+        doc_uninit(&sd.document);
+    }
+
+    if (sd.find)
+        find_destroy(sd.find);
+    free(sd.find_rows);
+
+    if (sd.quick_open)
+        qo_destroy(sd.quick_open);
+
+    if (sd.console)
+        console_destroy(sd.console);
+    term_uninit(&sd.console_term);
+    scrollback_destroy(sd.console_scrollback);
+
+    glfwDestroyWindow(window);
+
+    glfwTerminate();
+    return EXIT_SUCCESS;
+
+failure:
+    // The fonts and the file tree may still be starting on their threads, which have to be done before anything goes
+    startup_destroy(startup);
+    glfwTerminate();
+    return EXIT_FAILURE;
+}
+
+static void glfw_error_callback(int error, const char *description)
+{
+    fprintf(stderr, "GLFW error: %s\n", description);
+}
+
+static const char usage[] =
+    "Usage: TheEditor [options]\n"
+    "    --headless           draw offscreen with no display, on EGL or else OSMesa\n"
+    "    --size WIDTHxHEIGHT  the size drawn headless, 2000x1000 by default\n"
+    "    --record FILE        write the input to FILE as it comes\n"
+    "    --replay FILE        feed the input in FILE back in, then exit\n"
+    "    --frames N           exit after N frames\n"
+    "    --timings FILE       write how long each frame took on the CPU and GPU to FILE\n"
+    "    --checksums          add a hash of each frame's pixels to the timings\n"
+    "    --stats FILE         write where each frame's time went to FILE, F9 writes the last few seconds' at any time\n"
+    "    --trace              record tracing zones, F12 writes the last few frames' as Chrome trace JSON\n"
+    "    --trace-slow MS      record them too, writing them out after any frame that takes longer than MS\n"
+    "    --memory             say where the memory went on exit, as F11 does at any time\n"
+    "    --latency            say how long input took to be drawn on exit, as F8 does at any time\n"
+    "    --startup            say how long each stage of starting up took, up to the first frame\n";
+
+/* Reads the command line.  Returns false, having said why, if it makes no sense. */
+static bool parse_options(int nargs, const char *argv[], Options *options)
+{
+    *options = (Options){.width = WINDOW_WIDTH, .height = WINDOW_HEIGHT};
+
+    for (int i = 1; i < nargs; i++)
+    {
+        const char *arg = argv[i], *value = i + 1 < nargs ? argv[i + 1] : NULL;
+
+        if (!strcmp(arg, "--headless"))
+        {
+            options->headless = true;
+        }
+        else if (!strcmp(arg, "--checksums"))
+        {
+            options->checksums = true;
+        }
+        else if (!strcmp(arg, "--trace"))
+        {
+            options->trace = true;
+        }
+        else if (!strcmp(arg, "--memory"))
+        {
+            options->memory = true;
+        }
+        else if (!strcmp(arg, "--latency"))
+        {
+            options->latency = true;
+        }
+        else if (!strcmp(arg, "--startup"))
+        {
+            options->startup = true;
+        }
+        else if (!value)
+        {
+            fprintf(stderr, "%s%s needs a value\n", usage, arg);
+            return false;
+        }
+        else
+        {
+            if (!strcmp(arg, "--size"))
+            {
+                if (sscanf(value, "%dx%d", &options->width, &options->height) != 2
+                    || options->width <= 0 || options->height <= 0)
+                {
+                    fprintf(stderr, "%sThe size should be WIDTHxHEIGHT, not %s\n", usage, value);
+                    return false;
+                }
+            }
+            else if (!strcmp(arg, "--record"))
+            {
+                options->record = value;
+            }
+            else if (!strcmp(arg, "--replay"))
+            {
+                options->replay = value;
+            }
+            else if (!strcmp(arg, "--frames"))
+            {
+                options->frames = strtoull(value, NULL, 10);
+            }
+            else if (!strcmp(arg, "--timings"))
+            {
+                options->timings = value;
+            }
+            else if (!strcmp(arg, "--stats"))
+            {
+                options->stats = value;
+            }
+            else if (!strcmp(arg, "--trace-slow"))
+            {
+                options->trace = true;
+                options->trace_slow_ms = strtod(value, NULL);
+                if (options->trace_slow_ms <= 0)
+                {
+                    fprintf(stderr, "%sThe slow frame time should be a number of milliseconds, not %s\n", usage, value);
+                    return false;
+                }
+            }
+            else
+            {
+                fprintf(stderr, "%sUnknown option %s\n", usage, arg);
+                return false;
+            }
+
+            i++;
+        }
+    }
+
+    if (options->headless && !options->replay && !options->frames)
+    {
+        fprintf(stderr, "%sHeadless there is no input, so --replay or --frames is needed\n", usage);
+        return false;
+    }
+
+    if (options->checksums && !options->timings)
+    {
+        fprintf(stderr, "%sThe checksums go with the timings, so --timings is needed\n", usage);
+        return false;
+    }
+
+#ifndef THE_EDITOR_TRACE
+    if (options->trace)
+    {
+        fprintf(stderr, "%sThis build has no tracing zones, it needs THE_EDITOR_TRACE\n", usage);
+        return false;
+    }
+#endif
+
+    return true;
+}
+
+static GLFWwindow *create_window(const Options *options)
+{
+    GLFWwindow *window;
+
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, true);
+
+    if (!options->headless)
+        return glfwCreateWindow(options->width, options->height, "GLFW Window", NULL, NULL);
+
+    // EGL with no surface where Mesa has it, which is llvmpipe on a machine with no GPU, and OSMesa where not
+    glfwWindowHint(GLFW_VISIBLE, false);
+    glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_EGL_CONTEXT_API);
+    window = glfwCreateWindow(options->width, options->height, "TheEditor", NULL, NULL);
+
+    if (!window)
+    {
+        glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_OSMESA_CONTEXT_API);
+        window = glfwCreateWindow(options->width, options->height, "TheEditor", NULL, NULL);
+    }
+
+    return window;
+}
+
+/*
+ * Notes when an input event came in, to time it to the screen, and writes it to the recording, if there is one, as
+ * coming in before the frame about to be drawn.
+ */
+static void record(InputEvent event)
+{
+    latency_input(sd.latency, event.kind, platform_time_ns());
+
+    if (!sd.recording)
+        return;
+
+    event.frame = sd.frame;
+    event.time = glfwGetTime() - sd.recording_start;
+    input_record(sd.recording, &event);
+}
+
+/* Calls the callback a replayed event was recorded from, as GLFW would have. */
+static void replay_event(GLFWwindow *window, const InputEvent *event)
+{
+    switch (event->kind)
+    {
+    case INPUT_CURSOR:
+        glfw_cursor_pos_callback(window, event->x, event->y);
+        break;
+    case INPUT_BUTTON:
+        glfw_mouse_button_callback(window, event->key, event->action, event->mods);
+        break;
+    case INPUT_SCROLL:
+        glfw_scroll_callback(window, event->x, event->y);
+        break;
+    case INPUT_KEY:
+        glfw_key_callback(window, event->key, event->scancode, event->action, event->mods);
+        break;
+    case INPUT_CHAR:
+        glfw_char_callback(window, event->codepoint);
+        break;
+    }
+}
+
+/*
+ * Waits for the work the input so far started in the background, so a replayed frame shows the same whether the
+ * machine is fast or slow.  The console's shell is the exception, it writes when it writes.
+ */
+static void replay_settle(void)
+{
+    while (ft_busy(&sd.file_tree))
+    {
+        ft_poll(&sd.file_tree);
+        platform_sleep_ms(1);
+    }
+
+    if (sd.has_document)
+        while (doc_poll(&sd.document))
+            platform_sleep_ms(1);
+
+    if (sd.find)
+        while (find_poll(sd.find))
+            platform_sleep_ms(1);
+
+    if (sd.quick_open)
+        qo_wait(sd.quick_open);
+}
+
+/* Draws a frame, first feeding in whatever replayed input comes before it, and counts where its time went. */
+static void frame(GLFWwindow *window)
+{
+    InputEvent event;
+
+    if (sd.replay)
+    {
+        while (input_replay_next(sd.replay, sd.frame, &event))
+            replay_event(window, &event);
+        replay_settle();
+    }
+
+    uint64_t start = platform_time_ns();
+
+    render();
+
+    uint64_t rendered = platform_time_ns();
+
+    if (!sd.headless)
+        glfwSwapBuffers(window);
+    latency_frame(sd.latency, sd.frame);
+
+    uint64_t end = platform_time_ns(), cpu = end - start;
+    RenderFrameStats rs = render_frame_stats();
+    RenderGpuTime gpu_times[RENDER_GPU_TIMERS];
+
+    // What is left of the frame once the renderer's share is taken out is the UI building it
+    stats_push(sd.stats, &(FrameSample){
+                             .frame = rs.frame,
+                             .cpu_ns = cpu,
+                             .ui_ns = rendered - start - rs.upload_ns - rs.draw_ns,
+                             .upload_ns = rs.upload_ns,
+                             .draw_ns = rs.draw_ns,
+                             .swap_ns = end - rendered,
+                             .quads = rs.quads,
+                             .bytes_uploaded = rs.bytes_uploaded,
+                         });
+
+    for (size_t i = 0, n = render_gpu_times(gpu_times, RENDER_GPU_TIMERS); i < n; i++)
+        stats_gpu_time(sd.stats, gpu_times[i].frame, gpu_times[i].ns);
+
+    if (sd.trace_slow_ns && cpu > sd.trace_slow_ns
+        && (!sd.trace_written || end - sd.trace_written > TRACE_SLOW_COOLDOWN_NS))
+    {
+        char why[64];
+
+        snprintf(why, sizeof why, "a frame took %.1fms", (double)cpu / 1e6);
+        trace_write(why);
+        sd.trace_written = platform_time_ns();
+    }
+
+    if (sd.timings)
+    {
+        uint64_t gpu = 0;
+
+        // Waits for the GPU to finish the frame, which a timing run can afford
+        if (render_gpu_time_wait(&gpu))
+            stats_gpu_time(sd.stats, rs.frame, gpu);
+
+        fprintf(sd.timings, "%llu,%.3f,%.3f", (unsigned long long)sd.frame, (double)cpu / 1e6, (double)gpu / 1e6);
+        if (sd.checksums)
+            fprintf(sd.timings, ",%016llx", (unsigned long long)render_checksum());
+        fputc('\n', sd.timings);
+    }
+
+    sd.frame++;
+}
+
+/* Writes what the trace has kept of the last frames to a file named for this one, saying why and where. */
+static void trace_write(const char *why)
+{
+    char dir[4 * FILENAME_LEN], path[4 * FILENAME_LEN + 64];
+
+    // Not into the workspace, where it would turn up in the tree
+    if (!platform_cache_dir(dir, sizeof dir))
+    {
+        fprintf(stderr, "Found no cache directory to write the trace to\n");
+        return;
+    }
+
+    snprintf(path, sizeof path, "%s%ctrace-%llu.json", dir, PATH_SEPARATOR, (unsigned long long)sd.frame);
+
+    if (trace_dump(path))
+        fprintf(stderr, "Wrote the trace to %s, %s\n", path, why);
+    else
+        fprintf(stderr, "Failed to write the trace to %s\n", path);
+}
+
+/* Writes the last frames' statistics to a file named for this one, saying where. */
+static void stats_write(void)
+{
+    char dir[4 * FILENAME_LEN], path[4 * FILENAME_LEN + 64];
+
+    // Like the trace, out of the workspace
+    if (!platform_cache_dir(dir, sizeof dir))
+    {
+        fprintf(stderr, "Found no cache directory to write the frame statistics to\n");
+        return;
+    }
+
+    snprintf(path, sizeof path, "%s%cstats-%llu.csv", dir, PATH_SEPARATOR, (unsigned long long)sd.frame);
+
+    if (stats_write_csv(sd.stats, path))
+        fprintf(stderr, "Wrote the last %zu frames' statistics to %s\n", stats_count(sd.stats), path);
+    else
+        fprintf(stderr, "Failed to write the frame statistics to %s\n", path);
+}
+
+/* Loads a file into the editor in place of the one open.  Returns false, keeping that one, if it cannot be read. */
+static bool open_document(const char *path)
+{
+    Document document;
+
+    if (!doc_load(&document, path))
+    {
+        fprintf(stderr, "Failed to open %s\n", path);
+        return false;
+    }
+
+    if (sd.has_document)
+    {
+        hl_uninit(&sd.highlighter);
+        doc_uninit(&sd.document);
+    }
+
+    sd.document = document;
+    sd.has_document = true;
+    hl_init(&sd.highlighter, hl_language_for_path(path));
+    ui_container_set_scroll(EDITOR_CONTAINER_ID, (Vec2){0});
+
+    return true;
+}
+
+/* Drops the search in flight, its workers stop after the files they are on, and starts one for the query. */
+static void find_restart(void)
+{
+    if (sd.find)
+        find_destroy(sd.find);
+
+    sd.find = NULL;
+    sd.find_running = false;
+    sd.len_find_rows = 0;
+    sd.find_nrows = 0;
+    ui_container_set_scroll(FIND_CONTAINER_ID, (Vec2){0});
+
+    Search *search = search_create(sd.find_query, sd.len_find_query, 0);
+
+    if (search)
+    {
+        sd.find = find_start(".", search, sd.file_tree.ignore, 0);
+        sd.find_running = true;
+    }
+}
+
+/* Lays out the rows of the files taken in since the last frame after the ones already there. */
+static void find_rows_update(void)
+{
+    size_t nfiles = find_file_count(sd.find);
+
+    if (nfiles > sd.cap_find_rows)
+    {
+        sd.cap_find_rows = sd.cap_find_rows < 64 ? 64 : 2 * sd.cap_find_rows;
+        if (sd.cap_find_rows < nfiles)
+            sd.cap_find_rows = nfiles;
+        sd.find_rows = realloc(sd.find_rows, sd.cap_find_rows * sizeof *sd.find_rows);
+    }
+
+    for (size_t i = sd.len_find_rows; i < nfiles; i++)
+    {
+        sd.find_rows[i] = sd.find_nrows;
+        sd.find_nrows += 1 + find_file(sd.find, i)->nlines;
+    }
+
+    sd.len_find_rows = nfiles;
+}
+
+/* Puts the shell's output on the console's screen, answering whatever it asked of the terminal. */
+static void console_output(void *user, const char *data, size_t len)
+{
+    size_t len_reply;
+
+    term_feed(&sd.console_term, data, len);
+
+    const char *reply = term_take_reply(&sd.console_term, &len_reply);
+    if (len_reply)
+        console_write(sd.console, reply, len_reply);
+}
+
+static void console_scrolled(void *user, const TermCell *cells, int columns)
+{
+    scrollback_push(sd.console_scrollback, cells, columns);
+}
+
+/* The keys that send escape sequences, and those sending a character without one coming through as text. */
+static const struct {
+    int key;
+    const char *sequence;
+} console_keys[] = {
+    {GLFW_KEY_ENTER, "\r"},
+    {GLFW_KEY_BACKSPACE, "\x7f"},
+    {GLFW_KEY_TAB, "\t"},
+    {GLFW_KEY_ESCAPE, "\x1b"},
+    {GLFW_KEY_UP, "\x1b[A"},
+    {GLFW_KEY_DOWN, "\x1b[B"},
+    {GLFW_KEY_RIGHT, "\x1b[C"},
+    {GLFW_KEY_LEFT, "\x1b[D"},
+    {GLFW_KEY_HOME, "\x1b[H"},
+    {GLFW_KEY_END, "\x1b[F"},
+    {GLFW_KEY_DELETE, "\x1b[3~"},
+};
+
+/* Sends a key to the shell as the bytes a terminal would.  Returns false for keys that send nothing. */
+static bool console_key(int key, int mods)
+{
+    for (size_t i = 0; i < sizeof console_keys / sizeof console_keys[0]; i++)
+    {
+        if (console_keys[i].key == key)
+        {
+            console_write(sd.console, console_keys[i].sequence, strlen(console_keys[i].sequence));
+            return true;
+        }
+    }
+
+    // Control and a letter is the letter's control character, Ctrl+C being the interrupt
+    if (!(mods & GLFW_MOD_CONTROL) || key < GLFW_KEY_A || key > GLFW_KEY_Z)
+        return false;
+
+    char control = (char)(key - GLFW_KEY_A + 1);
+    console_write(sd.console, &control, 1);
+
+    return true;
+}
+
+/* Appends a typed character to a query as UTF-8.  Returns false if it does not fit, or is not text. */
+static bool query_append(char *query, size_t *len, size_t cap, unsigned int codepoint)
+{
+    char utf8[4];
+    size_t n;
+
+    if (codepoint < ' ')
+        return false;
+
+    if (codepoint < 0x80)
+    {
+        utf8[0] = (char)codepoint;
+        n = 1;
+    }
+    else if (codepoint < 0x800)
+    {
+        utf8[0] = (char)(0xc0 | codepoint >> 6);
+        utf8[1] = (char)(0x80 | (codepoint & 0x3f));
+        n = 2;
+    }
+    else if (codepoint < 0x10000)
+    {
+        utf8[0] = (char)(0xe0 | codepoint >> 12);
+        utf8[1] = (char)(0x80 | ((codepoint >> 6) & 0x3f));
+        utf8[2] = (char)(0x80 | (codepoint & 0x3f));
+        n = 3;
+    }
+    else
+    {
+        utf8[0] = (char)(0xf0 | codepoint >> 18);
+        utf8[1] = (char)(0x80 | ((codepoint >> 12) & 0x3f));
+        utf8[2] = (char)(0x80 | ((codepoint >> 6) & 0x3f));
+        utf8[3] = (char)(0x80 | (codepoint & 0x3f));
+        n = 4;
+    }
+
+    if (*len + n > cap)
+        return false;
+
+    memcpy(&query[*len], utf8, n);
+    *len += n;
+
+    return true;
+}
+
+/* Takes the last character off a query, a whole UTF-8 sequence.  Returns false if it was empty. */
+static bool query_backspace(const char *query, size_t *len)
+{
+    if (!*len)
+        return false;
+
+    do
+        --*len;
+    while (*len && (query[*len] & 0xc0) == 0x80);
+
+    return true;
+}
+
+static void quick_open_set_query(void)
+{
+    qo_set_query(sd.quick_open, sd.quick_open_query, sd.len_quick_open_query);
+    sd.quick_open_selected = 0;
+    ui_container_set_scroll(QUICK_OPEN_CONTAINER_ID, (Vec2){0});
+}
+
+/* Opens the file of the selected match and closes quick open, or leaves it be if the file cannot be read. */
+static void quick_open_accept(void)
+{
+    QuickOpenMatch matches[QUICK_OPEN_MAX_RESULTS];
+    size_t nmatches, total;
+    char path[4 * FILENAME_LEN];
+
+    qo_poll(sd.quick_open, matches, QUICK_OPEN_MAX_RESULTS, &nmatches, &total);
+
+    if (sd.quick_open_selected >= nmatches)
+        return;
+
+    String selected = path_index_get(qo_index(sd.quick_open), matches[sd.quick_open_selected].path);
+
+    if (selected.length >= sizeof path)
+    {
+        fprintf(stderr, "The path %.*s is too long to open\n", (int)selected.length, selected.data);
+        return;
+    }
+
+    memcpy(path, selected.data, selected.length);
+    path[selected.length] = '\0';
+
+    if (open_document(path))
+    {
+        sd.quick_opening = false;
+        sd.len_quick_open_query = 0;
+        quick_open_set_query();
+    }
+}
+
+static void glfw_key_callback(GLFWwindow *window, int key, int scancode, int action, int mods)
+{
+    record((InputEvent){.kind = INPUT_KEY, .key = key, .scancode = scancode, .action = action, .mods = mods});
+
+    if (action == GLFW_RELEASE)
+        return;
+
+    if (key == GLFW_KEY_F && (mods & GLFW_MOD_CONTROL) && (mods & GLFW_MOD_SHIFT))
+    {
+        sd.finding = true;
+        sd.quick_opening = false;
+        return;
+    }
+
+    if (key == GLFW_KEY_F12 && trace_enabled())
+    {
+        trace_write("as asked");
+        return;
+    }
+
+    if (key == GLFW_KEY_F11)
+    {
+        mem_report();
+        return;
+    }
+
+    if (key == GLFW_KEY_F8)
+    {
+        latency_report(sd.latency);
+        return;
+    }
+
+    if (key == GLFW_KEY_F10)
+    {
+        sd.stats_overlay = !sd.stats_overlay;
+        return;
+    }
+
+    if (key == GLFW_KEY_F9)
+    {
+        stats_write();
+        return;
+    }
+
+    if (key == GLFW_KEY_GRAVE_ACCENT && (mods & GLFW_MOD_CONTROL))
+    {
+        sd.bottom_panel.hidden = !sd.bottom_panel.hidden;
+
+        if (!sd.bottom_panel.hidden && !sd.console)
+        {
+            sd.console = console_create(NULL, sd.console_term.columns, sd.console_term.rows);
+            if (!sd.console)
+                fprintf(stderr, "Failed to start a shell for the console\n");
+        }
+
+        return;
+    }
+
+    // While the console is open every other key goes to the shell
+    if (!sd.bottom_panel.hidden && sd.console)
+    {
+        // Typing goes back down to the prompt from wherever the scrollback was
+        if (console_key(key, mods))
+            ui_container_set_scroll(CONSOLE_CONTAINER_ID, (Vec2){0});
+        return;
+    }
+
+    if (key == GLFW_KEY_P && (mods & GLFW_MOD_CONTROL))
+    {
+        // The crawl starts the first time, and the query can be typed before it is done
+        if (!sd.quick_open)
+            sd.quick_open = qo_create(".", sd.file_tree.ignore, 0);
+
+        sd.quick_opening = true;
+        sd.finding = false;
+        return;
+    }
+
+    // While searching, keys edit the query and the text itself comes through the char callback
+    if (sd.finding)
+    {
+        switch (key)
+        {
+        case GLFW_KEY_ESCAPE:
+            // An empty query starts nothing, so this only stops the search
+            sd.finding = false;
+            sd.len_find_query = 0;
+            find_restart();
+            break;
+        case GLFW_KEY_BACKSPACE:
+            if (query_backspace(sd.find_query, &sd.len_find_query))
+                find_restart();
+            break;
+        }
+
+        return;
+    }
+
+    if (sd.quick_opening)
+    {
+        switch (key)
+        {
+        case GLFW_KEY_ESCAPE:
+            sd.quick_opening = false;
+            sd.len_quick_open_query = 0;
+            quick_open_set_query();
+            break;
+        case GLFW_KEY_BACKSPACE:
+            if (query_backspace(sd.quick_open_query, &sd.len_quick_open_query))
+                quick_open_set_query();
+            break;
+        case GLFW_KEY_UP:
+            if (sd.quick_open_selected)
+                sd.quick_open_selected--;
+            break;
+        case GLFW_KEY_DOWN:
+            // Kept in range when drawn, the matches may still be coming in
+            sd.quick_open_selected++;
+            break;
+        case GLFW_KEY_ENTER:
+            quick_open_accept();
+            break;
+        }
+
+        return;
+    }
+
+    if (action != GLFW_PRESS)
+        return;
+
+    switch (key)
+    {
+    case GLFW_KEY_S:
+        sd.side_panel.hidden = !sd.side_panel.hidden;
+        break;
+    }
+}
+
+static void glfw_char_callback(GLFWwindow *window, unsigned int codepoint)
+{
+    record((InputEvent){.kind = INPUT_CHAR, .codepoint = codepoint});
+
+    if (!sd.bottom_panel.hidden && sd.console)
+    {
+        char utf8[4];
+        size_t n = 0;
+
+        if (query_append(utf8, &n, sizeof utf8, codepoint))
+        {
+            console_write(sd.console, utf8, n);
+            ui_container_set_scroll(CONSOLE_CONTAINER_ID, (Vec2){0});
+        }
+    }
+    else if (sd.finding)
+    {
+        if (query_append(sd.find_query, &sd.len_find_query, sizeof sd.find_query, codepoint))
+            find_restart();
+    }
+    else if (sd.quick_opening)
+    {
+        if (query_append(sd.quick_open_query, &sd.len_quick_open_query, sizeof sd.quick_open_query, codepoint))
+            quick_open_set_query();
+    }
+}
+
+static void glfw_cursor_pos_callback(GLFWwindow *window, double pos_x, double pos_y)
+{
+    record((InputEvent){.kind = INPUT_CURSOR, .x = pos_x, .y = pos_y});
+    ui_mouse_position((float)pos_x, (float)pos_y);
+}
+
+static void glfw_mouse_button_callback(GLFWwindow *window, int button, int action, int mods)
+{
+    record((InputEvent){.kind = INPUT_BUTTON, .key = button, .action = action, .mods = mods});
+
+    if (button == GLFW_MOUSE_BUTTON_LEFT)
+        switch (action)
+        {
+        case GLFW_PRESS:
+            ui_mouse_button(true);
+            break;
+        case GLFW_RELEASE:
+            ui_mouse_button(false);
+            break;
+        }
+}
+
+static void glfw_window_refresh_callback(GLFWwindow *window)
+{
+    render();
+    glfwSwapBuffers(window);
+    latency_frame(sd.latency, sd.frame);
+}
+
+static void glfw_framebuffer_size_callback(GLFWwindow *window, int width, int height)
+{
+    ui_viewport((float)width, (float)height);
+    render_viewport((Rect){0, 0, width, height});
+    sd.width = width;
+    sd.height = height;
+}
+
+static void glfw_scroll_callback(GLFWwindow *window, double scrollx, double scrolly)
+{
+    record((InputEvent){.kind = INPUT_SCROLL, .x = scrollx, .y = scrolly});
+    ui_scroll((Vec2) {(float)scrollx, (float)scrolly});
+}
+
+static void render()
+{
+    int id = FILE_TREE_CONTAINER_ID;
+
+    typedef enum {
+        OP_NONE = 0,
+        OP_EXPAND_FILE_TREE = 1,
+        OP_COLLAPSE_FILE_TREE,
+        OP_OPEN_FILE,
+    } PostUiOperation;
+
+    PostUiOperation op = OP_NONE;
+    FileTreeIndex op_arg = FT_NONE;
+
+    TRACE_BEGIN("render");
+    TRACE_BEGIN("poll");
+    ft_poll(&sd.file_tree);
+
+    // Whatever the shell wrote since the last frame, however much that is, the reader has already taken it off the pty
+    if (sd.console && !console_poll(sd.console, console_output, NULL))
+    {
+        console_destroy(sd.console);
+        sd.console = NULL;
+    }
+
+    if (sd.has_document)
+        doc_poll(&sd.document);
+
+    // Results that came in since the last frame show up in this one, while the workers go on
+    if (sd.find)
+    {
+        sd.find_running = find_poll(sd.find);
+        find_rows_update();
+    }
+
+    TRACE_END();
+
+    int editor_id = EDITOR_CONTAINER_ID;
+
+    if (sd.finding)
+        editor_id = FIND_CONTAINER_ID;
+    else if (sd.quick_opening)
+        editor_id = QUICK_OPEN_CONTAINER_ID;
+
+    ui_viewport((float)sd.width, (float)sd.height);
+
+    float editor_height = (float)sd.height;
+    if (!sd.bottom_panel.hidden)
+        editor_height -= (float)sd.bottom_panel.height;
+
+    ui_begin();
+        ui_container_begin(C_SCROLLY, (FRect) {0, 0, SIDE_PANEL_WIDTH, sd.height}, id);
+            // ui_button((FRect) {0, 0, 300, 150}, ++id);
+            ui_treelist_begin();
+            {
+                const FileTree *tree = &sd.file_tree;
+                size_t nrows = ft_visible_count(tree);
+                size_t first, count;
+                char label[FILENAME_LEN + 4];
+
+                // Only the rows inside the container are emitted, everything else is skipped over in one go
+                ui_treelist_visible_rows(nrows, &first, &count);
+                ui_treelist_skip(first);
+
+                FileTreeIndex node = ft_visible_row(tree, first);
+                for (size_t row = 0; row < count && node != FT_NONE; row++, node = ft_next_visible(tree, node))
+                {
+                    const FileTreeItem *item = &tree->nodes[node];
+                    String name = ft_name(tree, node);
+
+                    if ((item->flags & (FTI_LOADING | FTI_OPEN)) == (FTI_LOADING | FTI_OPEN))
+                    {
+                        int n = snprintf(label, sizeof label, "%.*s ...", (int)name.length, name.data);
+
+                        // A name converted from UTF-16 can be longer than FILENAME_LEN bytes
+                        name.length = n < (int)sizeof label ? (size_t)n : sizeof label - 1;
+                        name.data = label;
+                    }
+
+                    bool bold = !!(item->flags & FTI_DIRECTORY);
+
+                    if (ui_treelist_item(item->depth, name, bold, id + 1 + (int)(first + row)))
+                    {
+                        assert(!op && "only one item should ever be activated per render loop");
+
+                        if (item->flags & FTI_FILE)
+                        {
+                            op = OP_OPEN_FILE;
+                        }
+                        else if (item->flags & FTI_OPEN)
+                        {
+                            op = OP_COLLAPSE_FILE_TREE;
+                        }
+                        else
+                        {
+                            op = OP_EXPAND_FILE_TREE;
+                        }
+
+                        op_arg = node;
+                    }
+                }
+
+                ui_treelist_skip(nrows - first - count);
+                id += (int)nrows;
+            }
+            ui_treelist_end();
+        ui_container_end();
+        FRect editor_rect = {SIDE_PANEL_WIDTH, 0, sd.width - SIDE_PANEL_WIDTH, editor_height};
+        ui_container_begin(C_SCROLLY, editor_rect, editor_id);
+            ui_code_begin();
+            if (sd.finding)
+            {
+                char row[FIND_QUERY_MAX + 64];
+                TokenSpan span;
+                size_t first, count;
+
+                ui_code_visible_lines(1 + sd.find_nrows, &first, &count);
+                ui_code_skip(first);
+
+                if (first == 0 && count)
+                {
+                    int n = snprintf(row, sizeof row, "Find in files: %.*s%s", (int)sd.len_find_query, sd.find_query,
+                                     sd.find_running ? "  ..." : "");
+                    ui_code_line((String){.length = (size_t)n, .data = row}, NULL, 0);
+                    first++;
+                    count--;
+                }
+
+                // The file holding the first visible row, the rows after it are walked in order
+                size_t file = 0, lo = 0, hi = sd.len_find_rows;
+                while (lo < hi)
+                {
+                    size_t mid = lo + (hi - lo) / 2;
+                    if (sd.find_rows[mid] <= first - 1)
+                    {
+                        file = mid;
+                        lo = mid + 1;
+                    }
+                    else
+                    {
+                        hi = mid;
+                    }
+                }
+
+                for (size_t r = first - 1; r < first - 1 + count && file < sd.len_find_rows; r++)
+                {
+                    const FindFileResult *result = find_file(sd.find, file);
+                    size_t k = r - sd.find_rows[file];
+
+                    if (k == 0)
+                    {
+                        span = (TokenSpan){0, (uint16_t)result->path.length, TOKEN_KEYWORD};
+                        ui_code_line(result->path, &span, 1);
+                    }
+                    else
+                    {
+                        const FindLine *line = &result->lines[k - 1];
+                        int n = snprintf(row, sizeof row, "%8zu: %.*s", line->line + 1, (int)line->excerpt.length,
+                                         line->excerpt.data);
+                        size_t prefix = (size_t)n - line->excerpt.length;
+
+                        span = (TokenSpan){(uint32_t)(prefix + line->match_start), (uint16_t)line->match_len,
+                                           TOKEN_STRING};
+                        ui_code_line((String){.length = (size_t)n, .data = row}, &span, 1);
+                    }
+
+                    if (k == result->nlines)
+                        file++;
+                }
+
+                ui_code_skip(1 + sd.find_nrows - first - count);
+            }
+            else if (sd.quick_opening)
+            {
+                QuickOpenMatch matches[QUICK_OPEN_MAX_RESULTS];
+                uint32_t positions[QUICK_OPEN_QUERY_MAX];
+                TokenSpan spans[QUICK_OPEN_QUERY_MAX];
+                char row[4 * FILENAME_LEN];
+                size_t nmatches, total, first, count;
+                bool done = qo_poll(sd.quick_open, matches, QUICK_OPEN_MAX_RESULTS, &nmatches, &total);
+
+                if (sd.quick_open_selected >= nmatches)
+                    sd.quick_open_selected = nmatches ? nmatches - 1 : 0;
+
+                ui_code_visible_lines(1 + nmatches, &first, &count);
+                ui_code_skip(first);
+
+                if (first == 0 && count)
+                {
+                    const char *status = "  ...";
+                    char matched[32];
+
+                    if (!qo_ready(sd.quick_open))
+                    {
+                        status = "  Indexing ...";
+                    }
+                    else if (done)
+                    {
+                        snprintf(matched, sizeof matched, "  %zu files", total);
+                        status = matched;
+                    }
+
+                    int n = snprintf(row, sizeof row, "Open: %.*s%s", (int)sd.len_quick_open_query,
+                                     sd.quick_open_query, status);
+                    ui_code_line((String){.length = (size_t)n, .data = row}, NULL, 0);
+                    first++;
+                    count--;
+                }
+
+                for (size_t r = first - 1; r < first - 1 + count && r < nmatches; r++)
+                {
+                    String path = path_index_get(qo_index(sd.quick_open), matches[r].path);
+                    size_t npositions = qo_positions(sd.quick_open, matches[r].path, positions, QUICK_OPEN_QUERY_MAX);
+                    size_t nspans = 0;
+                    int n = snprintf(row, sizeof row, "%c %.*s", r == sd.quick_open_selected ? '>' : ' ',
+                                     (int)path.length, path.data);
+                    // A path too long for the row is cut short, and so are the matches past the cut
+                    size_t len = n < (int)sizeof row ? (size_t)n : sizeof row - 1;
+
+                    // The characters the query matched, those next to each other in one span
+                    for (size_t i = 0; i < npositions; i++)
+                    {
+                        uint32_t column = 2 + positions[i];
+
+                        if (column >= len)
+                            continue;
+
+                        if (nspans && spans[nspans - 1].column + spans[nspans - 1].length == column)
+                            spans[nspans - 1].length++;
+                        else
+                            spans[nspans++] = (TokenSpan){column, 1, TOKEN_STRING};
+                    }
+
+                    ui_code_line((String){.length = len, .data = row}, spans, nspans);
+                }
+
+                ui_code_skip(1 + nmatches - first - count);
+            }
+            else if (sd.has_document)
+            {
+                size_t nlines = doc_line_count(&sd.document);
+                size_t first, count;
+                TokenSpan spans[MAX_LINE_SPANS];
+
+                ui_code_visible_lines(nlines, &first, &count);
+                ui_code_skip(first);
+
+                // Lexes whatever the last edit left stale on screen in one pass, rather than line by line
+                if (count)
+                    hl_update(&sd.highlighter, &sd.document, first + count - 1);
+
+                for (size_t line = first; line < first + count; line++)
+                {
+                    String text;
+                    size_t nspans = hl_line(&sd.highlighter, &sd.document, line, &text, spans, MAX_LINE_SPANS);
+                    ui_code_line(text, spans, nspans);
+                }
+
+                ui_code_skip(nlines - first - count);
+            }
+            ui_code_end();
+        ui_container_end();
+        if (!sd.bottom_panel.hidden)
+        {
+            FRect where = {SIDE_PANEL_WIDTH, editor_height, sd.width - SIDE_PANEL_WIDTH, sd.bottom_panel.height};
+
+            // The screen is as big as the panel, and the shell is told whenever that changes
+            ui_container_begin(C_SCROLLY, where, CONSOLE_CONTAINER_ID);
+            {
+                int columns, rows;
+
+                ui_terminal_fit(&columns, &rows);
+                if (columns != sd.console_term.columns || rows != sd.console_term.rows)
+                {
+                    term_resize(&sd.console_term, columns, rows);
+                    if (sd.console)
+                        console_resize(sd.console, columns, rows);
+                }
+
+                ui_terminal(&sd.console_term, sd.console_scrollback);
+            }
+            ui_container_end();
+        }
+
+    if (sd.stats_overlay)
+        ui_frame_stats(sd.stats);
+    ui_end();
+
+    switch (op)
+    {
+    case OP_EXPAND_FILE_TREE:
+        ft_expand(&sd.file_tree, op_arg);
+        break;
+    case OP_COLLAPSE_FILE_TREE:
+        ft_collapse(&sd.file_tree, op_arg);
+        break;
+    case OP_OPEN_FILE:
+    {
+        char path[4 * FILENAME_LEN];
+
+        if (!ft_path(&sd.file_tree, op_arg, path, sizeof path))
+        {
+            fprintf(stderr, "The path of %.*s is too long to open\n",
+                    (int)ft_name(&sd.file_tree, op_arg).length, ft_name(&sd.file_tree, op_arg).data);
+            break;
+        }
+
+        open_document(path);
+        break;
+    }
+    default:
+        break;
+    }
+
+    TRACE_END();
+
+    // render_push_colored_quad((FRect) {0, 0, 200, 200}, COLOR_RGB(0xff0000), 0, NULL);
+    // render_push_colored_quad((FRect) {400, 300, 200, 200}, COLOR_RGB(0x00ff00), 0, NULL);
+    // render_draw();
+}
+
+static void glad_post_callback(void *ret, const char *name, GLADapiproc apiproc, int len_args, ...)
+{
+    // This crashes the program for some reason:
+
+    // if (glGetError())
+    // {
+    //     fprintf(stderr, "GL call failed: %s()\n", name);
+    //     exit(EXIT_FAILURE);
+    // }
+}
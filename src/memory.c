@@ -0,0 +1,210 @@
+#include "theeditor.h"
+
+#include <malloc.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#define usable_size(block) _msize(block)
+#else
+#define usable_size(block) malloc_usable_size(block)
+#endif
+
+// Mappings listed in the report, the largest first
+#define REPORT_MAPPINGS 16
+
+static const char *const mem_tag_names[] = {
+    [MEM_RENDER] = "render",
+    [MEM_UI] = "ui",
+    [MEM_FILETREE] = "filetree",
+    [MEM_STRINGS] = "strings",
+    [MEM_FONTS] = "fonts",
+    [MEM_FREETYPE] = "freetype",
+    [MEM_GL_BUFFERS] = "gl_buffers",
+    [MEM_GL_TEXTURES] = "gl_textures",
+};
+
+/*
+ * Counted by whichever thread allocates, the file tree's worker as much as the main thread.  Blocks are counted at the
+ * size the allocator gave rather than the size asked for, so a block freed by plain free() is missed but never wrong.
+ */
+static struct {
+    volatile size_t live, peak, allocations;
+} counters[NUM_MEM_TAGS];
+
+static void tally(MemTag tag, size_t added, size_t removed, size_t allocations)
+{
+    size_t live = platform_atomic_add_size(&counters[tag].live, added - removed);
+    size_t peak = platform_atomic_load_size(&counters[tag].peak);
+
+    // Another thread may raise it in between, in which case this tries again against what that thread left
+    while (live > peak && !platform_atomic_compare_exchange_size(&counters[tag].peak, &peak, live))
+        ;
+
+    if (allocations)
+        platform_atomic_add_size(&counters[tag].allocations, allocations);
+}
+
+void *mem_alloc(MemTag tag, size_t size)
+{
+    void *block = malloc(size);
+
+    if (block)
+        tally(tag, usable_size(block), 0, 1);
+
+    return block;
+}
+
+void *mem_calloc(MemTag tag, size_t count, size_t size)
+{
+    void *block = calloc(count, size);
+
+    if (block)
+        tally(tag, usable_size(block), 0, 1);
+
+    return block;
+}
+
+void *mem_realloc(MemTag tag, void *block, size_t size)
+{
+    if (!size)
+    {
+        mem_free(tag, block);
+        return NULL;
+    }
+
+    size_t old = block ? usable_size(block) : 0;
+    void *moved = realloc(block, size);
+
+    // A failed realloc leaves the block as it was
+    if (moved)
+        tally(tag, usable_size(moved), old, !block);
+
+    return moved;
+}
+
+void mem_free(MemTag tag, void *block)
+{
+    if (!block)
+        return;
+
+    tally(tag, 0, usable_size(block), 0);
+    free(block);
+}
+
+void mem_account(MemTag tag, size_t size)
+{
+    tally(tag, size, 0, 1);
+}
+
+void mem_unaccount(MemTag tag, size_t size)
+{
+    tally(tag, 0, size, 0);
+}
+
+MemStats mem_stats(MemTag tag)
+{
+    return (MemStats){
+        .live = platform_atomic_load_size(&counters[tag].live),
+        .peak = platform_atomic_load_size(&counters[tag].peak),
+        .allocations = platform_atomic_load_size(&counters[tag].allocations),
+    };
+}
+
+const char *mem_tag_name(MemTag tag)
+{
+    return mem_tag_names[tag];
+}
+
+typedef struct {
+    char name[FILENAME_LEN];
+    size_t resident, proportional;
+} Mapping;
+
+typedef struct {
+    Mapping *mappings;
+    size_t len, cap;
+} Mappings;
+
+/* Adds a mapping in with the others of the same file, so a library counts once however many times it is mapped. */
+static void mapping_add(void *user, const char *name, size_t resident, size_t proportional)
+{
+    Mappings *m = user;
+    size_t i;
+
+    if (!name)
+        name = "[anonymous]";
+
+    for (i = 0; i < m->len && strcmp(m->mappings[i].name, name); i++)
+        ;
+
+    if (i == m->len)
+    {
+        if (m->len == m->cap)
+        {
+            m->cap = m->cap ? 2 * m->cap : 64;
+            m->mappings = realloc(m->mappings, m->cap * sizeof *m->mappings);
+        }
+
+        m->mappings[m->len++] = (Mapping){0};
+        snprintf(m->mappings[i].name, sizeof m->mappings[i].name, "%s", name);
+    }
+
+    m->mappings[i].resident += resident;
+    m->mappings[i].proportional += proportional;
+}
+
+static int compare_mappings(const void *a, const void *b)
+{
+    const Mapping *x = a, *y = b;
+
+    if (x->proportional != y->proportional)
+        return x->proportional > y->proportional ? -1 : 1;
+
+    return x->resident > y->resident ? -1 : x->resident < y->resident;
+}
+
+static double megabytes(size_t size)
+{
+    return (double)size / (1 << 20);
+}
+
+void mem_report(void)
+{
+    PlatformMemoryUsage usage;
+    Mappings m = {0};
+    size_t heap = 0;
+
+    fprintf(stderr, "%-12s %10s %10s %12s\n", "tag", "live MB", "peak MB", "allocations");
+
+    for (int tag = 0; tag < NUM_MEM_TAGS; tag++)
+    {
+        MemStats stats = mem_stats(tag);
+
+        fprintf(stderr, "%-12s %10.2f %10.2f %12zu\n", mem_tag_names[tag], megabytes(stats.live),
+                megabytes(stats.peak), stats.allocations);
+
+        // The driver keeps its buffers and textures wherever it likes, in the process or on the card
+        if (tag != MEM_GL_BUFFERS && tag != MEM_GL_TEXTURES)
+            heap += stats.live;
+    }
+
+    if (platform_memory_usage(&usage))
+    {
+        fprintf(stderr, "Resident %.2f MB, proportional %.2f MB, anonymous %.2f MB of which %.2f MB is tagged\n",
+                megabytes(usage.resident), megabytes(usage.proportional), megabytes(usage.anonymous),
+                megabytes(heap));
+    }
+
+    if (platform_memory_mappings(mapping_add, &m))
+    {
+        qsort(m.mappings, m.len, sizeof *m.mappings, compare_mappings);
+
+        fprintf(stderr, "%10s %10s  mapping\n", "resident", "prop.");
+        for (size_t i = 0; i < m.len && i < REPORT_MAPPINGS; i++)
+            fprintf(stderr, "%10.2f %10.2f  %s\n", megabytes(m.mappings[i].resident),
+                    megabytes(m.mappings[i].proportional), m.mappings[i].name);
+    }
+
+    free(m.mappings);
+}
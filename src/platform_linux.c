@@ -0,0 +1,766 @@
+#define _GNU_SOURCE
+#include "theeditor.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <pty.h>
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+// Big enough that most directories come back in a single getdents64 call
+#define GETDENTS_BUFFER_SIZE (1 << 17)
+// Holds a few thousand events, so a burst drains in a handful of reads
+#define INOTIFY_BUFFER_SIZE (1 << 16)
+// The kernel default before the limit started scaling with memory
+#define DEFAULT_WATCH_LIMIT 8192
+// How long a shell gets to exit after hanging up on it, before it is killed
+#define PTY_HANGUP_WAIT_MS 100
+
+struct linux_dirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+static FileTreeItemFlags type_from_stat(int dirfd, const char *name)
+{
+    struct stat st;
+
+    // Follows symlinks, so a link to a directory can be expanded like the directory itself
+    if (fstatat(dirfd, name, &st, 0) == 0 && S_ISDIR(st.st_mode))
+        return FTI_DIRECTORY;
+
+    return FTI_FILE;
+}
+
+typedef bool (*DirentCallback)(void *user, int dirfd, const char *name, unsigned char d_type);
+
+/* Runs getdents64 over a directory, calling back for every entry except "." and "..". */
+static bool for_each_dirent(const char *path, DirentCallback callback, void *user)
+{
+    int dirfd = openat(AT_FDCWD, path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dirfd < 0)
+        return false;
+
+    char *buffer = malloc(GETDENTS_BUFFER_SIZE);
+    bool keep_going = true, listed = true;
+
+    while (keep_going)
+    {
+        long nread = syscall(SYS_getdents64, dirfd, buffer, GETDENTS_BUFFER_SIZE);
+        if (nread == 0)
+            break;
+
+        // The directory went away or could not be read part way through, which is not the end of it
+        if (nread < 0)
+        {
+            listed = false;
+            break;
+        }
+
+        for (long pos = 0; pos < nread && keep_going;)
+        {
+            const struct linux_dirent64 *d = (const struct linux_dirent64 *)&buffer[pos];
+            pos += d->d_reclen;
+
+            const char *name = d->d_name;
+            if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0')))
+                continue;
+
+            keep_going = callback(user, dirfd, name, d->d_type);
+        }
+    }
+
+    // Kept for the caller, past what freeing and closing could set it to
+    int error = errno;
+
+    free(buffer);
+    close(dirfd);
+    errno = error;
+
+    return listed;
+}
+
+typedef struct {
+    PlatformDirCallback callback;
+    void *user;
+} ListState;
+
+static bool list_entry(void *user, int dirfd, const char *name, unsigned char d_type)
+{
+    ListState *state = user;
+    FileTreeItemFlags type;
+
+    switch (d_type)
+    {
+    case DT_DIR:
+        type = FTI_DIRECTORY;
+        break;
+    case DT_LNK:
+    case DT_UNKNOWN:
+        // Only some filesystems leave the type out, everything else never needs a stat
+        type = type_from_stat(dirfd, name);
+        break;
+    default:
+        type = FTI_FILE;
+        break;
+    }
+
+    return state->callback(state->user, name, strlen(name), type);
+}
+
+bool platform_list_directory(const char *path, PlatformDirCallback callback, void *user)
+{
+    ListState state = {callback, user};
+    return for_each_dirent(path, list_entry, &state);
+}
+
+typedef struct {
+    PlatformDirStatCallback callback;
+    void *user;
+} ListStatState;
+
+static bool list_stat_entry(void *user, int dirfd, const char *name, unsigned char d_type)
+{
+    ListStatState *state = user;
+    struct stat st;
+
+    PlatformDirEntry entry = {
+        .name = name,
+        .len_name = strlen(name),
+        .type = d_type == DT_DIR ? FTI_DIRECTORY : FTI_FILE,
+    };
+
+    if (fstatat(dirfd, name, &st, AT_SYMLINK_NOFOLLOW) == 0)
+    {
+        entry.type = S_ISDIR(st.st_mode) ? FTI_DIRECTORY : FTI_FILE;
+        entry.size = (uint64_t)st.st_size;
+        entry.mtime = (int64_t)st.st_mtim.tv_sec * 1000000000ll + st.st_mtim.tv_nsec;
+    }
+
+    return state->callback(state->user, &entry);
+}
+
+bool platform_list_directory_stat(const char *path, PlatformDirStatCallback callback, void *user)
+{
+    ListStatState state = {callback, user};
+    return for_each_dirent(path, list_stat_entry, &state);
+}
+
+struct PlatformWatcher {
+    int fd;
+    char *buffer;
+};
+
+PlatformWatcher *platform_watcher_create(void)
+{
+    int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd < 0)
+        return NULL;
+
+    PlatformWatcher *watcher = malloc(sizeof *watcher);
+    watcher->fd = fd;
+    watcher->buffer = malloc(INOTIFY_BUFFER_SIZE);
+
+    return watcher;
+}
+
+void platform_watcher_destroy(PlatformWatcher *watcher)
+{
+    close(watcher->fd);
+    free(watcher->buffer);
+    free(watcher);
+}
+
+int platform_watch_add(PlatformWatcher *watcher, const char *path)
+{
+    uint32_t mask = IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_ONLYDIR;
+    return inotify_add_watch(watcher->fd, path, mask);
+}
+
+void platform_watch_remove(PlatformWatcher *watcher, int watch)
+{
+    // Fails harmlessly when the directory is already gone, the kernel dropped the watch with it
+    inotify_rm_watch(watcher->fd, watch);
+}
+
+size_t platform_watch_limit(void)
+{
+    FILE *f = fopen("/proc/sys/fs/inotify/max_user_watches", "r");
+    unsigned long limit = 0;
+
+    if (f)
+    {
+        if (fscanf(f, "%lu", &limit) != 1)
+            limit = 0;
+        fclose(f);
+    }
+
+    return limit ? limit : DEFAULT_WATCH_LIMIT;
+}
+
+void platform_watcher_poll(PlatformWatcher *watcher, PlatformWatchCallback callback, void *user)
+{
+    for (;;)
+    {
+        ssize_t nread = read(watcher->fd, watcher->buffer, INOTIFY_BUFFER_SIZE);
+        if (nread <= 0)
+            break;
+
+        for (ssize_t pos = 0; pos < nread;)
+        {
+            const struct inotify_event *e = (const struct inotify_event *)&watcher->buffer[pos];
+            pos += sizeof *e + e->len;
+
+            PlatformWatchEvent event = {
+                .watch = e->wd,
+                .cookie = e->cookie,
+                // Symbolic links show up as files until the directory is listed again
+                .type = e->mask & IN_ISDIR ? FTI_DIRECTORY : FTI_FILE,
+                .name = e->name,
+                .len_name = e->len ? strlen(e->name) : 0,
+            };
+
+            if (e->mask & IN_Q_OVERFLOW)
+                event.kind = PLATFORM_WATCH_OVERFLOW;
+            else if (e->mask & IN_CREATE)
+                event.kind = PLATFORM_WATCH_CREATED;
+            else if (e->mask & IN_DELETE)
+                event.kind = PLATFORM_WATCH_DELETED;
+            else if (e->mask & IN_MOVED_FROM)
+                event.kind = PLATFORM_WATCH_MOVED_FROM;
+            else if (e->mask & IN_MOVED_TO)
+                event.kind = PLATFORM_WATCH_MOVED_TO;
+            else if (e->mask & IN_DELETE_SELF)
+                event.kind = PLATFORM_WATCH_GONE;
+            else
+                continue;
+
+            callback(user, &event);
+        }
+    }
+}
+
+int64_t platform_file_mtime(const char *path)
+{
+    struct stat st;
+
+    if (stat(path, &st))
+        return 0;
+
+    return (int64_t)st.st_mtim.tv_sec * 1000000000ll + st.st_mtim.tv_nsec;
+}
+
+bool platform_replace_file(const char *from, const char *to)
+{
+    // Anyone still mapping the old file keeps its pages, they belong to the unlinked inode
+    return rename(from, to) == 0;
+}
+
+bool platform_cache_dir(char *path, size_t size)
+{
+    const char *cache = getenv("XDG_CACHE_HOME");
+    const char *home = getenv("HOME");
+    int n;
+
+    // A relative XDG_CACHE_HOME is to be ignored
+    if (cache && cache[0] == '/')
+        n = snprintf(path, size, "%s/theeditor", cache);
+    else if (home && home[0] == '/')
+        n = snprintf(path, size, "%s/.cache/theeditor", home);
+    else
+        return false;
+
+    if (n < 0 || (size_t)n >= size)
+        return false;
+
+    // Every level is made in turn, as ~/.cache may not be there either
+    for (char *slash = strchr(&path[1], '/');; slash = strchr(&slash[1], '/'))
+    {
+        if (slash)
+            *slash = '\0';
+
+        bool made = !mkdir(path, 0700) || errno == EEXIST;
+
+        if (!slash)
+            return made;
+        *slash = '/';
+    }
+}
+
+bool platform_current_dir(char *path, size_t size)
+{
+    return getcwd(path, size) != NULL;
+}
+
+static bool map_file(const char *path, PlatformFileMap *map, bool writable)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+
+    if (fd < 0)
+        return false;
+
+    if (fstat(fd, &st) || st.st_size <= 0)
+    {
+        close(fd);
+        return false;
+    }
+
+    void *data = mmap(NULL, (size_t)st.st_size, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if (data == MAP_FAILED)
+        return false;
+
+    map->data = data;
+    map->size = (size_t)st.st_size;
+
+    return true;
+}
+
+bool platform_map_file(const char *path, PlatformFileMap *map)
+{
+    return map_file(path, map, true);
+}
+
+bool platform_map_file_readonly(const char *path, PlatformFileMap *map)
+{
+    return map_file(path, map, false);
+}
+
+void platform_unmap_file(PlatformFileMap *map)
+{
+    if (map->data)
+        munmap(map->data, map->size);
+
+    *map = (PlatformFileMap){0};
+}
+
+void platform_map_release(PlatformFileMap *map, size_t offset, size_t size)
+{
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    size_t begin = (offset + page - 1) / page * page;
+    size_t end = (offset + size) / page * page;
+
+    // Unwritten pages of a private file mapping are the page cache's, dropping them only unmaps them from the process
+    if (begin < end)
+        madvise((char *)map->data + begin, end - begin, MADV_DONTNEED);
+}
+
+int platform_cpu_count(void)
+{
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+}
+
+bool platform_cpu_has_avx2(void)
+{
+#if defined(__x86_64__)
+    // Also checks that the system saves the wide registers
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#else
+    return false;
+#endif
+}
+
+size_t platform_resident_memory(void)
+{
+    FILE *f = fopen("/proc/self/statm", "r");
+    unsigned long long size, resident = 0;
+
+    if (!f)
+        return 0;
+
+    if (fscanf(f, "%llu %llu", &size, &resident) != 2)
+        resident = 0;
+    fclose(f);
+
+    return (size_t)resident * (size_t)sysconf(_SC_PAGESIZE);
+}
+
+bool platform_memory_usage(PlatformMemoryUsage *usage)
+{
+    // The totals of every mapping in smaps, added up by the kernel
+    FILE *f = fopen("/proc/self/smaps_rollup", "r");
+    char line[256];
+    unsigned long long kb;
+
+    *usage = (PlatformMemoryUsage){0};
+
+    if (!f)
+        return false;
+
+    while (fgets(line, sizeof line, f))
+    {
+        if (sscanf(line, "Rss: %llu kB", &kb) == 1)
+            usage->resident = (size_t)kb << 10;
+        else if (sscanf(line, "Pss: %llu kB", &kb) == 1)
+            usage->proportional = (size_t)kb << 10;
+        else if (sscanf(line, "Anonymous: %llu kB", &kb) == 1)
+            usage->anonymous = (size_t)kb << 10;
+    }
+
+    fclose(f);
+    return usage->resident != 0;
+}
+
+bool platform_memory_mappings(PlatformMappingCallback callback, void *user)
+{
+    FILE *f = fopen("/proc/self/smaps", "r");
+    // The name is what is left of its line, so it is given as much room
+    char line[FILENAME_LEN + 128], name[sizeof line];
+    size_t resident = 0, proportional = 0;
+    bool mapping = false;
+
+    if (!f)
+        return false;
+
+    while (fgets(line, sizeof line, f))
+    {
+        unsigned long start, end, inode;
+        unsigned long long kb;
+        int path;
+
+        // A mapping's sizes come in the lines after its own, so it is given once the next one starts
+        if (sscanf(line, "%lx-%lx %*s %*x %*x:%*x %lu %n", &start, &end, &inode, &path) == 3)
+        {
+            if (mapping)
+                callback(user, name[0] ? name : NULL, resident, proportional);
+
+            size_t len_name = strcspn(&line[path], "\n");
+
+            memcpy(name, &line[path], len_name);
+            name[len_name] = '\0';
+            resident = proportional = 0;
+            mapping = true;
+        }
+        else if (sscanf(line, "Rss: %llu kB", &kb) == 1)
+        {
+            resident = (size_t)kb << 10;
+        }
+        else if (sscanf(line, "Pss: %llu kB", &kb) == 1)
+        {
+            proportional = (size_t)kb << 10;
+        }
+    }
+
+    if (mapping)
+        callback(user, name[0] ? name : NULL, resident, proportional);
+
+    fclose(f);
+    return mapping;
+}
+
+uint64_t platform_time_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+void platform_sleep_ms(int ms)
+{
+    struct timespec ts = {ms / 1000, (long)(ms % 1000) * 1000000};
+    nanosleep(&ts, NULL);
+}
+
+struct PlatformThread {
+    pthread_t thread;
+    PlatformThreadProc proc;
+    void *arg;
+};
+
+struct PlatformMutex {
+    pthread_mutex_t mutex;
+};
+
+struct PlatformCond {
+    pthread_cond_t cond;
+};
+
+static void *thread_start(void *arg)
+{
+    PlatformThread *thread = arg;
+    thread->proc(thread->arg);
+    return NULL;
+}
+
+PlatformThread *platform_thread_create(PlatformThreadProc proc, void *arg)
+{
+    PlatformThread *thread = malloc(sizeof *thread);
+    thread->proc = proc;
+    thread->arg = arg;
+
+    if (pthread_create(&thread->thread, NULL, thread_start, thread))
+    {
+        free(thread);
+        return NULL;
+    }
+
+    return thread;
+}
+
+void platform_thread_join(PlatformThread *thread)
+{
+    pthread_join(thread->thread, NULL);
+    free(thread);
+}
+
+PlatformMutex *platform_mutex_create(void)
+{
+    PlatformMutex *mutex = malloc(sizeof *mutex);
+    pthread_mutex_init(&mutex->mutex, NULL);
+    return mutex;
+}
+
+void platform_mutex_destroy(PlatformMutex *mutex)
+{
+    pthread_mutex_destroy(&mutex->mutex);
+    free(mutex);
+}
+
+void platform_mutex_lock(PlatformMutex *mutex)
+{
+    pthread_mutex_lock(&mutex->mutex);
+}
+
+void platform_mutex_unlock(PlatformMutex *mutex)
+{
+    pthread_mutex_unlock(&mutex->mutex);
+}
+
+PlatformCond *platform_cond_create(void)
+{
+    PlatformCond *cond = malloc(sizeof *cond);
+    pthread_cond_init(&cond->cond, NULL);
+    return cond;
+}
+
+void platform_cond_destroy(PlatformCond *cond)
+{
+    pthread_cond_destroy(&cond->cond);
+    free(cond);
+}
+
+void platform_cond_wait(PlatformCond *cond, PlatformMutex *mutex)
+{
+    pthread_cond_wait(&cond->cond, &mutex->mutex);
+}
+
+void platform_cond_signal(PlatformCond *cond)
+{
+    pthread_cond_signal(&cond->cond);
+}
+
+void platform_cond_broadcast(PlatformCond *cond)
+{
+    pthread_cond_broadcast(&cond->cond);
+}
+
+void *platform_atomic_exchange_ptr(void *volatile *target, void *value)
+{
+    return __atomic_exchange_n(target, value, __ATOMIC_SEQ_CST);
+}
+
+void *platform_atomic_load_ptr(void *volatile *source)
+{
+    return __atomic_load_n(source, __ATOMIC_ACQUIRE);
+}
+
+void platform_atomic_store_ptr(void *volatile *target, void *value)
+{
+    __atomic_store_n(target, value, __ATOMIC_RELEASE);
+}
+
+size_t platform_atomic_load_size(volatile size_t *source)
+{
+    return __atomic_load_n(source, __ATOMIC_ACQUIRE);
+}
+
+void platform_atomic_store_size(volatile size_t *target, size_t value)
+{
+    __atomic_store_n(target, value, __ATOMIC_RELEASE);
+}
+
+size_t platform_atomic_add_size(volatile size_t *target, size_t value)
+{
+    return __atomic_add_fetch(target, value, __ATOMIC_SEQ_CST);
+}
+
+bool platform_atomic_compare_exchange_size(volatile size_t *target, size_t *expected, size_t value)
+{
+    return __atomic_compare_exchange_n(target, expected, value, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+}
+
+struct PlatformPty {
+    int master;
+    // Written to by platform_pty_wake, so a poll waiting on the master returns
+    int wake[2];
+    pid_t pid;
+};
+
+PlatformPty *platform_pty_spawn(const char *shell, int columns, int rows)
+{
+    PlatformPty *pty = malloc(sizeof *pty);
+    struct winsize size = {.ws_row = (unsigned short)rows, .ws_col = (unsigned short)columns};
+
+    if (!shell)
+        shell = getenv("SHELL");
+    if (!shell || !*shell)
+        shell = "/bin/sh";
+
+    if (pipe2(pty->wake, O_CLOEXEC | O_NONBLOCK))
+    {
+        free(pty);
+        return NULL;
+    }
+
+    /*
+     * The shell's environment is made here, before forking, since other threads may hold the allocator's or the
+     * environment's locks when it happens and the child can only call what is async-signal-safe.  The sequences
+     * programs send for xterm are the ones the console's terminal understands.
+     */
+    size_t nenv = 0;
+    while (environ[nenv])
+        nenv++;
+
+    char **envp = malloc((nenv + 2) * sizeof *envp);
+    char *argv[] = {(char *)shell, NULL};
+    size_t len_envp = 0;
+
+    for (size_t i = 0; i < nenv; i++)
+        if (strncmp(environ[i], "TERM=", 5))
+            envp[len_envp++] = environ[i];
+    envp[len_envp++] = "TERM=xterm-256color";
+    envp[len_envp] = NULL;
+
+    pty->pid = forkpty(&pty->master, NULL, NULL, &size);
+
+    if (pty->pid == 0)
+    {
+        execve(shell, argv, envp);
+        _exit(127);
+    }
+
+    free(envp);
+
+    if (pty->pid < 0)
+    {
+        close(pty->wake[0]);
+        close(pty->wake[1]);
+        free(pty);
+        return NULL;
+    }
+
+    // Writes of typed text must never hold up a frame, if the shell is not reading they are cut short instead
+    fcntl(pty->master, F_SETFD, FD_CLOEXEC);
+    fcntl(pty->master, F_SETFL, fcntl(pty->master, F_GETFL) | O_NONBLOCK);
+
+    return pty;
+}
+
+size_t platform_pty_read(PlatformPty *pty, void *buffer, size_t cap)
+{
+    struct pollfd fds[2] = {
+        {.fd = pty->master, .events = POLLIN},
+        {.fd = pty->wake[0], .events = POLLIN},
+    };
+
+    for (;;)
+    {
+        if (poll(fds, 2, -1) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            return 0;
+        }
+
+        if (fds[1].revents)
+            return 0;
+
+        ssize_t n = read(pty->master, buffer, cap);
+
+        if (n > 0)
+            return (size_t)n;
+        if (n < 0 && (errno == EINTR || errno == EAGAIN))
+            continue;
+
+        // EIO once the shell and everything it started have let go of the terminal
+        return 0;
+    }
+}
+
+void platform_pty_wake(PlatformPty *pty)
+{
+    char byte = 0;
+
+    // Can only fail with the pipe full of earlier wakeups, which do just as well
+    ssize_t n = write(pty->wake[1], &byte, 1);
+    (void)n;
+}
+
+size_t platform_pty_write(PlatformPty *pty, const void *data, size_t len)
+{
+    size_t written = 0;
+
+    while (written < len)
+    {
+        ssize_t n = write(pty->master, (const char *)data + written, len - written);
+
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+
+        written += (size_t)n;
+    }
+
+    return written;
+}
+
+void platform_pty_resize(PlatformPty *pty, int columns, int rows)
+{
+    struct winsize size = {.ws_row = (unsigned short)rows, .ws_col = (unsigned short)columns};
+
+    ioctl(pty->master, TIOCSWINSZ, &size);
+}
+
+void platform_pty_close(PlatformPty *pty)
+{
+    // Closing the master hangs up on the shell, which passes the hangup on to its jobs
+    close(pty->master);
+    kill(pty->pid, SIGHUP);
+
+    int waited = 0;
+    while (waitpid(pty->pid, NULL, WNOHANG) == 0)
+    {
+        if (waited++ == PTY_HANGUP_WAIT_MS)
+        {
+            kill(pty->pid, SIGKILL);
+            waitpid(pty->pid, NULL, 0);
+            break;
+        }
+
+        usleep(1000);
+    }
+
+    close(pty->wake[0]);
+    close(pty->wake[1]);
+    free(pty);
+}
@@ -0,0 +1,649 @@
+#include "theeditor.h"
+
+#ifdef UNICODE
+#undef UNICODE
+#endif
+#include <windows.h>
+#include <psapi.h>
+#include <intrin.h>
+#include <stdio.h>
+#include <string.h>
+#include <wchar.h>
+
+// How much output the shell can get ahead of the reader before its writes wait
+#define PTY_PIPE_SIZE (1 << 16)
+// How long a shell gets to exit after its console is closed, before it is killed
+#define PTY_CLOSE_WAIT_MS 100
+
+typedef bool (*FindCallback)(void *user, const WIN32_FIND_DATAW *ffd, const char *name, size_t len_name);
+
+/* Paths are UTF-8 everywhere else, the wide calls take them as UTF-16.  Fails on paths too long or not UTF-8. */
+static bool wide_path(const char *path, wchar_t *out, int cap)
+{
+    return MultiByteToWideChar(CP_UTF8, MB_ERR_INVALID_CHARS, path, -1, out, cap) > 0;
+}
+
+/* Runs FindFirstFileExW over a directory, calling back for every entry except "." and ".." with its name as UTF-8. */
+static bool for_each_find(const char *path, FindCallback callback, void *user)
+{
+    WIN32_FIND_DATAW ffd;
+    HANDLE hfind;
+    wchar_t search[MAX_PATH + 2];
+    // A UTF-16 unit is at most three bytes of UTF-8, a surrogate pair of two is four
+    char name[3 * MAX_PATH];
+
+    if (!wide_path(path, search, MAX_PATH))
+        return false;
+    wcscat(search, L"\\*");
+
+    // Basic info skips the 8.3 short names, and the large fetch batches entries per kernel call
+    hfind = FindFirstFileExW(search, FindExInfoBasic, &ffd, FindExSearchNameMatch, NULL, FIND_FIRST_EX_LARGE_FETCH);
+
+    if (hfind == INVALID_HANDLE_VALUE)
+        return false;
+
+    do
+    {
+        if (!wcscmp(ffd.cFileName, L".") || !wcscmp(ffd.cFileName, L".."))
+            continue;
+
+        // Names that are not valid UTF-16 have no UTF-8 to give, and are left out
+        int len_name =
+            WideCharToMultiByte(CP_UTF8, WC_ERR_INVALID_CHARS, ffd.cFileName, -1, name, (int)sizeof name, NULL, NULL);
+        if (!len_name)
+            continue;
+
+        if (!callback(user, &ffd, name, (size_t)len_name - 1))
+        {
+            FindClose(hfind);
+            return true;
+        }
+    }
+    while (FindNextFileW(hfind, &ffd));
+
+    // Running out of entries is the only way the listing is finished, anything else cut it short
+    bool listed = GetLastError() == ERROR_NO_MORE_FILES;
+
+    FindClose(hfind);
+
+    return listed;
+}
+
+typedef struct {
+    PlatformDirCallback callback;
+    void *user;
+} ListState;
+
+static bool list_entry(void *user, const WIN32_FIND_DATAW *ffd, const char *name, size_t len_name)
+{
+    ListState *state = user;
+    FileTreeItemFlags type;
+
+    if (ffd->dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+        type = FTI_DIRECTORY;
+    else
+        type = FTI_FILE;
+
+    return state->callback(state->user, name, len_name, type);
+}
+
+bool platform_list_directory(const char *path, PlatformDirCallback callback, void *user)
+{
+    ListState state = {callback, user};
+    return for_each_find(path, list_entry, &state);
+}
+
+typedef struct {
+    PlatformDirStatCallback callback;
+    void *user;
+} ListStatState;
+
+static bool list_stat_entry(void *user, const WIN32_FIND_DATAW *ffd, const char *name, size_t len_name)
+{
+    ListStatState *state = user;
+
+    // FILETIME counts 100ns intervals from 1601
+    const int64_t unix_epoch = 116444736000000000ll;
+    int64_t filetime = ((int64_t)ffd->ftLastWriteTime.dwHighDateTime << 32) | ffd->ftLastWriteTime.dwLowDateTime;
+
+    // Reparse points are left unexpanded, like symbolic links on Linux
+    bool is_dir = (ffd->dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)
+        && !(ffd->dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT);
+
+    PlatformDirEntry entry = {
+        .name = name,
+        .len_name = len_name,
+        .type = is_dir ? FTI_DIRECTORY : FTI_FILE,
+        .size = ((uint64_t)ffd->nFileSizeHigh << 32) | ffd->nFileSizeLow,
+        .mtime = (filetime - unix_epoch) * 100,
+    };
+
+    return state->callback(state->user, &entry);
+}
+
+bool platform_list_directory_stat(const char *path, PlatformDirStatCallback callback, void *user)
+{
+    ListStatState state = {callback, user};
+    return for_each_find(path, list_stat_entry, &state);
+}
+
+// Watching is not implemented on Windows yet, directories are only refreshed when they are expanded again
+PlatformWatcher *platform_watcher_create(void)
+{
+    return NULL;
+}
+
+void platform_watcher_destroy(PlatformWatcher *watcher)
+{
+}
+
+int platform_watch_add(PlatformWatcher *watcher, const char *path)
+{
+    return -1;
+}
+
+void platform_watch_remove(PlatformWatcher *watcher, int watch)
+{
+}
+
+size_t platform_watch_limit(void)
+{
+    return 0;
+}
+
+void platform_watcher_poll(PlatformWatcher *watcher, PlatformWatchCallback callback, void *user)
+{
+}
+
+int64_t platform_file_mtime(const char *path)
+{
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    wchar_t wide[MAX_PATH];
+
+    if (!wide_path(path, wide, MAX_PATH) || !GetFileAttributesExW(wide, GetFileExInfoStandard, &data))
+        return 0;
+
+    const int64_t unix_epoch = 116444736000000000ll;
+    int64_t filetime = ((int64_t)data.ftLastWriteTime.dwHighDateTime << 32) | data.ftLastWriteTime.dwLowDateTime;
+
+    return (filetime - unix_epoch) * 100;
+}
+
+bool platform_replace_file(const char *from, const char *to)
+{
+    wchar_t wide_from[MAX_PATH], wide_to[MAX_PATH];
+
+    if (!wide_path(from, wide_from, MAX_PATH) || !wide_path(to, wide_to, MAX_PATH))
+        return false;
+
+    return MoveFileExW(wide_from, wide_to, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+}
+
+bool platform_cache_dir(char *path, size_t size)
+{
+    static const wchar_t name[] = L"\\TheEditor";
+    wchar_t wide[MAX_PATH];
+    DWORD len = GetEnvironmentVariableW(L"LOCALAPPDATA", wide, MAX_PATH);
+
+    if (!len || len + wcslen(name) >= MAX_PATH)
+        return false;
+    wcscat(wide, name);
+
+    if (!CreateDirectoryW(wide, NULL) && GetLastError() != ERROR_ALREADY_EXISTS)
+        return false;
+
+    return WideCharToMultiByte(CP_UTF8, WC_ERR_INVALID_CHARS, wide, -1, path, (int)size, NULL, NULL) > 0;
+}
+
+bool platform_current_dir(char *path, size_t size)
+{
+    wchar_t wide[MAX_PATH];
+    DWORD len = GetCurrentDirectoryW(MAX_PATH, wide);
+
+    if (!len || len >= MAX_PATH)
+        return false;
+
+    return WideCharToMultiByte(CP_UTF8, WC_ERR_INVALID_CHARS, wide, -1, path, (int)size, NULL, NULL) > 0;
+}
+
+static bool map_file(const char *path, PlatformFileMap *map, bool writable)
+{
+    wchar_t wide[MAX_PATH];
+
+    if (!wide_path(path, wide, MAX_PATH))
+        return false;
+
+    // Shared for deletion, so the file can be replaced while it is still mapped
+    HANDLE file = CreateFileW(wide, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, NULL, OPEN_EXISTING,
+        FILE_ATTRIBUTE_NORMAL, NULL);
+    LARGE_INTEGER size;
+
+    if (file == INVALID_HANDLE_VALUE)
+        return false;
+
+    if (!GetFileSizeEx(file, &size) || size.QuadPart <= 0)
+    {
+        CloseHandle(file);
+        return false;
+    }
+
+    HANDLE mapping = CreateFileMapping(file, NULL, writable ? PAGE_WRITECOPY : PAGE_READONLY, 0, 0, NULL);
+    CloseHandle(file);
+
+    if (!mapping)
+        return false;
+
+    // The view keeps the mapping alive once the handle is closed
+    void *data = MapViewOfFile(mapping, writable ? FILE_MAP_COPY : FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);
+
+    if (!data)
+        return false;
+
+    map->data = data;
+    map->size = (size_t)size.QuadPart;
+
+    return true;
+}
+
+bool platform_map_file(const char *path, PlatformFileMap *map)
+{
+    return map_file(path, map, true);
+}
+
+bool platform_map_file_readonly(const char *path, PlatformFileMap *map)
+{
+    return map_file(path, map, false);
+}
+
+void platform_unmap_file(PlatformFileMap *map)
+{
+    if (map->data)
+        UnmapViewOfFile(map->data);
+
+    *map = (PlatformFileMap){0};
+}
+
+void platform_map_release(PlatformFileMap *map, size_t offset, size_t size)
+{
+    // Unlocking pages that were never locked fails, but takes them out of the working set all the same
+    VirtualUnlock((char *)map->data + offset, size);
+}
+
+int platform_cpu_count(void)
+{
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors > 0 ? (int)info.dwNumberOfProcessors : 1;
+}
+
+bool platform_cpu_has_avx2(void)
+{
+#if defined(_M_X64)
+    int info[4];
+
+    __cpuid(info, 0);
+    if (info[0] < 7)
+        return false;
+
+    // The processor has to have AVX and the system has to save the wide registers on a switch
+    __cpuid(info, 1);
+    if (!(info[2] & (1 << 27)) || !(info[2] & (1 << 28)) || (_xgetbv(0) & 6) != 6)
+        return false;
+
+    __cpuidex(info, 7, 0);
+    return info[1] & (1 << 5);
+#else
+    return false;
+#endif
+}
+
+size_t platform_resident_memory(void)
+{
+    PROCESS_MEMORY_COUNTERS counters;
+
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof counters))
+        return 0;
+
+    return counters.WorkingSetSize;
+}
+
+bool platform_memory_usage(PlatformMemoryUsage *usage)
+{
+    PROCESS_MEMORY_COUNTERS_EX counters;
+
+    *usage = (PlatformMemoryUsage){0};
+
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), (PROCESS_MEMORY_COUNTERS *)&counters, sizeof counters))
+        return false;
+
+    usage->resident = counters.WorkingSetSize;
+    usage->anonymous = counters.PrivateUsage;
+
+    return true;
+}
+
+bool platform_memory_mappings(PlatformMappingCallback callback, void *user)
+{
+    MEMORY_BASIC_INFORMATION info;
+    char name[FILENAME_LEN];
+    bool any = false;
+
+    // Every region of the address space in order, from the bottom until the query runs off the top
+    for (const char *p = NULL; VirtualQuery(p, &info, sizeof info);
+         p = (const char *)info.BaseAddress + info.RegionSize)
+    {
+        if (info.State != MEM_COMMIT)
+            continue;
+
+        bool named = info.Type != MEM_PRIVATE
+                     && GetMappedFileNameA(GetCurrentProcess(), info.BaseAddress, name, sizeof name);
+
+        callback(user, named ? name : NULL, info.RegionSize, info.RegionSize);
+        any = true;
+    }
+
+    return any;
+}
+
+uint64_t platform_time_ns(void)
+{
+    static LARGE_INTEGER frequency;
+    LARGE_INTEGER counter;
+
+    if (!frequency.QuadPart)
+        QueryPerformanceFrequency(&frequency);
+
+    QueryPerformanceCounter(&counter);
+
+    return (uint64_t)(counter.QuadPart / frequency.QuadPart) * 1000000000ull
+        + (uint64_t)(counter.QuadPart % frequency.QuadPart) * 1000000000ull / (uint64_t)frequency.QuadPart;
+}
+
+void platform_sleep_ms(int ms)
+{
+    Sleep((DWORD)ms);
+}
+
+struct PlatformThread {
+    HANDLE handle;
+    PlatformThreadProc proc;
+    void *arg;
+};
+
+struct PlatformMutex {
+    SRWLOCK lock;
+};
+
+struct PlatformCond {
+    CONDITION_VARIABLE cond;
+};
+
+static DWORD WINAPI thread_start(LPVOID arg)
+{
+    PlatformThread *thread = arg;
+    thread->proc(thread->arg);
+    return 0;
+}
+
+PlatformThread *platform_thread_create(PlatformThreadProc proc, void *arg)
+{
+    PlatformThread *thread = malloc(sizeof *thread);
+    thread->proc = proc;
+    thread->arg = arg;
+    thread->handle = CreateThread(NULL, 0, thread_start, thread, 0, NULL);
+
+    if (!thread->handle)
+    {
+        free(thread);
+        return NULL;
+    }
+
+    return thread;
+}
+
+void platform_thread_join(PlatformThread *thread)
+{
+    WaitForSingleObject(thread->handle, INFINITE);
+    CloseHandle(thread->handle);
+    free(thread);
+}
+
+PlatformMutex *platform_mutex_create(void)
+{
+    PlatformMutex *mutex = malloc(sizeof *mutex);
+    InitializeSRWLock(&mutex->lock);
+    return mutex;
+}
+
+void platform_mutex_destroy(PlatformMutex *mutex)
+{
+    free(mutex);
+}
+
+void platform_mutex_lock(PlatformMutex *mutex)
+{
+    AcquireSRWLockExclusive(&mutex->lock);
+}
+
+void platform_mutex_unlock(PlatformMutex *mutex)
+{
+    ReleaseSRWLockExclusive(&mutex->lock);
+}
+
+PlatformCond *platform_cond_create(void)
+{
+    PlatformCond *cond = malloc(sizeof *cond);
+    InitializeConditionVariable(&cond->cond);
+    return cond;
+}
+
+void platform_cond_destroy(PlatformCond *cond)
+{
+    free(cond);
+}
+
+void platform_cond_wait(PlatformCond *cond, PlatformMutex *mutex)
+{
+    SleepConditionVariableSRW(&cond->cond, &mutex->lock, INFINITE, 0);
+}
+
+void platform_cond_signal(PlatformCond *cond)
+{
+    WakeConditionVariable(&cond->cond);
+}
+
+void platform_cond_broadcast(PlatformCond *cond)
+{
+    WakeAllConditionVariable(&cond->cond);
+}
+
+void *platform_atomic_exchange_ptr(void *volatile *target, void *value)
+{
+    return InterlockedExchangePointer(target, value);
+}
+
+void *platform_atomic_load_ptr(void *volatile *source)
+{
+    // A compare that never swaps, for its barrier
+    return InterlockedCompareExchangePointer(source, NULL, NULL);
+}
+
+void platform_atomic_store_ptr(void *volatile *target, void *value)
+{
+    InterlockedExchangePointer(target, value);
+}
+
+size_t platform_atomic_load_size(volatile size_t *source)
+{
+    return (size_t)InterlockedCompareExchange64((volatile LONG64 *)source, 0, 0);
+}
+
+void platform_atomic_store_size(volatile size_t *target, size_t value)
+{
+    InterlockedExchange64((volatile LONG64 *)target, (LONG64)value);
+}
+
+size_t platform_atomic_add_size(volatile size_t *target, size_t value)
+{
+    return (size_t)InterlockedExchangeAdd64((volatile LONG64 *)target, (LONG64)value) + value;
+}
+
+bool platform_atomic_compare_exchange_size(volatile size_t *target, size_t *expected, size_t value)
+{
+    size_t was = (size_t)InterlockedCompareExchange64((volatile LONG64 *)target, (LONG64)value, (LONG64)*expected);
+    bool swapped = was == *expected;
+
+    *expected = was;
+    return swapped;
+}
+
+struct PlatformPty {
+    HPCON console;
+    // Output comes through a named pipe read overlapped, so waiting on it can be cut short by the wake event
+    HANDLE output, input, wake;
+    OVERLAPPED overlapped;
+    PROCESS_INFORMATION process;
+};
+
+/* Closes whatever handles of a pty were opened, and frees it. */
+static void pty_free(PlatformPty *pty)
+{
+    HANDLE handles[] = {pty->output, pty->input, pty->wake, pty->overlapped.hEvent, pty->process.hProcess,
+                        pty->process.hThread};
+
+    for (size_t i = 0; i < sizeof handles / sizeof handles[0]; i++)
+        if (handles[i] && handles[i] != INVALID_HANDLE_VALUE)
+            CloseHandle(handles[i]);
+
+    free(pty);
+}
+
+PlatformPty *platform_pty_spawn(const char *shell, int columns, int rows)
+{
+    static volatile LONG npipes;
+    PlatformPty *pty = calloc(1, sizeof *pty);
+    HANDLE input_read = NULL, output_write = INVALID_HANDLE_VALUE;
+    char name[64], command[MAX_PATH];
+
+    if (!shell)
+        shell = getenv("COMSPEC");
+    if (!shell || !*shell)
+        shell = "cmd.exe";
+
+    snprintf(name, sizeof name, "\\\\.\\pipe\\theeditor-pty-%lu-%ld", GetCurrentProcessId(),
+             InterlockedIncrement(&npipes));
+    pty->output = CreateNamedPipe(name, PIPE_ACCESS_INBOUND | FILE_FLAG_OVERLAPPED | FILE_FLAG_FIRST_PIPE_INSTANCE,
+                                  PIPE_TYPE_BYTE | PIPE_WAIT, 1, 0, PTY_PIPE_SIZE, 0, NULL);
+    if (pty->output != INVALID_HANDLE_VALUE)
+        output_write = CreateFile(name, GENERIC_WRITE, 0, NULL, OPEN_EXISTING, 0, NULL);
+
+    pty->wake = CreateEvent(NULL, TRUE, FALSE, NULL);
+    pty->overlapped.hEvent = CreateEvent(NULL, TRUE, FALSE, NULL);
+
+    COORD size = {(SHORT)columns, (SHORT)rows};
+    bool created = output_write != INVALID_HANDLE_VALUE && CreatePipe(&input_read, &pty->input, NULL, 0)
+        && SUCCEEDED(CreatePseudoConsole(size, input_read, output_write, 0, &pty->console));
+
+    // The pseudo console keeps handles of its own to its ends of the pipes
+    if (input_read)
+        CloseHandle(input_read);
+    if (output_write != INVALID_HANDLE_VALUE)
+        CloseHandle(output_write);
+
+    if (!created || !pty->wake || !pty->overlapped.hEvent)
+    {
+        if (pty->console)
+            ClosePseudoConsole(pty->console);
+        pty_free(pty);
+        return NULL;
+    }
+
+    STARTUPINFOEX startup = {.StartupInfo.cb = sizeof startup};
+    SIZE_T len_attributes = 0;
+
+    InitializeProcThreadAttributeList(NULL, 1, 0, &len_attributes);
+    startup.lpAttributeList = malloc(len_attributes);
+    InitializeProcThreadAttributeList(startup.lpAttributeList, 1, 0, &len_attributes);
+    UpdateProcThreadAttribute(startup.lpAttributeList, 0, PROC_THREAD_ATTRIBUTE_PSEUDOCONSOLE, pty->console,
+                              sizeof pty->console, NULL, NULL);
+
+    // CreateProcess may write to the command line it is given
+    snprintf(command, sizeof command, "%s", shell);
+    bool started = CreateProcess(NULL, command, NULL, NULL, FALSE, EXTENDED_STARTUPINFO_PRESENT, NULL, NULL,
+                                 &startup.StartupInfo, &pty->process);
+
+    DeleteProcThreadAttributeList(startup.lpAttributeList);
+    free(startup.lpAttributeList);
+
+    if (!started)
+    {
+        ClosePseudoConsole(pty->console);
+        pty_free(pty);
+        return NULL;
+    }
+
+    return pty;
+}
+
+size_t platform_pty_read(PlatformPty *pty, void *buffer, size_t cap)
+{
+    HANDLE events[3] = {pty->overlapped.hEvent, pty->wake, pty->process.hProcess};
+    DWORD n = 0;
+
+    if (WaitForSingleObject(pty->wake, 0) == WAIT_OBJECT_0)
+        return 0;
+
+    ResetEvent(pty->overlapped.hEvent);
+
+    if (!ReadFile(pty->output, buffer, cap < MAXDWORD ? (DWORD)cap : MAXDWORD, NULL, &pty->overlapped))
+    {
+        if (GetLastError() != ERROR_IO_PENDING)
+            return 0;
+
+        // The pseudo console outlives the shell, so its exit has to be watched for rather than the pipe closing
+        if (WaitForMultipleObjects(3, events, FALSE, INFINITE) != WAIT_OBJECT_0)
+        {
+            // The read has to be over before the buffer can be let go of
+            CancelIoEx(pty->output, &pty->overlapped);
+            GetOverlappedResult(pty->output, &pty->overlapped, &n, TRUE);
+            return 0;
+        }
+    }
+
+    if (!GetOverlappedResult(pty->output, &pty->overlapped, &n, FALSE))
+        return 0;
+
+    return n;
+}
+
+void platform_pty_wake(PlatformPty *pty)
+{
+    SetEvent(pty->wake);
+}
+
+size_t platform_pty_write(PlatformPty *pty, const void *data, size_t len)
+{
+    DWORD written = 0;
+
+    if (!WriteFile(pty->input, data, len < MAXDWORD ? (DWORD)len : MAXDWORD, &written, NULL))
+        return 0;
+
+    return written;
+}
+
+void platform_pty_resize(PlatformPty *pty, int columns, int rows)
+{
+    ResizePseudoConsole(pty->console, (COORD){(SHORT)columns, (SHORT)rows});
+}
+
+void platform_pty_close(PlatformPty *pty)
+{
+    // Closing the console sends the shell a close event, which ends it along with what it started
+    ClosePseudoConsole(pty->console);
+
+    if (WaitForSingleObject(pty->process.hProcess, PTY_CLOSE_WAIT_MS) != WAIT_OBJECT_0)
+        TerminateProcess(pty->process.hProcess, 1);
+
+    pty_free(pty);
+}
@@ -0,0 +1,810 @@
+#include "theeditor.h"
+
+#include <string.h>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <emmintrin.h>
+#define HAVE_X86
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// Paths a worker takes at a time, few enough that dropping a query never waits long on the chunks in flight
+#define CHUNK 8192
+
+// Scores after fzf's: every character matched counts, and more where it is likely what someone typing meant
+#define SCORE_MATCH 16
+#define PENALTY_GAP_START 3
+#define PENALTY_GAP_EXTEND 1
+#define BONUS_CONSECUTIVE 5
+// At the start of the path or of a directory or file name
+#define BONUS_SEPARATOR 10
+// After a `_`, `-`, `.` or space, or at an upper case letter after a lower case one
+#define BONUS_WORD 8
+#define BONUS_CAMEL 7
+// For every character matched in the file name rather than the directories above it
+#define BONUS_NAME 2
+
+/* The paths that matched a query.  Any longer query starting the same way only has to look through these. */
+typedef struct {
+    size_t len_query;
+    // NULL for the empty query, which every path matches
+    uint32_t *paths;
+    size_t len;
+    QuickOpenMatch top[QUICK_OPEN_MAX_RESULTS];
+    size_t ntop;
+} Level;
+
+/* A query being matched against the paths of a level, a chunk at a time. */
+typedef struct {
+    char query[QUICK_OPEN_QUERY_MAX];
+    size_t len_query;
+    uint64_t mask;
+
+    const uint32_t *input;
+    size_t len_input;
+    // The matches of chunk c are written from output[c * CHUNK] on, and moved together once all are in
+    uint32_t *output;
+    uint32_t *chunk_counts;
+    size_t nchunks, next_chunk, chunks_done;
+
+    // A heap with the worst of the best at the root
+    QuickOpenMatch top[QUICK_OPEN_MAX_RESULTS];
+    size_t ntop;
+    size_t nmatches;
+} Job;
+
+struct QuickOpen {
+    PathIndex index;
+    bool has_index;
+    PlatformThread *indexer;
+    char *root;
+    IgnoreCache *ignore;
+
+    int nworkers;
+    PlatformThread **workers;
+
+    PlatformMutex *mutex;
+    // Workers wait on this for chunks, everyone else on `settled` for jobs to finish or be let go of
+    PlatformCond *wake, *settled;
+    bool stop;
+
+    // The query last asked for, folded, with the levels of every prefix of it that was matched to the end
+    char query[QUICK_OPEN_QUERY_MAX];
+    size_t len_query;
+    Level *levels;
+    size_t nlevels;
+
+    Job job;
+    // Bumped whenever the job is dropped, chunks finished for an older one are thrown away
+    uint64_t generation;
+    bool running;
+    // Workers in the middle of a chunk, which still read the job's input and write its output
+    int busy;
+};
+
+static uint8_t fold(uint8_t c)
+{
+    return c >= 'A' && c <= 'Z' ? c | 0x20 : c;
+}
+
+static uint64_t char_bit(uint8_t c)
+{
+    c = fold(c);
+
+    if (c >= 'a' && c <= 'z')
+        return 1ull << (c - 'a');
+    if (c >= '0' && c <= '9')
+        return 1ull << (26 + c - '0');
+
+    // Everything else shares the bits left, which only makes the filter let a few more paths through
+    return 1ull << (36 + c % 28);
+}
+
+static uint64_t mask_of(const char *s, size_t len)
+{
+    uint64_t mask = 0;
+
+    for (size_t i = 0; i < len; i++)
+        mask |= char_bit((uint8_t)s[i]);
+
+    return mask;
+}
+
+static void text_append(PathIndex *index, size_t *cap, size_t at, const char *s, size_t len)
+{
+    if (at + len > *cap)
+    {
+        *cap = 2 * *cap + len;
+        index->text = realloc(index->text, *cap);
+    }
+
+    memcpy(&index->text[at], s, len);
+}
+
+void path_index_build(PathIndex *index, const WorkspaceSnapshot *snapshot)
+{
+    size_t nfiles = 0;
+
+    for (size_t i = 1; i < snapshot->len; i++)
+        nfiles += !(snapshot->flags[i] & FTI_DIRECTORY);
+
+    *index = (PathIndex){
+        .offsets = malloc((nfiles + 1) * sizeof *index->offsets),
+        .masks = malloc(nfiles * sizeof *index->masks),
+    };
+
+    // The paths of directories, each its parent's with its own name after it, and the root's empty
+    uint32_t *dir_start = malloc(snapshot->len * sizeof *dir_start);
+    uint32_t *dir_len = malloc(snapshot->len * sizeof *dir_len);
+    size_t len_dirs = 0, cap_dirs = 4096, cap_text = 4096;
+    char *dirs = malloc(cap_dirs);
+    size_t len_text = 0;
+
+    index->text = malloc(cap_text);
+    dir_start[0] = 0;
+    dir_len[0] = 0;
+
+    for (size_t i = 1; i < snapshot->len; i++)
+    {
+        uint32_t parent = snapshot->parent[i];
+        String name = strarena_get(&snapshot->strarena, snapshot->name[i]);
+        size_t len_prefix = dir_len[parent];
+        size_t len = len_prefix + (len_prefix ? 1 : 0) + name.length;
+
+        // Everything below a directory whose path did not fit is left out with it
+        if (len_prefix == UINT32_MAX || len_text + len > UINT32_MAX)
+        {
+            dir_len[i] = UINT32_MAX;
+            continue;
+        }
+
+        if (snapshot->flags[i] & FTI_DIRECTORY)
+        {
+            if (len_dirs + len > UINT32_MAX)
+            {
+                dir_len[i] = UINT32_MAX;
+                continue;
+            }
+
+            if (len_dirs + len > cap_dirs)
+            {
+                cap_dirs = 2 * cap_dirs + len;
+                dirs = realloc(dirs, cap_dirs);
+            }
+
+            memcpy(&dirs[len_dirs], &dirs[dir_start[parent]], len_prefix);
+            if (len_prefix)
+                dirs[len_dirs + len_prefix] = PATH_SEPARATOR;
+            memcpy(&dirs[len - name.length + len_dirs], name.data, name.length);
+
+            dir_start[i] = (uint32_t)len_dirs;
+            dir_len[i] = (uint32_t)len;
+            len_dirs += len;
+            continue;
+        }
+
+        char separator = PATH_SEPARATOR;
+
+        index->offsets[index->len] = (uint32_t)len_text;
+        text_append(index, &cap_text, len_text, &dirs[dir_start[parent]], len_prefix);
+        if (len_prefix)
+            text_append(index, &cap_text, len_text + len_prefix, &separator, 1);
+        text_append(index, &cap_text, len_text + len - name.length, name.data, name.length);
+        index->masks[index->len] = mask_of(&index->text[len_text], len);
+
+        len_text += len;
+        index->len++;
+    }
+
+    index->offsets[index->len] = (uint32_t)len_text;
+
+    // Room for reading a path 64 bytes at a time wherever it ends
+    index->text = realloc(index->text, len_text + PATH_INDEX_PADDING);
+    memset(&index->text[len_text], 0, PATH_INDEX_PADDING);
+
+    free(dirs);
+    free(dir_len);
+    free(dir_start);
+}
+
+void path_index_free(PathIndex *index)
+{
+    free(index->text);
+    free(index->offsets);
+    free(index->masks);
+    *index = (PathIndex){0};
+}
+
+String path_index_get(const PathIndex *index, uint32_t path)
+{
+    return (String){
+        .length = index->offsets[path + 1] - index->offsets[path],
+        .data = &index->text[index->offsets[path]],
+    };
+}
+
+/*
+ * Where the query goes in a path, and where the file name starts, scanning a byte at a time.  Returns false if the
+ * query is not there.
+ */
+static bool find_positions(const char *path, size_t len, const char *query, size_t len_query, uint32_t *positions,
+    uint32_t *name)
+{
+    size_t start = len;
+
+    for (size_t q = len_query; q > 0;)
+    {
+        if (start == 0)
+            return false;
+
+        if (fold((uint8_t)path[--start]) == (uint8_t)query[q - 1])
+            q--;
+    }
+
+    for (size_t i = start, q = 0; q < len_query; i++)
+    {
+        if (fold((uint8_t)path[i]) == (uint8_t)query[q])
+            positions[q++] = (uint32_t)i;
+    }
+
+    for (*name = (uint32_t)len; *name > 0 && path[*name - 1] != PATH_SEPARATOR;)
+        --*name;
+
+    return true;
+}
+
+#ifdef HAVE_X86
+static uint32_t lowest_bit(uint64_t x)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward64(&index, x);
+    return index;
+#else
+    return (uint32_t)__builtin_ctzll(x);
+#endif
+}
+
+static uint32_t highest_bit(uint64_t x)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanReverse64(&index, x);
+    return index;
+#else
+    return 63 - (uint32_t)__builtin_clzll(x);
+#endif
+}
+
+/*
+ * The same for paths of at most 64 bytes, which is most of them: the bytes equal to each query character are found 16
+ * at a time into a mask, and the query is lined up with a bit scan per character.  Reads up to 64 bytes past the path.
+ */
+static bool find_positions_short(const char *path, size_t len, const char *query, size_t len_query,
+    uint32_t *positions, uint32_t *name)
+{
+    __m128i blocks[4], folded[4];
+    uint64_t masks[QUICK_OPEN_QUERY_MAX];
+    uint64_t valid = len == 64 ? UINT64_MAX : (1ull << len) - 1;
+    uint64_t separators = 0;
+
+    for (int b = 0; b < 4; b++)
+    {
+        blocks[b] = _mm_loadu_si128((const __m128i *)&path[16 * b]);
+        folded[b] = _mm_or_si128(blocks[b], _mm_set1_epi8(0x20));
+        __m128i separator = _mm_cmpeq_epi8(blocks[b], _mm_set1_epi8(PATH_SEPARATOR));
+        separators |= (uint64_t)(uint16_t)_mm_movemask_epi8(separator) << (16 * b);
+    }
+
+    // Setting 0x20 turns A-Z into a-z and nothing else into a letter, so it folds case for letters of the query
+    for (size_t q = 0; q < len_query; q++)
+    {
+        uint8_t c = (uint8_t)query[q];
+        const __m128i *in = c >= 'a' && c <= 'z' ? folded : blocks;
+        __m128i needle = _mm_set1_epi8((char)c);
+        uint64_t mask = 0;
+
+        for (int b = 0; b < 4; b++)
+            mask |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(in[b], needle)) << (16 * b);
+
+        masks[q] = mask & valid;
+    }
+
+    uint64_t before = valid;
+
+    for (size_t q = len_query; q > 0; q--)
+    {
+        uint64_t candidates = masks[q - 1] & before;
+
+        if (!candidates)
+            return false;
+
+        uint32_t at = highest_bit(candidates);
+        before = (1ull << at) - 1;
+    }
+
+    uint64_t after = ~before;
+
+    for (size_t q = 0; q < len_query; q++)
+    {
+        uint32_t at = lowest_bit(masks[q] & after);
+        positions[q] = at;
+        after = at == 63 ? 0 : UINT64_MAX << (at + 1);
+    }
+
+    separators &= valid;
+    *name = separators ? highest_bit(separators) + 1 : 0;
+
+    return true;
+}
+#endif
+
+/*
+ * Lines the query up with the path as late as it can go, which favours the file name over the directories, then pulls
+ * it as tight as it goes from the first character on, and scores that.  Returns INT32_MIN if the query is not there.
+ */
+static int32_t fuzzy_score(const char *path, size_t len, const char *query, size_t len_query, uint32_t *positions)
+{
+    uint32_t name;
+
+#ifdef HAVE_X86
+    if (len <= 64 ? !find_positions_short(path, len, query, len_query, positions, &name)
+                  : !find_positions(path, len, query, len_query, positions, &name))
+        return INT32_MIN;
+#else
+    if (!find_positions(path, len, query, len_query, positions, &name))
+        return INT32_MIN;
+#endif
+
+    int32_t score = 0;
+
+    for (size_t q = 0; q < len_query; q++)
+    {
+        uint32_t i = positions[q];
+        uint8_t c = (uint8_t)path[i];
+        uint8_t before = i ? (uint8_t)path[i - 1] : PATH_SEPARATOR;
+
+        score += SCORE_MATCH;
+
+        if (before == PATH_SEPARATOR)
+            score += BONUS_SEPARATOR;
+        else if (before == '_' || before == '-' || before == '.' || before == ' ')
+            score += BONUS_WORD;
+        else if (c >= 'A' && c <= 'Z' && before >= 'a' && before <= 'z')
+            score += BONUS_CAMEL;
+
+        if (q)
+        {
+            uint32_t gap = i - positions[q - 1] - 1;
+
+            if (!gap)
+                score += BONUS_CONSECUTIVE;
+            else
+                score -= PENALTY_GAP_START + PENALTY_GAP_EXTEND * (int32_t)(gap - 1 < 16 ? gap - 1 : 16);
+        }
+
+        if (i >= name)
+            score += BONUS_NAME;
+    }
+
+    return score;
+}
+
+/* Higher scores first, then shorter paths, then whichever came first in the index. */
+static bool better(const PathIndex *index, QuickOpenMatch a, QuickOpenMatch b)
+{
+    if (a.score != b.score)
+        return a.score > b.score;
+
+    uint32_t len_a = index->offsets[a.path + 1] - index->offsets[a.path];
+    uint32_t len_b = index->offsets[b.path + 1] - index->offsets[b.path];
+
+    if (len_a != len_b)
+        return len_a < len_b;
+
+    return a.path < b.path;
+}
+
+/* Keeps the best QUICK_OPEN_MAX_RESULTS in a heap, the worst of them at the root to be pushed out first. */
+static void heap_push(const PathIndex *index, QuickOpenMatch *heap, size_t *len, QuickOpenMatch match)
+{
+    size_t i;
+
+    if (*len < QUICK_OPEN_MAX_RESULTS)
+    {
+        for (i = (*len)++; i > 0 && better(index, heap[(i - 1) / 2], match); i = (i - 1) / 2)
+            heap[i] = heap[(i - 1) / 2];
+
+        heap[i] = match;
+        return;
+    }
+
+    if (!better(index, match, heap[0]))
+        return;
+
+    for (i = 0;;)
+    {
+        size_t child = 2 * i + 1;
+
+        if (child >= *len)
+            break;
+        if (child + 1 < *len && better(index, heap[child], heap[child + 1]))
+            child++;
+        if (!better(index, match, heap[child]))
+            break;
+
+        heap[i] = heap[child];
+        i = child;
+    }
+
+    heap[i] = match;
+}
+
+/* Matches the paths of one chunk, writing those that match to its part of the output.  Returns how many did. */
+static size_t match_chunk(const QuickOpen *qo, size_t chunk, QuickOpenMatch *heap, size_t *len_heap)
+{
+    const Job *job = &qo->job;
+    const PathIndex *index = &qo->index;
+    size_t begin = chunk * CHUNK;
+    size_t end = begin + CHUNK < job->len_input ? begin + CHUNK : job->len_input;
+    uint32_t *out = &job->output[begin];
+    uint32_t positions[QUICK_OPEN_QUERY_MAX];
+    size_t n = 0;
+
+    for (size_t i = begin; i < end; i++)
+    {
+        uint32_t path = job->input ? job->input[i] : (uint32_t)i;
+
+        if ((index->masks[path] & job->mask) != job->mask)
+            continue;
+
+        uint32_t offset = index->offsets[path];
+        int32_t score = fuzzy_score(&index->text[offset], index->offsets[path + 1] - offset, job->query,
+                                    job->len_query, positions);
+
+        if (score == INT32_MIN)
+            continue;
+
+        out[n++] = path;
+        heap_push(index, heap, len_heap, (QuickOpenMatch){path, score});
+    }
+
+    return n;
+}
+
+/* Moves the chunks' matches together and keeps them as the level of the query.  The lock must be held. */
+static void finish_job(QuickOpen *qo)
+{
+    Job *job = &qo->job;
+    size_t len = 0;
+
+    for (size_t c = 0; c < job->nchunks; c++)
+    {
+        memmove(&job->output[len], &job->output[c * CHUNK], job->chunk_counts[c] * sizeof *job->output);
+        len += job->chunk_counts[c];
+    }
+
+    Level *level = &qo->levels[qo->nlevels++];
+
+    *level = (Level){.len_query = job->len_query, .paths = job->output, .len = len, .ntop = job->ntop};
+    memcpy(level->top, job->top, job->ntop * sizeof *job->top);
+
+    free(job->chunk_counts);
+    job->output = NULL;
+    job->chunk_counts = NULL;
+    qo->running = false;
+
+    platform_cond_broadcast(qo->settled);
+}
+
+static void worker_main(void *arg)
+{
+    QuickOpen *qo = arg;
+    QuickOpenMatch heap[QUICK_OPEN_MAX_RESULTS];
+
+    platform_mutex_lock(qo->mutex);
+
+    for (;;)
+    {
+        while (!qo->stop && !(qo->running && qo->job.next_chunk < qo->job.nchunks))
+            platform_cond_wait(qo->wake, qo->mutex);
+
+        if (qo->stop)
+            break;
+
+        size_t chunk = qo->job.next_chunk++;
+        uint64_t generation = qo->generation;
+        size_t len_heap = 0;
+
+        qo->busy++;
+        platform_mutex_unlock(qo->mutex);
+
+        size_t n = match_chunk(qo, chunk, heap, &len_heap);
+
+        platform_mutex_lock(qo->mutex);
+        qo->busy--;
+
+        if (generation == qo->generation)
+        {
+            Job *job = &qo->job;
+
+            for (size_t i = 0; i < len_heap; i++)
+                heap_push(&qo->index, job->top, &job->ntop, heap[i]);
+
+            job->chunk_counts[chunk] = (uint32_t)n;
+            job->nmatches += n;
+
+            if (++job->chunks_done == job->nchunks)
+                finish_job(qo);
+        }
+        else if (!qo->busy)
+        {
+            platform_cond_broadcast(qo->settled);
+        }
+    }
+
+    platform_mutex_unlock(qo->mutex);
+}
+
+/* Stops the job in flight and waits until no worker is still on one of its chunks.  The lock must be held. */
+static void drop_job(QuickOpen *qo)
+{
+    if (qo->running)
+    {
+        qo->generation++;
+        qo->running = false;
+    }
+
+    while (qo->busy)
+        platform_cond_wait(qo->settled, qo->mutex);
+
+    free(qo->job.output);
+    free(qo->job.chunk_counts);
+    qo->job.output = NULL;
+    qo->job.chunk_counts = NULL;
+}
+
+/* Matches the query from the deepest level it extends, or takes that level's results if it is the same query. */
+static void start_job(QuickOpen *qo)
+{
+    Job *job = &qo->job;
+    const Level *level = &qo->levels[qo->nlevels - 1];
+
+    memcpy(job->query, qo->query, qo->len_query);
+    job->len_query = qo->len_query;
+    job->mask = mask_of(qo->query, qo->len_query);
+
+    if (level->len_query == qo->len_query)
+    {
+        memcpy(job->top, level->top, level->ntop * sizeof *level->top);
+        job->ntop = level->ntop;
+        job->nmatches = level->len_query ? level->len : 0;
+        return;
+    }
+
+    job->input = level->paths;
+    job->len_input = level->len;
+    job->output = malloc((level->len ? level->len : 1) * sizeof *job->output);
+    job->nchunks = (level->len + CHUNK - 1) / CHUNK;
+    job->chunk_counts = calloc(job->nchunks ? job->nchunks : 1, sizeof *job->chunk_counts);
+    job->next_chunk = 0;
+    job->chunks_done = 0;
+    job->ntop = 0;
+    job->nmatches = 0;
+
+    if (!job->nchunks)
+    {
+        finish_job(qo);
+        return;
+    }
+
+    qo->running = true;
+    platform_cond_broadcast(qo->wake);
+}
+
+/* Starts the workers over an index, the lock must be held if they are running already. */
+static void set_index(QuickOpen *qo, PathIndex *index)
+{
+    qo->index = *index;
+    qo->has_index = true;
+    qo->levels[0].len = index->len;
+
+    if (qo->len_query)
+        start_job(qo);
+
+    platform_cond_broadcast(qo->settled);
+}
+
+static void index_main(void *arg)
+{
+    QuickOpen *qo = arg;
+    WorkspaceSnapshot snapshot;
+    PathIndex index;
+
+    ws_index(&snapshot, qo->root, 0, qo->ignore);
+    path_index_build(&index, &snapshot);
+    ws_snapshot_free(&snapshot);
+
+    platform_mutex_lock(qo->mutex);
+    set_index(qo, &index);
+    platform_mutex_unlock(qo->mutex);
+}
+
+static QuickOpen *create(int nthreads)
+{
+    QuickOpen *qo = calloc(1, sizeof *qo);
+
+    if (nthreads <= 0)
+        nthreads = platform_cpu_count();
+
+    qo->mutex = platform_mutex_create();
+    qo->wake = platform_cond_create();
+    qo->settled = platform_cond_create();
+    qo->levels = calloc(QUICK_OPEN_QUERY_MAX + 1, sizeof *qo->levels);
+    qo->nlevels = 1;
+    qo->workers = calloc(nthreads, sizeof *qo->workers);
+
+    for (int i = 0; i < nthreads; i++)
+    {
+        qo->workers[i] = platform_thread_create(worker_main, qo);
+        if (qo->workers[i])
+            qo->nworkers = i + 1;
+    }
+
+    return qo;
+}
+
+QuickOpen *qo_create(const char *root, IgnoreCache *ignore, int nthreads)
+{
+    QuickOpen *qo = create(nthreads);
+    size_t len_root = strlen(root);
+
+    qo->root = malloc(len_root + 1);
+    memcpy(qo->root, root, len_root + 1);
+    qo->ignore = ignore;
+    qo->indexer = platform_thread_create(index_main, qo);
+
+    return qo;
+}
+
+QuickOpen *qo_create_with_index(PathIndex *index, int nthreads)
+{
+    QuickOpen *qo = create(nthreads);
+
+    platform_mutex_lock(qo->mutex);
+    set_index(qo, index);
+    platform_mutex_unlock(qo->mutex);
+
+    return qo;
+}
+
+void qo_destroy(QuickOpen *qo)
+{
+    if (qo->indexer)
+        platform_thread_join(qo->indexer);
+
+    platform_mutex_lock(qo->mutex);
+    drop_job(qo);
+    qo->stop = true;
+    platform_cond_broadcast(qo->wake);
+    platform_mutex_unlock(qo->mutex);
+
+    for (int i = 0; i < qo->nworkers; i++)
+        if (qo->workers[i])
+            platform_thread_join(qo->workers[i]);
+
+    for (size_t i = 0; i < qo->nlevels; i++)
+        free(qo->levels[i].paths);
+
+    path_index_free(&qo->index);
+    free(qo->levels);
+    free(qo->workers);
+    free(qo->root);
+    platform_cond_destroy(qo->settled);
+    platform_cond_destroy(qo->wake);
+    platform_mutex_destroy(qo->mutex);
+    free(qo);
+}
+
+bool qo_ready(QuickOpen *qo)
+{
+    platform_mutex_lock(qo->mutex);
+    bool ready = qo->has_index;
+    platform_mutex_unlock(qo->mutex);
+
+    return ready;
+}
+
+const PathIndex *qo_index(const QuickOpen *qo)
+{
+    return &qo->index;
+}
+
+void qo_set_query(QuickOpen *qo, const char *query, size_t len)
+{
+    if (len > QUICK_OPEN_QUERY_MAX)
+        len = QUICK_OPEN_QUERY_MAX;
+
+    platform_mutex_lock(qo->mutex);
+    drop_job(qo);
+
+    // Levels stay for as long as their query starts the new one, the ones still there are prefixes of it
+    for (size_t i = 0; i < len && i < qo->len_query; i++)
+    {
+        if (fold((uint8_t)query[i]) == (uint8_t)qo->query[i])
+            continue;
+
+        while (qo->nlevels > 1 && qo->levels[qo->nlevels - 1].len_query > i)
+            free(qo->levels[--qo->nlevels].paths);
+        break;
+    }
+
+    while (qo->nlevels > 1 && qo->levels[qo->nlevels - 1].len_query > len)
+        free(qo->levels[--qo->nlevels].paths);
+
+    for (size_t i = 0; i < len; i++)
+        qo->query[i] = (char)fold((uint8_t)query[i]);
+    qo->len_query = len;
+    qo->job.ntop = 0;
+    qo->job.nmatches = 0;
+
+    if (qo->has_index)
+        start_job(qo);
+
+    platform_mutex_unlock(qo->mutex);
+}
+
+bool qo_poll(QuickOpen *qo, QuickOpenMatch *out, size_t max, size_t *nout, size_t *nmatches)
+{
+    QuickOpenMatch top[QUICK_OPEN_MAX_RESULTS];
+
+    platform_mutex_lock(qo->mutex);
+    size_t ntop = qo->job.ntop;
+    memcpy(top, qo->job.top, ntop * sizeof *top);
+    *nmatches = qo->job.nmatches;
+    bool done = qo->has_index && !qo->running;
+    platform_mutex_unlock(qo->mutex);
+
+    // The heap comes out best first by insertion, there are only ever a hundred of them
+    for (size_t i = 1; i < ntop; i++)
+    {
+        QuickOpenMatch match = top[i];
+        size_t j = i;
+
+        for (; j > 0 && better(&qo->index, match, top[j - 1]); j--)
+            top[j] = top[j - 1];
+
+        top[j] = match;
+    }
+
+    *nout = ntop < max ? ntop : max;
+    memcpy(out, top, *nout * sizeof *out);
+
+    return done;
+}
+
+void qo_wait(QuickOpen *qo)
+{
+    platform_mutex_lock(qo->mutex);
+
+    while (!qo->has_index || qo->running)
+        platform_cond_wait(qo->settled, qo->mutex);
+
+    platform_mutex_unlock(qo->mutex);
+}
+
+size_t qo_positions(QuickOpen *qo, uint32_t path, uint32_t *positions, size_t max)
+{
+    uint32_t all[QUICK_OPEN_QUERY_MAX];
+    String text = path_index_get(&qo->index, path);
+
+    if (fuzzy_score(text.data, text.length, qo->query, qo->len_query, all) == INT32_MIN)
+        return 0;
+
+    size_t n = qo->len_query < max ? qo->len_query : max;
+    memcpy(positions, all, n * sizeof *positions);
+
+    return n;
+}
@@ -0,0 +1,196 @@
+#include "theeditor.h"
+
+#include <stdio.h>
+#include <string.h>
+
+/*
+ * A recording is text, one event a line: the frame it came before, the seconds since recording started, then its kind
+ * and arguments, the same numbers the GLFW callback was given.
+ *
+ *     120 2.0153 cursor 240.5 310
+ *     120 2.0153 button 0 1 0
+ *     121 2.0321 scroll 0 -1
+ *     130 2.1802 key 265 328 1 0
+ *     131 2.1950 char 97
+ *
+ * Lines starting with # are comments, so scripts of sessions can be written by hand in the same form.
+ */
+#define INPUT_HEADER "# theeditor input 1\n"
+#define INPUT_LINE_MAX 256
+
+static const char *const input_kind_names[] = {
+    [INPUT_CURSOR] = "cursor",
+    [INPUT_BUTTON] = "button",
+    [INPUT_SCROLL] = "scroll",
+    [INPUT_KEY] = "key",
+    [INPUT_CHAR] = "char",
+};
+
+const char *input_kind_name(InputKind kind)
+{
+    return input_kind_names[kind];
+}
+
+struct InputRecording {
+    FILE *file;
+};
+
+struct InputReplay {
+    InputEvent *events;
+    size_t len_events, next;
+};
+
+InputRecording *input_record_start(const char *path)
+{
+    FILE *file = fopen(path, "w");
+
+    if (!file)
+        return NULL;
+
+    InputRecording *rec = malloc(sizeof *rec);
+    rec->file = file;
+    fputs(INPUT_HEADER, file);
+
+    return rec;
+}
+
+void input_record(InputRecording *rec, const InputEvent *event)
+{
+    fprintf(rec->file, "%llu %.4f %s ", (unsigned long long)event->frame, event->time, input_kind_names[event->kind]);
+
+    switch (event->kind)
+    {
+    case INPUT_CURSOR:
+    case INPUT_SCROLL:
+        fprintf(rec->file, "%.9g %.9g\n", event->x, event->y);
+        break;
+    case INPUT_BUTTON:
+        fprintf(rec->file, "%d %d %d\n", event->key, event->action, event->mods);
+        break;
+    case INPUT_KEY:
+        fprintf(rec->file, "%d %d %d %d\n", event->key, event->scancode, event->action, event->mods);
+        break;
+    case INPUT_CHAR:
+        fprintf(rec->file, "%lu\n", (unsigned long)event->codepoint);
+        break;
+    }
+}
+
+void input_record_stop(InputRecording *rec)
+{
+    fclose(rec->file);
+    free(rec);
+}
+
+/* Reads the arguments of an event of the kind named.  Returns false if the kind is unknown or any are missing. */
+static bool parse_event(const char *kind, const char *args, InputEvent *event)
+{
+    unsigned long codepoint;
+
+    for (size_t k = 0; k < NUM_INPUT_KINDS; k++)
+    {
+        if (strcmp(kind, input_kind_names[k]))
+            continue;
+
+        event->kind = (InputKind)k;
+
+        switch (event->kind)
+        {
+        case INPUT_CURSOR:
+        case INPUT_SCROLL:
+            return sscanf(args, "%lf %lf", &event->x, &event->y) == 2;
+        case INPUT_BUTTON:
+            return sscanf(args, "%d %d %d", &event->key, &event->action, &event->mods) == 3;
+        case INPUT_KEY:
+            return sscanf(args, "%d %d %d %d", &event->key, &event->scancode, &event->action, &event->mods) == 4;
+        case INPUT_CHAR:
+            if (sscanf(args, "%lu", &codepoint) != 1)
+                return false;
+            event->codepoint = (uint32_t)codepoint;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+InputReplay *input_replay_load(const char *path)
+{
+    FILE *file = fopen(path, "r");
+    char line[INPUT_LINE_MAX];
+    size_t cap_events = 256, number = 0;
+
+    if (!file)
+    {
+        fprintf(stderr, "Could not open the input recording %s\n", path);
+        return NULL;
+    }
+
+    InputReplay *replay = calloc(1, sizeof *replay);
+    replay->events = malloc(cap_events * sizeof *replay->events);
+
+    while (fgets(line, sizeof line, file))
+    {
+        InputEvent event = {0};
+        unsigned long long frame;
+        char kind[16];
+        int end;
+
+        number++;
+
+        size_t skip = strspn(line, " \t");
+        if (line[skip] == '#' || line[skip] == '\n' || line[skip] == '\r' || !line[skip])
+            continue;
+
+        if (sscanf(line, "%llu %lf %15s %n", &frame, &event.time, kind, &end) != 3
+            || !parse_event(kind, &line[end], &event))
+        {
+            fprintf(stderr, "%s:%zu: not an input event\n", path, number);
+            goto failure;
+        }
+
+        event.frame = frame;
+
+        // Events are fed in the order they are written, which has to be the order of their frames
+        if (replay->len_events && event.frame < replay->events[replay->len_events - 1].frame)
+        {
+            fprintf(stderr, "%s:%zu: event for frame %llu comes after a later frame's\n", path, number, frame);
+            goto failure;
+        }
+
+        if (replay->len_events == cap_events)
+        {
+            cap_events *= 2;
+            replay->events = realloc(replay->events, cap_events * sizeof *replay->events);
+        }
+        replay->events[replay->len_events++] = event;
+    }
+
+    fclose(file);
+    return replay;
+
+failure:
+    fclose(file);
+    input_replay_destroy(replay);
+    return NULL;
+}
+
+void input_replay_destroy(InputReplay *replay)
+{
+    free(replay->events);
+    free(replay);
+}
+
+bool input_replay_next(InputReplay *replay, uint64_t frame, InputEvent *event)
+{
+    if (replay->next == replay->len_events || replay->events[replay->next].frame > frame)
+        return false;
+
+    *event = replay->events[replay->next++];
+    return true;
+}
+
+uint64_t input_replay_last_frame(const InputReplay *replay)
+{
+    return replay->len_events ? replay->events[replay->len_events - 1].frame : 0;
+}
@@ -0,0 +1,445 @@
+#include "theeditor.h"
+
+#include <string.h>
+
+// Lines are packed together until they come to about this much, which is also what is unpacked to show any of them
+#define BLOCK_SIZE (64u << 10)
+// Enough for scrolling back through a screen that straddles two blocks, and for going back and forth over one
+#define CACHED_BLOCKS 4
+// Never an attribute byte, so it ends a line's runs
+#define END_OF_LINE 0xff
+
+/*
+ * A line is its runs of cells with the same colors and attributes, each being the attributes, foreground and
+ * background, the length of its text as a varint, and the text as UTF-8, then END_OF_LINE.  The blanks at the end of
+ * a line are left off, and colors the attributes say are the defaults are written as 0, so lines that look the same
+ * are the same bytes and pack well.
+ */
+typedef struct {
+    uint64_t first_line;
+    uint32_t nlines;
+    uint32_t len_raw, len_packed;
+    uint8_t *packed;
+} Block;
+
+typedef struct {
+    // The first line of the block this holds, UINT64_MAX for none
+    uint64_t first_line;
+    uint8_t *raw;
+    size_t cap_raw;
+    uint32_t *offsets;
+    size_t cap_offsets;
+    uint64_t used;
+} CachedBlock;
+
+/*
+ * Packed blocks are kept oldest first, those before `first_block` having been evicted, and their first lines are
+ * the index that is searched to find the block a line is in.  The lines after the last block are the open one, kept
+ * unpacked with each line's offset until there are enough of them to pack.
+ */
+struct Scrollback {
+    size_t budget;
+    Block *blocks;
+    size_t first_block, len_blocks, cap_blocks;
+    size_t len_packed;
+    uint8_t *open;
+    size_t len_open, cap_open;
+    uint32_t *open_offsets;
+    uint32_t open_lines, cap_open_lines;
+    uint64_t end_line;
+    // Where a block is packed into before it is copied out at its size
+    uint8_t *scratch;
+    size_t cap_scratch;
+    CachedBlock cache[CACHED_BLOCKS];
+    uint64_t clock;
+};
+
+static uint8_t *put_varint(uint8_t *out, uint32_t value)
+{
+    for (; value >= 0x80; value >>= 7)
+        *out++ = (uint8_t)(value | 0x80);
+    *out++ = (uint8_t)value;
+
+    return out;
+}
+
+static const uint8_t *get_varint(const uint8_t *in, uint32_t *value)
+{
+    *value = 0;
+
+    for (int shift = 0;; shift += 7)
+    {
+        uint8_t b = *in++;
+        *value |= (uint32_t)(b & 0x7f) << shift;
+        if (!(b & 0x80))
+            return in;
+    }
+}
+
+static uint8_t *put_utf8(uint8_t *out, uint32_t c)
+{
+    if (c < 0x80)
+    {
+        *out++ = (uint8_t)c;
+    }
+    else if (c < 0x800)
+    {
+        *out++ = (uint8_t)(0xc0 | c >> 6);
+        *out++ = (uint8_t)(0x80 | (c & 0x3f));
+    }
+    else if (c < 0x10000)
+    {
+        *out++ = (uint8_t)(0xe0 | c >> 12);
+        *out++ = (uint8_t)(0x80 | (c >> 6 & 0x3f));
+        *out++ = (uint8_t)(0x80 | (c & 0x3f));
+    }
+    else
+    {
+        *out++ = (uint8_t)(0xf0 | c >> 18);
+        *out++ = (uint8_t)(0x80 | (c >> 12 & 0x3f));
+        *out++ = (uint8_t)(0x80 | (c >> 6 & 0x3f));
+        *out++ = (uint8_t)(0x80 | (c & 0x3f));
+    }
+
+    return out;
+}
+
+/* Reads back what put_utf8 wrote, which needs none of the checks text from elsewhere does. */
+static const uint8_t *get_utf8(const uint8_t *in, uint32_t *c)
+{
+    uint8_t b = *in++;
+
+    if (b < 0x80)
+    {
+        *c = b;
+        return in;
+    }
+
+    int more = b >= 0xf0 ? 3 : b >= 0xe0 ? 2 : 1;
+    *c = b & (0x3f >> more);
+    while (more--)
+        *c = *c << 6 | (*in++ & 0x3f);
+
+    return in;
+}
+
+/* A cell with the colors the attributes leave unused set to 0. */
+static TermCell canonical(TermCell cell)
+{
+    if (cell.attributes & CELL_DEFAULT_FG)
+        cell.fg = 0;
+    if (cell.attributes & CELL_DEFAULT_BG)
+        cell.bg = 0;
+    cell.unused = 0;
+
+    return cell;
+}
+
+static bool is_blank(TermCell cell)
+{
+    return cell.codepoint == ' ' && cell.attributes == (CELL_DEFAULT_FG | CELL_DEFAULT_BG);
+}
+
+/* The most bytes a line of this many cells can take, every cell a run of a four-byte character. */
+static size_t max_line_size(int columns)
+{
+    return (size_t)columns * 12 + 1;
+}
+
+static size_t encode_line(const TermCell *cells, int columns, uint8_t *out)
+{
+    uint8_t *start = out;
+    int n = columns;
+
+    while (n && is_blank(cells[n - 1]))
+        n--;
+
+    for (int x = 0; x < n;)
+    {
+        TermCell style = canonical(cells[x]);
+        uint8_t text[4 * 256];
+        uint8_t *end = text;
+
+        // Runs are cut at 256 cells so their text always fits
+        int run_end = x + 256 < n ? x + 256 : n;
+        for (; x < run_end; x++)
+        {
+            TermCell cell = canonical(cells[x]);
+            if (cell.fg != style.fg || cell.bg != style.bg || cell.attributes != style.attributes)
+                break;
+            end = put_utf8(end, cell.codepoint);
+        }
+
+        *out++ = style.attributes;
+        *out++ = style.fg;
+        *out++ = style.bg;
+        out = put_varint(out, (uint32_t)(end - text));
+        memcpy(out, text, (size_t)(end - text));
+        out += end - text;
+    }
+
+    *out++ = END_OF_LINE;
+
+    return (size_t)(out - start);
+}
+
+static void decode_line(const uint8_t *in, TermCell *cells, int columns)
+{
+    int x = 0;
+
+    while (*in != END_OF_LINE)
+    {
+        TermCell style = {.attributes = in[0], .fg = in[1], .bg = in[2]};
+        uint32_t len;
+
+        in = get_varint(in + 3, &len);
+
+        const uint8_t *end = in + len;
+        while (in < end)
+        {
+            uint32_t c;
+            in = get_utf8(in, &c);
+
+            if (x < columns)
+            {
+                cells[x] = style;
+                cells[x++].codepoint = c;
+            }
+        }
+    }
+
+    for (; x < columns; x++)
+        cells[x] = (TermCell){.codepoint = ' ', .attributes = CELL_DEFAULT_FG | CELL_DEFAULT_BG};
+}
+
+static const uint8_t *skip_line(const uint8_t *in)
+{
+    while (*in != END_OF_LINE)
+    {
+        uint32_t len;
+        in = get_varint(in + 3, &len);
+        in += len;
+    }
+
+    return in + 1;
+}
+
+Scrollback *scrollback_create(size_t budget)
+{
+    Scrollback *sb = malloc(sizeof *sb);
+
+    *sb = (Scrollback){.budget = budget};
+
+    for (int i = 0; i < CACHED_BLOCKS; i++)
+        sb->cache[i].first_line = UINT64_MAX;
+
+    return sb;
+}
+
+void scrollback_destroy(Scrollback *sb)
+{
+    for (size_t i = sb->first_block; i < sb->len_blocks; i++)
+        free(sb->blocks[i].packed);
+
+    for (int i = 0; i < CACHED_BLOCKS; i++)
+    {
+        free(sb->cache[i].raw);
+        free(sb->cache[i].offsets);
+    }
+
+    free(sb->blocks);
+    free(sb->open);
+    free(sb->open_offsets);
+    free(sb->scratch);
+    free(sb);
+}
+
+/* Drops the oldest blocks until what is kept fits the budget, the open block always staying. */
+static void evict(Scrollback *sb)
+{
+    while (sb->first_block < sb->len_blocks && scrollback_memory(sb) > sb->budget)
+    {
+        Block *block = &sb->blocks[sb->first_block++];
+
+        sb->len_packed -= block->len_packed;
+        free(block->packed);
+    }
+
+    // Moved down once half the array is evicted ones, which keeps it a copy per block on average
+    if (sb->first_block && sb->first_block * 2 >= sb->len_blocks)
+    {
+        memmove(sb->blocks, &sb->blocks[sb->first_block], (sb->len_blocks - sb->first_block) * sizeof *sb->blocks);
+        sb->len_blocks -= sb->first_block;
+        sb->first_block = 0;
+    }
+}
+
+static void pack_open(Scrollback *sb)
+{
+    size_t bound = lz_bound(sb->len_open);
+
+    if (bound > sb->cap_scratch)
+    {
+        sb->cap_scratch = bound;
+        sb->scratch = realloc(sb->scratch, bound);
+    }
+
+    size_t len_packed = lz_compress(sb->open, sb->len_open, sb->scratch);
+
+    if (sb->len_blocks == sb->cap_blocks)
+    {
+        sb->cap_blocks = sb->cap_blocks ? 2 * sb->cap_blocks : 64;
+        sb->blocks = realloc(sb->blocks, sb->cap_blocks * sizeof *sb->blocks);
+    }
+
+    Block *block = &sb->blocks[sb->len_blocks++];
+
+    *block = (Block){
+        .first_line = sb->end_line - sb->open_lines,
+        .nlines = sb->open_lines,
+        .len_raw = (uint32_t)sb->len_open,
+        .len_packed = (uint32_t)len_packed,
+        .packed = malloc(len_packed),
+    };
+    memcpy(block->packed, sb->scratch, len_packed);
+
+    sb->len_packed += len_packed;
+    sb->len_open = 0;
+    sb->open_lines = 0;
+
+    evict(sb);
+}
+
+void scrollback_push(Scrollback *sb, const TermCell *cells, int columns)
+{
+    size_t most = max_line_size(columns);
+
+    if (sb->open_lines && sb->len_open + most > BLOCK_SIZE)
+        pack_open(sb);
+
+    if (sb->len_open + most > sb->cap_open)
+    {
+        sb->cap_open = sb->len_open + most > BLOCK_SIZE ? sb->len_open + most : BLOCK_SIZE;
+        sb->open = realloc(sb->open, sb->cap_open);
+    }
+
+    if (sb->open_lines == sb->cap_open_lines)
+    {
+        sb->cap_open_lines = sb->cap_open_lines ? 2 * sb->cap_open_lines : 1024;
+        sb->open_offsets = realloc(sb->open_offsets, sb->cap_open_lines * sizeof *sb->open_offsets);
+    }
+
+    sb->open_offsets[sb->open_lines++] = (uint32_t)sb->len_open;
+    sb->len_open += encode_line(cells, columns, &sb->open[sb->len_open]);
+    sb->end_line++;
+}
+
+void scrollback_range(const Scrollback *sb, uint64_t *first, uint64_t *end)
+{
+    *first = sb->first_block < sb->len_blocks ? sb->blocks[sb->first_block].first_line : sb->end_line - sb->open_lines;
+    *end = sb->end_line;
+}
+
+/* The last block starting at or before the line, by binary search of their first lines. */
+static const Block *find_block(const Scrollback *sb, uint64_t line)
+{
+    size_t low = sb->first_block, high = sb->len_blocks;
+
+    while (high - low > 1)
+    {
+        size_t middle = low + (high - low) / 2;
+
+        if (sb->blocks[middle].first_line <= line)
+            low = middle;
+        else
+            high = middle;
+    }
+
+    return &sb->blocks[low];
+}
+
+/* The block unpacked with the offset of each of its lines, from the cache or into its least recently used entry. */
+static const CachedBlock *unpack(Scrollback *sb, const Block *block)
+{
+    CachedBlock *entry = &sb->cache[0];
+
+    for (int i = 0; i < CACHED_BLOCKS; i++)
+    {
+        if (sb->cache[i].first_line == block->first_line)
+        {
+            sb->cache[i].used = ++sb->clock;
+            return &sb->cache[i];
+        }
+
+        if (sb->cache[i].used < entry->used)
+            entry = &sb->cache[i];
+    }
+
+    if (block->len_raw > entry->cap_raw)
+    {
+        entry->cap_raw = block->len_raw;
+        entry->raw = realloc(entry->raw, entry->cap_raw);
+    }
+    if (block->nlines > entry->cap_offsets)
+    {
+        entry->cap_offsets = block->nlines;
+        entry->offsets = realloc(entry->offsets, entry->cap_offsets * sizeof *entry->offsets);
+    }
+
+    // Packed here from lines that were well formed, so this can only fail on a bug
+    if (!lz_decompress(block->packed, block->len_packed, entry->raw, block->len_raw))
+    {
+        entry->first_line = UINT64_MAX;
+        return NULL;
+    }
+
+    const uint8_t *at = entry->raw;
+    for (uint32_t i = 0; i < block->nlines; i++)
+    {
+        entry->offsets[i] = (uint32_t)(at - entry->raw);
+        at = skip_line(at);
+    }
+
+    entry->first_line = block->first_line;
+    entry->used = ++sb->clock;
+
+    return entry;
+}
+
+bool scrollback_line(Scrollback *sb, uint64_t line, TermCell *cells, int columns)
+{
+    uint64_t first, end;
+
+    scrollback_range(sb, &first, &end);
+
+    if (line < first || line >= end)
+        return false;
+
+    uint64_t open_first = sb->end_line - sb->open_lines;
+
+    if (line >= open_first)
+    {
+        decode_line(&sb->open[sb->open_offsets[line - open_first]], cells, columns);
+        return true;
+    }
+
+    const Block *block = find_block(sb, line);
+    const CachedBlock *entry = unpack(sb, block);
+
+    if (!entry)
+        return false;
+
+    decode_line(&entry->raw[entry->offsets[line - block->first_line]], cells, columns);
+    return true;
+}
+
+size_t scrollback_memory(const Scrollback *sb)
+{
+    size_t total = sizeof *sb + sb->len_packed + sb->cap_open + sb->cap_open_lines * sizeof *sb->open_offsets +
+                   sb->cap_blocks * sizeof *sb->blocks + sb->cap_scratch;
+
+    for (int i = 0; i < CACHED_BLOCKS; i++)
+        total += sb->cache[i].cap_raw + sb->cache[i].cap_offsets * sizeof *sb->cache[i].offsets;
+
+    return total;
+}
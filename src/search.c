@@ -0,0 +1,1378 @@
+#include "theeditor.h"
+
+#include <assert.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <immintrin.h>
+#define HAVE_X86
+#ifdef _MSC_VER
+#include <intrin.h>
+// MSVC takes AVX2 intrinsics anywhere, GCC and Clang only in functions built for it
+#define TARGET_AVX2
+#else
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+#define NOT_FOUND SIZE_MAX
+// Bounds on what a pattern can compile to, `x{1000}` already makes a thousand copies of x
+#define MAX_REPEAT 1000
+#define MAX_PROGRAM (1 << 16)
+// Regular expressions look at a line at a time, this much of the document is read in one go
+#define SCAN_WINDOW (1 << 20)
+
+typedef size_t (*FindLiteral)(const char *text, size_t len, const char *needle, size_t len_needle, bool ignore_case);
+
+typedef enum {
+    OP_BYTE,
+    // A letter in either case
+    OP_FOLDED,
+    OP_CLASS,
+    OP_ANY,
+    OP_SPLIT,
+    OP_JUMP,
+    OP_LINE_START,
+    OP_LINE_END,
+    OP_WORD_BOUNDARY,
+    OP_NOT_WORD_BOUNDARY,
+    OP_MATCH,
+} OpCode;
+
+typedef struct {
+    uint8_t op;
+    uint8_t byte;
+    // The class for OP_CLASS, the targets for OP_SPLIT in order of preference, the target for OP_JUMP
+    uint32_t x, y;
+} Inst;
+
+typedef struct {
+    uint8_t bits[32];
+} ByteClass;
+
+struct Search {
+    SearchFlags flags;
+    FindLiteral find;
+
+    // The pattern of a literal search, or a run of bytes every match of a regular expression has
+    char *literal;
+    size_t len_literal;
+
+    // Empty for a literal search
+    Inst *program;
+    size_t len_program;
+    ByteClass *classes;
+    size_t len_classes;
+};
+
+static bool is_word(uint8_t c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+}
+
+static bool is_letter(uint8_t c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+static uint8_t fold(uint8_t c)
+{
+    return c >= 'A' && c <= 'Z' ? c | 0x20 : c;
+}
+
+static bool equal_bytes(const char *a, const char *b, size_t len, bool ignore_case)
+{
+    if (!ignore_case)
+        return memcmp(a, b, len) == 0;
+
+    for (size_t i = 0; i < len; i++)
+        if (fold((uint8_t)a[i]) != fold((uint8_t)b[i]))
+            return false;
+
+    return true;
+}
+
+static size_t find_scalar(const char *text, size_t len, const char *needle, size_t len_needle, bool ignore_case)
+{
+    if (len_needle > len)
+        return NOT_FOUND;
+
+    uint8_t first = fold((uint8_t)needle[0]);
+
+    for (size_t i = 0; i <= len - len_needle; i++)
+    {
+        if (!ignore_case)
+        {
+            const char *c = memchr(&text[i], needle[0], len - len_needle - i + 1);
+            if (!c)
+                break;
+            i = (size_t)(c - text);
+        }
+        else if (fold((uint8_t)text[i]) != first)
+        {
+            continue;
+        }
+
+        if (equal_bytes(&text[i + 1], &needle[1], len_needle - 1, ignore_case))
+            return i;
+    }
+
+    return NOT_FOUND;
+}
+
+#ifdef HAVE_X86
+static uint32_t lowest_bit(uint32_t x)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, x);
+    return index;
+#else
+    return __builtin_ctz(x);
+#endif
+}
+
+// Bytes of source code from the most common to the least, anything not here is taken to be rarer still
+static const char common_bytes[] = " etaoinsrlcdu_hpmf()\n;,.=g\t>ybx{}*/\"'-vwk0123456789#<[]&+:!|zqj%\\?";
+
+/* Higher for bytes that turn up less often. */
+static size_t rarity(const char *needle, size_t i, bool ignore_case)
+{
+    uint8_t c = ignore_case ? fold((uint8_t)needle[i]) : (uint8_t)needle[i];
+    const char *at = memchr(common_bytes, c, sizeof common_bytes - 1);
+
+    return at ? (size_t)(at - common_bytes) : sizeof common_bytes;
+}
+
+/* The two positions of the needle whose bytes should turn up least often in text, so the filters pass the fewest. */
+static void pick_rare(const char *needle, size_t len_needle, bool ignore_case, size_t *rare1, size_t *rare2)
+{
+    size_t best1 = rarity(needle, 0, ignore_case), best2 = 0;
+
+    *rare1 = *rare2 = 0;
+
+    for (size_t i = 1; i < len_needle; i++)
+    {
+        size_t r = rarity(needle, i, ignore_case);
+
+        if (r > best1)
+        {
+            best2 = best1;
+            *rare2 = *rare1;
+            best1 = r;
+            *rare1 = i;
+        }
+        // The same byte again says nothing more, but a different one as common as the rarest still helps
+        else if (r > best2 && (r < best1 || fold((uint8_t)needle[i]) != fold((uint8_t)needle[*rare1])))
+        {
+            best2 = r;
+            *rare2 = i;
+        }
+    }
+}
+
+/*
+ * Both finders compare a block of positions against the rarest byte of the needle, at its offset in the needle, and
+ * the block at the offset of the second rarest against that byte, and only look closer where both match.  That is
+ * rare in text for most needles, so they run at about the speed of loading the text.  Letters are compared with their
+ * case bit set when case is ignored, which makes both cases of a letter equal and nothing else.
+ */
+static size_t find_sse2(const char *text, size_t len, const char *needle, size_t len_needle, bool ignore_case)
+{
+    if (len_needle > len)
+        return NOT_FOUND;
+
+    size_t last = len_needle - 1, i = 0, x, y;
+    pick_rare(needle, len_needle, ignore_case, &x, &y);
+
+    uint8_t x_byte = (uint8_t)needle[x], y_byte = (uint8_t)needle[y];
+    uint8_t x_case = ignore_case && is_letter(x_byte) ? 0x20 : 0;
+    uint8_t y_case = ignore_case && is_letter(y_byte) ? 0x20 : 0;
+
+    const __m128i x_ = _mm_set1_epi8((char)(x_byte | x_case));
+    const __m128i y_ = _mm_set1_epi8((char)(y_byte | y_case));
+    const __m128i x_or = _mm_set1_epi8((char)x_case);
+    const __m128i y_or = _mm_set1_epi8((char)y_case);
+
+    for (; i + last + 16 <= len; i += 16)
+    {
+        __m128i a = _mm_or_si128(_mm_loadu_si128((const __m128i *)&text[i + x]), x_or);
+        __m128i b = _mm_or_si128(_mm_loadu_si128((const __m128i *)&text[i + y]), y_or);
+        uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, x_), _mm_cmpeq_epi8(b, y_)));
+
+        for (; mask; mask &= mask - 1)
+        {
+            size_t at = i + lowest_bit(mask);
+            if (equal_bytes(&text[at], needle, len_needle, ignore_case))
+                return at;
+        }
+    }
+
+    size_t rest = find_scalar(&text[i], len - i, needle, len_needle, ignore_case);
+    return rest == NOT_FOUND ? NOT_FOUND : i + rest;
+}
+
+TARGET_AVX2 static size_t find_avx2(const char *text, size_t len, const char *needle, size_t len_needle,
+                                    bool ignore_case)
+{
+    if (len_needle > len)
+        return NOT_FOUND;
+
+    size_t last = len_needle - 1, i = 0, x, y;
+    pick_rare(needle, len_needle, ignore_case, &x, &y);
+
+    uint8_t x_byte = (uint8_t)needle[x], y_byte = (uint8_t)needle[y];
+    uint8_t x_case = ignore_case && is_letter(x_byte) ? 0x20 : 0;
+    uint8_t y_case = ignore_case && is_letter(y_byte) ? 0x20 : 0;
+
+    const __m256i x_ = _mm256_set1_epi8((char)(x_byte | x_case));
+    const __m256i y_ = _mm256_set1_epi8((char)(y_byte | y_case));
+    const __m256i x_or = _mm256_set1_epi8((char)x_case);
+    const __m256i y_or = _mm256_set1_epi8((char)y_case);
+
+    // Two blocks a round, with one test for whether either has a candidate
+    for (; i + last + 64 <= len; i += 64)
+    {
+        __m256i a0 = _mm256_or_si256(_mm256_loadu_si256((const __m256i *)&text[i + x]), x_or);
+        __m256i b0 = _mm256_or_si256(_mm256_loadu_si256((const __m256i *)&text[i + y]), y_or);
+        __m256i a1 = _mm256_or_si256(_mm256_loadu_si256((const __m256i *)&text[i + 32 + x]), x_or);
+        __m256i b1 = _mm256_or_si256(_mm256_loadu_si256((const __m256i *)&text[i + 32 + y]), y_or);
+        __m256i m0 = _mm256_and_si256(_mm256_cmpeq_epi8(a0, x_), _mm256_cmpeq_epi8(b0, y_));
+        __m256i m1 = _mm256_and_si256(_mm256_cmpeq_epi8(a1, x_), _mm256_cmpeq_epi8(b1, y_));
+
+        if (_mm256_testz_si256(_mm256_or_si256(m0, m1), _mm256_or_si256(m0, m1)))
+            continue;
+
+        for (int half = 0; half < 2; half++)
+        {
+            uint32_t mask = (uint32_t)_mm256_movemask_epi8(half ? m1 : m0);
+
+            for (; mask; mask &= mask - 1)
+            {
+                size_t at = i + 32 * half + lowest_bit(mask);
+                if (equal_bytes(&text[at], needle, len_needle, ignore_case))
+                    return at;
+            }
+        }
+    }
+
+    size_t rest = find_sse2(&text[i], len - i, needle, len_needle, ignore_case);
+    return rest == NOT_FOUND ? NOT_FOUND : i + rest;
+}
+#endif
+
+/* The fastest finder this processor runs, SSE2 is always there on x86-64. */
+static FindLiteral pick_finder(void)
+{
+#ifdef HAVE_X86
+    return platform_cpu_has_avx2() ? find_avx2 : find_sse2;
+#else
+    return find_scalar;
+#endif
+}
+
+typedef enum {
+    NODE_EMPTY,
+    NODE_BYTE,
+    NODE_CLASS,
+    NODE_ANY,
+    NODE_LINE_START,
+    NODE_LINE_END,
+    NODE_WORD_BOUNDARY,
+    NODE_NOT_WORD_BOUNDARY,
+    NODE_CONCAT,
+    NODE_ALTERNATE,
+    NODE_REPEAT,
+} NodeType;
+
+/* A node of a parsed pattern, children are linked through `next`. */
+typedef struct {
+    uint8_t type;
+    uint8_t byte;
+    bool greedy;
+    int min, max;
+    uint32_t class_index;
+    uint32_t first, last, next;
+} PatternNode;
+
+typedef struct {
+    const char *pattern;
+    size_t len, pos;
+    bool ignore_case;
+    bool failed;
+
+    PatternNode *nodes;
+    size_t len_nodes, cap_nodes;
+    ByteClass *classes;
+    size_t len_classes, cap_classes;
+} Parser;
+
+static uint32_t node_new(Parser *p, NodeType type)
+{
+    if (p->len_nodes == p->cap_nodes)
+    {
+        p->cap_nodes = p->cap_nodes < 16 ? 16 : 2 * p->cap_nodes;
+        p->nodes = realloc(p->nodes, p->cap_nodes * sizeof *p->nodes);
+    }
+
+    p->nodes[p->len_nodes] = (PatternNode){.type = type, .first = UINT32_MAX, .last = UINT32_MAX, .next = UINT32_MAX};
+    return (uint32_t)p->len_nodes++;
+}
+
+static void node_append(Parser *p, uint32_t parent, uint32_t child)
+{
+    if (p->nodes[parent].first == UINT32_MAX)
+        p->nodes[parent].first = child;
+    else
+        p->nodes[p->nodes[parent].last].next = child;
+
+    p->nodes[parent].last = child;
+}
+
+static uint32_t class_new(Parser *p)
+{
+    if (p->len_classes == p->cap_classes)
+    {
+        p->cap_classes = p->cap_classes < 4 ? 4 : 2 * p->cap_classes;
+        p->classes = realloc(p->classes, p->cap_classes * sizeof *p->classes);
+    }
+
+    memset(&p->classes[p->len_classes], 0, sizeof *p->classes);
+    return (uint32_t)p->len_classes++;
+}
+
+static void class_add(ByteClass *c, uint8_t lo, uint8_t hi)
+{
+    for (unsigned b = lo; b <= hi; b++)
+        c->bits[b / 8] |= (uint8_t)(1 << (b % 8));
+}
+
+static bool class_has(const ByteClass *c, uint8_t b)
+{
+    return c->bits[b / 8] & (1 << (b % 8));
+}
+
+/* Adds the class `\d`, `\w` or `\s` stands for, or its complement for the capital letter.  False for other escapes. */
+static bool class_add_escape(ByteClass *c, char e)
+{
+    ByteClass set = {0};
+
+    switch (e | 0x20)
+    {
+    case 'd':
+        class_add(&set, '0', '9');
+        break;
+    case 'w':
+        class_add(&set, 'a', 'z');
+        class_add(&set, 'A', 'Z');
+        class_add(&set, '0', '9');
+        class_add(&set, '_', '_');
+        break;
+    case 's':
+        class_add(&set, ' ', ' ');
+        class_add(&set, '\t', '\r');
+        break;
+    default:
+        return false;
+    }
+
+    // Matching is a line at a time, so not even a complement takes in a line break
+    bool negate = e >= 'A' && e <= 'Z';
+    for (size_t i = 0; i < sizeof set.bits; i++)
+        c->bits[i] |= negate ? (uint8_t)~set.bits[i] : set.bits[i];
+    c->bits['\n' / 8] &= (uint8_t)~(1 << ('\n' % 8));
+
+    return true;
+}
+
+/* The byte an escape outside of a class stands for, like `\t` or `\.`. */
+static uint8_t escape_byte(char e)
+{
+    switch (e)
+    {
+    case 'n': return '\n';
+    case 't': return '\t';
+    case 'r': return '\r';
+    case 'f': return '\f';
+    case 'v': return '\v';
+    case '0': return '\0';
+    default:  return (uint8_t)e;
+    }
+}
+
+static bool at_end(const Parser *p)
+{
+    return p->pos >= p->len;
+}
+
+static char peek(const Parser *p)
+{
+    return at_end(p) ? '\0' : p->pattern[p->pos];
+}
+
+static uint32_t parse_alternation(Parser *p);
+
+static uint32_t parse_class(Parser *p)
+{
+    uint32_t index = class_new(p);
+    ByteClass set = {0};
+    bool negate = false;
+
+    if (peek(p) == '^')
+    {
+        negate = true;
+        p->pos++;
+    }
+
+    // A bracket right at the start is taken literally, as in `[]a]`
+    for (bool first = true; !at_end(p) && (first || peek(p) != ']'); first = false)
+    {
+        uint8_t lo = (uint8_t)p->pattern[p->pos++];
+
+        if (lo == '\\')
+        {
+            if (at_end(p))
+                break;
+            char e = p->pattern[p->pos++];
+            if (class_add_escape(&set, e))
+                continue;
+            lo = escape_byte(e);
+        }
+
+        uint8_t hi = lo;
+
+        if (peek(p) == '-' && p->pos + 1 < p->len && p->pattern[p->pos + 1] != ']')
+        {
+            p->pos++;
+            hi = (uint8_t)p->pattern[p->pos++];
+
+            if (hi == '\\' && !at_end(p))
+                hi = escape_byte(p->pattern[p->pos++]);
+            if (hi < lo)
+                p->failed = true;
+        }
+
+        class_add(&set, lo, hi);
+    }
+
+    if (peek(p) != ']')
+        p->failed = true;
+    p->pos++;
+
+    // Letters are folded before the class is negated, so `[^a]` leaves out both cases
+    if (p->ignore_case)
+    {
+        for (uint8_t c = 'a'; c <= 'z'; c++)
+        {
+            if (class_has(&set, c) || class_has(&set, c & ~0x20))
+            {
+                class_add(&set, c, c);
+                class_add(&set, c & ~0x20, c & ~0x20);
+            }
+        }
+    }
+
+    for (size_t i = 0; i < sizeof set.bits; i++)
+        p->classes[index].bits[i] = negate ? (uint8_t)~set.bits[i] : set.bits[i];
+    if (negate)
+        p->classes[index].bits['\n' / 8] &= (uint8_t)~(1 << ('\n' % 8));
+
+    uint32_t node = node_new(p, NODE_CLASS);
+    p->nodes[node].class_index = index;
+    return node;
+}
+
+static uint32_t parse_atom(Parser *p)
+{
+    char c = p->pattern[p->pos++];
+    uint32_t node;
+
+    switch (c)
+    {
+    case '(':
+        // Groups only group, nothing is captured
+        if (p->pos + 1 < p->len && p->pattern[p->pos] == '?' && p->pattern[p->pos + 1] == ':')
+            p->pos += 2;
+        node = parse_alternation(p);
+        if (peek(p) != ')')
+            p->failed = true;
+        p->pos++;
+        return node;
+    case '[':
+        return parse_class(p);
+    case '.':
+        return node_new(p, NODE_ANY);
+    case '^':
+        return node_new(p, NODE_LINE_START);
+    case '$':
+        return node_new(p, NODE_LINE_END);
+    case '*':
+    case '+':
+    case '?':
+    case ')':
+        // Nothing to repeat, or a group that was never opened
+        p->failed = true;
+        return node_new(p, NODE_EMPTY);
+    case '\\':
+        if (at_end(p))
+        {
+            p->failed = true;
+            return node_new(p, NODE_EMPTY);
+        }
+
+        c = p->pattern[p->pos++];
+
+        if (c == 'b')
+            return node_new(p, NODE_WORD_BOUNDARY);
+        if (c == 'B')
+            return node_new(p, NODE_NOT_WORD_BOUNDARY);
+
+        {
+            ByteClass set = {0};
+            if (class_add_escape(&set, c))
+            {
+                node = node_new(p, NODE_CLASS);
+                p->nodes[node].class_index = class_new(p);
+                p->classes[p->nodes[node].class_index] = set;
+                return node;
+            }
+        }
+
+        c = (char)escape_byte(c);
+        break;
+    }
+
+    node = node_new(p, NODE_BYTE);
+    p->nodes[node].byte = (uint8_t)c;
+    return node;
+}
+
+/* Reads a count of `{m}`, `{m,}` or `{m,n}`, leaving the position alone if what follows is not one. */
+static bool parse_count(Parser *p, int *min, int *max)
+{
+    size_t pos = p->pos + 1;
+    int values[2] = {0, -1};
+    int nvalues = 0;
+    bool digits = false;
+
+    for (; pos < p->len; pos++)
+    {
+        char c = p->pattern[pos];
+
+        if (c >= '0' && c <= '9')
+        {
+            if (values[nvalues] < 0)
+                values[nvalues] = 0;
+            values[nvalues] = values[nvalues] * 10 + (c - '0');
+            digits = true;
+            if (values[nvalues] > MAX_REPEAT)
+            {
+                p->failed = true;
+                return false;
+            }
+        }
+        else if (c == ',' && nvalues == 0 && digits)
+        {
+            nvalues = 1;
+        }
+        else if (c == '}' && digits)
+        {
+            break;
+        }
+        else
+        {
+            // Not a count, the brace is a literal
+            return false;
+        }
+    }
+
+    if (pos >= p->len)
+        return false;
+
+    *min = values[0];
+    *max = nvalues == 0 ? values[0] : values[1];
+    p->pos = pos + 1;
+
+    if (*max >= 0 && *max < *min)
+        p->failed = true;
+
+    return true;
+}
+
+static uint32_t parse_repeat(Parser *p)
+{
+    uint32_t atom = parse_atom(p);
+
+    while (!at_end(p))
+    {
+        int min, max;
+        char c = peek(p);
+
+        if (c == '*')
+            min = 0, max = -1, p->pos++;
+        else if (c == '+')
+            min = 1, max = -1, p->pos++;
+        else if (c == '?')
+            min = 0, max = 1, p->pos++;
+        else if (c != '{' || !parse_count(p, &min, &max))
+            break;
+
+        uint32_t node = node_new(p, NODE_REPEAT);
+        p->nodes[node].min = min;
+        p->nodes[node].max = max;
+        p->nodes[node].greedy = true;
+        node_append(p, node, atom);
+
+        if (peek(p) == '?')
+        {
+            p->nodes[node].greedy = false;
+            p->pos++;
+        }
+
+        atom = node;
+    }
+
+    return atom;
+}
+
+static uint32_t parse_concatenation(Parser *p)
+{
+    uint32_t node = node_new(p, NODE_CONCAT);
+
+    while (!at_end(p) && peek(p) != '|' && peek(p) != ')' && !p->failed)
+    {
+        uint32_t child = parse_repeat(p);
+
+        // A group inside a sequence is part of the sequence, which keeps the literal runs in it whole
+        if (p->nodes[child].type == NODE_CONCAT)
+        {
+            for (uint32_t c = p->nodes[child].first, next; c != UINT32_MAX; c = next)
+            {
+                next = p->nodes[c].next;
+                p->nodes[c].next = UINT32_MAX;
+                node_append(p, node, c);
+            }
+        }
+        else
+        {
+            node_append(p, node, child);
+        }
+    }
+
+    return node;
+}
+
+static uint32_t parse_alternation(Parser *p)
+{
+    uint32_t first = parse_concatenation(p);
+
+    if (peek(p) != '|')
+        return first;
+
+    uint32_t node = node_new(p, NODE_ALTERNATE);
+    node_append(p, node, first);
+
+    while (peek(p) == '|' && !p->failed)
+    {
+        p->pos++;
+        node_append(p, node, parse_concatenation(p));
+    }
+
+    return node;
+}
+
+typedef struct {
+    const Parser *parser;
+    Inst *program;
+    size_t len, cap;
+    bool failed;
+} Compiler;
+
+static uint32_t emit(Compiler *c, OpCode op)
+{
+    if (c->len == MAX_PROGRAM)
+    {
+        c->failed = true;
+        return (uint32_t)c->len - 1;
+    }
+
+    if (c->len == c->cap)
+    {
+        c->cap = c->cap < 32 ? 32 : 2 * c->cap;
+        c->program = realloc(c->program, c->cap * sizeof *c->program);
+    }
+
+    c->program[c->len] = (Inst){.op = (uint8_t)op};
+    return (uint32_t)c->len++;
+}
+
+static void compile_node(Compiler *c, uint32_t index)
+{
+    const PatternNode *node = &c->parser->nodes[index];
+
+    switch (node->type)
+    {
+    case NODE_EMPTY:
+        break;
+    case NODE_BYTE:
+    {
+        bool folded = c->parser->ignore_case && is_letter(node->byte);
+        uint32_t x = emit(c, folded ? OP_FOLDED : OP_BYTE);
+        c->program[x].byte = folded ? fold(node->byte) : node->byte;
+        break;
+    }
+    case NODE_CLASS:
+    {
+        // Emitting can move the program, the index is taken first
+        uint32_t x = emit(c, OP_CLASS);
+        c->program[x].x = node->class_index;
+        break;
+    }
+    case NODE_ANY:
+        emit(c, OP_ANY);
+        break;
+    case NODE_LINE_START:
+        emit(c, OP_LINE_START);
+        break;
+    case NODE_LINE_END:
+        emit(c, OP_LINE_END);
+        break;
+    case NODE_WORD_BOUNDARY:
+        emit(c, OP_WORD_BOUNDARY);
+        break;
+    case NODE_NOT_WORD_BOUNDARY:
+        emit(c, OP_NOT_WORD_BOUNDARY);
+        break;
+    case NODE_CONCAT:
+        for (uint32_t child = node->first; child != UINT32_MAX && !c->failed; child = c->parser->nodes[child].next)
+            compile_node(c, child);
+        break;
+    case NODE_ALTERNATE:
+    {
+        // Each branch but the last is tried first, then jumps past the rest
+        uint32_t jumps = UINT32_MAX;
+
+        for (uint32_t child = node->first; child != UINT32_MAX && !c->failed; child = c->parser->nodes[child].next)
+        {
+            if (c->parser->nodes[child].next == UINT32_MAX)
+            {
+                compile_node(c, child);
+                break;
+            }
+
+            uint32_t split = emit(c, OP_SPLIT);
+            c->program[split].x = split + 1;
+            compile_node(c, child);
+
+            // Pending jumps are chained through their targets until the end is known
+            uint32_t jump = emit(c, OP_JUMP);
+            c->program[jump].x = jumps;
+            jumps = jump;
+            c->program[split].y = (uint32_t)c->len;
+        }
+
+        while (jumps != UINT32_MAX && !c->failed)
+        {
+            uint32_t next = c->program[jumps].x;
+            c->program[jumps].x = (uint32_t)c->len;
+            jumps = next;
+        }
+        break;
+    }
+    case NODE_REPEAT:
+    {
+        for (int i = 0; i < node->min && !c->failed; i++)
+            compile_node(c, node->first);
+
+        if (node->max < 0)
+        {
+            uint32_t split = emit(c, OP_SPLIT);
+            compile_node(c, node->first);
+            uint32_t jump = emit(c, OP_JUMP);
+            c->program[jump].x = split;
+
+            c->program[split].x = node->greedy ? split + 1 : (uint32_t)c->len;
+            c->program[split].y = node->greedy ? (uint32_t)c->len : split + 1;
+            break;
+        }
+
+        // Each optional copy can stop the repetition, the stops are chained like the jumps of an alternation
+        uint32_t splits = UINT32_MAX;
+
+        for (int i = node->min; i < node->max && !c->failed; i++)
+        {
+            uint32_t split = emit(c, OP_SPLIT);
+            c->program[split].x = splits;
+            splits = split;
+            compile_node(c, node->first);
+        }
+
+        while (splits != UINT32_MAX && !c->failed)
+        {
+            uint32_t next = c->program[splits].x;
+            c->program[splits].x = node->greedy ? splits + 1 : (uint32_t)c->len;
+            c->program[splits].y = node->greedy ? (uint32_t)c->len : splits + 1;
+            splits = next;
+        }
+        break;
+    }
+    }
+}
+
+/* Finds the longest run of bytes that every match has one after another, for the finder to look for first. */
+static void extract_literal(const Parser *p, uint32_t root, char *out, size_t *len_out)
+{
+    const PatternNode *node = &p->nodes[root];
+    size_t len = 0;
+
+    *len_out = 0;
+
+    if (node->type == NODE_BYTE)
+    {
+        out[0] = (char)node->byte;
+        *len_out = 1;
+        return;
+    }
+
+    if (node->type != NODE_CONCAT)
+        return;
+
+    for (uint32_t child = node->first; ; child = p->nodes[child].next)
+    {
+        const PatternNode *c = child == UINT32_MAX ? NULL : &p->nodes[child];
+
+        // Assertions take up no bytes, the bytes on either side of one are still next to each other
+        if (c && (c->type == NODE_BYTE || c->type == NODE_LINE_START || c->type == NODE_LINE_END
+                  || c->type == NODE_WORD_BOUNDARY || c->type == NODE_NOT_WORD_BOUNDARY))
+        {
+            if (c->type == NODE_BYTE)
+                out[*len_out + len++] = (char)c->byte;
+            continue;
+        }
+
+        bool repeated_byte = c && c->type == NODE_REPEAT && c->min > 0 && p->nodes[c->first].type == NODE_BYTE;
+
+        // A byte repeated at least once ends a run with one copy of itself and starts the next one with another
+        if (repeated_byte)
+            out[*len_out + len++] = (char)p->nodes[c->first].byte;
+
+        // The longest run so far stays at the front of the buffer
+        if (len > *len_out)
+        {
+            memmove(out, &out[*len_out], len);
+            *len_out = len;
+        }
+        len = 0;
+
+        if (!c)
+            break;
+
+        if (repeated_byte)
+            out[*len_out + len++] = (char)p->nodes[c->first].byte;
+    }
+}
+
+/* Whether a pattern is just a run of bytes, which is searched for without running a program at all. */
+static bool is_plain(const Parser *p, uint32_t root)
+{
+    const PatternNode *node = &p->nodes[root];
+
+    if (node->type == NODE_BYTE)
+        return true;
+    if (node->type != NODE_CONCAT || node->first == UINT32_MAX)
+        return false;
+
+    for (uint32_t child = node->first; child != UINT32_MAX; child = p->nodes[child].next)
+        if (p->nodes[child].type != NODE_BYTE)
+            return false;
+
+    return true;
+}
+
+static bool compile_regex(Search *search, const char *pattern, size_t len)
+{
+    Parser p = {.pattern = pattern, .len = len, .ignore_case = search->flags & SEARCH_IGNORE_CASE};
+    uint32_t root = parse_alternation(&p);
+
+    if (!at_end(&p))
+        p.failed = true;
+
+    if (p.failed)
+    {
+        free(p.nodes);
+        free(p.classes);
+        return false;
+    }
+
+    // Every run of bytes is at most as long as the pattern
+    search->literal = malloc(len + 1);
+    extract_literal(&p, root, search->literal, &search->len_literal);
+
+    if (is_plain(&p, root))
+    {
+        search->flags &= ~SEARCH_REGEX;
+        free(p.nodes);
+        free(p.classes);
+        return true;
+    }
+
+    Compiler c = {.parser = &p};
+    compile_node(&c, root);
+    emit(&c, OP_MATCH);
+
+    free(p.nodes);
+
+    if (c.failed)
+    {
+        free(c.program);
+        free(p.classes);
+        return false;
+    }
+
+    search->program = c.program;
+    search->len_program = c.len;
+    search->classes = p.classes;
+    search->len_classes = p.len_classes;
+
+    return true;
+}
+
+Search *search_create(const char *pattern, size_t len, SearchFlags flags)
+{
+    if (!len)
+        return NULL;
+
+    Search *search = malloc(sizeof *search);
+    *search = (Search){.flags = flags, .find = pick_finder()};
+
+    if (flags & SEARCH_REGEX)
+    {
+        if (!compile_regex(search, pattern, len))
+        {
+            search_destroy(search);
+            return NULL;
+        }
+    }
+    else
+    {
+        search->literal = malloc(len);
+        memcpy(search->literal, pattern, len);
+        search->len_literal = len;
+    }
+
+    return search;
+}
+
+void search_destroy(Search *search)
+{
+    free(search->literal);
+    free(search->program);
+    free(search->classes);
+    free(search);
+}
+
+typedef struct {
+    uint32_t pc;
+    size_t start;
+} VmThread;
+
+/* What running a program needs, allocated once per search rather than per line. */
+typedef struct {
+    VmThread *lists[2];
+    size_t *marks;
+    uint32_t *stack;
+    size_t generation;
+} VmScratch;
+
+static void scratch_init(VmScratch *scratch, const Search *search)
+{
+    size_t n = search->len_program;
+
+    scratch->lists[0] = malloc(n * sizeof *scratch->lists[0]);
+    scratch->lists[1] = malloc(n * sizeof *scratch->lists[1]);
+    scratch->marks = calloc(n, sizeof *scratch->marks);
+    scratch->stack = malloc(n * sizeof *scratch->stack);
+    scratch->generation = 0;
+}
+
+static void scratch_uninit(VmScratch *scratch)
+{
+    free(scratch->lists[0]);
+    free(scratch->lists[1]);
+    free(scratch->marks);
+    free(scratch->stack);
+}
+
+/*
+ * Adds a thread at `pc` and everything it reaches without reading a byte, in order of preference.  The marks keep
+ * each instruction on a list once, the first thread to get there has the better claim to it.
+ */
+static void add_thread(const Search *search, VmScratch *scratch, VmThread *list, size_t *len, uint32_t pc,
+                       size_t start, const char *text, size_t end, size_t p)
+{
+    size_t height = 0;
+
+    scratch->stack[height++] = pc;
+
+    while (height)
+    {
+        pc = scratch->stack[--height];
+
+        if (scratch->marks[pc] == scratch->generation)
+            continue;
+        scratch->marks[pc] = scratch->generation;
+
+        const Inst *inst = &search->program[pc];
+        bool before = p > 0 && is_word((uint8_t)text[p - 1]);
+        bool after = p < end && is_word((uint8_t)text[p]);
+
+        switch (inst->op)
+        {
+        case OP_JUMP:
+            scratch->stack[height++] = inst->x;
+            break;
+        case OP_SPLIT:
+            // The preferred branch goes on top, so all of it is added before the other one
+            scratch->stack[height++] = inst->y;
+            scratch->stack[height++] = inst->x;
+            break;
+        case OP_LINE_START:
+            if (p == 0 || text[p - 1] == '\n')
+                scratch->stack[height++] = pc + 1;
+            break;
+        case OP_LINE_END:
+            if (p == end)
+                scratch->stack[height++] = pc + 1;
+            break;
+        case OP_WORD_BOUNDARY:
+            if (before != after)
+                scratch->stack[height++] = pc + 1;
+            break;
+        case OP_NOT_WORD_BOUNDARY:
+            if (before == after)
+                scratch->stack[height++] = pc + 1;
+            break;
+        default:
+            list[(*len)++] = (VmThread){pc, start};
+            break;
+        }
+    }
+}
+
+/*
+ * Runs the program over a line from `start` to `end`, the first match found is the leftmost one, and of those the one
+ * the pattern prefers.  The bytes before `start` are still looked at by assertions.
+ */
+static bool run_program(const Search *search, VmScratch *scratch, const char *text, size_t start, size_t end,
+                        DocRange *match)
+{
+    VmThread *current = scratch->lists[0], *next = scratch->lists[1];
+    size_t len_current = 0, len_next;
+    bool found = false;
+
+    scratch->generation++;
+
+    for (size_t p = start; ; p++)
+    {
+        // A thread starting here comes after all the ones that started earlier
+        if (!found)
+            add_thread(search, scratch, current, &len_current, 0, p, text, end, p);
+
+        if (!len_current)
+        {
+            if (found || p == end)
+                break;
+
+            // Nothing got past this position, the next one starts over on an empty list
+            scratch->generation++;
+            continue;
+        }
+
+        scratch->generation++;
+        len_next = 0;
+
+        for (size_t i = 0; i < len_current; i++)
+        {
+            const Inst *inst = &search->program[current[i].pc];
+            uint8_t c = p < end ? (uint8_t)text[p] : 0;
+            bool step;
+
+            if (inst->op == OP_MATCH)
+            {
+                // Threads after this one are worse, they are dropped
+                *match = (DocRange){current[i].start, p - current[i].start};
+                found = true;
+                break;
+            }
+
+            if (p == end)
+                continue;
+
+            switch (inst->op)
+            {
+            case OP_BYTE:
+                step = c == inst->byte;
+                break;
+            case OP_FOLDED:
+                step = fold(c) == inst->byte;
+                break;
+            case OP_CLASS:
+                step = class_has(&search->classes[inst->x], c);
+                break;
+            case OP_ANY:
+                step = c != '\n';
+                break;
+            default:
+                step = false;
+                break;
+            }
+
+            if (step)
+                add_thread(search, scratch, next, &len_next, current[i].pc + 1, current[i].start, text, end, p + 1);
+        }
+
+        VmThread *swap = current;
+        current = next;
+        next = swap;
+        len_current = len_next;
+
+        if (p == end)
+            break;
+    }
+
+    return found;
+}
+
+/* Looks for a match line by line, skipping to the lines with the literal every match has when there is one. */
+static bool search_lines(const Search *search, VmScratch *scratch, const char *text, size_t len, size_t from,
+                         DocRange *match)
+{
+    bool ignore_case = search->flags & SEARCH_IGNORE_CASE;
+
+    for (size_t pos = from; pos <= len;)
+    {
+        size_t begin = pos;
+
+        if (search->len_literal)
+        {
+            size_t hit = search->find(&text[pos], len - pos, search->literal, search->len_literal, ignore_case);
+            if (hit == NOT_FOUND)
+                return false;
+
+            begin = pos + hit;
+            while (begin > pos && text[begin - 1] != '\n')
+                begin--;
+            pos += hit;
+        }
+
+        const char *nl = memchr(&text[pos], '\n', len - pos);
+        size_t end = nl ? (size_t)(nl - text) : len;
+
+        if (run_program(search, scratch, text, begin, end, match))
+            return true;
+
+        pos = end + 1;
+    }
+
+    return false;
+}
+
+bool search_buffer(const Search *search, const char *text, size_t len, size_t from, DocRange *match)
+{
+    if (!(search->flags & SEARCH_REGEX))
+    {
+        bool ignore_case = search->flags & SEARCH_IGNORE_CASE;
+        size_t hit = from > len ? NOT_FOUND
+            : search->find(&text[from], len - from, search->literal, search->len_literal, ignore_case);
+
+        if (hit == NOT_FOUND)
+            return false;
+
+        *match = (DocRange){from + hit, search->len_literal};
+        return true;
+    }
+
+    VmScratch scratch;
+    scratch_init(&scratch, search);
+    bool found = search_lines(search, &scratch, text, len, from, match);
+    scratch_uninit(&scratch);
+
+    return found;
+}
+
+size_t search_overlap(const Search *search)
+{
+    // A regular expression stays within its line, only a literal can take in the newline
+    return search->flags & SEARCH_REGEX ? 0 : search->len_literal;
+}
+
+typedef bool (*MatchCallback)(void *user, DocRange match);
+
+/* Finds the literal in the pieces themselves, and reads across the boundaries between them for matches split by one. */
+static void scan_literal(const Search *search, const Document *doc, size_t from, MatchCallback callback, void *user)
+{
+    size_t length = doc_length(doc), n = search->len_literal;
+    bool ignore_case = search->flags & SEARCH_IGNORE_CASE;
+    char *window = malloc(2 * n);
+
+    // Matches do not overlap, the next one starts at `pos` or after
+    size_t pos = from;
+
+    for (size_t at = from; at < length;)
+    {
+        const char *data;
+        size_t len_chunk = doc_chunk(doc, at, &data);
+        size_t end = at + len_chunk;
+
+        if (pos < at)
+            pos = at;
+
+        while (pos < end)
+        {
+            size_t hit = search->find(&data[pos - at], end - pos, search->literal, n, ignore_case);
+            if (hit == NOT_FOUND)
+                break;
+
+            DocRange match = {pos + hit, n};
+            if (!callback(user, match))
+                goto done;
+            pos = match.offset + n;
+        }
+
+        // Only one match can cross a boundary, two would overlap
+        size_t straddle = end >= n - 1 && end - (n - 1) > pos ? end - (n - 1) : pos;
+
+        if (n > 1 && end < length && straddle < end)
+        {
+            size_t got = doc_read(doc, straddle, window, end - straddle + n - 1);
+            size_t hit = search->find(window, got, search->literal, n, ignore_case);
+
+            if (hit != NOT_FOUND && straddle + hit < end)
+            {
+                DocRange match = {straddle + hit, n};
+                if (!callback(user, match))
+                    goto done;
+                pos = match.offset + n;
+            }
+        }
+
+        at = end;
+    }
+
+done:
+    free(window);
+}
+
+/* Reads the document a window of whole lines at a time, a byte early so assertions see what comes before. */
+static void scan_lines(const Search *search, const Document *doc, size_t from, MatchCallback callback, void *user)
+{
+    size_t length = doc_length(doc), cap = SCAN_WINDOW;
+    char *window = malloc(cap);
+    VmScratch scratch;
+
+    scratch_init(&scratch, search);
+
+    for (size_t pos = from; pos <= length;)
+    {
+        size_t lead = pos > 0 ? 1 : 0;
+        size_t start = pos - lead;
+        size_t got = doc_read(doc, start, window, cap);
+        size_t len = got;
+
+        // The window ends after its last line break, a line longer than the window makes it grow
+        if (start + got < length)
+        {
+            while (len > lead && window[len - 1] != '\n')
+                len--;
+
+            if (len == lead)
+            {
+                cap *= 2;
+                window = realloc(window, cap);
+                continue;
+            }
+        }
+
+        bool last = start + len >= length;
+        DocRange match;
+
+        for (size_t at = lead; search_lines(search, &scratch, window, len, at, &match);)
+        {
+            // The line after the last break belongs to the next window
+            if (match.offset == len && !last)
+                break;
+
+            at = match.offset + match.len + (match.len == 0);
+            match.offset += start;
+
+            if (!callback(user, match))
+                goto done;
+            if (at > len)
+                break;
+        }
+
+        if (last)
+            break;
+        pos = start + len;
+    }
+
+done:
+    scratch_uninit(&scratch);
+    free(window);
+}
+
+static void scan_document(const Search *search, const Document *doc, size_t from, MatchCallback callback, void *user)
+{
+    if (search->flags & SEARCH_REGEX)
+        scan_lines(search, doc, from, callback, user);
+    else
+        scan_literal(search, doc, from, callback, user);
+}
+
+static bool keep_first(void *user, DocRange match)
+{
+    *(DocRange *)user = match;
+    return false;
+}
+
+bool search_document(const Search *search, const Document *doc, size_t from, DocRange *match)
+{
+    DocRange found = {SIZE_MAX, 0};
+
+    scan_document(search, doc, from, keep_first, &found);
+    if (found.offset == SIZE_MAX)
+        return false;
+
+    *match = found;
+    return true;
+}
+
+typedef struct {
+    DocRange *ranges;
+    size_t len, cap;
+} RangeList;
+
+static bool keep_all(void *user, DocRange match)
+{
+    RangeList *list = user;
+
+    if (list->len == list->cap)
+    {
+        list->cap = list->cap < 256 ? 256 : 2 * list->cap;
+        list->ranges = realloc(list->ranges, list->cap * sizeof *list->ranges);
+    }
+
+    list->ranges[list->len++] = match;
+    return true;
+}
+
+size_t search_replace_all(const Search *search, Document *doc, const char *text, size_t len)
+{
+    RangeList list = {0};
+
+    scan_document(search, doc, 0, keep_all, &list);
+    doc_replace_ranges(doc, list.ranges, list.len, text, len);
+    free(list.ranges);
+
+    return list.len;
+}
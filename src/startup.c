@@ -0,0 +1,161 @@
+#include "theeditor.h"
+
+#include <assert.h>
+#include <stdio.h>
+
+// More stages than there are to start up
+#define STARTUP_STAGES 16
+// The width of the timeline drawn in the report
+#define REPORT_TIMELINE 40
+
+typedef struct {
+    const char *name;
+    // Spawned onto a thread of its own rather than run on the main thread
+    bool worker;
+    uint64_t begin, end;
+} StartupStage;
+
+typedef struct {
+    StartupStage *stage;
+    PlatformThreadProc proc;
+    void *arg;
+    PlatformThread *thread;
+} StartupJob;
+
+/*
+ * A stage's times are written by the thread running it and read by the main thread only once that thread has been
+ * joined, so nothing is shared while it runs.
+ */
+struct Startup {
+    uint64_t start;
+    StartupStage stages[STARTUP_STAGES];
+    size_t nstages;
+    StartupJob jobs[STARTUP_STAGES];
+    size_t njobs, joined;
+    // The stage being timed on the main thread, if any
+    StartupStage *current;
+};
+
+Startup *startup_create(void)
+{
+    Startup *startup = calloc(1, sizeof(Startup));
+
+    startup->start = platform_time_ns();
+    return startup;
+}
+
+void startup_destroy(Startup *startup)
+{
+    startup_join(startup);
+    free(startup);
+}
+
+static StartupStage *stage_add(Startup *startup, const char *name, bool worker)
+{
+    assert(startup->nstages < STARTUP_STAGES && "too many startup stages");
+
+    StartupStage *stage = &startup->stages[startup->nstages++];
+
+    *stage = (StartupStage){.name = name, .worker = worker};
+    return stage;
+}
+
+static void job_run(void *arg)
+{
+    StartupJob *job = arg;
+
+    job->stage->begin = platform_time_ns();
+    TRACE_BEGIN(job->stage->name);
+    job->proc(job->arg);
+    TRACE_END();
+    job->stage->end = platform_time_ns();
+}
+
+void startup_spawn(Startup *startup, const char *name, PlatformThreadProc proc, void *arg)
+{
+    StartupJob *job = &startup->jobs[startup->njobs];
+
+    *job = (StartupJob){.stage = stage_add(startup, name, true), .proc = proc, .arg = arg};
+    job->thread = platform_thread_create(job_run, job);
+
+    if (job->thread)
+    {
+        startup->njobs++;
+        return;
+    }
+
+    // Slower, but it starts all the same
+    job->stage->worker = false;
+    job_run(job);
+}
+
+void startup_begin(Startup *startup, const char *name)
+{
+    assert(!startup->current && "startup stages do not nest");
+
+    startup->current = stage_add(startup, name, false);
+    startup->current->begin = platform_time_ns();
+    TRACE_BEGIN(name);
+}
+
+void startup_end(Startup *startup)
+{
+    TRACE_END();
+    startup->current->end = platform_time_ns();
+    startup->current = NULL;
+}
+
+void startup_join(Startup *startup)
+{
+    if (startup->joined == startup->njobs)
+        return;
+
+    startup_begin(startup, "waiting");
+    for (; startup->joined < startup->njobs; startup->joined++)
+        platform_thread_join(startup->jobs[startup->joined].thread);
+    startup_end(startup);
+}
+
+uint64_t startup_elapsed(const Startup *startup)
+{
+    uint64_t end = startup->start;
+
+    for (size_t i = 0; i < startup->nstages; i++)
+        if (startup->stages[i].end > end)
+            end = startup->stages[i].end;
+
+    return end - startup->start;
+}
+
+static double milliseconds(uint64_t ns)
+{
+    return (double)ns / 1e6;
+}
+
+void startup_report(const Startup *startup)
+{
+    uint64_t elapsed = startup_elapsed(startup);
+    char timeline[REPORT_TIMELINE + 1];
+
+    fprintf(stderr, "Started up in %.2f ms\n", milliseconds(elapsed));
+    fprintf(stderr, "%-16s %-6s %9s %9s %9s\n", "stage", "thread", "begin ms", "end ms", "took ms");
+
+    for (size_t i = 0; i < startup->nstages; i++)
+    {
+        const StartupStage *stage = &startup->stages[i];
+        uint64_t begin = stage->begin - startup->start, end = stage->end - startup->start;
+        // At least a column for every stage, however short
+        size_t from = elapsed ? begin * REPORT_TIMELINE / elapsed : 0;
+        size_t to = elapsed ? end * REPORT_TIMELINE / elapsed : 0;
+
+        from = from < REPORT_TIMELINE ? from : REPORT_TIMELINE - 1;
+        to = to > from ? to : from + 1;
+
+        for (size_t c = 0; c < REPORT_TIMELINE; c++)
+            timeline[c] = c >= from && c < to ? '#' : '.';
+        timeline[REPORT_TIMELINE] = '\0';
+
+        fprintf(stderr, "%-16s %-6s %9.2f %9.2f %9.2f %s\n", stage->name, stage->worker ? "worker" : "main",
+                milliseconds(begin), milliseconds(end), milliseconds(end - begin), timeline);
+    }
+}
@@ -0,0 +1,180 @@
+#include "theeditor.h"
+
+#include <stdio.h>
+#include <string.h>
+
+// Rows a CSV takes before it is moved aside to make room for a new one, about half an hour at 60 frames a second
+#define STATS_CSV_ROWS 100000
+// Frames a row waits before it is written, enough for the GPU's time of it to have come in
+#define STATS_CSV_LAG 8
+
+#define STATS_CSV_HEADER "frame,cpu_ms,ui_ms,upload_ms,draw_ms,swap_ms,gpu_ms,quads,bytes_uploaded\n"
+
+struct FrameStats {
+    // A ring of the latest frames, `next` counting every frame ever pushed
+    FrameSample samples[STATS_FRAMES];
+    uint64_t next;
+    FILE *csv;
+    char *csv_path;
+    size_t csv_rows;
+};
+
+FrameStats *stats_create(void)
+{
+    return calloc(1, sizeof(FrameStats));
+}
+
+static void write_row(FILE *file, const FrameSample *s)
+{
+    fprintf(file, "%llu,%.3f,%.3f,%.3f,%.3f,%.3f,", (unsigned long long)s->frame, (double)s->cpu_ns / 1e6,
+            (double)s->ui_ns / 1e6, (double)s->upload_ns / 1e6, (double)s->draw_ns / 1e6, (double)s->swap_ns / 1e6);
+
+    // Left empty for a frame the GPU was too far behind to time
+    if (s->gpu_known)
+        fprintf(file, "%.3f", (double)s->gpu_ns / 1e6);
+
+    fprintf(file, ",%zu,%zu\n", s->quads, s->bytes_uploaded);
+}
+
+void stats_destroy(FrameStats *stats)
+{
+    if (stats->csv)
+    {
+        // The frames still waiting on the GPU go out as they are
+        for (size_t age = stats_count(stats) < STATS_CSV_LAG ? stats_count(stats) : STATS_CSV_LAG; age > 0; age--)
+            write_row(stats->csv, stats_sample(stats, age - 1));
+
+        fclose(stats->csv);
+    }
+
+    free(stats->csv_path);
+    free(stats);
+}
+
+bool stats_csv_start(FrameStats *stats, const char *path)
+{
+    stats->csv = fopen(path, "w");
+
+    if (!stats->csv)
+        return false;
+
+    size_t len = strlen(path) + 1;
+    stats->csv_path = malloc(len);
+    memcpy(stats->csv_path, path, len);
+    fputs(STATS_CSV_HEADER, stats->csv);
+
+    return true;
+}
+
+/* Moves a full CSV aside, keeping only the one before it, and starts the next. */
+static void csv_roll(FrameStats *stats)
+{
+    size_t len = strlen(stats->csv_path);
+    char *previous = malloc(len + 3);
+
+    memcpy(previous, stats->csv_path, len);
+    memcpy(&previous[len], ".1", 3);
+
+    fclose(stats->csv);
+    if (!platform_replace_file(stats->csv_path, previous))
+        fprintf(stderr, "Failed to move %s aside to %s\n", stats->csv_path, previous);
+    free(previous);
+
+    stats->csv = fopen(stats->csv_path, "w");
+    stats->csv_rows = 0;
+
+    if (stats->csv)
+        fputs(STATS_CSV_HEADER, stats->csv);
+    else
+        fprintf(stderr, "Failed to start %s again, frame statistics are no longer written\n", stats->csv_path);
+}
+
+void stats_push(FrameStats *stats, const FrameSample *sample)
+{
+    stats->samples[stats->next++ % STATS_FRAMES] = *sample;
+
+    if (!stats->csv || stats->next <= STATS_CSV_LAG)
+        return;
+
+    write_row(stats->csv, stats_sample(stats, STATS_CSV_LAG));
+
+    if (++stats->csv_rows == STATS_CSV_ROWS)
+        csv_roll(stats);
+}
+
+void stats_gpu_time(FrameStats *stats, uint64_t frame, uint64_t ns)
+{
+    for (size_t age = 0; age < stats_count(stats); age++)
+    {
+        FrameSample *s = &stats->samples[(stats->next - 1 - age) % STATS_FRAMES];
+
+        if (s->frame == frame)
+        {
+            s->gpu_ns = ns;
+            s->gpu_known = true;
+            return;
+        }
+    }
+}
+
+size_t stats_count(const FrameStats *stats)
+{
+    return stats->next < STATS_FRAMES ? (size_t)stats->next : STATS_FRAMES;
+}
+
+const FrameSample *stats_sample(const FrameStats *stats, size_t age)
+{
+    return &stats->samples[(stats->next - 1 - age) % STATS_FRAMES];
+}
+
+static int compare_u64(const void *a, const void *b)
+{
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+FrameSummary stats_summary(const FrameStats *stats)
+{
+    uint64_t cpu[STATS_FRAMES], gpu[STATS_FRAMES];
+    size_t ncpu = stats_count(stats), ngpu = 0;
+    FrameSummary summary = {0};
+
+    for (size_t i = 0; i < ncpu; i++)
+    {
+        const FrameSample *s = &stats->samples[i];
+
+        cpu[i] = s->cpu_ns;
+        if (s->gpu_known)
+            gpu[ngpu++] = s->gpu_ns;
+    }
+
+    qsort(cpu, ncpu, sizeof *cpu, compare_u64);
+    qsort(gpu, ngpu, sizeof *gpu, compare_u64);
+
+    if (ncpu)
+    {
+        summary.cpu_p50 = cpu[ncpu / 2];
+        summary.cpu_p99 = cpu[ncpu * 99 / 100];
+    }
+    if (ngpu)
+    {
+        summary.gpu_p50 = gpu[ngpu / 2];
+        summary.gpu_p99 = gpu[ngpu * 99 / 100];
+    }
+
+    return summary;
+}
+
+bool stats_write_csv(const FrameStats *stats, const char *path)
+{
+    FILE *file = fopen(path, "w");
+
+    if (!file)
+        return false;
+
+    fputs(STATS_CSV_HEADER, file);
+    for (size_t age = stats_count(stats); age > 0; age--)
+        write_row(file, stats_sample(stats, age - 1));
+
+    return !fclose(file);
+}
@@ -0,0 +1,255 @@
+#include "theeditor.h"
+
+#include <assert.h>
+#include <string.h>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+// Strings are stored behind a 16 bit length, and never straddle two chunks
+#define LEN_PREFIX 2
+#define MAX_STRING_LEN UINT16_MAX
+
+static uint32_t log2_u32(uint32_t x)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanReverse(&index, x);
+    return index;
+#else
+    return 31 - __builtin_clz(x);
+#endif
+}
+
+static size_t chunk_size(size_t chunk)
+{
+    return (size_t)STRARENA_FIRST_CHUNK << chunk;
+}
+
+static size_t chunk_start(size_t chunk)
+{
+    return (size_t)STRARENA_FIRST_CHUNK * (((size_t)1 << chunk) - 1);
+}
+
+static const char *handle_data(const StringArena *arena, StringHandle handle)
+{
+    size_t chunk = log2_u32(handle / STRARENA_FIRST_CHUNK + 1);
+    return &arena->chunks[chunk][handle - chunk_start(chunk)];
+}
+
+static uint32_t hash_string(const char *s, size_t len)
+{
+    uint32_t hash = 2166136261u;
+
+    for (size_t i = 0; i < len; i++)
+    {
+        hash ^= (uint8_t)s[i];
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+void strarena_init(StringArena *arena)
+{
+    *arena = (StringArena){0};
+}
+
+void strarena_uninit(StringArena *arena)
+{
+    for (size_t i = arena->nborrowed; i < arena->nchunks; i++)
+        mem_free(MEM_STRINGS, arena->chunks[i]);
+
+    if (!arena->borrowed_table)
+    {
+        mem_free(MEM_STRINGS, arena->table);
+        mem_free(MEM_STRINGS, arena->hashes);
+    }
+
+    *arena = (StringArena){0};
+}
+
+void strarena_borrow(StringArena *arena, char *chunks, size_t nchunks, size_t len_last, void *table, size_t len_table,
+    size_t cap_table)
+{
+    assert(!arena->nchunks && !arena->cap_table && nchunks <= STRARENA_MAX_CHUNKS);
+
+    for (size_t i = 0; i < nchunks; i++)
+        arena->chunks[i] = &chunks[chunk_start(i)];
+
+    arena->nchunks = arena->nborrowed = nchunks;
+    arena->len_last = len_last;
+
+    arena->table = table;
+    arena->hashes = (uint32_t *)&arena->table[cap_table];
+    arena->len_table = len_table;
+    arena->cap_table = cap_table;
+    arena->borrowed_table = cap_table > 0;
+}
+
+bool strarena_handle_valid(const StringArena *arena, StringHandle handle)
+{
+    if (!arena->nchunks || handle >= chunk_start(arena->nchunks - 1) + arena->len_last)
+        return false;
+
+    size_t chunk = log2_u32(handle / STRARENA_FIRST_CHUNK + 1);
+    size_t offset = handle - chunk_start(chunk);
+    size_t used = chunk + 1 == arena->nchunks ? arena->len_last : chunk_size(chunk);
+    uint16_t len;
+
+    if (used - offset < LEN_PREFIX)
+        return false;
+
+    memcpy(&len, &arena->chunks[chunk][offset], sizeof len);
+    return len <= used - offset - LEN_PREFIX;
+}
+
+bool strarena_table_valid(const StringArena *arena)
+{
+    size_t len = 0;
+
+    for (size_t i = 0; i < arena->cap_table; i++)
+    {
+        if (arena->table[i] == STRING_NONE)
+            continue;
+
+        if (!strarena_handle_valid(arena, arena->table[i]))
+            return false;
+        len++;
+    }
+
+    return len == arena->len_table;
+}
+
+String strarena_get(const StringArena *arena, StringHandle handle)
+{
+    const char *data = handle_data(arena, handle);
+    uint16_t len;
+
+    memcpy(&len, data, sizeof len);
+
+    return (String){
+        .length = len,
+        .data = (char *)data + LEN_PREFIX,
+    };
+}
+
+size_t strarena_memory(const StringArena *arena)
+{
+    size_t bytes = arena->cap_table * (sizeof *arena->table + sizeof *arena->hashes);
+
+    for (size_t i = 0; i < arena->nchunks; i++)
+        bytes += chunk_size(i);
+
+    return bytes;
+}
+
+/* Copies a string into the last chunk, starting a new one if it does not fit. */
+static StringHandle arena_push(StringArena *arena, const char *s, size_t len)
+{
+    size_t needed = LEN_PREFIX + len;
+
+    if (!arena->nchunks || arena->len_last + needed > chunk_size(arena->nchunks - 1))
+    {
+        assert(arena->nchunks < STRARENA_MAX_CHUNKS && "string arena ran out of handle space");
+
+        arena->chunks[arena->nchunks] = mem_alloc(MEM_STRINGS, chunk_size(arena->nchunks));
+        arena->nchunks++;
+        arena->len_last = 0;
+    }
+
+    size_t chunk = arena->nchunks - 1;
+    char *data = &arena->chunks[chunk][arena->len_last];
+    uint16_t len_prefix = (uint16_t)len;
+
+    memcpy(data, &len_prefix, sizeof len_prefix);
+    memcpy(data + LEN_PREFIX, s, len);
+
+    StringHandle handle = (StringHandle)(chunk_start(chunk) + arena->len_last);
+    arena->len_last += needed;
+
+    return handle;
+}
+
+static void table_grow(StringArena *arena)
+{
+    size_t cap = arena->cap_table ? 2 * arena->cap_table : 1024;
+    StringHandle *table = mem_alloc(MEM_STRINGS, cap * sizeof *table);
+    uint32_t *hashes = mem_alloc(MEM_STRINGS, cap * sizeof *hashes);
+
+    for (size_t i = 0; i < cap; i++)
+        table[i] = STRING_NONE;
+
+    for (size_t i = 0; i < arena->cap_table; i++)
+    {
+        if (arena->table[i] == STRING_NONE)
+            continue;
+
+        size_t slot = arena->hashes[i] & (cap - 1);
+        while (table[slot] != STRING_NONE)
+            slot = (slot + 1) & (cap - 1);
+
+        table[slot] = arena->table[i];
+        hashes[slot] = arena->hashes[i];
+    }
+
+    if (!arena->borrowed_table)
+    {
+        mem_free(MEM_STRINGS, arena->table);
+        mem_free(MEM_STRINGS, arena->hashes);
+    }
+    arena->table = table;
+    arena->hashes = hashes;
+    arena->cap_table = cap;
+    arena->borrowed_table = false;
+}
+
+/* The slot holding a string, or the empty slot where it would go. */
+static size_t table_probe(const StringArena *arena, const char *s, size_t len, uint32_t hash)
+{
+    size_t mask = arena->cap_table - 1;
+    size_t slot = hash & mask;
+
+    for (; arena->table[slot] != STRING_NONE; slot = (slot + 1) & mask)
+    {
+        if (arena->hashes[slot] != hash)
+            continue;
+
+        String existing = strarena_get(arena, arena->table[slot]);
+        if (existing.length == len && !memcmp(existing.data, s, len))
+            break;
+    }
+
+    return slot;
+}
+
+StringHandle strarena_find(const StringArena *arena, const char *s, size_t len)
+{
+    if (!arena->cap_table || len > MAX_STRING_LEN)
+        return STRING_NONE;
+
+    return arena->table[table_probe(arena, s, len, hash_string(s, len))];
+}
+
+StringHandle strarena_intern(StringArena *arena, const char *s, size_t len)
+{
+    assert(len <= MAX_STRING_LEN);
+
+    // Kept at most three quarters full so probe runs stay short
+    if (4 * (arena->len_table + 1) > 3 * arena->cap_table)
+        table_grow(arena);
+
+    uint32_t hash = hash_string(s, len);
+    size_t slot = table_probe(arena, s, len, hash);
+
+    if (arena->table[slot] != STRING_NONE)
+        return arena->table[slot];
+
+    StringHandle handle = arena_push(arena, s, len);
+    arena->table[slot] = handle;
+    arena->hashes[slot] = hash;
+    arena->len_table++;
+
+    return handle;
+}
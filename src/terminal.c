@@ -0,0 +1,1136 @@
+#include "theeditor.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <emmintrin.h>
+#define HAVE_X86
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#define TAB_WIDTH 8
+// Larger parameters are clamped, nothing takes a count or position past what a screen could be
+#define PARAM_MAX 65535
+
+enum {
+    STATE_GROUND,
+    STATE_ESCAPE,
+    STATE_ESCAPE_INTERMEDIATE,
+    STATE_CSI,
+    // A control sequence that is malformed or too long, skipped up to its final byte
+    STATE_CSI_IGNORE,
+    STATE_OSC,
+    // Device control and the other strings nothing here uses, skipped up to the string terminator
+    STATE_STRING,
+};
+
+/* The standard 16 colors, the 6x6x6 cube and the 24 greys, as xterm has them. */
+uint32_t term_palette(uint8_t index)
+{
+    static const uint32_t base[16] = {
+        0x000000, 0xcd0000, 0x00cd00, 0xcdcd00, 0x0000ee, 0xcd00cd, 0x00cdcd, 0xe5e5e5,
+        0x7f7f7f, 0xff0000, 0x00ff00, 0xffff00, 0x5c5cff, 0xff00ff, 0x00ffff, 0xffffff,
+    };
+
+    if (index < 16)
+        return base[index];
+
+    if (index < 232)
+    {
+        static const uint8_t levels[6] = {0x00, 0x5f, 0x87, 0xaf, 0xd7, 0xff};
+        int i = index - 16;
+        return (uint32_t)levels[i / 36] << 16 | (uint32_t)levels[i / 6 % 6] << 8 | levels[i % 6];
+    }
+
+    uint32_t grey = 8 + 10 * (uint32_t)(index - 232);
+    return grey << 16 | grey << 8 | grey;
+}
+
+/* The palette entry closest to a color, out of the cube and the greys. */
+static uint8_t nearest_color(int r, int g, int b)
+{
+    // Levels are 0, then 95 and every 40 after, so the nearest is found by rounding against the midpoints
+    int ri = r < 48 ? 0 : r < 115 ? 1 : (r - 35) / 40;
+    int gi = g < 48 ? 0 : g < 115 ? 1 : (g - 35) / 40;
+    int bi = b < 48 ? 0 : b < 115 ? 1 : (b - 35) / 40;
+    uint8_t cube = (uint8_t)(16 + 36 * ri + 6 * gi + bi);
+
+    int average = (r + g + b) / 3;
+    int gi_grey = average < 8 ? 0 : average > 238 ? 23 : (average - 3) / 10;
+    uint8_t grey = (uint8_t)(232 + gi_grey);
+
+    uint32_t c = term_palette(cube), k = term_palette(grey);
+    int dc = abs((int)(c >> 16) - r) + abs((int)(c >> 8 & 0xff) - g) + abs((int)(c & 0xff) - b);
+    int dk = abs((int)(k >> 16) - r) + abs((int)(k >> 8 & 0xff) - g) + abs((int)(k & 0xff) - b);
+
+    return dk < dc ? grey : cube;
+}
+
+static uint32_t lowest_bit(uint32_t x)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, x);
+    return index;
+#else
+    return (uint32_t)__builtin_ctz(x);
+#endif
+}
+
+/* How many bytes from the start are printable ASCII, 16 at a time. */
+static size_t printable_run(const uint8_t *text, size_t len)
+{
+    size_t i = 0;
+
+#ifdef HAVE_X86
+    const __m128i below = _mm_set1_epi8(0x1f), above = _mm_set1_epi8(0x7f);
+
+    for (; i + 16 <= len; i += 16)
+    {
+        __m128i bytes = _mm_loadu_si128((const __m128i *)&text[i]);
+        // Compared signed, so bytes from 0x80 up are negative and fail the first test
+        __m128i printable = _mm_and_si128(_mm_cmpgt_epi8(bytes, below), _mm_cmplt_epi8(bytes, above));
+        uint32_t stop = ~(uint32_t)_mm_movemask_epi8(printable) & 0xffff;
+
+        if (stop)
+            return i + lowest_bit(stop);
+    }
+#endif
+
+    while (i < len && text[i] >= 0x20 && text[i] < 0x7f)
+        i++;
+
+    return i;
+}
+
+/* Writes ASCII into cells with the pen's colors and attributes, widening eight bytes to eight cells at a time. */
+static void write_ascii(TermCell *cells, const uint8_t *text, size_t len, TermCell pen)
+{
+    size_t i = 0;
+
+#ifdef HAVE_X86
+    // A cell is its codepoint and then four bytes that are the same for the whole run
+    uint32_t style;
+    memcpy(&style, (const char *)&pen + sizeof pen.codepoint, sizeof style);
+
+    const __m128i styles = _mm_set1_epi32((int)style), zero = _mm_setzero_si128();
+
+    for (; i + 8 <= len; i += 8)
+    {
+        __m128i words = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)&text[i]), zero);
+        __m128i low = _mm_unpacklo_epi16(words, zero), high = _mm_unpackhi_epi16(words, zero);
+
+        _mm_storeu_si128((__m128i *)&cells[i], _mm_unpacklo_epi32(low, styles));
+        _mm_storeu_si128((__m128i *)&cells[i + 2], _mm_unpackhi_epi32(low, styles));
+        _mm_storeu_si128((__m128i *)&cells[i + 4], _mm_unpacklo_epi32(high, styles));
+        _mm_storeu_si128((__m128i *)&cells[i + 6], _mm_unpackhi_epi32(high, styles));
+    }
+#endif
+
+    for (; i < len; i++)
+    {
+        cells[i] = pen;
+        cells[i].codepoint = text[i];
+    }
+}
+
+static int slot(const Terminal *term, int row)
+{
+    int s = term->top + row;
+    return s < term->rows ? s : s - term->rows;
+}
+
+static TermCell *row_cells(Terminal *term, int row)
+{
+    return &term->cells[(size_t)slot(term, row) * term->columns];
+}
+
+static void mark_dirty(Terminal *term, int row)
+{
+    int s = slot(term, row);
+    term->dirty[s / 64] |= 1ull << (s % 64);
+}
+
+static void mark_all_dirty(Terminal *term)
+{
+    memset(term->dirty, 0xff, ((size_t)term->rows + 63) / 64 * sizeof *term->dirty);
+}
+
+/* An empty cell as erasing leaves it, in the pen's background as xterm does. */
+static TermCell blank(const Terminal *term)
+{
+    return (TermCell){
+        .codepoint = ' ',
+        .fg = term->pen.fg,
+        .bg = term->pen.bg,
+        .attributes = term->pen.attributes & (CELL_DEFAULT_FG | CELL_DEFAULT_BG),
+    };
+}
+
+static void clear_cells(TermCell *cells, size_t count, TermCell with)
+{
+    for (size_t i = 0; i < count; i++)
+        cells[i] = with;
+}
+
+static void clear_rows(Terminal *term, int from, int to)
+{
+    TermCell with = blank(term);
+
+    for (int row = from; row < to; row++)
+    {
+        clear_cells(row_cells(term, row), (size_t)term->columns, with);
+        mark_dirty(term, row);
+    }
+}
+
+/* Moves the rows of a region up, clearing as many at its bottom.  The whole screen only turns its ring of rows. */
+static void scroll_up(Terminal *term, int top, int bottom, int count)
+{
+    if (count > bottom - top)
+        count = bottom - top;
+
+    if (top == 0 && bottom == term->rows)
+    {
+        for (int i = 0; i < count; i++)
+        {
+            if (term->scrolled && !term->alternate)
+                term->scrolled(term->scrolled_user, row_cells(term, 0), term->columns);
+
+            term->top = slot(term, 1);
+            clear_rows(term, term->rows - 1, term->rows);
+        }
+
+        return;
+    }
+
+    size_t len_row = (size_t)term->columns * sizeof(TermCell);
+
+    for (int row = top; row < bottom - count; row++)
+    {
+        memcpy(row_cells(term, row), row_cells(term, row + count), len_row);
+        mark_dirty(term, row);
+    }
+
+    clear_rows(term, bottom - count, bottom);
+}
+
+static void scroll_down(Terminal *term, int top, int bottom, int count)
+{
+    if (count > bottom - top)
+        count = bottom - top;
+
+    if (top == 0 && bottom == term->rows)
+    {
+        for (int i = 0; i < count; i++)
+        {
+            term->top = slot(term, term->rows - 1);
+            clear_rows(term, 0, 1);
+        }
+
+        return;
+    }
+
+    size_t len_row = (size_t)term->columns * sizeof(TermCell);
+
+    for (int row = bottom - 1; row >= top + count; row--)
+    {
+        memcpy(row_cells(term, row), row_cells(term, row - count), len_row);
+        mark_dirty(term, row);
+    }
+
+    clear_rows(term, top, top + count);
+}
+
+/* Moves the cursor down a row, scrolling the region if it is on the region's last. */
+static void line_feed(Terminal *term)
+{
+    term->wrap_pending = false;
+
+    if (term->cursor_y == term->scroll_bottom - 1)
+        scroll_up(term, term->scroll_top, term->scroll_bottom, 1);
+    else if (term->cursor_y < term->rows - 1)
+        term->cursor_y++;
+}
+
+static void reverse_line_feed(Terminal *term)
+{
+    term->wrap_pending = false;
+
+    if (term->cursor_y == term->scroll_top)
+        scroll_down(term, term->scroll_top, term->scroll_bottom, 1);
+    else if (term->cursor_y > 0)
+        term->cursor_y--;
+}
+
+/* Goes on to the next line if the last character filled the one the cursor is on. */
+static void wrap_if_pending(Terminal *term)
+{
+    if (term->wrap_pending)
+    {
+        term->cursor_x = 0;
+        line_feed(term);
+    }
+}
+
+/* Whether a character takes two columns, as the East Asian wide and fullwidth ones and most emoji do. */
+static bool is_wide(uint32_t codepoint)
+{
+    static const struct {
+        uint32_t first, last;
+    } ranges[] = {
+        {0x1100, 0x115f},   {0x231a, 0x231b},   {0x2329, 0x232a},   {0x23e9, 0x23ec},   {0x2614, 0x2615},
+        {0x2648, 0x2653},   {0x26a1, 0x26a1},   {0x26aa, 0x26ab},   {0x26bd, 0x26be},   {0x26c4, 0x26c5},
+        {0x26d4, 0x26d4},   {0x26ea, 0x26ea},   {0x26f5, 0x26f5},   {0x26fa, 0x26fa},   {0x26fd, 0x26fd},
+        {0x2705, 0x2705},   {0x270a, 0x270b},   {0x2728, 0x2728},   {0x274c, 0x274c},   {0x2753, 0x2755},
+        {0x2757, 0x2757},   {0x2795, 0x2797},   {0x27b0, 0x27b0},   {0x27bf, 0x27bf},   {0x2b1b, 0x2b1c},
+        {0x2b50, 0x2b50},   {0x2b55, 0x2b55},   {0x2e80, 0x303e},   {0x3041, 0x33ff},   {0x3400, 0x4dbf},
+        {0x4e00, 0x9fff},   {0xa000, 0xa4cf},   {0xa960, 0xa97f},   {0xac00, 0xd7a3},   {0xf900, 0xfaff},
+        {0xfe10, 0xfe19},   {0xfe30, 0xfe6f},   {0xff00, 0xff60},   {0xffe0, 0xffe6},   {0x16fe0, 0x18cff},
+        {0x1b000, 0x1b2ff}, {0x1f004, 0x1f004}, {0x1f0cf, 0x1f0cf}, {0x1f18e, 0x1f18e}, {0x1f191, 0x1f19a},
+        {0x1f200, 0x1f2ff}, {0x1f300, 0x1f64f}, {0x1f680, 0x1f6ff}, {0x1f7e0, 0x1f7eb}, {0x1f90c, 0x1f9ff},
+        {0x1fa70, 0x1faff}, {0x20000, 0x2fffd}, {0x30000, 0x3fffd},
+    };
+
+    // Below the first range is everything a build or a shell usually writes
+    if (codepoint < 0x1100)
+        return false;
+
+    size_t low = 0, high = sizeof ranges / sizeof ranges[0];
+
+    while (low < high)
+    {
+        size_t middle = (low + high) / 2;
+
+        if (codepoint > ranges[middle].last)
+            low = middle + 1;
+        else if (codepoint < ranges[middle].first)
+            high = middle;
+        else
+            return true;
+    }
+
+    return false;
+}
+
+/* Blanks what writing over cells from `from` up to `to` would leave of a wide character cut in half. */
+static void break_wide(TermCell *cells, int from, int to, int columns)
+{
+    if (from > 0 && cells[from].codepoint == 0)
+        cells[from - 1].codepoint = ' ';
+    if (to < columns && cells[to].codepoint == 0)
+        cells[to].codepoint = ' ';
+}
+
+/* Writes a run of printable ASCII at the cursor, wrapping it over as many lines as it takes. */
+static void put_ascii(Terminal *term, const uint8_t *text, size_t len)
+{
+    while (len)
+    {
+        if (term->autowrap)
+            wrap_if_pending(term);
+
+        TermCell *cells = row_cells(term, term->cursor_y);
+        size_t room = (size_t)(term->columns - term->cursor_x);
+        size_t n = len < room ? len : room;
+
+        break_wide(cells, term->cursor_x, term->cursor_x + (int)n, term->columns);
+
+        // Without autowrap everything past the last column lands on it, only the last of it stays
+        if (!term->autowrap && n < len)
+        {
+            write_ascii(&cells[term->cursor_x], text, n - 1, term->pen);
+            text += len - 1;
+            len = n = 1;
+            term->cursor_x = term->columns - 1;
+        }
+
+        write_ascii(&cells[term->cursor_x], text, n, term->pen);
+        mark_dirty(term, term->cursor_y);
+
+        term->cursor_x += (int)n;
+        text += n;
+        len -= n;
+
+        if (term->cursor_x == term->columns)
+        {
+            term->cursor_x = term->columns - 1;
+            term->wrap_pending = true;
+        }
+    }
+}
+
+static void put_codepoint(Terminal *term, uint32_t codepoint)
+{
+    int width = term->columns > 1 && is_wide(codepoint) ? 2 : 1;
+
+    if (term->autowrap)
+        wrap_if_pending(term);
+
+    // A wide character has no room in the last column, it goes to the next line or without autowrap back one column
+    if (width == 2 && term->cursor_x == term->columns - 1)
+    {
+        if (term->autowrap)
+        {
+            term->cursor_x = 0;
+            line_feed(term);
+        }
+        else
+        {
+            term->cursor_x--;
+        }
+    }
+
+    TermCell *cells = row_cells(term, term->cursor_y);
+    int x = term->cursor_x;
+
+    break_wide(cells, x, x + width, term->columns);
+    cells[x] = term->pen;
+    cells[x].codepoint = codepoint;
+    if (width == 2)
+    {
+        cells[x + 1] = term->pen;
+        cells[x + 1].codepoint = 0;
+    }
+    mark_dirty(term, term->cursor_y);
+
+    if (x + width == term->columns)
+    {
+        term->cursor_x = term->columns - 1;
+        term->wrap_pending = true;
+    }
+    else
+    {
+        term->cursor_x = x + width;
+    }
+}
+
+static void reply(Terminal *term, const char *text)
+{
+    size_t len = strlen(text);
+
+    if (term->len_reply + len <= sizeof term->reply)
+    {
+        memcpy(&term->reply[term->len_reply], text, len);
+        term->len_reply += len;
+    }
+}
+
+static void move_cursor(Terminal *term, int x, int y)
+{
+    term->cursor_x = x < 0 ? 0 : x >= term->columns ? term->columns - 1 : x;
+    term->cursor_y = y < 0 ? 0 : y >= term->rows ? term->rows - 1 : y;
+    term->wrap_pending = false;
+}
+
+static void save_cursor(Terminal *term)
+{
+    term->saved_x = term->cursor_x;
+    term->saved_y = term->cursor_y;
+    term->saved_pen = term->pen;
+}
+
+static void restore_cursor(Terminal *term)
+{
+    term->pen = term->saved_pen;
+    move_cursor(term, term->saved_x, term->saved_y);
+}
+
+static void reset(Terminal *term)
+{
+    term->pen = (TermCell){.codepoint = ' ', .attributes = CELL_DEFAULT_FG | CELL_DEFAULT_BG};
+    term->saved_pen = term->pen;
+    term->saved_x = term->saved_y = 0;
+    term->cursor_x = term->cursor_y = 0;
+    term->wrap_pending = false;
+    term->autowrap = true;
+    term->cursor_hidden = false;
+    term->scroll_top = 0;
+    term->scroll_bottom = term->rows;
+    term->state = STATE_GROUND;
+    term->utf8_needed = 0;
+    clear_rows(term, 0, term->rows);
+}
+
+static void control(Terminal *term, uint8_t c)
+{
+    switch (c)
+    {
+    case '\b':
+        if (term->cursor_x > 0)
+            term->cursor_x--;
+        term->wrap_pending = false;
+        break;
+    case '\t':
+    {
+        int x = (term->cursor_x / TAB_WIDTH + 1) * TAB_WIDTH;
+        term->cursor_x = x < term->columns ? x : term->columns - 1;
+        break;
+    }
+    case '\n':
+    case '\v':
+    case '\f':
+        line_feed(term);
+        break;
+    case '\r':
+        term->cursor_x = 0;
+        term->wrap_pending = false;
+        break;
+    default:
+        // The bell, shift in and out, and the rest do nothing on a screen
+        break;
+    }
+}
+
+/* A parameter of the sequence, or its default when it was left out or given as 0. */
+static int param(const Terminal *term, int i, int fallback)
+{
+    return i < term->nparams && term->params[i] ? term->params[i] : fallback;
+}
+
+/* Applies select graphic rendition, taking 38 and 48 with their own parameters after them. */
+static void select_graphic_rendition(Terminal *term)
+{
+    TermCell *pen = &term->pen;
+
+    if (!term->nparams)
+        term->params[term->nparams++] = 0;
+
+    for (int i = 0; i < term->nparams; i++)
+    {
+        int p = term->params[i];
+
+        if (p == 0)
+        {
+            pen->attributes = CELL_DEFAULT_FG | CELL_DEFAULT_BG;
+            pen->fg = pen->bg = 0;
+        }
+        else if (p == 1)
+            pen->attributes |= CELL_BOLD;
+        else if (p == 2)
+            pen->attributes |= CELL_DIM;
+        else if (p == 3)
+            pen->attributes |= CELL_ITALIC;
+        else if (p == 4)
+            pen->attributes |= CELL_UNDERLINE;
+        else if (p == 7)
+            pen->attributes |= CELL_INVERSE;
+        else if (p == 22)
+            pen->attributes &= ~(CELL_BOLD | CELL_DIM);
+        else if (p == 23)
+            pen->attributes &= ~CELL_ITALIC;
+        else if (p == 24)
+            pen->attributes &= ~CELL_UNDERLINE;
+        else if (p == 27)
+            pen->attributes &= ~CELL_INVERSE;
+        else if ((p >= 30 && p <= 37) || (p >= 90 && p <= 97))
+        {
+            pen->fg = (uint8_t)(p >= 90 ? p - 90 + 8 : p - 30);
+            pen->attributes &= ~CELL_DEFAULT_FG;
+        }
+        else if ((p >= 40 && p <= 47) || (p >= 100 && p <= 107))
+        {
+            pen->bg = (uint8_t)(p >= 100 ? p - 100 + 8 : p - 40);
+            pen->attributes &= ~CELL_DEFAULT_BG;
+        }
+        else if (p == 39)
+            pen->attributes |= CELL_DEFAULT_FG;
+        else if (p == 49)
+            pen->attributes |= CELL_DEFAULT_BG;
+        else if ((p == 38 || p == 48) && i + 1 < term->nparams)
+        {
+            uint8_t color;
+
+            if (term->params[i + 1] == 5 && i + 2 < term->nparams)
+            {
+                color = (uint8_t)term->params[i + 2];
+                i += 2;
+            }
+            else if (term->params[i + 1] == 2 && i + 4 < term->nparams)
+            {
+                color = nearest_color(term->params[i + 2] & 0xff, term->params[i + 3] & 0xff,
+                                      term->params[i + 4] & 0xff);
+                i += 4;
+            }
+            else
+            {
+                break;
+            }
+
+            if (p == 38)
+            {
+                pen->fg = color;
+                pen->attributes &= ~CELL_DEFAULT_FG;
+            }
+            else
+            {
+                pen->bg = color;
+                pen->attributes &= ~CELL_DEFAULT_BG;
+            }
+        }
+    }
+}
+
+static void switch_screen(Terminal *term, bool alternate)
+{
+    if (term->alternate == alternate)
+        return;
+
+    TermCell *cells = term->cells;
+    int top = term->top;
+
+    term->cells = term->alternate_cells;
+    term->top = term->alternate_top;
+    term->alternate_cells = cells;
+    term->alternate_top = top;
+    term->alternate = alternate;
+    mark_all_dirty(term);
+}
+
+static void set_private_mode(Terminal *term, int mode, bool on)
+{
+    switch (mode)
+    {
+    case 7:
+        term->autowrap = on;
+        break;
+    case 25:
+        term->cursor_hidden = !on;
+        break;
+    case 47:
+    case 1047:
+        switch_screen(term, on);
+        break;
+    case 1049:
+        // The cursor is saved on the way in and the alternate screen starts empty
+        if (on)
+        {
+            save_cursor(term);
+            switch_screen(term, true);
+            clear_rows(term, 0, term->rows);
+        }
+        else
+        {
+            switch_screen(term, false);
+            restore_cursor(term);
+        }
+        break;
+    default:
+        break;
+    }
+}
+
+static void csi_dispatch(Terminal *term, uint8_t final)
+{
+    TermCell *row = row_cells(term, term->cursor_y);
+    int x = term->cursor_x, y = term->cursor_y;
+    int n = param(term, 0, 1);
+    char buffer[32];
+
+    if (term->private_marker == '?')
+    {
+        if (final == 'h' || final == 'l')
+            for (int i = 0; i < term->nparams; i++)
+                set_private_mode(term, term->params[i], final == 'h');
+        return;
+    }
+
+    // Secondary attributes, cursor styles and the like
+    if (term->private_marker || term->intermediate)
+        return;
+
+    switch (final)
+    {
+    case '@':
+    {
+        int shift = n < term->columns - x ? n : term->columns - x;
+        memmove(&row[x + shift], &row[x], (size_t)(term->columns - x - shift) * sizeof *row);
+        clear_cells(&row[x], (size_t)shift, blank(term));
+        mark_dirty(term, y);
+        break;
+    }
+    case 'A':
+        move_cursor(term, x, y - n < term->scroll_top && y >= term->scroll_top ? term->scroll_top : y - n);
+        break;
+    case 'B':
+    case 'e':
+        move_cursor(term, x, y + n >= term->scroll_bottom && y < term->scroll_bottom ? term->scroll_bottom - 1 : y + n);
+        break;
+    case 'C':
+    case 'a':
+        move_cursor(term, x + n, y);
+        break;
+    case 'D':
+        move_cursor(term, x - n, y);
+        break;
+    case 'E':
+        move_cursor(term, 0, y + n);
+        break;
+    case 'F':
+        move_cursor(term, 0, y - n);
+        break;
+    case 'G':
+    case '`':
+        move_cursor(term, n - 1, y);
+        break;
+    case 'H':
+    case 'f':
+        move_cursor(term, param(term, 1, 1) - 1, n - 1);
+        break;
+    case 'J':
+        switch (param(term, 0, 0))
+        {
+        case 0:
+            clear_cells(&row[x], (size_t)(term->columns - x), blank(term));
+            mark_dirty(term, y);
+            clear_rows(term, y + 1, term->rows);
+            break;
+        case 1:
+            clear_rows(term, 0, y);
+            clear_cells(row, (size_t)x + 1, blank(term));
+            mark_dirty(term, y);
+            break;
+        default:
+            clear_rows(term, 0, term->rows);
+            break;
+        }
+        break;
+    case 'K':
+        switch (param(term, 0, 0))
+        {
+        case 0:
+            clear_cells(&row[x], (size_t)(term->columns - x), blank(term));
+            break;
+        case 1:
+            clear_cells(row, (size_t)x + 1, blank(term));
+            break;
+        default:
+            clear_cells(row, (size_t)term->columns, blank(term));
+            break;
+        }
+        mark_dirty(term, y);
+        break;
+    case 'L':
+        if (y >= term->scroll_top && y < term->scroll_bottom)
+            scroll_down(term, y, term->scroll_bottom, n);
+        term->cursor_x = 0;
+        term->wrap_pending = false;
+        break;
+    case 'M':
+        if (y >= term->scroll_top && y < term->scroll_bottom)
+            scroll_up(term, y, term->scroll_bottom, n);
+        term->cursor_x = 0;
+        term->wrap_pending = false;
+        break;
+    case 'P':
+    {
+        int shift = n < term->columns - x ? n : term->columns - x;
+        memmove(&row[x], &row[x + shift], (size_t)(term->columns - x - shift) * sizeof *row);
+        clear_cells(&row[term->columns - shift], (size_t)shift, blank(term));
+        mark_dirty(term, y);
+        break;
+    }
+    case 'S':
+        scroll_up(term, term->scroll_top, term->scroll_bottom, n);
+        break;
+    case 'T':
+        scroll_down(term, term->scroll_top, term->scroll_bottom, n);
+        break;
+    case 'X':
+        clear_cells(&row[x], (size_t)(n < term->columns - x ? n : term->columns - x), blank(term));
+        mark_dirty(term, y);
+        break;
+    case 'd':
+        move_cursor(term, x, n - 1);
+        break;
+    case 'm':
+        select_graphic_rendition(term);
+        break;
+    case 'n':
+        if (param(term, 0, 0) == 5)
+        {
+            reply(term, "\x1b[0n");
+        }
+        else if (param(term, 0, 0) == 6)
+        {
+            snprintf(buffer, sizeof buffer, "\x1b[%d;%dR", y + 1, x + 1);
+            reply(term, buffer);
+        }
+        break;
+    case 'c':
+        // A VT220 with color, which is what programs that ask expect TERM=xterm to be
+        reply(term, "\x1b[?62;22c");
+        break;
+    case 'r':
+    {
+        int top = param(term, 0, 1) - 1, bottom = param(term, 1, term->rows);
+
+        if (bottom > term->rows)
+            bottom = term->rows;
+        if (top < bottom - 1)
+        {
+            term->scroll_top = top;
+            term->scroll_bottom = bottom;
+            move_cursor(term, 0, 0);
+        }
+        break;
+    }
+    case 's':
+        save_cursor(term);
+        break;
+    case 'u':
+        restore_cursor(term);
+        break;
+    default:
+        break;
+    }
+}
+
+static void esc_dispatch(Terminal *term, uint8_t final)
+{
+    switch (final)
+    {
+    case '7':
+        save_cursor(term);
+        break;
+    case '8':
+        restore_cursor(term);
+        break;
+    case 'D':
+        line_feed(term);
+        break;
+    case 'E':
+        term->cursor_x = 0;
+        line_feed(term);
+        break;
+    case 'M':
+        reverse_line_feed(term);
+        break;
+    case 'c':
+        switch_screen(term, false);
+        reset(term);
+        break;
+    default:
+        break;
+    }
+}
+
+/* Takes a byte of a multibyte sequence, printing the codepoint once it is complete. */
+static void utf8_byte(Terminal *term, uint8_t c)
+{
+    if (term->utf8_needed)
+    {
+        if ((c & 0xc0) == 0x80)
+        {
+            term->utf8_codepoint = term->utf8_codepoint << 6 | (c & 0x3f);
+
+            if (--term->utf8_needed == 0)
+            {
+                uint32_t cp = term->utf8_codepoint;
+                bool valid = cp >= term->utf8_min && cp <= 0x10ffff && (cp < 0xd800 || cp > 0xdfff);
+                put_codepoint(term, valid ? cp : UTF8_REPLACEMENT);
+            }
+            return;
+        }
+
+        // Cut short, the sequence so far is one bad character and the byte is looked at afresh
+        term->utf8_needed = 0;
+        put_codepoint(term, UTF8_REPLACEMENT);
+
+        if (c < 0x80)
+        {
+            term_feed(term, (const char *)&c, 1);
+            return;
+        }
+    }
+
+    if (c >= 0xc2 && c <= 0xdf)
+    {
+        term->utf8_codepoint = c & 0x1f;
+        term->utf8_needed = 1;
+        term->utf8_min = 0x80;
+    }
+    else if (c >= 0xe0 && c <= 0xef)
+    {
+        term->utf8_codepoint = c & 0x0f;
+        term->utf8_needed = 2;
+        term->utf8_min = 0x800;
+    }
+    else if (c >= 0xf0 && c <= 0xf4)
+    {
+        term->utf8_codepoint = c & 0x07;
+        term->utf8_needed = 3;
+        term->utf8_min = 0x10000;
+    }
+    else
+    {
+        put_codepoint(term, UTF8_REPLACEMENT);
+    }
+}
+
+/* Runs one byte through the parser, which follows the DEC state diagram less the states for unused strings. */
+static void step(Terminal *term, uint8_t c)
+{
+    if (term->state == STATE_GROUND && (c >= 0x80 || term->utf8_needed))
+    {
+        utf8_byte(term, c);
+        return;
+    }
+
+    // Cancel and substitute end any sequence, escape starts a new one, also as the first half of a string terminator
+    if (c == 0x18 || c == 0x1a)
+    {
+        term->state = STATE_GROUND;
+        return;
+    }
+
+    if (c == 0x1b)
+    {
+        term->state = STATE_ESCAPE;
+        term->intermediate = 0;
+        return;
+    }
+
+    switch (term->state)
+    {
+    case STATE_GROUND:
+        if (c < 0x20)
+            control(term, c);
+        else if (c < 0x7f)
+            put_codepoint(term, c);
+        break;
+    case STATE_ESCAPE:
+        if (c < 0x20)
+        {
+            control(term, c);
+        }
+        else if (c < 0x30)
+        {
+            term->intermediate = c;
+            term->state = STATE_ESCAPE_INTERMEDIATE;
+        }
+        else if (c == '[')
+        {
+            term->state = STATE_CSI;
+            term->nparams = 0;
+            term->private_marker = 0;
+            memset(term->params, 0, sizeof term->params);
+        }
+        else if (c == ']')
+        {
+            term->state = STATE_OSC;
+        }
+        else if (c == 'P' || c == 'X' || c == '^' || c == '_')
+        {
+            term->state = STATE_STRING;
+        }
+        else
+        {
+            term->state = STATE_GROUND;
+            esc_dispatch(term, c);
+        }
+        break;
+    case STATE_ESCAPE_INTERMEDIATE:
+        if (c < 0x20)
+            control(term, c);
+        else if (c < 0x30)
+            term->intermediate = c;
+        else if (c < 0x7f)
+            // Character set designations and the like, which only matter for line drawing
+            term->state = STATE_GROUND;
+        break;
+    case STATE_CSI:
+        if (c < 0x20)
+        {
+            control(term, c);
+        }
+        else if (c >= '0' && c <= '9')
+        {
+            if (!term->nparams)
+                term->nparams = 1;
+
+            int *p = &term->params[term->nparams - 1];
+            *p = *p * 10 + (c - '0');
+            if (*p > PARAM_MAX)
+                *p = PARAM_MAX;
+        }
+        else if (c == ';' || c == ':')
+        {
+            if (!term->nparams)
+                term->nparams = 1;
+
+            if (term->nparams == TERM_MAX_PARAMS)
+                term->state = STATE_CSI_IGNORE;
+            else
+                term->nparams++;
+        }
+        else if (c >= '<' && c <= '?')
+        {
+            // Only allowed before the parameters
+            if (term->nparams || term->private_marker)
+                term->state = STATE_CSI_IGNORE;
+            else
+                term->private_marker = c;
+        }
+        else if (c < 0x30)
+        {
+            term->intermediate = c;
+        }
+        else if (c >= 0x40 && c < 0x7f)
+        {
+            term->state = STATE_GROUND;
+            csi_dispatch(term, c);
+        }
+        break;
+    case STATE_CSI_IGNORE:
+        if (c < 0x20)
+            control(term, c);
+        else if (c >= 0x40 && c < 0x7f)
+            term->state = STATE_GROUND;
+        break;
+    case STATE_OSC:
+        // Window titles and such, ended by the bell or by a string terminator
+        if (c == 0x07)
+            term->state = STATE_GROUND;
+        break;
+    default:
+        break;
+    }
+}
+
+void term_init(Terminal *term, int columns, int rows)
+{
+    size_t ncells = (size_t)columns * rows;
+
+    *term = (Terminal){
+        .columns = columns,
+        .rows = rows,
+        .cells = malloc(ncells * sizeof *term->cells),
+        .alternate_cells = malloc(ncells * sizeof *term->cells),
+        .dirty = malloc(((size_t)rows + 63) / 64 * sizeof *term->dirty),
+    };
+
+    reset(term);
+    clear_cells(term->alternate_cells, ncells, blank(term));
+    mark_all_dirty(term);
+}
+
+void term_uninit(Terminal *term)
+{
+    free(term->cells);
+    free(term->alternate_cells);
+    free(term->dirty);
+}
+
+/* Copies the rows of a screen into a new size, dropping rows off the top if the cursor would end up below it. */
+static TermCell *resized(const Terminal *term, const TermCell *cells, int top, int columns, int rows, int dropped)
+{
+    TermCell *to = malloc((size_t)columns * rows * sizeof *to);
+    int copy_columns = columns < term->columns ? columns : term->columns;
+    TermCell with = blank(term);
+
+    for (int row = 0; row < rows; row++)
+    {
+        TermCell *out = &to[(size_t)row * columns];
+        int from = row + dropped;
+
+        if (from < term->rows)
+        {
+            int s = (top + from) % term->rows;
+            memcpy(out, &cells[(size_t)s * term->columns], (size_t)copy_columns * sizeof *out);
+            clear_cells(&out[copy_columns], (size_t)(columns - copy_columns), with);
+        }
+        else
+        {
+            clear_cells(out, (size_t)columns, with);
+        }
+    }
+
+    return to;
+}
+
+void term_resize(Terminal *term, int columns, int rows)
+{
+    if (columns == term->columns && rows == term->rows)
+        return;
+
+    int dropped = term->cursor_y >= rows ? term->cursor_y - rows + 1 : 0;
+
+    // Rows dropped off the top go where they would have gone scrolling
+    if (term->scrolled && !term->alternate)
+        for (int row = 0; row < dropped; row++)
+            term->scrolled(term->scrolled_user, row_cells(term, row), term->columns);
+
+    TermCell *cells = resized(term, term->cells, term->top, columns, rows, dropped);
+    TermCell *alternate = resized(term, term->alternate_cells, term->alternate_top, columns, rows, 0);
+
+    free(term->cells);
+    free(term->alternate_cells);
+    free(term->dirty);
+
+    term->cells = cells;
+    term->alternate_cells = alternate;
+    term->top = term->alternate_top = 0;
+    term->columns = columns;
+    term->rows = rows;
+    term->dirty = malloc(((size_t)rows + 63) / 64 * sizeof *term->dirty);
+    term->scroll_top = 0;
+    term->scroll_bottom = rows;
+
+    move_cursor(term, term->cursor_x, term->cursor_y - dropped);
+    mark_all_dirty(term);
+}
+
+void term_feed(Terminal *term, const char *data, size_t len)
+{
+    const uint8_t *text = (const uint8_t *)data;
+
+    for (size_t i = 0; i < len;)
+    {
+        // Runs of plain text go straight into the cells, which is most of what a build or a cat writes
+        if (term->state == STATE_GROUND && !term->utf8_needed)
+        {
+            size_t run = printable_run(&text[i], len - i);
+
+            if (run)
+            {
+                put_ascii(term, &text[i], run);
+                i += run;
+                continue;
+            }
+        }
+
+        step(term, text[i++]);
+    }
+}
+
+const TermCell *term_row(const Terminal *term, int row)
+{
+    return &term->cells[(size_t)slot(term, row) * term->columns];
+}
+
+int term_row_slot(const Terminal *term, int row)
+{
+    return slot(term, row);
+}
+
+bool term_take_dirty(Terminal *term, int slot)
+{
+    uint64_t bit = 1ull << (slot % 64);
+    bool dirty = term->dirty[slot / 64] & bit;
+
+    term->dirty[slot / 64] &= ~bit;
+
+    return dirty;
+}
+
+const char *term_take_reply(Terminal *term, size_t *len)
+{
+    *len = term->len_reply;
+    term->len_reply = 0;
+
+    return term->reply;
+}
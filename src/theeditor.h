@@ -1,160 +1,1156 @@
-﻿#ifndef THE_EDITOR_H
-#define THE_EDITOR_H
-
-#include <stdbool.h>
-#include <stdint.h>
-#include <stdlib.h>
-
-#include "linmath.h"
-
-typedef struct {
-    size_t len, cap;
-    char *buffer;
-} StringArena;
-
-typedef struct {
-    int x, y;
-    int width, height;
-} Rect;
-
-typedef struct {
-    float x, y;
-    float width, height;
-} FRect;
-
-typedef struct
-{
-    size_t length;
-    char *data;
-} String;
-
-#define STRLIT(literal) ((String){.length = strlen(literal), .data = literal})
-
-typedef uint32_t Color;
-
-#define COLOR_RGB(x) (Color)((((Color)x) << 8) | 0xff)
-#define COLOR_RGBA(x) ((Color)(x))
-
-typedef struct {
-    int width;
-    Color background;
-    bool hidden;
-} SidePanel;
-
-typedef struct {
-    int height;
-    Color background;
-    bool hidden;
-} BottomPanel;
-
-typedef struct {
-    Color background;
-} MainPanel;
-
-typedef struct {
-    SidePanel side_panel;
-    BottomPanel bottom_panel;
-    MainPanel main_panel;
-} Layout;
-
-extern Layout layout;
-
-void color_as_rgb(Color c, float out[3]);
-void color_as_rgba(Color c, float out[4]);
-
-typedef struct
-{
-    size_t index;
-    Rect position;
-    Vec2 bearing;
-    Vec2 advance;
-} GlyphInfo;
-
-typedef struct
-{
-    int x, y;
-    int max_y;
-} FontAtlasFillState;
-
-typedef int FontId;
-bool font_init(void);
-bool font_uninit(void);
-/** Returns -1 if failed. */
-FontId font_create_face(const char *path);
-void font_delete_face(FontId id);
-/** Returns true if there was no overflow. */
-bool font_atlas_fill(
-    size_t width, size_t height, uint8_t *atlas,
-    size_t ncodes, const uint32_t *char_codes,
-    FontId face,
-    GlyphInfo *out_glyphinfos,
-    FontAtlasFillState *fill_state);
-
-/** To be called once before all render functions */
-void render_init(void);
-/** Set the viewport of the renderer, just use this for resizing the window. */
-void render_viewport(Rect pos);
-/** To be called before rendering, persists per frame.  Currently only supporting 8 bit single channel textures. */
-int render_init_texture_atlas(size_t width, size_t height, const uint8_t *buffer,
-                              size_t nsubtextures, const Rect *subtexture_boxes);
-// TODO let a user replace a texture atlas data with a new one
-/** Renders at the location with the top left as the origin by default.  Removed after draw. */
-void render_push_textured_quad(int atlasid, int subtexid, Vec2 pos, int8_t z, const FRect *clip_mask);
-/** Removed after draw. */
-void render_push_colored_quad(FRect pos, Color color, int8_t z, const FRect *clip_mask);
-/** Draws the elements to the screen and and resets the per-frame queue. */
-void render_draw(void);
-/** Cleans up the renderer when done. */
-void render_uninit(void);
-
-#define FILENAME_LEN 264
-
-typedef enum {
-    // Common flags
-    FTI_FILE      = 1 << 0,
-    FTI_DIRECTORY = 1 << 1,
-    // To be set only if FTI_DIRECTORY is set
-    FTI_OPEN      = 1 << 2,
-    FTI_EXPLORED  = 1 << 3,
-} FileTreeItemFlags;
-
-typedef struct {
-    size_t len_name;
-    const char *name;
-    int depth;
-    FileTreeItemFlags flags;
-} FileTreeItem;
-
-void ft_init(size_t *len_listing, FileTreeItem **listing, StringArena *strarena);
-void ft_uninit(size_t len_listing, FileTreeItem *listing, StringArena *strarena);
-void ft_expand(size_t *len_listing, FileTreeItem **listing, StringArena *strarena, int index);
-void ft_collapse(size_t len_listing, FileTreeItem *listing, int index);
-
-typedef enum
-{
-    C_FILLWIDTH  = 1 << 0,
-    C_FILLHEIGHT = 1 << 1,
-    C_SCROLLX    = 1 << 2,
-    C_SCROLLY    = 1 << 3,
-} ContainerFlags;
-
-void ui_begin(void);
-void ui_end(void);
-void ui_mouse_position(float x, float y);
-void ui_mouse_button(bool down);
-void ui_viewport(float width, float height);
-void ui_scroll(Vec2 scroll);
-void ui_container_begin(ContainerFlags flags, FRect where, int id);
-void ui_container_end();
-void ui_filetree_begin(void);
-void ui_filetree_end(void);
-bool ui_filetree_item(const FileTreeItem *item, int id);
-void ui_treelist_begin(void);
-void ui_treelist_end(void);
-bool ui_treelist_item(int depth, String name, bool bold, int id);
-bool ui_button(FRect where, int id);
-
-// /** Throwaway testing for imui. to be removed. */
-// bool ui_button(float x, float y, int id);
-
-#endif // THE_EDITOR_H
+﻿#ifndef THE_EDITOR_H
+#define THE_EDITOR_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "linmath.h"
+
+typedef struct {
+    int x, y;
+    int width, height;
+} Rect;
+
+typedef struct {
+    float x, y;
+    float width, height;
+} FRect;
+
+typedef struct
+{
+    size_t length;
+    char *data;
+} String;
+
+#define STRLIT(literal) ((String){.length = strlen(literal), .data = literal})
+
+/** A compact reference to a string interned in a StringArena. */
+typedef uint32_t StringHandle;
+#define STRING_NONE UINT32_MAX
+
+// Chunk k holds STRARENA_FIRST_CHUNK << k bytes, so 20 chunks cover the whole 32 bit handle space
+#define STRARENA_FIRST_CHUNK 4096
+#define STRARENA_MAX_CHUNKS 20
+
+/**
+ * Strings live in chunks that never move once allocated, each twice the size of the last.  A handle is the offset of
+ * a string in the chunks laid end to end.  Equal strings are interned to the same handle.
+ */
+typedef struct {
+    size_t nchunks;
+    char *chunks[STRARENA_MAX_CHUNKS];
+    // Bytes used in the last chunk
+    size_t len_last;
+
+    size_t len_table, cap_table;
+    StringHandle *table;
+    uint32_t *hashes;
+
+    // The first chunks, and the table until it grows, may be borrowed from a mapped snapshot and are never freed
+    size_t nborrowed;
+    bool borrowed_table;
+} StringArena;
+
+void strarena_init(StringArena *arena);
+void strarena_uninit(StringArena *arena);
+/** Returns the handle of an equal string if one was interned already, otherwise copies it in. */
+StringHandle strarena_intern(StringArena *arena, const char *s, size_t len);
+/** The handle of an equal string, or STRING_NONE if none was interned.  Never copies anything in. */
+StringHandle strarena_find(const StringArena *arena, const char *s, size_t len);
+/** The string is valid for the lifetime of the arena. */
+String strarena_get(const StringArena *arena, StringHandle handle);
+/**
+ * Points an empty arena at chunks laid end to end, each of its full size, and at a table of `cap_table` handles
+ * followed by as many hashes.  They are written in place as strings are added, so they must be writable, but the arena
+ * never frees them.
+ */
+void strarena_borrow(StringArena *arena, char *chunks, size_t nchunks, size_t len_last, void *table, size_t len_table,
+    size_t cap_table);
+/** Whether a handle read from a file points at a string that lies wholly within the chunks in use. */
+bool strarena_handle_valid(const StringArena *arena, StringHandle handle);
+/** Whether a borrowed table holds only valid handles, and as many as it says, so every probe ends at an empty slot. */
+bool strarena_table_valid(const StringArena *arena);
+/** Bytes reserved by the chunks and the interning table. */
+size_t strarena_memory(const StringArena *arena);
+
+typedef uint32_t Color;
+
+#define COLOR_RGB(x) (Color)((((Color)x) << 8) | 0xff)
+#define COLOR_RGBA(x) ((Color)(x))
+
+typedef struct {
+    int width;
+    Color background;
+    bool hidden;
+} SidePanel;
+
+typedef struct {
+    int height;
+    Color background;
+    bool hidden;
+} BottomPanel;
+
+typedef struct {
+    Color background;
+} MainPanel;
+
+typedef struct {
+    SidePanel side_panel;
+    BottomPanel bottom_panel;
+    MainPanel main_panel;
+} Layout;
+
+extern Layout layout;
+
+void color_as_rgb(Color c, float out[3]);
+void color_as_rgba(Color c, float out[4]);
+
+// Drawn for bytes that are not UTF-8, and for codepoints without a glyph of their own
+#define UTF8_REPLACEMENT 0xfffd
+
+/** The number of bytes at the start of the text below 0x80, found sixteen at a time. */
+size_t utf8_ascii_prefix(const char *text, size_t len);
+/** Whether the text is all well-formed UTF-8: no overlong forms, surrogates, stray or missing continuation bytes. */
+bool utf8_validate(const char *text, size_t len);
+/**
+ * Decodes text into `out`, which needs room for `len` codepoints.  Each longest run of bytes that could have started a
+ * sequence but did not finish one becomes a single UTF8_REPLACEMENT.  If `offsets` is not NULL it gets the byte each
+ * codepoint starts at.  Returns the number of codepoints.
+ */
+size_t utf8_decode(const char *text, size_t len, uint32_t *out, uint32_t *offsets);
+
+typedef struct
+{
+    size_t index;
+    Rect position;
+    Vec2 bearing;
+    Vec2 advance;
+} GlyphInfo;
+
+typedef struct
+{
+    int x, y;
+    int max_y;
+} FontAtlasFillState;
+
+typedef int FontId;
+bool font_init(void);
+bool font_uninit(void);
+/** Returns -1 if failed. */
+FontId font_create_face(const char *path);
+void font_delete_face(FontId id);
+/** Returns true if there was no overflow. */
+bool font_atlas_fill(
+    size_t width, size_t height, uint8_t *atlas,
+    size_t ncodes, const uint32_t *char_codes,
+    FontId face,
+    GlyphInfo *out_glyphinfos,
+    FontAtlasFillState *fill_state);
+
+/** To be called once before all render functions */
+void render_init(void);
+/** Set the viewport of the renderer, just use this for resizing the window. */
+void render_viewport(Rect pos);
+/** To be called before rendering, persists per frame.  Currently only supporting 8 bit single channel textures. */
+int render_init_texture_atlas(size_t width, size_t height, const uint8_t *buffer,
+                              size_t nsubtextures, const Rect *subtexture_boxes);
+// TODO let a user replace a texture atlas data with a new one
+/** Renders at the location with the top left as the origin by default, tinted with the color.  Removed after draw. */
+void render_push_textured_quad(int atlasid, int subtexid, Vec2 pos, Color color, int8_t z, const FRect *clip_mask);
+/** Removed after draw. */
+void render_push_colored_quad(FRect pos, Color color, int8_t z, const FRect *clip_mask);
+/** Draws the elements to the screen and and resets the per-frame queue. */
+void render_draw(void);
+
+typedef struct {
+    // The last frame drawn, counted as RenderGpuTime counts them
+    uint64_t frame;
+    // Quads drawn, the draw calls they took and the bytes of vertices handed to the driver for them
+    size_t quads, draws, bytes_uploaded;
+    // CPU time handing those over and issuing the draws, in nanoseconds
+    uint64_t upload_ns, draw_ns;
+} RenderFrameStats;
+
+/** What was drawn since the last call, which starts counting again from nothing. */
+RenderFrameStats render_frame_stats(void);
+
+// Frames the GPU may fall behind by before one goes untimed, rather than waiting on its query
+#define RENDER_GPU_TIMERS 4
+
+typedef struct {
+    // Counted by render_draw, the first frame drawn being 0
+    uint64_t frame;
+    uint64_t ns;
+} RenderGpuTime;
+
+/**
+ * The GPU time of the frames the GPU has finished since the last call, oldest first, up to `max` of them.  Frames are
+ * timed by a few queries in turn, never waited on, so a frame goes untimed if the GPU is that far behind.
+ */
+size_t render_gpu_times(RenderGpuTime *times, size_t max);
+/** Waits for the GPU to finish the last frame drawn and gives its time.  Returns false if it went untimed. */
+bool render_gpu_time_wait(uint64_t *ns);
+
+typedef struct RenderFence RenderFence;
+/** Marks how far the GL's commands have been issued, to learn when the GPU has finished them all. */
+RenderFence *render_fence(void);
+/** Whether the GPU has got past the fence, waiting until it has if `wait`.  A fence passed is deleted. */
+bool render_fence_passed(RenderFence *fence, bool wait);
+/**
+ * Draws into a framebuffer of its own of a fixed size rather than the window's, for running with no display.  The
+ * context must have been made current.  Returns false if the framebuffer could not be made.
+ */
+bool render_init_offscreen(int width, int height);
+/** A hash of the pixels last drawn, which is the same whenever a frame comes out the same. */
+uint64_t render_checksum(void);
+/** Cleans up the renderer when done. */
+void render_uninit(void);
+
+#define FILENAME_LEN 264
+
+/** Compiled rules of the .gitignore and .ignore files in one directory, chained to those of its ancestors. */
+typedef struct IgnoreRules IgnoreRules;
+/** Compiled rule sets by directory, shared between threads. */
+typedef struct IgnoreCache IgnoreCache;
+
+typedef struct {
+    // Hash probes and glob runs done to test entries
+    uint64_t evaluations;
+    // Entries left out, so directories among them were never descended
+    uint64_t pruned;
+} IgnoreStats;
+
+typedef enum {
+    // Common flags
+    FTI_FILE      = 1 << 0,
+    FTI_DIRECTORY = 1 << 1,
+    // To be set only if FTI_DIRECTORY is set
+    FTI_OPEN      = 1 << 2,
+    FTI_EXPLORED  = 1 << 3,
+    // Entries are still being enumerated in the background
+    FTI_LOADING   = 1 << 4,
+} FileTreeItemFlags;
+
+typedef uint32_t FileTreeIndex;
+#define FT_NONE UINT32_MAX
+// The implicit root of the workspace, it has no row of its own
+#define FT_ROOT 0
+
+/**
+ * A node of the file tree pool.  The parent/child/sibling links give the directory structure, and every node is also
+ * a row in an order-statistic treap of the rows in display order.  Rows below a collapsed directory are cut out into
+ * that directory's `hidden` treap, so they cost nothing until it is opened again.
+ */
+typedef struct {
+    StringHandle name;
+    int depth;
+    FileTreeItemFlags flags;
+
+    FileTreeIndex parent, first_child, last_child, prev_sibling, next_sibling;
+
+    // Row order treap, keyed implicitly by position and augmented with subtree sizes
+    FileTreeIndex left, right, up;
+    uint32_t priority;
+    uint32_t size;
+    FileTreeIndex hidden;
+
+    // Filesystem watch on an open directory, or -1
+    int watch;
+    // A directory's modification time as of its last listing, or 0 if unknown
+    int64_t mtime;
+} FileTreeItem;
+
+typedef struct {
+    size_t len_nodes, cap_nodes;
+    FileTreeItem *nodes;
+    // Removed nodes, linked through next_sibling
+    FileTreeIndex free_nodes;
+    // Treap of the visible rows
+    FileTreeIndex rows;
+    StringArena strarena;
+    // Open addressed table of the nodes keyed by parent and name
+    size_t len_children, cap_children;
+    FileTreeIndex *children;
+    // Ignored entries are left out of every listing
+    IgnoreCache *ignore;
+    IgnoreStats ignore_stats;
+} FileTree;
+
+#ifdef _WIN32
+#define PATH_SEPARATOR '\\'
+#else
+#define PATH_SEPARATOR '/'
+#endif
+
+/** Called once per directory entry.  Return false to stop the listing early. */
+typedef bool (*PlatformDirCallback)(void *user, const char *name, size_t len_name, FileTreeItemFlags type);
+/** Lists the entries of a directory in a single pass, skipping "." and "..".  Returns false if it could not be read. */
+bool platform_list_directory(const char *path, PlatformDirCallback callback, void *user);
+typedef struct {
+    const char *name;
+    size_t len_name;
+    FileTreeItemFlags type;
+    uint64_t size;
+    // Last modification, in nanoseconds since the Unix epoch
+    int64_t mtime;
+} PlatformDirEntry;
+
+/** Called once per directory entry, with its size and modification time.  Return false to stop early. */
+typedef bool (*PlatformDirStatCallback)(void *user, const PlatformDirEntry *entry);
+/**
+ * Like platform_list_directory, but also gives sizes and modification times.  Symbolic links are reported as files
+ * rather than followed, so a crawl can never loop.
+ */
+bool platform_list_directory_stat(const char *path, PlatformDirStatCallback callback, void *user);
+typedef enum {
+    PLATFORM_WATCH_CREATED,
+    PLATFORM_WATCH_DELETED,
+    PLATFORM_WATCH_MOVED_FROM,
+    PLATFORM_WATCH_MOVED_TO,
+    // The watched directory itself was deleted
+    PLATFORM_WATCH_GONE,
+    // Events were dropped, everything watched has to be listed again
+    PLATFORM_WATCH_OVERFLOW,
+} PlatformWatchEventKind;
+
+typedef struct {
+    PlatformWatchEventKind kind;
+    int watch;
+    // Pairs the two halves of a rename
+    uint32_t cookie;
+    FileTreeItemFlags type;
+    const char *name;
+    size_t len_name;
+} PlatformWatchEvent;
+
+typedef struct PlatformWatcher PlatformWatcher;
+typedef void (*PlatformWatchCallback)(void *user, const PlatformWatchEvent *event);
+
+/** Returns NULL where directories cannot be watched. */
+PlatformWatcher *platform_watcher_create(void);
+void platform_watcher_destroy(PlatformWatcher *watcher);
+/** Starts watching the entries of a directory, returns a watch id or -1. */
+int platform_watch_add(PlatformWatcher *watcher, const char *path);
+void platform_watch_remove(PlatformWatcher *watcher, int watch);
+/** How many watches the system allows a user in total. */
+size_t platform_watch_limit(void);
+/** Reports the events that arrived since the last call, without blocking. */
+void platform_watcher_poll(PlatformWatcher *watcher, PlatformWatchCallback callback, void *user);
+/** The last modification of a file or directory in nanoseconds since the Unix epoch, or 0 if it could not be read. */
+int64_t platform_file_mtime(const char *path);
+/** Moves a file over another, replacing it in one step so readers never see it half written. */
+bool platform_replace_file(const char *from, const char *to);
+/**
+ * The directory the editor keeps its own files in for the current user, made if it is not there yet:
+ * $XDG_CACHE_HOME/theeditor or ~/.cache/theeditor, and %LOCALAPPDATA%\TheEditor on Windows.  Returns false if there is
+ * none to be had or it does not fit.
+ */
+bool platform_cache_dir(char *path, size_t size);
+/** The absolute path of the current directory, returns false if it does not fit. */
+bool platform_current_dir(char *path, size_t size);
+
+typedef struct {
+    void *data;
+    size_t size;
+} PlatformFileMap;
+
+/**
+ * Maps a whole file copy-on-write, so it can be written in place without the changes ever reaching the file.  Pages
+ * are only read in when first touched.  Returns false if the file could not be mapped, or is empty.
+ */
+bool platform_map_file(const char *path, PlatformFileMap *map);
+/** Maps a whole file read-only, which costs no memory up front however large the file is. */
+bool platform_map_file_readonly(const char *path, PlatformFileMap *map);
+void platform_unmap_file(PlatformFileMap *map);
+/** Takes the pages of a range of a read-only mapping out of the process, they are read back in if touched again. */
+void platform_map_release(PlatformFileMap *map, size_t offset, size_t size);
+/** The memory the process has resident, in bytes. */
+size_t platform_resident_memory(void);
+
+typedef struct {
+    // All the process has resident, and its share of that with each page shared by n processes counted as 1/n
+    size_t resident, proportional;
+    // What is backed by no file: the heaps, the stacks and whatever the libraries and drivers allocate
+    size_t anonymous;
+} PlatformMemoryUsage;
+
+/**
+ * The process's memory as the system counts it.  Windows has no proportional share, it is left 0, and the anonymous
+ * memory there is the private memory committed, resident or not.
+ */
+bool platform_memory_usage(PlatformMemoryUsage *usage);
+
+/** Given each mapping in turn, named for the file it maps or NULL for anonymous memory, with its sizes in bytes. */
+typedef void (*PlatformMappingCallback)(void *user, const char *name, size_t resident, size_t proportional);
+
+/**
+ * Calls back with every mapping in the process.  On Windows the sizes are both of the memory committed in each
+ * region, resident or not.  Returns false if the mappings could not be read.
+ */
+bool platform_memory_mappings(PlatformMappingCallback callback, void *user);
+/** The number of logical processors available. */
+int platform_cpu_count(void);
+/** Whether the processor runs AVX2 and the system saves its registers on a switch.  Always false off x86-64. */
+bool platform_cpu_has_avx2(void);
+/** A monotonic clock in nanoseconds, only meaningful relative to other calls. */
+uint64_t platform_time_ns(void);
+/** Gives up the processor for a while, for waiting on work in the background that has no way to signal it is done. */
+void platform_sleep_ms(int ms);
+
+typedef struct PlatformThread PlatformThread;
+typedef struct PlatformMutex PlatformMutex;
+typedef struct PlatformCond PlatformCond;
+typedef void (*PlatformThreadProc)(void *arg);
+
+/** Returns NULL if the thread could not be started. */
+PlatformThread *platform_thread_create(PlatformThreadProc proc, void *arg);
+/** Waits for the thread to finish and frees it. */
+void platform_thread_join(PlatformThread *thread);
+PlatformMutex *platform_mutex_create(void);
+void platform_mutex_destroy(PlatformMutex *mutex);
+void platform_mutex_lock(PlatformMutex *mutex);
+void platform_mutex_unlock(PlatformMutex *mutex);
+PlatformCond *platform_cond_create(void);
+void platform_cond_destroy(PlatformCond *cond);
+/** The mutex must be locked, it is released while waiting and locked again before returning. */
+void platform_cond_wait(PlatformCond *cond, PlatformMutex *mutex);
+void platform_cond_signal(PlatformCond *cond);
+void platform_cond_broadcast(PlatformCond *cond);
+/** Swaps `value` into `*target` and gives back what was there, in one step with a full barrier. */
+void *platform_atomic_exchange_ptr(void *volatile *target, void *value);
+/** Reads a pointer stored by another thread, along with everything that thread wrote before storing it. */
+void *platform_atomic_load_ptr(void *volatile *source);
+/** Stores a pointer so that everything written before it is seen by the thread that loads it. */
+void platform_atomic_store_ptr(void *volatile *target, void *value);
+/** Reads a size stored by another thread, along with everything that thread wrote before storing it. */
+size_t platform_atomic_load_size(volatile size_t *source);
+/** Stores a size so that everything written before it is seen by the thread that loads it. */
+void platform_atomic_store_size(volatile size_t *target, size_t value);
+/** Adds to a size, wrapping round to take away, and gives back the sum, in one step with a full barrier. */
+size_t platform_atomic_add_size(volatile size_t *target, size_t value);
+/** Stores `value` if `*target` still holds `*expected`, returning true, or else reads what it does hold into it. */
+bool platform_atomic_compare_exchange_size(volatile size_t *target, size_t *expected, size_t value);
+
+typedef struct PlatformPty PlatformPty;
+
+/** Starts a shell on a new pseudo-terminal of the given size, the user's own if `shell` is NULL.  NULL on failure. */
+PlatformPty *platform_pty_spawn(const char *shell, int columns, int rows);
+/** Waits for output and reads up to `cap` bytes of it.  Returns 0 once the shell has exited, or the pty was woken. */
+size_t platform_pty_read(PlatformPty *pty, void *buffer, size_t cap);
+/** Makes platform_pty_read return 0 on the thread waiting in it, and on every call after. */
+void platform_pty_wake(PlatformPty *pty);
+/** Sends input to the shell, returns how much of it there was room for. */
+size_t platform_pty_write(PlatformPty *pty, const void *data, size_t len);
+void platform_pty_resize(PlatformPty *pty, int columns, int rows);
+/** Hangs up on the shell, waits for it to exit and frees the pty.  No thread may be reading it any more. */
+void platform_pty_close(PlatformPty *pty);
+
+/**
+ * Zones of time on any thread, each recorded as a timestamp at its beginning and end into a ring of the thread's own,
+ * with no locks once the thread has its ring.  Recording is off until trace_enable, and the zones compile to nothing
+ * without THE_EDITOR_TRACE.  Names must be string literals, they are kept as pointers.
+ */
+#ifdef THE_EDITOR_TRACE
+#define TRACE_BEGIN(name) trace_begin(name)
+#define TRACE_END() trace_end()
+#else
+#define TRACE_BEGIN(name) ((void)0)
+#define TRACE_END() ((void)0)
+#endif
+/** Traces the statement or block that follows, which must not return or break out of it. */
+#define TRACE_ZONE(name) for (int trace_zone_ = (TRACE_BEGIN(name), 1); trace_zone_; trace_zone_ = (TRACE_END(), 0))
+
+/** To be called once on the main thread before any other is started. */
+void trace_init(void);
+void trace_enable(bool enabled);
+bool trace_enabled(void);
+void trace_begin(const char *name);
+void trace_end(void);
+/** Writes the zones every thread still has in its ring as Chrome trace events, for chrome://tracing or Perfetto. */
+bool trace_dump(const char *path);
+
+/**
+ * The stages of starting up, timed on a timeline from when it began.  Stages that need neither the window nor the GL
+ * run on threads of their own while the main thread makes those.  Names must be string literals, as for tracing.
+ */
+typedef struct Startup Startup;
+
+/** Starts the timeline from now. */
+Startup *startup_create(void);
+/** Joins any stage still running first. */
+void startup_destroy(Startup *startup);
+/** Runs a stage on a thread of its own, or here and now if there is no thread to be had. */
+void startup_spawn(Startup *startup, const char *name, PlatformThreadProc proc, void *arg);
+/** Times a stage on the calling thread, from now until startup_end.  They do not nest. */
+void startup_begin(Startup *startup, const char *name);
+void startup_end(Startup *startup);
+/** Waits for every stage spawned to finish, timing the wait as a stage of its own. */
+void startup_join(Startup *startup);
+/** From the start of the timeline to the end of the last stage to finish, in nanoseconds. */
+uint64_t startup_elapsed(const Startup *startup);
+/** Prints each stage, the thread it ran on and when, to stderr. */
+void startup_report(const Startup *startup);
+
+/** Frames the statistics keep, four seconds' worth at 60 a second. */
+#define STATS_FRAMES 240
+
+typedef struct {
+    // Numbered as render_draw numbers them, so the GPU's times can be matched up
+    uint64_t frame;
+    // CPU time for the whole frame, and for building the UI, handing over vertices, issuing draws and swapping
+    uint64_t cpu_ns, ui_ns, upload_ns, draw_ns, swap_ns;
+    // Known some frames later once the GPU has finished, if it was not too far behind to time at all
+    uint64_t gpu_ns;
+    bool gpu_known;
+    size_t quads, bytes_uploaded;
+} FrameSample;
+
+typedef struct {
+    uint64_t cpu_p50, cpu_p99, gpu_p50, gpu_p99;
+} FrameSummary;
+
+/** The latest frames' timings and what they drew, for the overlay and for writing out as CSV. */
+typedef struct FrameStats FrameStats;
+
+FrameStats *stats_create(void);
+/** Writes out the rows still waiting on the GPU, if a CSV is being written. */
+void stats_destroy(FrameStats *stats);
+/**
+ * Writes a row for every frame to a CSV from now on, each a few frames late so the GPU's time is in it.  Past a
+ * hundred thousand rows the file is moved aside to `path`.1, replacing the one before, and a new one started.
+ */
+bool stats_csv_start(FrameStats *stats, const char *path);
+void stats_push(FrameStats *stats, const FrameSample *sample);
+/** Fills in the GPU time of a frame, if it is still kept. */
+void stats_gpu_time(FrameStats *stats, uint64_t frame, uint64_t ns);
+size_t stats_count(const FrameStats *stats);
+/** The frame `age` frames before the latest, which is 0.  `age` must be less than stats_count. */
+const FrameSample *stats_sample(const FrameStats *stats, size_t age);
+/** Medians and 99th percentiles of the frames kept, 0 for the GPU's if none were timed. */
+FrameSummary stats_summary(const FrameStats *stats);
+/** Writes every frame kept as CSV, oldest first. */
+bool stats_write_csv(const FrameStats *stats, const char *path);
+
+/** What memory is for, each counted apart from the others. */
+typedef enum {
+    MEM_RENDER,
+    MEM_UI,
+    MEM_FILETREE,
+    MEM_STRINGS,
+    // The atlases and glyph metrics made from the fonts, and FreeType's own allocations
+    MEM_FONTS,
+    MEM_FREETYPE,
+    // Estimated from the sizes asked of the GL, the driver's copies are its own business
+    MEM_GL_BUFFERS,
+    MEM_GL_TEXTURES,
+    NUM_MEM_TAGS,
+} MemTag;
+
+typedef struct {
+    // Bytes held now and at most, and how many allocations were ever made
+    size_t live, peak, allocations;
+} MemStats;
+
+/** malloc and friends, counted under a tag.  A block must go back to mem_free or mem_realloc with the same tag. */
+void *mem_alloc(MemTag tag, size_t size);
+void *mem_calloc(MemTag tag, size_t count, size_t size);
+void *mem_realloc(MemTag tag, void *block, size_t size);
+void mem_free(MemTag tag, void *block);
+/** Counts memory allocated outside the process's heap, such as what the GL is asked for. */
+void mem_account(MemTag tag, size_t size);
+void mem_unaccount(MemTag tag, size_t size);
+MemStats mem_stats(MemTag tag);
+const char *mem_tag_name(MemTag tag);
+/** Writes every tag's figures to stderr, with the process's memory and the mappings that take the most of it. */
+void mem_report(void);
+
+/** Lists the working directory synchronously as the children of FT_ROOT. */
+void ft_init(FileTree *tree);
+void ft_uninit(FileTree *tree);
+/**
+ * Opens a directory in O(log n) and starts watching it.  It is enumerated on a background worker the first time, and
+ * listed again afterwards to catch up on changes made while it was closed.
+ */
+void ft_expand(FileTree *tree, FileTreeIndex node);
+/**
+ * Splices entries enumerated in the background into the tree, and applies filesystem changes once a burst of them
+ * settles.  To be called at the start of a frame.
+ */
+void ft_poll(FileTree *tree);
+/** Whether listings, or the catching up after ft_load, are still in flight. */
+bool ft_busy(const FileTree *tree);
+/**
+ * Writes the whole tree with its expanded directories and a scroll offset to `path`, as an image of the node pool that
+ * ft_load can map without parsing.  It is written next to `path` first and moved over it once complete.
+ */
+bool ft_save(const FileTree *tree, const char *path, float scroll);
+/**
+ * Maps a snapshot written by ft_save as the tree, in place of ft_init.  Nothing is parsed or copied, but every node is
+ * checked once against the others and the rows it is shown in, since the nodes are used in place.  The directories
+ * that were watched are then watched again and listed in the background if their modification time changed, a few per
+ * ft_poll.  Returns false if there was no usable snapshot, truncated, from another build or corrupt.
+ */
+bool ft_load(FileTree *tree, const char *path, float *scroll);
+/** Hides the rows below a directory in O(log n), and stops watching it. */
+void ft_collapse(FileTree *tree, FileTreeIndex node);
+/** The number of rows currently visible, O(1). */
+size_t ft_visible_count(const FileTree *tree);
+/** The node shown on the given visible row in O(log n), or FT_NONE past the end. */
+FileTreeIndex ft_visible_row(const FileTree *tree, size_t row);
+/** The node on the row after this one, amortised O(1), or FT_NONE at the end. */
+FileTreeIndex ft_next_visible(const FileTree *tree, FileTreeIndex node);
+/** Paths given to the cache are relative to `root`, like the ones from ft_path. */
+IgnoreCache *ignore_cache_create(const char *root);
+void ignore_cache_destroy(IgnoreCache *cache);
+/** The rules in effect inside a directory, reading and compiling ignore files on the way down once.  Thread safe. */
+const IgnoreRules *ignore_rules_for(IgnoreCache *cache, const char *path);
+/** Like ignore_rules_for when the parent's rules are known, and whether the directory holds ignore files too. */
+const IgnoreRules *ignore_rules_child(IgnoreCache *cache, const IgnoreRules *parent, const char *path, bool has_files);
+/** Whether a name is one of the files rules are read from. */
+bool ignore_is_rule_file(const char *name, size_t len_name);
+/** Whether an entry of the directory `dir` should be listed.  .git is always left out. */
+bool ignore_keep(const IgnoreRules *rules, const char *dir, const char *name, size_t len_name, FileTreeItemFlags type,
+    IgnoreStats *stats);
+
+/**
+ * A columnar listing of a whole workspace.  Entry 0 is the root, and the children of each directory sit in one
+ * contiguous run that comes after the directory's own entry.
+ */
+typedef struct {
+    size_t len;
+    uint32_t *parent;
+    StringHandle *name;
+    uint8_t *flags;
+    uint64_t *size;
+    int64_t *mtime;
+    StringArena strarena;
+    IgnoreStats ignore_stats;
+} WorkspaceSnapshot;
+
+/**
+ * Crawls everything below `root` with a work-stealing pool of `nthreads` workers, or one per core if 0.  Entries
+ * ignored by `ignore`, which must have been created for the same root, are never listed or descended.  It may be NULL.
+ */
+bool ws_index(WorkspaceSnapshot *snapshot, const char *root, int nthreads, IgnoreCache *ignore);
+void ws_snapshot_free(WorkspaceSnapshot *snapshot);
+/** Rebuilds the tree from a snapshot of the working directory, with every directory explored and closed. */
+void ft_populate(FileTree *tree, const WorkspaceSnapshot *snapshot);
+
+/** The name of a node, valid for the lifetime of the tree. */
+String ft_name(const FileTree *tree, FileTreeIndex node);
+/** Writes the path of a node relative to the workspace root, returns its length or 0 if it did not fit. */
+size_t ft_path(const FileTree *tree, FileTreeIndex node, char *buffer, size_t size);
+
+typedef struct PieceNode PieceNode;
+typedef struct DocIndexer DocIndexer;
+
+/**
+ * The text of an open file as a piece table: the file's bytes and an append-only buffer of everything typed since,
+ * with the pieces kept in order in a treap that knows the bytes and newlines below each node.  Edits and conversions
+ * between offsets and lines take O(log n) in the number of pieces.
+ *
+ * Large files are mapped rather than read, and their lines counted on a background thread.  Until the count reaches a
+ * part of the file its lines are estimated, so seeking to a line there lands near it rather than on it.
+ */
+typedef struct {
+    char *original;
+    size_t len_original;
+    char *add;
+    size_t len_add, cap_add;
+
+    PieceNode *nodes;
+    size_t len_nodes, cap_nodes;
+    uint32_t free_nodes;
+    uint32_t root;
+
+    DocIndexer *indexer;
+} Document;
+
+/** A version of a document kept for undo, it shares all its pieces with the document and costs nothing to take. */
+typedef uint32_t DocSnapshot;
+
+typedef struct {
+    size_t offset, len;
+} DocRange;
+
+/** Starts a document holding `text`, which it takes ownership of. */
+void doc_init(Document *doc, char *text, size_t len);
+/** Reads a file, or maps it if it is large, in which case only the first screen or so has been looked at yet. */
+bool doc_load(Document *doc, const char *path);
+/** Takes in the lines counted in the background since the last call, returns whether there are more to come. */
+bool doc_poll(Document *doc);
+/** How far into the document lines are exact, rather than estimated. */
+size_t doc_counted_length(const Document *doc);
+/** Frees the document along with any snapshots still taken of it. */
+void doc_uninit(Document *doc);
+size_t doc_length(const Document *doc);
+size_t doc_line_count(const Document *doc);
+void doc_insert(Document *doc, size_t offset, const char *text, size_t len);
+void doc_delete(Document *doc, size_t offset, size_t len);
+/** Copies up to `len` bytes from `offset` into `out`, returns how many there were. */
+size_t doc_read(const Document *doc, size_t offset, char *out, size_t len);
+/** Points at the bytes from `offset` to the end of the piece holding them, returns how many there are. */
+size_t doc_chunk(const Document *doc, size_t offset, const char **data);
+/**
+ * Puts `text` in place of each of the ranges, which are sorted and do not overlap.  The text is added once and the
+ * pieces rebuilt in one pass, so this is a single edit however many ranges there are.
+ */
+void doc_replace_ranges(Document *doc, const DocRange *ranges, size_t nranges, const char *text, size_t len);
+/** The offset a line starts at, counting from 0, or the length of the document past the last line. */
+size_t doc_line_start(const Document *doc, size_t line);
+/** The line and column in bytes of an offset, both counting from 0. */
+void doc_position(const Document *doc, size_t offset, size_t *line, size_t *column);
+DocSnapshot doc_snapshot(Document *doc);
+/** Brings the document back to a snapshot, which stays valid until released. */
+void doc_restore(Document *doc, DocSnapshot snapshot);
+void doc_release(Document *doc, DocSnapshot snapshot);
+/** Counts the line breaks in a span of text, 16 bytes at a time where SSE2 is there. */
+size_t doc_count_newlines(const char *text, size_t len);
+
+typedef enum {
+    SEARCH_IGNORE_CASE = 1 << 0,
+    SEARCH_REGEX = 1 << 1,
+} SearchFlags;
+
+/**
+ * A pattern ready to be looked for, either bytes as they are or a regular expression.  Regular expressions match
+ * within a line and support classes, `.`, `^`, `$`, `\b`, groups, alternation and greedy or lazy repetition, with no
+ * captures.  Only ASCII letters have their case ignored.
+ */
+typedef struct Search Search;
+
+/** Returns NULL for an empty pattern or a regular expression that does not parse. */
+Search *search_create(const char *pattern, size_t len, SearchFlags flags);
+void search_destroy(Search *search);
+/** Finds the first match starting at `from` or after in a buffer. */
+bool search_buffer(const Search *search, const char *text, size_t len, size_t from, DocRange *match);
+/**
+ * For text searched a chunk at a time with each chunk ending on a newline: how far back from the newline the next
+ * chunk has to start over, to find the matches that run on past it.
+ */
+size_t search_overlap(const Search *search);
+/** Finds the first match starting at `from` or after in a document. */
+bool search_document(const Search *search, const Document *doc, size_t from, DocRange *match);
+/** Replaces every match with `text` as a single edit, returns how many there were. */
+size_t search_replace_all(const Search *search, Document *doc, const char *text, size_t len);
+
+/** A line of a file with a match on it. */
+typedef struct {
+    // Both counting from 0, the column in bytes of the first match on the line
+    size_t line, column;
+    // The part of the line around the match, and where the match sits in it
+    String excerpt;
+    uint32_t match_start, match_len;
+} FindLine;
+
+/** Everything found in one file, reported once the file has been searched through. */
+typedef struct {
+    // Relative to the root the search was started at
+    String path;
+    size_t nlines;
+    FindLine *lines;
+    // More lines matched than were kept
+    bool truncated;
+} FindFileResult;
+
+typedef struct {
+    uint64_t files, bytes;
+    // Files left unsearched because they looked binary
+    uint64_t binary;
+    uint64_t lines;
+    IgnoreStats ignore_stats;
+} FindStats;
+
+/** A search through every file of a workspace, running on a pool of workers. */
+typedef struct FindInFiles FindInFiles;
+
+/**
+ * Starts searching everything below `root` not ignored by `ignore`, which must have been created for the same root and
+ * may be NULL, with `nthreads` workers or one per core if 0.  The workers list directories and search files as they
+ * go, so results come in from the first directory on.  Takes ownership of the search.
+ */
+FindInFiles *find_start(const char *root, Search *search, IgnoreCache *ignore, int nthreads);
+/** Takes in the files searched since the last call without blocking, returns whether the search is still running. */
+bool find_poll(FindInFiles *find);
+/** The files with matches taken in so far, in the order they were finished. */
+size_t find_file_count(const FindInFiles *find);
+const FindFileResult *find_file(const FindInFiles *find, size_t index);
+/** What the workers have gone through so far. */
+FindStats find_stats(FindInFiles *find);
+/** Stops the workers partway into the files they are on, and frees the search with its results. */
+void find_destroy(FindInFiles *find);
+
+/**
+ * Every file path of a workspace relative to its root, laid end to end in one arena.  Each path has a mask of the
+ * characters in it with case folded, so a path missing any character of a query is passed over without reading it.
+ */
+#define PATH_INDEX_PADDING 64
+
+typedef struct {
+    size_t len;
+    // Path i runs from offsets[i] to offsets[i + 1], and the last is followed by PATH_INDEX_PADDING zeros
+    char *text;
+    uint32_t *offsets;
+    uint64_t *masks;
+} PathIndex;
+
+/** Takes the files of a snapshot.  Paths past the first 4 GB of them are left out. */
+void path_index_build(PathIndex *index, const WorkspaceSnapshot *snapshot);
+void path_index_free(PathIndex *index);
+String path_index_get(const PathIndex *index, uint32_t path);
+
+#define QUICK_OPEN_MAX_RESULTS 100
+#define QUICK_OPEN_QUERY_MAX 256
+
+typedef struct {
+    uint32_t path;
+    int32_t score;
+} QuickOpenMatch;
+
+/**
+ * Fuzzy matching of a query against a path index, on a pool of workers that each take a chunk of paths at a time.  A
+ * path matches if the query's characters appear in it in order, ignoring case, and scores higher the more of them are
+ * next to each other, at the start of words and in the file name.  The paths that matched each query are kept, so a
+ * query that extends the last one only looks at those, and taking characters back off costs nothing.
+ */
+typedef struct QuickOpen QuickOpen;
+
+/** Crawls `root` in the background with the ignore rules of `ignore`, which may be NULL, and indexes its files. */
+QuickOpen *qo_create(const char *root, IgnoreCache *ignore, int nthreads);
+/** Works over an index built already, which it takes ownership of. */
+QuickOpen *qo_create_with_index(PathIndex *index, int nthreads);
+void qo_destroy(QuickOpen *qo);
+/** Whether the index has been built, before that queries are kept until it has. */
+bool qo_ready(QuickOpen *qo);
+/** The index, only to be used once qo_ready has said so. */
+const PathIndex *qo_index(const QuickOpen *qo);
+/** Starts matching a query without blocking, dropping the one in flight.  It is cut to QUICK_OPEN_QUERY_MAX bytes. */
+void qo_set_query(QuickOpen *qo, const char *query, size_t len);
+/**
+ * Writes up to `max` of the best matches found so far, best first, and returns whether the query has been matched
+ * against every path.  Results come in as the chunks of paths are finished, so they can be shown while it runs.
+ */
+bool qo_poll(QuickOpen *qo, QuickOpenMatch *out, size_t max, size_t *nout, size_t *nmatches);
+/** Blocks until the query has been matched against every path. */
+void qo_wait(QuickOpen *qo);
+/** Where the query's characters matched in a path, for highlighting them.  Returns how many were written. */
+size_t qo_positions(QuickOpen *qo, uint32_t path, uint32_t *positions, size_t max);
+
+/** A lexer for one language, with its keyword tables. */
+typedef struct Language Language;
+
+typedef enum {
+    TOKEN_PLAIN,
+    TOKEN_KEYWORD,
+    TOKEN_TYPE,
+    TOKEN_NUMBER,
+    TOKEN_STRING,
+    TOKEN_COMMENT,
+    TOKEN_PREPROCESSOR,
+    NUM_TOKEN_KINDS,
+} TokenKind;
+
+/** A run of one line in one color.  Bytes no span covers are plain. */
+typedef struct {
+    uint32_t column;
+    uint16_t length;
+    uint8_t kind;
+} TokenSpan;
+
+/**
+ * Syntax highlighting of a document, which keeps the state the lexer is in at the start of every line.  After an edit
+ * only the lines from the edit on are lexed again, up to the first one that starts in the state it did before, and
+ * never further than the lines asked for.
+ */
+typedef struct {
+    const Language *language;
+    uint32_t *states;
+    size_t len_states, cap_states;
+    // Lines before this start in the state recorded for them
+    size_t valid;
+    // From this line on, each recorded state follows from lexing the line before in the state recorded for it
+    size_t dirty_end;
+    char *buffer;
+    size_t cap_buffer;
+} Highlighter;
+
+/** The language of a file going by its extension, NULL if there is none. */
+const Language *hl_language_for_path(const char *path);
+Color hl_token_color(TokenKind kind);
+/** Starts highlighting an unlexed document, `language` may be NULL for plain text. */
+void hl_init(Highlighter *hl, const Language *language);
+void hl_uninit(Highlighter *hl);
+/** Tells the highlighter that `line` was edited, and the `removed` lines after it were replaced by `added` others. */
+void hl_edit(Highlighter *hl, size_t line, size_t removed, size_t added);
+/** Lexes whatever is needed for the start states of the lines up to `last_line` and a margin after it to be known. */
+void hl_update(Highlighter *hl, const Document *doc, size_t last_line);
+/**
+ * Gives the text of a line without its line break, valid until the next call, and writes up to `max_spans` of its
+ * colored spans.  Returns how many were written.
+ */
+size_t hl_line(Highlighter *hl, const Document *doc, size_t line, String *text, TokenSpan *spans, size_t max_spans);
+
+/**
+ * A shell on a pseudo-terminal, whose output a thread of its own reads into a ring as fast as it comes.  The UI takes
+ * it from the ring once a frame, and the shell is only held up when a whole ring of it has not been taken yet.
+ */
+typedef struct Console Console;
+typedef void (*ConsoleOutputCallback)(void *user, const char *data, size_t len);
+
+/** Starts a shell, the user's own if `shell` is NULL.  Returns NULL if it could not be started. */
+Console *console_create(const char *shell, int columns, int rows);
+/** Hangs up on the shell and waits for the reader to stop. */
+void console_destroy(Console *console);
+/**
+ * Hands everything the shell wrote since the last call to `callback`, in two pieces where the ring wraps.  To be
+ * called at the start of a frame.  Returns false once the shell has exited and all it wrote has been handed over.
+ */
+bool console_poll(Console *console, ConsoleOutputCallback callback, void *user);
+/** Sends typed text to the shell, returns how much of it there was room for. */
+size_t console_write(Console *console, const char *data, size_t len);
+void console_resize(Console *console, int columns, int rows);
+
+#define TERM_MAX_PARAMS 16
+#define TERM_REPLY_MAX 64
+
+typedef enum {
+    CELL_BOLD = 1 << 0,
+    CELL_DIM = 1 << 1,
+    CELL_ITALIC = 1 << 2,
+    CELL_UNDERLINE = 1 << 3,
+    CELL_INVERSE = 1 << 4,
+    // The terminal's own colors rather than the palette entries in the cell
+    CELL_DEFAULT_FG = 1 << 5,
+    CELL_DEFAULT_BG = 1 << 6,
+} TermCellAttributes;
+
+/** A character on a terminal's screen, packed into eight bytes so runs of them are written a vector at a time. */
+typedef struct {
+    // A wide character takes two cells, the second of them being 0
+    uint32_t codepoint;
+    // Palette entries, colors given as RGB are taken to the closest one
+    uint8_t fg, bg;
+    uint8_t attributes;
+    uint8_t unused;
+} TermCell;
+
+/** Called with each row that scrolls off the top of the main screen, before it is cleared. */
+typedef void (*TermScrollCallback)(void *user, const TermCell *cells, int columns);
+
+/**
+ * The screen of a VT-style terminal and the parser feeding it.  Rows are kept in a ring, the screen's row r being
+ * slot (top + r) % rows, so scrolling the whole screen moves no cells.  Each slot has a dirty bit, set when its cells
+ * change and taken by whoever draws it.
+ */
+typedef struct {
+    int columns, rows;
+    TermCell *cells;
+    int top;
+    uint64_t *dirty;
+    // The screen full-screen programs switch to and back from, swapped with the one above while in use
+    TermCell *alternate_cells;
+    int alternate_top;
+    bool alternate;
+    int cursor_x, cursor_y;
+    // Having written to the last column the cursor stays on it, and the next character goes on the next line
+    bool wrap_pending;
+    bool autowrap, cursor_hidden;
+    // What characters are written with, and erased cells take the background of
+    TermCell pen;
+    // Scrolling happens between these rows, the bottom one being past the region
+    int scroll_top, scroll_bottom;
+    int saved_x, saved_y;
+    TermCell saved_pen;
+    uint8_t state, private_marker, intermediate;
+    int params[TERM_MAX_PARAMS];
+    int nparams;
+    uint32_t utf8_codepoint, utf8_min;
+    int utf8_needed;
+    // Answers to the program's queries, to be written back to it
+    char reply[TERM_REPLY_MAX];
+    size_t len_reply;
+    // Set by the owner to keep the rows, the alternate screen's are never given
+    TermScrollCallback scrolled;
+    void *scrolled_user;
+} Terminal;
+
+/** The RGB of a palette entry: the 16 standard colors, the 6x6x6 cube and the greys, as xterm has them. */
+uint32_t term_palette(uint8_t index);
+/** Starts a blank screen with the cursor at the top left. */
+void term_init(Terminal *term, int columns, int rows);
+void term_uninit(Terminal *term);
+/** Keeps what fits of the screen, dropping rows off the top rather than losing the cursor's row.  All are dirty. */
+void term_resize(Terminal *term, int columns, int rows);
+/**
+ * Interprets a program's output: text, controls, and the escape sequences for colors, cursor movement, erasing and
+ * scrolling.  Runs of printable ASCII are found and written into the cells 16 bytes at a time.
+ */
+void term_feed(Terminal *term, const char *data, size_t len);
+/** The cells of a row of the screen, counting from the top. */
+const TermCell *term_row(const Terminal *term, int row);
+/** The slot a row of the screen is in, which stays the same as the screen scrolls. */
+int term_row_slot(const Terminal *term, int row);
+/** Whether a slot changed since the last call for it. */
+bool term_take_dirty(Terminal *term, int slot);
+/** The answers to queries written since the last call, valid until the next term_feed. */
+const char *term_take_reply(Terminal *term, size_t *len);
+
+/** The most lz_compress can write for this much input. */
+size_t lz_bound(size_t len);
+/** Compresses with a fast LZ77 codec into lz_bound(len) bytes of room.  Returns the compressed size. */
+size_t lz_compress(const void *src, size_t len, void *dst);
+/** Decompresses into exactly len_dst bytes.  Returns false if the input is malformed or gives any other size. */
+bool lz_decompress(const void *src, size_t len, void *dst, size_t len_dst);
+
+/**
+ * The lines a terminal scrolled off its screen.  The most recent are kept as they came, and the rest packed into
+ * blocks of a few hundred lines compressed with lz_compress, each unpacked again when a line of it is asked for.
+ * The oldest blocks are dropped to keep the memory used within a budget.
+ */
+typedef struct Scrollback Scrollback;
+
+Scrollback *scrollback_create(size_t budget);
+void scrollback_destroy(Scrollback *sb);
+void scrollback_push(Scrollback *sb, const TermCell *cells, int columns);
+/** The lines still kept, numbered from the first ever pushed, `end` being one past the last. */
+void scrollback_range(const Scrollback *sb, uint64_t *first, uint64_t *end);
+/** Fills a row with a line, blank past its end or cut at the row's.  Returns false for a line no longer kept. */
+bool scrollback_line(Scrollback *sb, uint64_t line, TermCell *cells, int columns);
+/** Everything the scrollback has allocated, which is what its budget is held to. */
+size_t scrollback_memory(const Scrollback *sb);
+
+typedef enum {
+    INPUT_CURSOR,
+    INPUT_BUTTON,
+    INPUT_SCROLL,
+    INPUT_KEY,
+    INPUT_CHAR,
+} InputKind;
+
+#define NUM_INPUT_KINDS (INPUT_CHAR + 1)
+
+/** As recordings write it. */
+const char *input_kind_name(InputKind kind);
+
+/** A call of one of the window's input callbacks, and the frame it came in before. */
+typedef struct {
+    uint64_t frame;
+    // Seconds since recording started, kept to see how a session went but not replayed
+    double time;
+    InputKind kind;
+    // The cursor's position, or the scroll
+    double x, y;
+    // A key, or a mouse button with its action and mods
+    int key, scancode, action, mods;
+    uint32_t codepoint;
+} InputEvent;
+
+typedef struct InputRecording InputRecording;
+/** Events read back from a recording, handed out by frame so a session plays out the same whatever the frame rate. */
+typedef struct InputReplay InputReplay;
+
+/** Starts writing events to a file as text, replacing it.  Returns NULL if it could not be created. */
+InputRecording *input_record_start(const char *path);
+void input_record(InputRecording *rec, const InputEvent *event);
+void input_record_stop(InputRecording *rec);
+/** Reads a recording, or a script written like one.  Returns NULL, saying why, if any line of it is not an event. */
+InputReplay *input_replay_load(const char *path);
+void input_replay_destroy(InputReplay *replay);
+/** Takes the next event to be fed in before `frame` is drawn.  Returns false when there are none left for it. */
+bool input_replay_next(InputReplay *replay, uint64_t frame, InputEvent *event);
+/** The frame the last event comes in before. */
+uint64_t input_replay_last_frame(const InputReplay *replay);
+
+// Latencies are counted in buckets of half a millisecond, the last taking everything longer
+#define LATENCY_BUCKET_NS 500000
+#define LATENCY_BUCKETS 100
+
+typedef struct {
+    size_t buckets[LATENCY_BUCKETS];
+    size_t count;
+    uint64_t total_ns, max_ns;
+    // The frame that showed the slowest, counted as replays count them
+    uint64_t max_frame;
+} LatencyHistogram;
+
+/**
+ * How long input takes to reach the screen, from the callback it came in by to the GPU finishing the first frame
+ * swapped after it.  What the compositor and the display add after that is not counted.
+ */
+typedef struct Latency Latency;
+
+Latency *latency_create(void);
+/** Waits for the frames the GPU is still on, so their fences can go. */
+void latency_destroy(Latency *latency);
+/** An event came in at `time`, from platform_time_ns.  The next frame swapped is the first to show it. */
+void latency_input(Latency *latency, InputKind kind, uint64_t time);
+/** A frame has been swapped, showing the input that came in since the last. */
+void latency_frame(Latency *latency, uint64_t frame);
+/** Counts the frames the GPU has finished since, waiting for every one swapped if `wait`. */
+void latency_poll(Latency *latency, bool wait);
+const LatencyHistogram *latency_histogram(const Latency *latency, InputKind kind);
+/** Prints each kind of event's latencies, then their histograms, to stderr. */
+void latency_report(const Latency *latency);
+
+typedef enum
+{
+    C_FILLWIDTH  = 1 << 0,
+    C_FILLHEIGHT = 1 << 1,
+    C_SCROLLX    = 1 << 2,
+    C_SCROLLY    = 1 << 3,
+} ContainerFlags;
+
+/**
+ * Rasterises the fonts the UI draws with, ahead of the first frame that needs them.  Any thread may, so long as no
+ * other uses the fonts or the UI until it is done.
+ */
+void ui_fonts_rasterise(void);
+/** Hands the fonts to the GL, rasterising any not yet.  Otherwise each is loaded by the first frame to draw with it. */
+void ui_fonts_load(void);
+void ui_begin(void);
+void ui_end(void);
+void ui_mouse_position(float x, float y);
+void ui_mouse_button(bool down);
+void ui_viewport(float width, float height);
+void ui_scroll(Vec2 scroll);
+void ui_container_begin(ContainerFlags flags, FRect where, int id);
+void ui_container_end();
+/** The scroll offset a container keeps between frames, zero before it was first laid out. */
+Vec2 ui_container_scroll(int id);
+/** Sets the scroll offset of a container, which may not have been laid out yet. */
+void ui_container_set_scroll(int id, Vec2 offset);
+void ui_filetree_begin(void);
+void ui_filetree_end(void);
+bool ui_filetree_item(const FileTreeItem *item, int id);
+void ui_treelist_begin(void);
+void ui_treelist_end(void);
+/** Gives the range of rows that fall inside the current container, so only those need to be emitted. */
+void ui_treelist_visible_rows(size_t nrows, size_t *first, size_t *count);
+/** Advances the layout past rows that are not emitted. */
+void ui_treelist_skip(size_t nrows);
+bool ui_treelist_item(int depth, String name, bool bold, int id);
+void ui_code_begin(void);
+void ui_code_end(void);
+/** Gives the range of lines that fall inside the current container, only those need to be highlighted and emitted. */
+void ui_code_visible_lines(size_t nlines, size_t *first, size_t *count);
+/** Advances the layout past lines that are not emitted. */
+void ui_code_skip(size_t nlines);
+/** Emits a line of text colored by its token spans, which are sorted by column and do not overlap. */
+void ui_code_line(String text, const TokenSpan *spans, size_t nspans);
+/** How many columns and rows of terminal cells fit in the current container. */
+void ui_terminal_fit(int *columns, int *rows);
+/**
+ * Emits a terminal's screen in the current container.  Rows are laid out again only when the terminal marked them
+ * dirty, otherwise what they were drawn with last frame is pushed again.  The container's scroll goes back through
+ * the scrollback a line at a time, and stays on the same lines as more are pushed.  The scrollback may be NULL.
+ */
+void ui_terminal(Terminal *term, Scrollback *scrollback);
+/** Draws the frame statistics over everything else in the top right corner: a graph of frame times and the figures. */
+void ui_frame_stats(const FrameStats *stats);
+bool ui_button(FRect where, int id);
+
+// /** Throwaway testing for imui. to be removed. */
+// bool ui_button(float x, float y, int id);
+
+#endif // THE_EDITOR_H
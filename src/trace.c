@@ -0,0 +1,171 @@
+#include "theeditor.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _MSC_VER
+#define THREAD_LOCAL __declspec(thread)
+#else
+#define THREAD_LOCAL _Thread_local
+#endif
+
+// Records kept per thread, a few frames' worth for the main thread at the zones there are
+#define TRACE_RING_SIZE (1u << 14)
+#define TRACE_MAX_THREADS 256
+
+/* A zone beginning, or ending when the name is NULL, which is all Chrome needs to match it with its beginning. */
+typedef struct {
+    uint64_t time;
+    const char *name;
+} TraceRecord;
+
+/*
+ * Only its own thread writes a ring, publishing each record by moving the head past it.  A dump reads the head, copies
+ * the records before it and reads the head again, dropping any that were written over in between.
+ */
+typedef struct {
+    TraceRecord records[TRACE_RING_SIZE];
+    volatile size_t head;
+} TraceRing;
+
+static struct {
+    bool enabled;
+    uint64_t start;
+    PlatformMutex *mutex;
+    TraceRing *rings[TRACE_MAX_THREADS];
+    volatile size_t nrings;
+} trace;
+
+static THREAD_LOCAL TraceRing *thread_ring;
+// Set once a thread could not have a ring, so it does not ask again on every record
+static THREAD_LOCAL bool thread_refused;
+
+static TraceRing *thread_ring_create(void);
+
+void trace_init(void)
+{
+    trace.mutex = platform_mutex_create();
+    trace.start = platform_time_ns();
+
+    // The calling thread gets the first ring, so it is the one shown as the main thread
+    thread_ring_create();
+}
+
+void trace_enable(bool enabled)
+{
+    trace.enabled = enabled;
+}
+
+bool trace_enabled(void)
+{
+    return trace.enabled;
+}
+
+/* Gives the thread a ring of its own the first time it records anything.  Rings outlive their threads. */
+static TraceRing *thread_ring_create(void)
+{
+    TraceRing *ring = NULL;
+
+    if (thread_refused || !trace.mutex)
+        return NULL;
+
+    platform_mutex_lock(trace.mutex);
+
+    size_t n = trace.nrings;
+    if (n < TRACE_MAX_THREADS)
+    {
+        ring = calloc(1, sizeof *ring);
+        trace.rings[n] = ring;
+        platform_atomic_store_size(&trace.nrings, n + 1);
+    }
+
+    platform_mutex_unlock(trace.mutex);
+
+    thread_ring = ring;
+    thread_refused = !ring;
+
+    return ring;
+}
+
+static void trace_record(const char *name)
+{
+    TraceRing *ring = thread_ring ? thread_ring : thread_ring_create();
+
+    if (!ring)
+        return;
+
+    size_t head = ring->head;
+    ring->records[head & (TRACE_RING_SIZE - 1)] = (TraceRecord){platform_time_ns(), name};
+    platform_atomic_store_size(&ring->head, head + 1);
+}
+
+void trace_begin(const char *name)
+{
+    if (trace.enabled)
+        trace_record(name);
+}
+
+void trace_end(void)
+{
+    if (trace.enabled)
+        trace_record(NULL);
+}
+
+/* Writes what is left in a ring as Chrome trace events, each after a comma. */
+static void dump_ring(FILE *file, const TraceRing *ring, size_t tid, TraceRecord *copy)
+{
+    size_t head = platform_atomic_load_size((volatile size_t *)&ring->head);
+    size_t begin = head > TRACE_RING_SIZE ? head - TRACE_RING_SIZE : 0;
+
+    for (size_t i = begin; i < head; i++)
+        copy[i - begin] = ring->records[i & (TRACE_RING_SIZE - 1)];
+
+    // Whatever the thread wrote over while this copied is gone, and the ends of zones begun before the oldest kept
+    size_t after = platform_atomic_load_size((volatile size_t *)&ring->head);
+    size_t valid = after > TRACE_RING_SIZE && after - TRACE_RING_SIZE > begin ? after - TRACE_RING_SIZE : begin;
+    size_t depth = 0;
+
+    for (size_t i = valid; i < head; i++)
+    {
+        const TraceRecord *record = &copy[i - begin];
+        double ts = (double)(record->time - trace.start) / 1e3;
+
+        if (record->name)
+        {
+            fprintf(file, ",\n{\"name\": \"%s\", \"ph\": \"B\", \"ts\": %.3f, \"pid\": 1, \"tid\": %zu}", record->name,
+                    ts, tid);
+            depth++;
+        }
+        else if (depth)
+        {
+            fprintf(file, ",\n{\"ph\": \"E\", \"ts\": %.3f, \"pid\": 1, \"tid\": %zu}", ts, tid);
+            depth--;
+        }
+    }
+}
+
+bool trace_dump(const char *path)
+{
+    FILE *file = fopen(path, "w");
+
+    if (!file)
+        return false;
+
+    TraceRecord *copy = malloc(TRACE_RING_SIZE * sizeof *copy);
+    size_t nrings = platform_atomic_load_size(&trace.nrings);
+
+    fputs("{\"traceEvents\": [\n{\"name\": \"process_name\", \"ph\": \"M\", \"pid\": 1, "
+          "\"args\": {\"name\": \"TheEditor\"}}", file);
+
+    for (size_t i = 0; i < nrings; i++)
+    {
+        fprintf(file, ",\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %zu, "
+                      "\"args\": {\"name\": \"%s\"}}", i, i ? "worker" : "main");
+        dump_ring(file, trace.rings[i], i, copy);
+    }
+
+    fputs("\n]}\n", file);
+    free(copy);
+
+    return !fclose(file);
+}
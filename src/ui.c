@@ -1,369 +1,1006 @@
-#include "theeditor.h"
-
-#include <assert.h>
-#include <math.h>
-#include <stdio.h>
-#include <string.h>
-
-static int hot;
-static int active = 0;
-static float mouse_pos_x = 0;
-static float mouse_pos_y = 0;
-static bool mouse_button_down = false;
-static Vec2 mouse_scroll = {0};
-static float window_width;
-static float window_height;
-
-#define MAX_UI_NEST_DEPTH 8
-#define SCROLL_SPEED 20.0
-
-typedef struct
-{
-    FRect local_rect;
-    // Vec2 local_scroll_offset;
-} Container;
-
-static size_t container_stack_height = 0;
-static Container *container_stack = NULL;
-
-typedef struct
-{
-    int id;
-    Vec2 local_scroll_offset;
-} ContainerState;
-
-static size_t container_state_len = 0;
-static size_t container_state_cap = 0;
-static ContainerState *container_state = NULL;
-static ContainerState *container_state_current = NULL;
-
-void ui_container_begin(ContainerFlags flags, FRect where, int id)
-{
-    assert(container_stack_height < MAX_UI_NEST_DEPTH);
-
-    Vec2 scroll_offset;
-    int found = -1;
-
-    for (size_t i = 0; i < container_state_len; i++)
-    {
-        if (container_state[i].id == id)
-        {
-            scroll_offset = container_state[i].local_scroll_offset;
-            found = i;
-            break;
-        }
-    }
-
-    if (found < 0 && container_state_len >= container_state_cap)
-    {
-        container_state_cap = 2 * container_state_cap;
-        if (container_state_cap < 8)
-            container_state_cap = 8;
-        container_state = realloc(container_state, container_state_cap * sizeof *container_state);
-    }
-
-    if (flags & C_FILLWIDTH)
-    {
-        where.x = 0.0f;
-        where.width = container_stack[container_stack_height - 1].local_rect.width;
-    }
-    if (flags & C_FILLHEIGHT)
-    {
-        where.y = 0.0f;
-        where.height = container_stack[container_stack_height - 1].local_rect.height;
-    }
-
-    if (found < 0)
-    {
-        container_state[container_state_len] = (ContainerState)
-        {
-            .id = id,
-            .local_scroll_offset = {0},
-        };
-        container_state_len++;
-        container_state_current = &container_state[container_state_len];
-    }
-    else
-    {
-        Vec2 scroll = mouse_scroll;
-        if (!(flags & C_SCROLLX))
-            scroll.x = 0.0f;
-        if (!(flags & C_SCROLLY))
-            scroll.y = 0.0f;
-
-        Vec2 *offset = &container_state[found].local_scroll_offset;
-        *offset = v2_add(*offset, scroll);
-        container_state_current = &container_state[found];
-    }
-
-    container_stack[container_stack_height] = (Container)
-    {
-        .local_rect = where,
-    };
-    container_stack_height++;
-}
-
-void ui_container_end()
-{
-    container_stack_height--;
-}
-
-static bool frect_contains_point(FRect rect, Vec2 point)
-{
-    return rect.x <= point.x && point.x <= rect.x + rect.width
-            && rect.y <= point.y && point.y <= rect.y + rect.height;
-}
-
-static inline FRect compute_mask(size_t ncontainers, const Container *containers)
-{
-    Vec2 offset = {0};
-    float greatest_left = -INFINITY, least_right = INFINITY;
-    float greatest_top = -INFINITY, least_bottom = INFINITY;
-    FRect r, t;
-
-    for (int i = 0; i < ncontainers; i++)
-    {
-        r = containers[i].local_rect;
-
-        t = r;
-        t.x += offset.x;
-        t.y += offset.y;
-
-        if (t.x > greatest_left) greatest_left = t.x;
-        if (t.y > greatest_top) greatest_top = t.y;
-        if (t.x + t.width < least_right) least_right = t.x + t.width;
-        if (t.y + t.height < least_bottom) least_bottom = t.y + t.height;
-
-        offset = v2_add(offset, (Vec2) {r.x, r.y});
-    }
-
-    r.x = greatest_left;
-    r.y = greatest_top;
-    r.width = fmaxf(least_right - greatest_left, 0);
-    r.height = fmaxf(least_bottom - greatest_top, 0);
-
-    return r;
-}
-
-/* Applies the container stack to convert these coordinates to global ones. */
-static FRect frect_transformed(FRect rect)
-{
-    Vec2 x = {rect.x, rect.y};
-
-    for (int i = 0; i < container_stack_height; i++)
-        x = v2_add(x, (Vec2){container_stack[i].local_rect.x, container_stack[i].local_rect.y});
-
-    if (container_state_current)
-        x = v2_add(x, container_state_current->local_scroll_offset);
-
-    rect.x = x.x;
-    rect.y = x.y;
-
-    return rect;
-}
-
-void ui_begin(void)
-{
-    if (!container_stack)
-    {
-        container_stack = malloc(MAX_UI_NEST_DEPTH * sizeof *container_stack);
-    }
-
-    hot = 0;
-
-    memset(container_stack, 0, MAX_UI_NEST_DEPTH * sizeof *container_stack);
-    container_stack[0].local_rect = (FRect){
-        .x = 0, .y = 0,
-        .width = window_width, .height = window_height,
-    };
-    container_stack_height = 1;
-}
-
-void ui_end(void)
-{
-    if (!mouse_button_down)
-    {
-        active = 0;
-    }
-    else if (!active)
-    {
-        // The user is clicking/dragging dead space; disallow other widgets to be selected
-        active = -1;
-    }
-
-    render_draw();
-}
-
-static float treelist_item_offset_y;
-static int treelist_atlas = -1;
-static size_t treelist_glyph_info_len;
-static GlyphInfo *treelist_glyph_info;
-
-void ui_treelist_begin(void)
-{
-    // TODO generalise this to either a ui function or a system of its own; it is quick and dirty
-    if (treelist_atlas < 0)
-    {
-        FontId face = font_create_face("C:\\Windows\\Fonts\\segoeui.ttf");
-
-        const char begin = ' ';
-        const char end = '~';
-        size_t width = 1024, height = 1024;
-        uint8_t *atlas_data = malloc(width * height * sizeof *atlas_data);
-
-        treelist_glyph_info_len = end - begin + 1;
-        uint32_t *codes = malloc(treelist_glyph_info_len * sizeof *codes);
-        for (int i = 0; i < treelist_glyph_info_len; i++)
-            codes[i] = begin + i;
-        // allocate double the glyphs for regular and bold
-        treelist_glyph_info = malloc(2 * treelist_glyph_info_len * sizeof *treelist_glyph_info);
-        FontAtlasFillState fill_state = {0};
-        font_atlas_fill(
-            width, height, atlas_data,
-            treelist_glyph_info_len, codes,
-            face,
-            treelist_glyph_info,
-            &fill_state);
-        font_delete_face(face);
-        face = font_create_face("C:\\Windows\\Fonts\\segoeuib.ttf");
-        font_atlas_fill(
-            width, height, atlas_data,
-            treelist_glyph_info_len, codes,
-            face,
-            treelist_glyph_info + treelist_glyph_info_len,
-            &fill_state);
-        font_delete_face(face);
-        free(codes);
-
-        // also need separate boxes for regular and bold
-        Rect *boxes = malloc(2 * treelist_glyph_info_len * sizeof *boxes);
-        for (int i = 0; i < 2 * treelist_glyph_info_len; i++)
-            boxes[i] = treelist_glyph_info[i].position;
-        treelist_atlas = render_init_texture_atlas(width, height, atlas_data, 2 * treelist_glyph_info_len, boxes);
-        free(boxes);
-    }
-
-    treelist_item_offset_y = 0.0f;
-}
-
-void ui_treelist_end(void)
-{
-}
-
-bool ui_treelist_item(int depth, String text, bool bold, int id)
-{
-    const float baseline_padding = 12;
-    const float depth_distance = 24;
-    const float width = container_stack[container_stack_height - 1].local_rect.width;
-    const float height = 48;
-
-    bool was_activated = false;
-
-    FRect mask = compute_mask(container_stack_height, container_stack);
-    FRect where = frect_transformed((FRect) {0, treelist_item_offset_y, width, height});
-    Vec2 mouse_pos = (Vec2) {mouse_pos_x, mouse_pos_y};
-
-    treelist_item_offset_y += height;
-
-    if (frect_contains_point(where, mouse_pos) && frect_contains_point(mask, mouse_pos))
-    {
-        hot = id;
-
-        if (!active && mouse_button_down)
-        {
-            active = id;
-        }
-        else if (active == id && !mouse_button_down)
-        {
-            was_activated = true;
-        }
-    }
-
-    if (active == id)
-    {
-        render_push_colored_quad(where, COLOR_RGB(0x808080), 1, &mask);
-    }
-    else if (hot == id)
-    {
-        render_push_colored_quad(where, COLOR_RGB(0x404040), 1, &mask);
-    }
-
-    Vec2 offset = {
-        where.x + baseline_padding + depth_distance * (depth - 1),
-        where.y + where.height - 12,
-    };
-
-    GlyphInfo *glyph_buffer = treelist_glyph_info;
-    if (bold)
-        glyph_buffer += treelist_glyph_info_len;
-
-    for (int i = 0; i < text.length; i++)
-    {
-        char c = text.data[i];
-        Vec2 with_bearing = v2_add(offset, glyph_buffer[c - ' '].bearing);
-
-        render_push_textured_quad(
-            treelist_atlas,
-            (int)(c - ' ') + (bold ? treelist_glyph_info_len : 0),
-            with_bearing,
-            1,
-            &mask
-		);
-
-        offset = v2_add(offset, glyph_buffer[c - ' '].advance);
-    }
-
-    return was_activated;
-}
-
-bool ui_button(FRect where, int id)
-{
-    FRect mask = compute_mask(container_stack_height, container_stack);
-    where = frect_transformed(where);
-    Vec2 mouse_pos = (Vec2) {mouse_pos_x, mouse_pos_y};
-
-    if (frect_contains_point(where, mouse_pos) && frect_contains_point(mask, mouse_pos))
-    {
-        hot = id;
-
-        if (!active && mouse_button_down)
-        {
-            active = id;
-        }
-    }
-
-    if (active == id)
-    {
-        render_push_colored_quad(where, COLOR_RGB(0x00FF00), 0, &mask);
-    }
-    else if (hot == id)
-    {
-        render_push_colored_quad(where, COLOR_RGB(0xFF0000), 0, &mask);
-    }
-    else
-    {
-        render_push_colored_quad(where, COLOR_RGB(0x0000FF), 0, &mask);
-    }
-}
-
-void ui_mouse_position(float x, float y)
-{
-    mouse_pos_x = x;
-    mouse_pos_y = y;
-}
-
-void ui_mouse_button(bool down)
-{
-    mouse_button_down = down;
-}
-
-void ui_viewport(float width, float height)
-{
-    window_width = width;
-    window_height = height;
-}
-
-void ui_scroll(Vec2 scroll)
-{
-    mouse_scroll = scroll;
-}
+#include "theeditor.h"
+
+#include <assert.h>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+static int hot;
+static int active = 0;
+static float mouse_pos_x = 0;
+static float mouse_pos_y = 0;
+static bool mouse_button_down = false;
+static Vec2 mouse_scroll = {0};
+static float window_width;
+static float window_height;
+
+#define MAX_UI_NEST_DEPTH 8
+#define SCROLL_SPEED 20.0
+#define TREELIST_ITEM_HEIGHT 48
+#define CODE_LINE_HEIGHT 36
+#define CODE_TAB_WIDTH 4
+// Lines are decoded this far at most, further than any window is wide
+#define CODE_LINE_DECODE_MAX 1024
+
+// The system's own fonts, off Windows those that come with most distributions so the editor runs headless anywhere
+#ifdef _WIN32
+#define TREELIST_FONT "C:\\Windows\\Fonts\\segoeui.ttf"
+#define TREELIST_FONT_BOLD "C:\\Windows\\Fonts\\segoeuib.ttf"
+#define CODE_FONT "C:\\Windows\\Fonts\\consola.ttf"
+#else
+#define TREELIST_FONT "/usr/share/fonts/truetype/dejavu/DejaVuSans.ttf"
+#define TREELIST_FONT_BOLD "/usr/share/fonts/truetype/dejavu/DejaVuSans-Bold.ttf"
+#define CODE_FONT "/usr/share/fonts/truetype/dejavu/DejaVuSansMono.ttf"
+#endif
+
+/* The codepoints the atlases have glyphs for, in atlas order.  The replacement character comes last. */
+static const struct {
+    uint32_t first, last;
+} glyph_ranges[] = {
+    {' ', '~'},
+    // Latin-1 Supplement and Latin Extended-A
+    {0xa0, 0x17f},
+    {0x391, 0x3c9},
+    {0x400, 0x45f},
+    {UTF8_REPLACEMENT, UTF8_REPLACEMENT},
+};
+
+#define NUM_GLYPH_RANGES (sizeof glyph_ranges / sizeof glyph_ranges[0])
+
+typedef struct
+{
+    FRect local_rect;
+    // Vec2 local_scroll_offset;
+} Container;
+
+static size_t container_stack_height = 0;
+static Container *container_stack = NULL;
+
+typedef struct
+{
+    int id;
+    Vec2 local_scroll_offset;
+} ContainerState;
+
+static size_t container_state_len = 0;
+static size_t container_state_cap = 0;
+static ContainerState *container_state = NULL;
+static ContainerState *container_state_current = NULL;
+
+static int container_state_find(int id)
+{
+    for (size_t i = 0; i < container_state_len; i++)
+        if (container_state[i].id == id)
+            return (int)i;
+
+    return -1;
+}
+
+static void container_state_reserve(void)
+{
+    if (container_state_len >= container_state_cap)
+    {
+        container_state_cap = 2 * container_state_cap;
+        if (container_state_cap < 8)
+            container_state_cap = 8;
+        container_state = mem_realloc(MEM_UI, container_state, container_state_cap * sizeof *container_state);
+    }
+}
+
+Vec2 ui_container_scroll(int id)
+{
+    int found = container_state_find(id);
+    return found < 0 ? (Vec2){0} : container_state[found].local_scroll_offset;
+}
+
+void ui_container_set_scroll(int id, Vec2 offset)
+{
+    int found = container_state_find(id);
+
+    if (found < 0)
+    {
+        container_state_reserve();
+        found = (int)container_state_len++;
+        container_state[found].id = id;
+    }
+
+    container_state[found].local_scroll_offset = offset;
+}
+
+void ui_container_begin(ContainerFlags flags, FRect where, int id)
+{
+    assert(container_stack_height < MAX_UI_NEST_DEPTH);
+
+    int found = container_state_find(id);
+
+    if (found < 0)
+        container_state_reserve();
+
+    if (flags & C_FILLWIDTH)
+    {
+        where.x = 0.0f;
+        where.width = container_stack[container_stack_height - 1].local_rect.width;
+    }
+    if (flags & C_FILLHEIGHT)
+    {
+        where.y = 0.0f;
+        where.height = container_stack[container_stack_height - 1].local_rect.height;
+    }
+
+    if (found < 0)
+    {
+        container_state[container_state_len] = (ContainerState)
+        {
+            .id = id,
+            .local_scroll_offset = {0},
+        };
+        container_state_current = &container_state[container_state_len];
+        container_state_len++;
+    }
+    else
+    {
+        Vec2 scroll = mouse_scroll;
+        if (!(flags & C_SCROLLX))
+            scroll.x = 0.0f;
+        if (!(flags & C_SCROLLY))
+            scroll.y = 0.0f;
+
+        Vec2 *offset = &container_state[found].local_scroll_offset;
+        *offset = v2_add(*offset, scroll);
+        container_state_current = &container_state[found];
+    }
+
+    container_stack[container_stack_height] = (Container)
+    {
+        .local_rect = where,
+    };
+    container_stack_height++;
+}
+
+void ui_container_end()
+{
+    container_stack_height--;
+}
+
+static bool frect_contains_point(FRect rect, Vec2 point)
+{
+    return rect.x <= point.x && point.x <= rect.x + rect.width
+            && rect.y <= point.y && point.y <= rect.y + rect.height;
+}
+
+static bool frect_intersects(FRect a, FRect b)
+{
+    return a.x < b.x + b.width && b.x < a.x + a.width
+            && a.y < b.y + b.height && b.y < a.y + a.height;
+}
+
+static inline FRect compute_mask(size_t ncontainers, const Container *containers)
+{
+    Vec2 offset = {0};
+    float greatest_left = -INFINITY, least_right = INFINITY;
+    float greatest_top = -INFINITY, least_bottom = INFINITY;
+    FRect r, t;
+
+    for (int i = 0; i < ncontainers; i++)
+    {
+        r = containers[i].local_rect;
+
+        t = r;
+        t.x += offset.x;
+        t.y += offset.y;
+
+        if (t.x > greatest_left) greatest_left = t.x;
+        if (t.y > greatest_top) greatest_top = t.y;
+        if (t.x + t.width < least_right) least_right = t.x + t.width;
+        if (t.y + t.height < least_bottom) least_bottom = t.y + t.height;
+
+        offset = v2_add(offset, (Vec2) {r.x, r.y});
+    }
+
+    r.x = greatest_left;
+    r.y = greatest_top;
+    r.width = fmaxf(least_right - greatest_left, 0);
+    r.height = fmaxf(least_bottom - greatest_top, 0);
+
+    return r;
+}
+
+/* Applies the container stack to convert these coordinates to global ones. */
+static FRect frect_transformed(FRect rect)
+{
+    Vec2 x = {rect.x, rect.y};
+
+    for (int i = 0; i < container_stack_height; i++)
+        x = v2_add(x, (Vec2){container_stack[i].local_rect.x, container_stack[i].local_rect.y});
+
+    if (container_state_current)
+        x = v2_add(x, container_state_current->local_scroll_offset);
+
+    rect.x = x.x;
+    rect.y = x.y;
+
+    return rect;
+}
+
+void ui_begin(void)
+{
+    // The zone is the whole pass, it ends once ui_end has drawn it
+    TRACE_BEGIN("ui");
+
+    if (!container_stack)
+    {
+        container_stack = mem_alloc(MEM_UI, MAX_UI_NEST_DEPTH * sizeof *container_stack);
+    }
+
+    hot = 0;
+
+    memset(container_stack, 0, MAX_UI_NEST_DEPTH * sizeof *container_stack);
+    container_stack[0].local_rect = (FRect){
+        .x = 0, .y = 0,
+        .width = window_width, .height = window_height,
+    };
+    container_stack_height = 1;
+}
+
+void ui_end(void)
+{
+    if (!mouse_button_down)
+    {
+        active = 0;
+    }
+    else if (!active)
+    {
+        // The user is clicking/dragging dead space; disallow other widgets to be selected
+        active = -1;
+    }
+
+    render_draw();
+    TRACE_END();
+}
+
+/* Every codepoint with a glyph, in atlas order.  The result must be freed. */
+static uint32_t *glyph_codes(size_t *ncodes)
+{
+    size_t n = 0;
+
+    for (size_t r = 0; r < NUM_GLYPH_RANGES; r++)
+        n += glyph_ranges[r].last - glyph_ranges[r].first + 1;
+
+    uint32_t *codes = mem_alloc(MEM_FONTS, n * sizeof *codes);
+
+    *ncodes = 0;
+    for (size_t r = 0; r < NUM_GLYPH_RANGES; r++)
+        for (uint32_t c = glyph_ranges[r].first; c <= glyph_ranges[r].last; c++)
+            codes[(*ncodes)++] = c;
+
+    return codes;
+}
+
+/* Where a codepoint's glyph is in the atlases, the replacement character's for any without one. */
+static size_t glyph_index(uint32_t codepoint)
+{
+    size_t base = 0;
+
+    for (size_t r = 0; r < NUM_GLYPH_RANGES; r++)
+    {
+        if (codepoint >= glyph_ranges[r].first && codepoint <= glyph_ranges[r].last)
+            return base + codepoint - glyph_ranges[r].first;
+
+        base += glyph_ranges[r].last - glyph_ranges[r].first + 1;
+    }
+
+    return base - 1;
+}
+
+#define TREELIST_ATLAS_WIDTH 2048
+#define TREELIST_ATLAS_HEIGHT 1024
+#define CODE_ATLAS_WIDTH 1024
+#define CODE_ATLAS_HEIGHT 1024
+
+static float treelist_item_offset_y;
+static int treelist_atlas = -1;
+static size_t treelist_glyph_info_len;
+static GlyphInfo *treelist_glyph_info;
+// Rasterised but not yet handed to the GL, which only the thread with the context can do
+static uint8_t *treelist_atlas_data;
+
+/* Rasterises the regular and bold weights of the tree's font into one atlas, unless it already has been. */
+static void treelist_atlas_rasterise(void)
+{
+    // TODO generalise this to either a ui function or a system of its own; it is quick and dirty
+    if (treelist_atlas < 0 && !treelist_atlas_data)
+    {
+        FontId face = font_create_face(TREELIST_FONT);
+
+        size_t width = TREELIST_ATLAS_WIDTH, height = TREELIST_ATLAS_HEIGHT;
+        uint8_t *atlas_data = mem_alloc(MEM_FONTS, width * height * sizeof *atlas_data);
+        uint32_t *codes = glyph_codes(&treelist_glyph_info_len);
+        // allocate double the glyphs for regular and bold
+        treelist_glyph_info = mem_alloc(MEM_FONTS, 2 * treelist_glyph_info_len * sizeof *treelist_glyph_info);
+        FontAtlasFillState fill_state = {0};
+        font_atlas_fill(
+            width, height, atlas_data,
+            treelist_glyph_info_len, codes,
+            face,
+            treelist_glyph_info,
+            &fill_state);
+        font_delete_face(face);
+        face = font_create_face(TREELIST_FONT_BOLD);
+        font_atlas_fill(
+            width, height, atlas_data,
+            treelist_glyph_info_len, codes,
+            face,
+            treelist_glyph_info + treelist_glyph_info_len,
+            &fill_state);
+        font_delete_face(face);
+        mem_free(MEM_FONTS, codes);
+
+        treelist_atlas_data = atlas_data;
+    }
+}
+
+static void treelist_atlas_load(void)
+{
+    if (treelist_atlas >= 0)
+        return;
+
+    treelist_atlas_rasterise();
+
+    // also need separate boxes for regular and bold
+    Rect *boxes = mem_alloc(MEM_FONTS, 2 * treelist_glyph_info_len * sizeof *boxes);
+    for (int i = 0; i < 2 * treelist_glyph_info_len; i++)
+        boxes[i] = treelist_glyph_info[i].position;
+    treelist_atlas = render_init_texture_atlas(TREELIST_ATLAS_WIDTH, TREELIST_ATLAS_HEIGHT, treelist_atlas_data,
+                                               2 * treelist_glyph_info_len, boxes);
+    mem_free(MEM_FONTS, boxes);
+    mem_free(MEM_FONTS, treelist_atlas_data);
+    treelist_atlas_data = NULL;
+}
+
+void ui_treelist_begin(void)
+{
+    TRACE_BEGIN("ui_treelist");
+    treelist_atlas_load();
+    treelist_item_offset_y = 0.0f;
+}
+
+void ui_treelist_end(void)
+{
+    TRACE_END();
+}
+
+/* The rows of a list laid out from offset_y down that fall inside the current container. */
+static void visible_rows(float offset_y, float row_height, size_t nrows, size_t *first, size_t *count)
+{
+    FRect mask = compute_mask(container_stack_height, container_stack);
+    FRect where = frect_transformed((FRect) {0, offset_y, 0, 0});
+
+    float top = (mask.y - where.y) / row_height;
+    float bottom = (mask.y + mask.height - where.y) / row_height;
+
+    size_t begin = top > 0 ? (size_t)top : 0;
+    size_t end = bottom > 0 ? (size_t)ceilf(bottom) : 0;
+
+    if (begin > nrows)
+        begin = nrows;
+    if (end > nrows)
+        end = nrows;
+    if (end < begin)
+        end = begin;
+
+    *first = begin;
+    *count = end - begin;
+}
+
+void ui_treelist_visible_rows(size_t nrows, size_t *first, size_t *count)
+{
+    visible_rows(treelist_item_offset_y, TREELIST_ITEM_HEIGHT, nrows, first, count);
+}
+
+void ui_treelist_skip(size_t nrows)
+{
+    treelist_item_offset_y += (float)nrows * TREELIST_ITEM_HEIGHT;
+}
+
+bool ui_treelist_item(int depth, String text, bool bold, int id)
+{
+    const float baseline_padding = 12;
+    const float depth_distance = 24;
+    const float width = container_stack[container_stack_height - 1].local_rect.width;
+    const float height = TREELIST_ITEM_HEIGHT;
+
+    bool was_activated = false;
+
+    FRect mask = compute_mask(container_stack_height, container_stack);
+    FRect where = frect_transformed((FRect) {0, treelist_item_offset_y, width, height});
+    Vec2 mouse_pos = (Vec2) {mouse_pos_x, mouse_pos_y};
+
+    treelist_item_offset_y += height;
+
+    // Rows scrolled out of the container cost nothing beyond the layout
+    if (!frect_intersects(where, mask))
+        return false;
+
+    if (frect_contains_point(where, mouse_pos) && frect_contains_point(mask, mouse_pos))
+    {
+        hot = id;
+
+        if (!active && mouse_button_down)
+        {
+            active = id;
+        }
+        else if (active == id && !mouse_button_down)
+        {
+            was_activated = true;
+        }
+    }
+
+    if (active == id)
+    {
+        render_push_colored_quad(where, COLOR_RGB(0x808080), 1, &mask);
+    }
+    else if (hot == id)
+    {
+        render_push_colored_quad(where, COLOR_RGB(0x404040), 1, &mask);
+    }
+
+    Vec2 offset = {
+        where.x + baseline_padding + depth_distance * (depth - 1),
+        where.y + where.height - 12,
+    };
+
+    GlyphInfo *glyph_buffer = treelist_glyph_info;
+    if (bold)
+        glyph_buffer += treelist_glyph_info_len;
+
+    uint32_t codepoints[FILENAME_LEN + 4];
+    size_t ncodepoints = utf8_decode(text.data, text.length < FILENAME_LEN + 4 ? text.length : FILENAME_LEN + 4,
+                                     codepoints, NULL);
+
+    for (size_t i = 0; i < ncodepoints; i++)
+    {
+        size_t glyph = glyph_index(codepoints[i]);
+        Vec2 with_bearing = v2_add(offset, glyph_buffer[glyph].bearing);
+
+        render_push_textured_quad(
+            treelist_atlas,
+            (int)glyph + (bold ? treelist_glyph_info_len : 0),
+            with_bearing,
+            COLOR_RGB(0xFFFFFF),
+            1,
+            &mask
+		);
+
+        offset = v2_add(offset, glyph_buffer[glyph].advance);
+    }
+
+    return was_activated;
+}
+
+static float code_line_offset_y;
+static int code_atlas = -1;
+static size_t code_glyph_info_len;
+static GlyphInfo *code_glyph_info;
+static uint8_t *code_atlas_data;
+
+/* Rasterises the monospaced font, for code and the terminal alike, unless it already has been. */
+static void code_atlas_rasterise(void)
+{
+    if (code_atlas < 0 && !code_atlas_data)
+    {
+        FontId face = font_create_face(CODE_FONT);
+
+        size_t width = CODE_ATLAS_WIDTH, height = CODE_ATLAS_HEIGHT;
+        uint8_t *atlas_data = mem_alloc(MEM_FONTS, width * height * sizeof *atlas_data);
+        uint32_t *codes = glyph_codes(&code_glyph_info_len);
+
+        code_glyph_info = mem_alloc(MEM_FONTS, code_glyph_info_len * sizeof *code_glyph_info);
+
+        FontAtlasFillState fill_state = {0};
+        font_atlas_fill(width, height, atlas_data, code_glyph_info_len, codes, face, code_glyph_info, &fill_state);
+        font_delete_face(face);
+        mem_free(MEM_FONTS, codes);
+
+        code_atlas_data = atlas_data;
+    }
+}
+
+/* Hands the monospaced font to the GL the first time it is needed, rasterising it first if it has not been. */
+static void code_atlas_load(void)
+{
+    if (code_atlas >= 0)
+        return;
+
+    code_atlas_rasterise();
+
+    Rect *boxes = mem_alloc(MEM_FONTS, code_glyph_info_len * sizeof *boxes);
+    for (size_t i = 0; i < code_glyph_info_len; i++)
+        boxes[i] = code_glyph_info[i].position;
+    code_atlas = render_init_texture_atlas(CODE_ATLAS_WIDTH, CODE_ATLAS_HEIGHT, code_atlas_data, code_glyph_info_len,
+                                           boxes);
+    mem_free(MEM_FONTS, boxes);
+    mem_free(MEM_FONTS, code_atlas_data);
+    code_atlas_data = NULL;
+}
+
+void ui_fonts_rasterise(void)
+{
+    treelist_atlas_rasterise();
+    code_atlas_rasterise();
+}
+
+void ui_fonts_load(void)
+{
+    treelist_atlas_load();
+    code_atlas_load();
+}
+
+void ui_code_begin(void)
+{
+    TRACE_BEGIN("ui_code");
+    code_atlas_load();
+    code_line_offset_y = 0.0f;
+}
+
+void ui_code_end(void)
+{
+    TRACE_END();
+}
+
+void ui_code_visible_lines(size_t nlines, size_t *first, size_t *count)
+{
+    visible_rows(code_line_offset_y, CODE_LINE_HEIGHT, nlines, first, count);
+}
+
+void ui_code_skip(size_t nlines)
+{
+    code_line_offset_y += (float)nlines * CODE_LINE_HEIGHT;
+}
+
+void ui_code_line(String text, const TokenSpan *spans, size_t nspans)
+{
+    const float left_padding = 12;
+    const float width = container_stack[container_stack_height - 1].local_rect.width;
+
+    FRect mask = compute_mask(container_stack_height, container_stack);
+    FRect where = frect_transformed((FRect) {0, code_line_offset_y, width, CODE_LINE_HEIGHT});
+
+    code_line_offset_y += CODE_LINE_HEIGHT;
+
+    if (!frect_intersects(where, mask))
+        return;
+
+    // The font is monospaced, every column is as wide as a space
+    Vec2 space = code_glyph_info[0].advance;
+    Vec2 offset = {where.x + left_padding, where.y + where.height - 9};
+    float right = mask.x + mask.width;
+    size_t span = 0;
+
+    // Lines of ASCII are drawn a byte at a time, anything else is decoded first and drawn a codepoint a column
+    uint32_t codepoints[CODE_LINE_DECODE_MAX], columns[CODE_LINE_DECODE_MAX];
+    bool ascii = utf8_ascii_prefix(text.data, text.length) == text.length;
+    size_t count = text.length;
+
+    if (!ascii)
+    {
+        size_t len = text.length;
+
+        // Cut before the sequence the limit falls in, rather than through it
+        if (len > CODE_LINE_DECODE_MAX)
+            for (len = CODE_LINE_DECODE_MAX; len > CODE_LINE_DECODE_MAX - 3 && (text.data[len] & 0xc0) == 0x80;)
+                len--;
+
+        count = utf8_decode(text.data, len, codepoints, columns);
+    }
+
+    for (size_t k = 0; k < count && offset.x < right; k++)
+    {
+        uint32_t c = ascii ? (unsigned char)text.data[k] : codepoints[k];
+        size_t i = ascii ? k : columns[k];
+
+        while (span < nspans && spans[span].column + spans[span].length <= i)
+            span++;
+
+        if (c == '\t')
+        {
+            offset = v2_add(offset, v2_scale(CODE_TAB_WIDTH, space));
+            continue;
+        }
+
+        // Spaces and control characters take a column and push no quad
+        if (c <= ' ' || (c >= 0x7f && c < 0xa0))
+        {
+            offset = v2_add(offset, space);
+            continue;
+        }
+
+        TokenKind kind = span < nspans && spans[span].column <= i ? spans[span].kind : TOKEN_PLAIN;
+        size_t index = glyph_index(c);
+        const GlyphInfo *glyph = &code_glyph_info[index];
+
+        render_push_textured_quad(code_atlas, (int)index, v2_add(offset, glyph->bearing), hl_token_color(kind), 1,
+                                  &mask);
+
+        offset = v2_add(offset, glyph->advance);
+    }
+}
+
+/* A glyph of a terminal row, placed from the row's top left. */
+typedef struct {
+    Vec2 pos;
+    int glyph;
+    Color color;
+} TerminalGlyph;
+
+typedef struct {
+    FRect rect;
+    Color color;
+} TerminalFill;
+
+/*
+ * What each slot of the terminal's row ring is drawn with, kept from frame to frame and only laid out again when
+ * the terminal says the slot changed.  A slot holds at most a glyph per column, and a background run and an
+ * underline run per column.  As many again come after for the scrollback's lines, laid out every frame they show.
+ */
+static const Terminal *terminal_cached;
+static int terminal_cached_columns, terminal_cached_rows;
+static TerminalGlyph *terminal_glyphs;
+static TerminalFill *terminal_fills;
+static int *terminal_nglyphs, *terminal_nfills;
+static TermCell *terminal_line;
+// The scrollback's end last frame, to keep the view on the same lines when it grows
+static uint64_t terminal_end_line;
+
+static void terminal_cache_reserve(const Terminal *term)
+{
+    size_t nslots = 2 * (size_t)term->rows, columns = (size_t)term->columns;
+
+    terminal_line = mem_realloc(MEM_UI, terminal_line, columns * sizeof *terminal_line);
+    terminal_glyphs = mem_realloc(MEM_UI, terminal_glyphs, nslots * columns * sizeof *terminal_glyphs);
+    terminal_fills = mem_realloc(MEM_UI, terminal_fills, nslots * 2 * columns * sizeof *terminal_fills);
+    terminal_nglyphs = mem_realloc(MEM_UI, terminal_nglyphs, nslots * sizeof *terminal_nglyphs);
+    terminal_nfills = mem_realloc(MEM_UI, terminal_nfills, nslots * sizeof *terminal_nfills);
+
+    terminal_cached = term;
+    terminal_cached_columns = term->columns;
+    terminal_cached_rows = term->rows;
+}
+
+/* The RGB a cell is drawn in and on, and whether its background needs drawing at all. */
+static void terminal_cell_colors(const TermCell *cell, uint32_t *fg, uint32_t *bg, bool *has_bg)
+{
+    // The background is the window's where the terminal leaves it alone
+    uint32_t default_fg = hl_token_color(TOKEN_PLAIN) >> 8, default_bg = 0x000000;
+    uint8_t index = cell->fg;
+
+    // Bold makes the first eight colors their bright ones, as there is no bold face to draw it with
+    if ((cell->attributes & CELL_BOLD) && index < 8)
+        index += 8;
+
+    *fg = cell->attributes & CELL_DEFAULT_FG ? default_fg : term_palette(index);
+    *bg = cell->attributes & CELL_DEFAULT_BG ? default_bg : term_palette(cell->bg);
+    *has_bg = !(cell->attributes & CELL_DEFAULT_BG);
+
+    if (cell->attributes & CELL_DIM)
+        *fg = *fg >> 1 & 0x7f7f7f;
+
+    if (cell->attributes & CELL_INVERSE)
+    {
+        uint32_t swap = *fg;
+        *fg = *bg;
+        *bg = swap;
+        *has_bg = true;
+    }
+}
+
+/* Adds a fill to a slot, joining it to the one before when it carries on from it in the same color. */
+static void terminal_push_fill(TerminalFill *fills, int *nfills, FRect rect, Color color)
+{
+    TerminalFill *last = *nfills ? &fills[*nfills - 1] : NULL;
+
+    if (last && last->color == color && last->rect.y == rect.y && last->rect.x + last->rect.width == rect.x)
+    {
+        last->rect.width += rect.width;
+        return;
+    }
+
+    fills[(*nfills)++] = (TerminalFill){rect, color};
+}
+
+static void terminal_layout_slot(const Terminal *term, int slot, const TermCell *cells)
+{
+    const float left_padding = 12;
+    const float baseline = CODE_LINE_HEIGHT - 9;
+    const float width = code_glyph_info[glyph_index(' ')].advance.x;
+
+    TerminalGlyph *glyphs = &terminal_glyphs[(size_t)slot * term->columns];
+    TerminalFill *fills = &terminal_fills[(size_t)slot * 2 * term->columns];
+    int nglyphs = 0, nfills = 0;
+
+    // Backgrounds first and apart, so each run of them joins up into a single quad
+    for (int x = 0; x < term->columns; x++)
+    {
+        uint32_t fg, bg;
+        bool has_bg;
+
+        terminal_cell_colors(&cells[x], &fg, &bg, &has_bg);
+        if (has_bg)
+            terminal_push_fill(fills, &nfills, (FRect){left_padding + x * width, 0, width, CODE_LINE_HEIGHT},
+                               COLOR_RGB(bg));
+    }
+
+    for (int x = 0; x < term->columns; x++)
+    {
+        uint32_t fg, bg, codepoint = cells[x].codepoint;
+        bool has_bg;
+        float left = left_padding + x * width;
+
+        terminal_cell_colors(&cells[x], &fg, &bg, &has_bg);
+
+        if (cells[x].attributes & CELL_UNDERLINE)
+            terminal_push_fill(fills, &nfills, (FRect){left, baseline + 2, width, 2}, COLOR_RGB(fg));
+
+        if (codepoint <= ' ' || (codepoint >= 0x7f && codepoint < 0xa0))
+            continue;
+
+        size_t index = glyph_index(codepoint);
+        glyphs[nglyphs++] = (TerminalGlyph){
+            .pos = v2_add((Vec2){left, baseline}, code_glyph_info[index].bearing),
+            .glyph = (int)index,
+            .color = COLOR_RGB(fg),
+        };
+    }
+
+    terminal_nglyphs[slot] = nglyphs;
+    terminal_nfills[slot] = nfills;
+}
+
+void ui_terminal_fit(int *columns, int *rows)
+{
+    const float left_padding = 12;
+    FRect where = container_stack[container_stack_height - 1].local_rect;
+
+    code_atlas_load();
+
+    float width = code_glyph_info[glyph_index(' ')].advance.x;
+
+    *columns = (int)((where.width - left_padding) / width);
+    *rows = (int)(where.height / CODE_LINE_HEIGHT);
+
+    if (*columns < 1)
+        *columns = 1;
+    if (*rows < 1)
+        *rows = 1;
+}
+
+static void terminal_draw_slot(const Terminal *term, int slot, Vec2 origin, const FRect *mask)
+{
+    const TerminalFill *fills = &terminal_fills[(size_t)slot * 2 * term->columns];
+    const TerminalGlyph *glyphs = &terminal_glyphs[(size_t)slot * term->columns];
+
+    for (int i = 0; i < terminal_nfills[slot]; i++)
+    {
+        FRect rect = fills[i].rect;
+        rect.x += origin.x;
+        rect.y += origin.y;
+        render_push_colored_quad(rect, fills[i].color, 0, mask);
+    }
+
+    for (int i = 0; i < terminal_nglyphs[slot]; i++)
+        render_push_textured_quad(code_atlas, glyphs[i].glyph, v2_add(origin, glyphs[i].pos), glyphs[i].color, 1, mask);
+}
+
+void ui_terminal(Terminal *term, Scrollback *scrollback)
+{
+    const float left_padding = 12;
+
+    TRACE_BEGIN("ui_terminal");
+    code_atlas_load();
+
+    bool stale = terminal_cached != term || terminal_cached_columns != term->columns ||
+                 terminal_cached_rows != term->rows;
+
+    if (stale)
+        terminal_cache_reserve(term);
+
+    uint64_t first = 0, end = 0, back = 0;
+    if (scrollback)
+        scrollback_range(scrollback, &first, &end);
+
+    // The container's scroll is how far back the view is, in whole lines and no further than the scrollback goes
+    if (container_state_current)
+    {
+        float *y = &container_state_current->local_scroll_offset.y;
+
+        if (*y > 0 && end > terminal_end_line)
+            *y += (float)(end - terminal_end_line) * CODE_LINE_HEIGHT;
+        *y = fminf(fmaxf(*y, 0), (float)(end - first) * CODE_LINE_HEIGHT);
+
+        back = (uint64_t)(*y / CODE_LINE_HEIGHT);
+    }
+
+    terminal_end_line = end;
+
+    FRect mask = compute_mask(container_stack_height, container_stack);
+    Vec2 where = {0};
+    for (size_t i = 0; i < container_stack_height; i++)
+        where = v2_add(where, (Vec2){container_stack[i].local_rect.x, container_stack[i].local_rect.y});
+
+    // Lines from the scrollback on top, as many as the view is back and fit
+    int history = back < (uint64_t)term->rows ? (int)back : term->rows;
+
+    for (int row = 0; row < history; row++)
+    {
+        if (!scrollback_line(scrollback, end - back + (uint64_t)row, terminal_line, term->columns))
+            continue;
+
+        terminal_layout_slot(term, term->rows + row, terminal_line);
+        terminal_draw_slot(term, term->rows + row, (Vec2){where.x, where.y + (float)row * CODE_LINE_HEIGHT}, &mask);
+    }
+
+    for (int row = 0; row < term->rows; row++)
+    {
+        int slot = term_row_slot(term, row);
+
+        // Taken either way, a slot laid out now is clean
+        if (term_take_dirty(term, slot) || stale)
+            terminal_layout_slot(term, slot, term_row(term, row));
+
+        // A row that scrolled keeps its layout and only moves down the screen
+        if (history + row < term->rows)
+            terminal_draw_slot(term, slot, (Vec2){where.x, where.y + (float)(history + row) * CODE_LINE_HEIGHT}, &mask);
+    }
+
+    if (!term->cursor_hidden && history + term->cursor_y < term->rows)
+    {
+        float width = code_glyph_info[glyph_index(' ')].advance.x;
+        FRect cursor = {
+            where.x + left_padding + (float)term->cursor_x * width,
+            where.y + (float)(history + term->cursor_y) * CODE_LINE_HEIGHT,
+            width,
+            CODE_LINE_HEIGHT,
+        };
+
+        render_push_colored_quad(cursor, COLOR_RGB(0x808080), 0, &mask);
+    }
+
+    TRACE_END();
+}
+
+/* Pushes a line of ASCII in the code font, starting at its baseline on the left. */
+static void stats_text(Vec2 pen, Color color, const char *text)
+{
+    for (const char *c = text; *c; c++)
+    {
+        size_t index = glyph_index((unsigned char)*c);
+        const GlyphInfo *glyph = &code_glyph_info[index];
+
+        if (*c != ' ')
+            render_push_textured_quad(code_atlas, (int)index, v2_add(pen, glyph->bearing), color, 1, NULL);
+
+        pen = v2_add(pen, glyph->advance);
+    }
+}
+
+void ui_frame_stats(const FrameStats *stats)
+{
+    // A bar a frame, as tall as the frame took up to two frames at 60 a second
+    const float bar_width = 2, graph_height = 120, padding = 16, ns_per_pixel = 33333333.0f / graph_height;
+    const float width = STATS_FRAMES * bar_width + 2 * padding;
+    const float height = graph_height + 4 * CODE_LINE_HEIGHT + 3 * padding;
+    const FRect panel = {window_width - width - padding, padding, width, height};
+    const FRect graph = {panel.x + padding, panel.y + padding, STATS_FRAMES * bar_width, graph_height};
+
+    size_t nframes = stats_count(stats);
+    FrameSummary summary = stats_summary(stats);
+    char line[128];
+
+    TRACE_BEGIN("ui_frame_stats");
+    code_atlas_load();
+
+    render_push_colored_quad(panel, COLOR_RGB(0x202020), 0, NULL);
+    render_push_colored_quad(graph, COLOR_RGB(0x101010), 0, NULL);
+
+    // The newest frame on the right, older ones going off to the left
+    for (size_t age = 0; age < nframes; age++)
+    {
+        const FrameSample *s = stats_sample(stats, age);
+        float x = graph.x + graph.width - (float)(age + 1) * bar_width;
+        float h = fminf((float)s->cpu_ns / ns_per_pixel, graph_height);
+        Color color = s->cpu_ns < 16666667 ? COLOR_RGB(0x40c040) : s->cpu_ns < 33333333 ? COLOR_RGB(0xd0b030)
+                                                                                         : COLOR_RGB(0xd04040);
+
+        render_push_colored_quad((FRect){x, graph.y + graph_height - h, bar_width, h}, color, 0, NULL);
+
+        if (s->gpu_known)
+        {
+            float g = fminf((float)s->gpu_ns / ns_per_pixel, graph_height);
+            render_push_colored_quad((FRect){x, graph.y + graph_height - g - 1, bar_width, 2}, COLOR_RGB(0x60a0ff), 0,
+                                     NULL);
+        }
+    }
+
+    // Where a frame runs out of time at 60 a second
+    render_push_colored_quad((FRect){graph.x, graph.y + graph_height - 16666667 / ns_per_pixel, graph.width, 1},
+                             COLOR_RGB(0x808080), 0, NULL);
+
+    Vec2 pen = {graph.x, graph.y + graph_height + padding + CODE_LINE_HEIGHT - 9};
+    Vec2 next_line = {0, CODE_LINE_HEIGHT};
+
+    snprintf(line, sizeof line, "cpu p50 %.2f p99 %.2f ms", (double)summary.cpu_p50 / 1e6,
+             (double)summary.cpu_p99 / 1e6);
+    stats_text(pen, COLOR_RGB(0x40c040), line);
+    pen = v2_add(pen, next_line);
+
+    snprintf(line, sizeof line, "gpu p50 %.2f p99 %.2f ms", (double)summary.gpu_p50 / 1e6,
+             (double)summary.gpu_p99 / 1e6);
+    stats_text(pen, COLOR_RGB(0x60a0ff), line);
+    pen = v2_add(pen, next_line);
+
+    if (nframes)
+    {
+        const FrameSample *s = stats_sample(stats, 0);
+
+        snprintf(line, sizeof line, "ui %.2f up %.2f draw %.2f swap %.2f", (double)s->ui_ns / 1e6,
+                 (double)s->upload_ns / 1e6, (double)s->draw_ns / 1e6, (double)s->swap_ns / 1e6);
+        stats_text(pen, COLOR_RGB(0xd0d0d0), line);
+        pen = v2_add(pen, next_line);
+
+        snprintf(line, sizeof line, "%zu quads, %.1f KB uploaded", s->quads, (double)s->bytes_uploaded / 1024);
+        stats_text(pen, COLOR_RGB(0xd0d0d0), line);
+    }
+
+    TRACE_END();
+}
+
+bool ui_button(FRect where, int id)
+{
+    FRect mask = compute_mask(container_stack_height, container_stack);
+    where = frect_transformed(where);
+    Vec2 mouse_pos = (Vec2) {mouse_pos_x, mouse_pos_y};
+
+    if (frect_contains_point(where, mouse_pos) && frect_contains_point(mask, mouse_pos))
+    {
+        hot = id;
+
+        if (!active && mouse_button_down)
+        {
+            active = id;
+        }
+    }
+
+    if (active == id)
+    {
+        render_push_colored_quad(where, COLOR_RGB(0x00FF00), 0, &mask);
+    }
+    else if (hot == id)
+    {
+        render_push_colored_quad(where, COLOR_RGB(0xFF0000), 0, &mask);
+    }
+    else
+    {
+        render_push_colored_quad(where, COLOR_RGB(0x0000FF), 0, &mask);
+    }
+}
+
+void ui_mouse_position(float x, float y)
+{
+    mouse_pos_x = x;
+    mouse_pos_y = y;
+}
+
+void ui_mouse_button(bool down)
+{
+    mouse_button_down = down;
+}
+
+void ui_viewport(float width, float height)
+{
+    window_width = width;
+    window_height = height;
+}
+
+void ui_scroll(Vec2 scroll)
+{
+    mouse_scroll = scroll;
+}
@@ -0,0 +1,481 @@
+#include "theeditor.h"
+
+#include <string.h>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <immintrin.h>
+#define HAVE_X86
+#ifdef _MSC_VER
+// MSVC takes AVX2 intrinsics anywhere, GCC and Clang only in functions built for it
+#define TARGET_AVX2
+#else
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+// What decode_one gives for bytes that start no valid sequence, never a codepoint
+#define INVALID UINT32_MAX
+
+typedef bool (*Validate)(const uint8_t *text, size_t len);
+
+/*
+ * Decodes the sequence at the start of the text, or gives INVALID for its longest start that could have been one: a
+ * lead byte and the continuation bytes that fit it, or a single byte that fits nothing.  Returns the bytes used.
+ */
+static size_t decode_one(const uint8_t *text, size_t len, uint32_t *codepoint)
+{
+    uint8_t c = text[0];
+    uint8_t low = 0x80, high = 0xbf;
+    size_t need;
+    uint32_t value;
+
+    if (c < 0x80)
+    {
+        *codepoint = c;
+        return 1;
+    }
+
+    // C0 and C1 only ever start overlong forms, and nothing past F4 is below U+110000
+    if (c < 0xc2 || c > 0xf4)
+    {
+        *codepoint = INVALID;
+        return 1;
+    }
+
+    // The second byte's range shuts out overlong forms, surrogates and codepoints past U+10FFFF
+    if (c < 0xe0)
+    {
+        need = 1;
+        value = c & 0x1f;
+    }
+    else if (c < 0xf0)
+    {
+        need = 2;
+        value = c & 0x0f;
+        if (c == 0xe0)
+            low = 0xa0;
+        else if (c == 0xed)
+            high = 0x9f;
+    }
+    else
+    {
+        need = 3;
+        value = c & 0x07;
+        if (c == 0xf0)
+            low = 0x90;
+        else if (c == 0xf4)
+            high = 0x8f;
+    }
+
+    for (size_t i = 1; i <= need; i++)
+    {
+        if (i >= len || text[i] < low || text[i] > high)
+        {
+            *codepoint = INVALID;
+            return i;
+        }
+
+        value = value << 6 | (text[i] & 0x3f);
+        low = 0x80;
+        high = 0xbf;
+    }
+
+    *codepoint = value;
+    return need + 1;
+}
+
+static bool validate_scalar(const uint8_t *text, size_t len)
+{
+    for (size_t i = 0; i < len;)
+    {
+        uint64_t word;
+        uint32_t codepoint;
+
+        // Eight ASCII bytes at a time
+        if (i + 8 <= len)
+        {
+            memcpy(&word, &text[i], 8);
+            if (!(word & 0x8080808080808080ull))
+            {
+                i += 8;
+                continue;
+            }
+        }
+
+        i += decode_one(&text[i], len - i, &codepoint);
+        if (codepoint == INVALID)
+            return false;
+    }
+
+    return true;
+}
+
+#ifdef HAVE_X86
+static uint32_t lowest_bit(uint32_t x)
+{
+#ifdef _MSC_VER
+    unsigned long index;
+    _BitScanForward(&index, x);
+    return index;
+#else
+    return (uint32_t)__builtin_ctz(x);
+#endif
+}
+
+// The ways two bytes in a row can be wrong, after Keiser and Lemire's "Validating UTF-8 In Less Than One Instruction
+// Per Byte".  Each table gives, for the high or low nibble of a byte, the errors it could be part of, and a pair of
+// bytes is wrong if some error is in all three of their lookups.
+#define TOO_SHORT (1 << 0)
+#define TOO_LONG (1 << 1)
+#define OVERLONG_3 (1 << 2)
+#define TOO_LARGE (1 << 3)
+#define SURROGATE (1 << 4)
+#define OVERLONG_2 (1 << 5)
+#define TOO_LARGE_1000 (1 << 6)
+#define OVERLONG_4 (1 << 6)
+#define TWO_CONTINUATIONS (1 << 7)
+#define CARRY (TOO_SHORT | TOO_LONG | TWO_CONTINUATIONS)
+
+#define TABLE(...) _mm256_setr_epi8(__VA_ARGS__, __VA_ARGS__)
+
+/* The 32 bytes ending `n` before the end of `input`, the first of them from the end of `previous`. */
+#define PREVIOUS(input, previous, n) \
+    _mm256_alignr_epi8(input, _mm256_permute2x128_si256(previous, input, 0x21), 16 - (n))
+
+TARGET_AVX2 static __m256i high_nibbles(__m256i v)
+{
+    return _mm256_and_si256(_mm256_srli_epi16(v, 4), _mm256_set1_epi8(0x0f));
+}
+
+/* Checks 32 bytes against the end of the 32 before them, adding anything wrong to `error`. */
+TARGET_AVX2 static __m256i check_block(__m256i input, __m256i previous, __m256i error)
+{
+    const __m256i byte_1_high = TABLE(
+        TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+        TWO_CONTINUATIONS, TWO_CONTINUATIONS, TWO_CONTINUATIONS, TWO_CONTINUATIONS,
+        TOO_SHORT | OVERLONG_2,
+        TOO_SHORT,
+        TOO_SHORT | OVERLONG_3 | SURROGATE,
+        TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4);
+    const __m256i byte_1_low = TABLE(
+        CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4,
+        CARRY | OVERLONG_2,
+        CARRY,
+        CARRY,
+        CARRY | TOO_LARGE,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000);
+    const __m256i byte_2_high = TABLE(
+        TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+        (char)(TOO_LONG | OVERLONG_2 | TWO_CONTINUATIONS | OVERLONG_3 | TOO_LARGE_1000 | OVERLONG_4),
+        (char)(TOO_LONG | OVERLONG_2 | TWO_CONTINUATIONS | OVERLONG_3 | TOO_LARGE),
+        (char)(TOO_LONG | OVERLONG_2 | TWO_CONTINUATIONS | SURROGATE | TOO_LARGE),
+        (char)(TOO_LONG | OVERLONG_2 | TWO_CONTINUATIONS | SURROGATE | TOO_LARGE),
+        TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT);
+
+    __m256i previous_1 = PREVIOUS(input, previous, 1);
+    __m256i special = _mm256_and_si256(
+        _mm256_and_si256(_mm256_shuffle_epi8(byte_1_high, high_nibbles(previous_1)),
+                         _mm256_shuffle_epi8(byte_1_low, _mm256_and_si256(previous_1, _mm256_set1_epi8(0x0f)))),
+        _mm256_shuffle_epi8(byte_2_high, high_nibbles(input)));
+
+    // The third and fourth bytes of a sequence have to be continuations, and so two continuations in a row there
+    __m256i third = _mm256_subs_epu8(PREVIOUS(input, previous, 2), _mm256_set1_epi8((char)(0xe0 - 0x80)));
+    __m256i fourth = _mm256_subs_epu8(PREVIOUS(input, previous, 3), _mm256_set1_epi8((char)(0xf0 - 0x80)));
+    __m256i must_continue = _mm256_and_si256(_mm256_or_si256(third, fourth), _mm256_set1_epi8((char)0x80));
+
+    return _mm256_or_si256(error, _mm256_xor_si256(must_continue, special));
+}
+
+/* Non-zero where the last three bytes start a sequence longer than what is left of the block. */
+TARGET_AVX2 static __m256i incomplete(__m256i input)
+{
+    const __m256i max = _mm256_setr_epi8(
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        (char)(0xf0 - 1), (char)(0xe0 - 1), (char)(0xc0 - 1));
+
+    return _mm256_subs_epu8(input, max);
+}
+
+TARGET_AVX2 static bool validate_avx2(const uint8_t *text, size_t len)
+{
+    __m256i error = _mm256_setzero_si256();
+    __m256i previous = _mm256_setzero_si256();
+    __m256i previous_incomplete = _mm256_setzero_si256();
+    uint8_t tail[32];
+
+    for (size_t i = 0; i < len; i += 32)
+    {
+        __m256i input;
+
+        // The last few bytes go with zeros after them, which pass as ASCII and show up a sequence cut short
+        if (i + 32 <= len)
+        {
+            input = _mm256_loadu_si256((const __m256i *)&text[i]);
+        }
+        else
+        {
+            memset(tail, 0, sizeof tail);
+            memcpy(tail, &text[i], len - i);
+            input = _mm256_loadu_si256((const __m256i *)tail);
+        }
+
+        // A block of ASCII has nothing to check but that the block before it did not end partway into a sequence
+        if (!_mm256_movemask_epi8(input))
+        {
+            error = _mm256_or_si256(error, previous_incomplete);
+            previous_incomplete = _mm256_setzero_si256();
+        }
+        else
+        {
+            error = check_block(input, previous, error);
+            previous_incomplete = incomplete(input);
+        }
+
+        previous = input;
+
+        // Text found bad stops being read every so often, rather than only at the end
+        if ((i & 0xffff) == 0x10000 - 32 && !_mm256_testz_si256(error, error))
+            return false;
+    }
+
+    error = _mm256_or_si256(error, previous_incomplete);
+
+    return _mm256_testz_si256(error, error);
+}
+#endif
+
+size_t utf8_ascii_prefix(const char *text, size_t len)
+{
+    size_t i = 0;
+
+#ifdef HAVE_X86
+    for (; i + 16 <= len; i += 16)
+    {
+        uint32_t mask = (uint32_t)_mm_movemask_epi8(_mm_loadu_si128((const __m128i *)&text[i]));
+
+        if (mask)
+            return i + lowest_bit(mask);
+    }
+#endif
+
+    while (i < len && !(text[i] & 0x80))
+        i++;
+
+    return i;
+}
+
+bool utf8_validate(const char *text, size_t len)
+{
+    static void *volatile picked;
+    Validate validate = (Validate)platform_atomic_load_ptr(&picked);
+
+    // Every thread that gets here first picks the same one
+    if (!validate)
+    {
+#ifdef HAVE_X86
+        validate = platform_cpu_has_avx2() ? validate_avx2 : validate_scalar;
+#else
+        validate = validate_scalar;
+#endif
+        platform_atomic_store_ptr(&picked, (void *)validate);
+    }
+
+    return validate((const uint8_t *)text, len);
+}
+
+#ifdef HAVE_X86
+/*
+ * Decodes the sequences starting in the first 14 of 16 bytes, all of them one to three bytes long, and every lane at
+ * once: each lane works out the codepoint a sequence starting there would be, and the lanes that do start one are
+ * then picked out.  Gives 0 without writing anything unless the bytes are well-formed as far as they are decoded, for
+ * one at a time to deal with.  Otherwise returns the codepoints written, and `used` the bytes they took.
+ */
+static size_t decode_block(const uint8_t *text, uint32_t *out, uint32_t *offsets, size_t at, size_t *used)
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i block = _mm_loadu_si128((const __m128i *)text);
+
+    // Four byte sequences, bytes that are never in UTF-8 and the overlong leads C0 and C1
+    __m128i short_leads = _mm_cmpeq_epi8(_mm_max_epu8(block, _mm_set1_epi8((char)0xef)), _mm_set1_epi8((char)0xef));
+    __m128i overlong_2 = _mm_cmpeq_epi8(_mm_and_si128(block, _mm_set1_epi8((char)0xfe)), _mm_set1_epi8((char)0xc0));
+
+    if (_mm_movemask_epi8(short_leads) != 0xffff || _mm_movemask_epi8(overlong_2))
+        return 0;
+
+    // Continuation bytes are the only ones below 0xC0 taken as signed
+    uint32_t high = (uint32_t)_mm_movemask_epi8(block);
+    uint32_t continuations = (uint32_t)_mm_movemask_epi8(_mm_cmplt_epi8(block, _mm_set1_epi8((char)0xc0)));
+    __m128i at_least_e0 = _mm_cmpeq_epi8(_mm_max_epu8(block, _mm_set1_epi8((char)0xe0)), block);
+    uint32_t leads_3 = (uint32_t)_mm_movemask_epi8(at_least_e0);
+    uint32_t leads_2 = high & ~continuations & ~leads_3;
+    uint32_t leads = ~continuations & 0xffff;
+
+    // Starting on a multibyte sequence, which is also what keeps the writes below in bounds
+    if (!(high & 1) || (continuations & 1))
+        return 0;
+
+    // A sequence starting in the last two bytes may not end in the block, so the block ends where the first one starts
+    uint32_t last = leads & 0xc000;
+    uint32_t end = last ? lowest_bit(last) : 16;
+    uint32_t decoded = (1u << end) - 1;
+
+    leads &= decoded;
+    leads_2 &= decoded;
+    leads_3 &= decoded;
+
+    // Every lead has to have exactly the continuations it calls for, and none may run past the end
+    if (((leads_2 | leads_3) << 1 | leads_3 << 2) != (continuations & decoded))
+        return 0;
+
+    __m128i next_1 = _mm_srli_si128(block, 1), next_2 = _mm_srli_si128(block, 2);
+    __m128i low_6 = _mm_set1_epi16(0x3f);
+    __m128i codepoints[2], bad[2];
+
+    // Codepoints up to three bytes long fit in 16 bits, so eight lanes a half
+    for (int h = 0; h < 2; h++)
+    {
+        __m128i b0 = h ? _mm_unpackhi_epi8(block, zero) : _mm_unpacklo_epi8(block, zero);
+        __m128i b1 = h ? _mm_unpackhi_epi8(next_1, zero) : _mm_unpacklo_epi8(next_1, zero);
+        __m128i b2 = h ? _mm_unpackhi_epi8(next_2, zero) : _mm_unpacklo_epi8(next_2, zero);
+
+        __m128i two =
+            _mm_or_si128(_mm_slli_epi16(_mm_and_si128(b0, _mm_set1_epi16(0x1f)), 6), _mm_and_si128(b1, low_6));
+        __m128i three = _mm_or_si128(_mm_or_si128(_mm_slli_epi16(b0, 12), _mm_slli_epi16(_mm_and_si128(b1, low_6), 6)),
+                                     _mm_and_si128(b2, low_6));
+
+        __m128i is_3 = _mm_cmpgt_epi16(b0, _mm_set1_epi16(0xdf));
+        __m128i is_2 = _mm_andnot_si128(is_3, _mm_cmpgt_epi16(b0, _mm_set1_epi16(0xbf)));
+        __m128i is_1 = _mm_cmplt_epi16(b0, _mm_set1_epi16(0x80));
+
+        codepoints[h] = _mm_or_si128(_mm_or_si128(_mm_and_si128(is_1, b0), _mm_and_si128(is_2, two)),
+                                     _mm_and_si128(is_3, three));
+
+        // The second byte's range for E0 and ED, checked on the codepoint: nothing overlong and no surrogates
+        __m128i top = _mm_and_si128(three, _mm_set1_epi16((short)0xf800));
+        bad[h] = _mm_and_si128(is_3, _mm_or_si128(_mm_cmpeq_epi16(top, zero),
+                                                  _mm_cmpeq_epi16(top, _mm_set1_epi16((short)0xd800))));
+    }
+
+    if ((uint32_t)_mm_movemask_epi8(_mm_packs_epi16(bad[0], bad[1])) & leads)
+        return 0;
+
+    uint32_t lanes[16];
+
+    _mm_storeu_si128((__m128i *)&lanes[0], _mm_unpacklo_epi16(codepoints[0], zero));
+    _mm_storeu_si128((__m128i *)&lanes[4], _mm_unpackhi_epi16(codepoints[0], zero));
+    _mm_storeu_si128((__m128i *)&lanes[8], _mm_unpacklo_epi16(codepoints[1], zero));
+    _mm_storeu_si128((__m128i *)&lanes[12], _mm_unpackhi_epi16(codepoints[1], zero));
+
+    // Every lane is written and only those starting a sequence kept, which stays in bounds as with the first sequence
+    // being multibyte there are fewer codepoints than bytes
+    size_t n = 0;
+
+    if (offsets)
+    {
+        for (uint32_t lane = 0; lane < 16; lane++)
+        {
+            out[n] = lanes[lane];
+            offsets[n] = (uint32_t)at + lane;
+            n += leads >> lane & 1;
+        }
+    }
+    else
+    {
+        for (uint32_t lane = 0; lane < 16; lane++)
+        {
+            out[n] = lanes[lane];
+            n += leads >> lane & 1;
+        }
+    }
+
+    *used = end;
+    return n;
+}
+#endif
+
+size_t utf8_decode(const char *text, size_t len, uint32_t *out, uint32_t *offsets)
+{
+    const uint8_t *bytes = (const uint8_t *)text;
+    size_t i = 0, n = 0;
+
+    while (i < len)
+    {
+#ifdef HAVE_X86
+        // ASCII sixteen bytes at a time, widened into codepoints.  All sixteen are written even when only the first
+        // few are ASCII, which fits: there are never more codepoints than bytes before them.
+        while (i + 16 <= len)
+        {
+            const __m128i zero = _mm_setzero_si128();
+            __m128i block = _mm_loadu_si128((const __m128i *)&bytes[i]);
+            uint32_t mask = (uint32_t)_mm_movemask_epi8(block);
+
+            if (mask & 1)
+                break;
+
+            __m128i low = _mm_unpacklo_epi8(block, zero), high = _mm_unpackhi_epi8(block, zero);
+
+            _mm_storeu_si128((__m128i *)&out[n], _mm_unpacklo_epi16(low, zero));
+            _mm_storeu_si128((__m128i *)&out[n + 4], _mm_unpackhi_epi16(low, zero));
+            _mm_storeu_si128((__m128i *)&out[n + 8], _mm_unpacklo_epi16(high, zero));
+            _mm_storeu_si128((__m128i *)&out[n + 12], _mm_unpackhi_epi16(high, zero));
+
+            if (offsets)
+            {
+                __m128i at = _mm_add_epi32(_mm_set1_epi32((int)i), _mm_setr_epi32(0, 1, 2, 3));
+
+                for (int k = 0; k < 16; k += 4, at = _mm_add_epi32(at, _mm_set1_epi32(4)))
+                    _mm_storeu_si128((__m128i *)&offsets[n + k], at);
+            }
+
+            if (mask)
+            {
+                i += lowest_bit(mask);
+                n += lowest_bit(mask);
+                break;
+            }
+
+            i += 16;
+            n += 16;
+        }
+
+        // Then text of two and three byte sequences, such as most accented or CJK text, a block at a time
+        if (i + 16 <= len)
+        {
+            size_t used, count = decode_block(&bytes[i], &out[n], offsets ? &offsets[n] : NULL, i, &used);
+
+            if (count)
+            {
+                i += used;
+                n += count;
+                continue;
+            }
+        }
+
+        if (i >= len)
+            break;
+#endif
+
+        uint32_t codepoint;
+        size_t used = decode_one(&bytes[i], len - i, &codepoint);
+
+        out[n] = codepoint == INVALID ? UTF8_REPLACEMENT : codepoint;
+        if (offsets)
+            offsets[n] = (uint32_t)i;
+
+        i += used;
+        n++;
+    }
+
+    return n;
+}